@@ -0,0 +1,81 @@
+/*===--- Fracture.h - C interface to the decompiler -------------*- C -*-===*\
+|*                                                                            *|
+|*              Fracture: The Draper Decompiler Infrastructure                *|
+|*                                                                            *|
+|* This file is distributed under the University of Illinois Open Source      *|
+|* License. See LICENSE.TXT for details.                                      *|
+|*                                                                            *|
+|*===----------------------------------------------------------------------===*|
+|*                                                                            *|
+|* Decodes and lifts code held in memory owned by the caller, such as a       *|
+|* process snapshot or a JIT region, without a file on disk. The bytes are    *|
+|* never copied, so they must stay valid and unchanged for the life of the    *|
+|* handle.                                                                    *|
+|*                                                                            *|
+|* Every handle has its own LLVM context and state, and calls on one handle   *|
+|* are serialized. Different handles may be used from different threads at    *|
+|* once, with one limit: the library's command line options (cl::opt) and     *|
+|* statistics counters are process-wide. Options must not be changed, e.g.    *|
+|* with LLVMParseCommandLineOptions, while any handle is in use, and the      *|
+|* counters add up the work of all handles.                                   *|
+|* Results are owned by the handle and stay valid until the next call on it.  *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+#ifndef FRACTURE_C_H
+#define FRACTURE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FractureOpaqueHandle *FractureHandleRef;
+
+/* Region permissions, the same values as fracture::AddressSpace. */
+enum {
+  FracturePermRead = 1,
+  FracturePermWrite = 2,
+  FracturePermExecute = 4
+};
+
+typedef struct {
+  uint64_t Address;
+  uint32_t Size;
+  uint32_t Opcode;  /* Target opcode, see <Target>GenInstrInfo.inc. */
+  const char *Text; /* Assembly, NUL terminated. */
+} FractureInstruction;
+
+/* Creates a handle for Triple (e.g. "armv7-unknown-linux") with Bytes mapped
+ * at Base. CPU and Features may be NULL. Returns NULL if the target is
+ * unknown or the region is empty. */
+FractureHandleRef FractureCreateHandle(const char *Triple, const char *CPU,
+                                       const char *Features,
+                                       const uint8_t *Bytes, uint64_t Size,
+                                       uint64_t Base, unsigned Perms);
+void FractureDisposeHandle(FractureHandleRef H);
+
+/* Maps another region. Returns non-zero if it overlaps an existing one. */
+int FractureAddRegion(FractureHandleRef H, const uint8_t *Bytes,
+                      uint64_t Size, uint64_t Base, unsigned Perms);
+
+/* Decodes the function at Address. Returns non-zero on failure. */
+int FractureDisassembleFunction(FractureHandleRef H, uint64_t Address,
+                                const FractureInstruction **Instrs,
+                                size_t *NumInstrs);
+
+/* Lifts the function at Address to a bitcode module holding its body and
+ * declarations of everything it references. Returns non-zero on failure. */
+int FractureLiftFunction(FractureHandleRef H, uint64_t Address,
+                         const char **Bitcode, size_t *Size);
+
+/* Diagnostics from the last call on H, or an empty string. */
+const char *FractureGetError(FractureHandleRef H);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRACTURE_C_H */
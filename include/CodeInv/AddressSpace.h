@@ -0,0 +1,94 @@
+//===--- AddressSpace - Unified view of mapped memory regions ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Presents every loaded region of a binary (ELF sections, or the blobs of a
+// firmware memory map) as one address space. Regions are kept sorted by
+// base address, so finding the region that holds an address is a binary
+// search and the decoder can follow code from one region into another
+// without switching sections.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ADDRESSSPACE_H
+#define ADDRESSSPACE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Object/ObjectFile.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class AddressSpace {
+public:
+  enum Permissions { Read = 1, Write = 2, Execute = 4 };
+
+  struct Region {
+    uint64_t Base;
+    StringRef Bytes;
+    unsigned Perms;
+    std::string Name;
+    /// The section this region was built from, if any.
+    object::SectionRef Section;
+
+    uint64_t getEnd() const { return Base + Bytes.size(); }
+  };
+
+  /// addRegion - Maps Bytes at Base. Returns false, leaving the space
+  /// unchanged, if the region is empty or overlaps one already mapped.
+  bool addRegion(uint64_t Base, StringRef Bytes, unsigned Perms,
+    StringRef Name, object::SectionRef Section = object::SectionRef());
+  /// addZeroRegion - Maps Size zero bytes at Base, held by the address
+  /// space, as addRegion does.
+  bool addZeroRegion(uint64_t Base, uint64_t Size, unsigned Perms,
+    StringRef Name, object::SectionRef Section = object::SectionRef());
+  /// addSections - Maps the text, data and BSS sections of Obj, the latter
+  /// zero filled. Sections that overlap an earlier one are skipped.
+  void addSections(const object::ObjectFile *Obj);
+  void clear() {
+    Regions.clear();
+    ZeroFill.clear();
+  }
+
+  /// find - The region holding Address, or null.
+  const Region *find(uint64_t Address) const;
+  bool contains(uint64_t Address) const { return find(Address) != NULL; }
+  bool isExecutable(uint64_t Address) const {
+    const Region *R = find(Address);
+    return R && (R->Perms & Execute);
+  }
+  /// isReadOnly - Returns true if Size bytes at Address are all mapped
+  /// readable and not writable, so what they hold now is what the program
+  /// reads.
+  bool isReadOnly(uint64_t Address, uint64_t Size) const;
+
+  /// getBytes - The bytes from Address to the end of its region, or an empty
+  /// array if Address is not mapped.
+  ArrayRef<uint8_t> getBytes(uint64_t Address) const;
+  /// readBytes - Copies Size bytes at Addr into Buf. Returns 0 on success and
+  /// -1 if any byte is unmapped, like FractureMemoryObject.
+  uint64_t readBytes(uint8_t *Buf, uint64_t Addr, uint64_t Size) const;
+
+  const std::vector<Region> &regions() const { return Regions; }
+
+private:
+  /// Sorted by Base, non-overlapping.
+  std::vector<Region> Regions;
+  /// Backing store of the zero-filled regions, shared by copies.
+  std::vector<std::shared_ptr<std::string> > ZeroFill;
+};
+
+} // end namespace fracture
+
+#endif /* ADDRESSSPACE_H */
@@ -0,0 +1,121 @@
+//===--- CostModel - Static cycle estimates for decoded code ----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Estimates what the original machine code of a function costs on the CPU
+// the MCDirector was created for, in the manner of llvm-mca: every block is
+// charged the larger of its throughput bound (micro-ops against the issue
+// width, and cycles on each processor resource) and the latency of its
+// longest register dependency chain. Loops, found on the CFG of the decoded
+// machine code, are charged per iteration the larger of their throughput
+// bound and the latency carried from one iteration into the next.
+//
+// CPUs without a per-instruction model fall back to the itineraries and
+// then to one cycle per instruction. Memory dependencies are not modelled.
+//
+// The cycles of a function are the sum of its block costs, each weighted by
+// -cost-loop-trips for every loop the block is in.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COSTMODEL_H
+#define COSTMODEL_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/CodeGen/MachineInstr.h"
+#include "llvm/CodeGen/TargetSchedule.h"
+#include "llvm/IR/Function.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class Disassembler;
+
+class CostModel {
+public:
+  struct BlockCost {
+    uint64_t Address;
+    unsigned NumInstrs;
+    unsigned MicroOps;
+    /// Cycles needed to issue the block and to get it through the busiest
+    /// processor resource.
+    double Throughput;
+    /// Cycles along the longest register dependency chain.
+    unsigned Latency;
+    unsigned LoopDepth;
+
+    double getCycles() const {
+      return std::max(Throughput, double(Latency));
+    }
+  };
+
+  struct LoopCost {
+    uint64_t Header;
+    unsigned Depth;
+    unsigned NumBlocks;
+    unsigned NumInstrs;
+    /// Throughput bound of one iteration of the whole body.
+    double Throughput;
+    /// Latency of the longest dependency carried around the back edge.
+    unsigned Recurrence;
+
+    double getCycles() const {
+      return std::max(Throughput, double(Recurrence));
+    }
+  };
+
+  struct FunctionCost {
+    uint64_t Address;
+    std::string Name;
+    std::vector<BlockCost> Blocks;   // By address.
+    std::vector<LoopCost> Loops;     // By header, outer loops first.
+    double Cycles;
+  };
+
+  CostModel(Disassembler *NewDis);
+  ~CostModel();
+
+  /// getModelName - How latencies and resources are known: "machine model",
+  /// "itineraries" or "default".
+  const char *getModelName() const;
+
+  /// estimateFunction - Decode the function at Address if needed and fill in
+  /// Cost. Returns false if it could not be decoded.
+  bool estimateFunction(uint64_t Address, FunctionCost &Cost);
+
+  /// readProfile - Reads "ADDRESS WEIGHT" lines, e.g. sample counts per
+  /// function entry. Blank lines and lines starting with '#' are skipped.
+  static std::error_code readProfile(StringRef FileName,
+    std::map<uint64_t, uint64_t> &Weights);
+
+private:
+  Disassembler *Dis;
+  Function *ScratchFn;
+  TargetSchedModel SchedModel;
+
+  /// Bounds of a straight run of instructions, repeated Iterations times.
+  struct SequenceCost {
+    unsigned MicroOps;
+    double Throughput;
+    unsigned Latency;
+    unsigned Recurrence;
+  };
+  void estimateSequence(ArrayRef<const MachineInstr *> MIs,
+    unsigned Iterations, SequenceCost &Cost) const;
+};
+
+} // end namespace fracture
+
+#endif /* COSTMODEL_H */
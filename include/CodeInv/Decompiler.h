@@ -16,7 +16,10 @@
 #ifndef DECOMPILER_H
 #define DECOMPILER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/IndexedMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/CodeGen/ISDOpcodes.h"
 #include "llvm/CodeGen/SelectionDAGNodes.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
@@ -29,6 +32,9 @@
 #include "llvm/IR/TypeBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Target/TargetLowering.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/PromoteMemToReg.h"
@@ -36,6 +42,11 @@
 
 #include "CodeInv/InvISelDAG.h"
 #include "CodeInv/Disassembler.h"
+#include "CodeInv/FunctionBudget.h"
+#include "Transforms/LoopRecovery.h"
+#include "Transforms/RegisterSummary.h"
+#include "Transforms/SideEffects.h"
+#include "Transforms/StackRecovery.h"
 #include "Transforms/TypeRecovery.h"
 
 #include "CodeInv/InvISelDAG.h"
@@ -66,10 +77,27 @@ public:
   ///
   void decompile(unsigned Address);
   Function* decompileFunction(unsigned Address);
+  ///===-------------------------------------------------------------------===//
+  /// decompileTrace - Lifts the code at Address on its own, for execution
+  /// rather than analysis.
+  ///
+  /// Decoding follows fall-through and direct branches from Address for up to
+  /// MaxBlocks basic blocks, which are lifted into one void() function named
+  /// "fracture.tb.<address>". Where control leaves those blocks, the function
+  /// calls "fracture.exit" with the guest address to continue at and returns;
+  /// a guest return is a plain return. The function is not analyzed further
+  /// and is not one of the lifted functions of the module.
+  ///
+  Function* decompileTrace(unsigned Address, unsigned MaxBlocks = 1);
   BasicBlock* decompileBasicBlock(MachineBasicBlock *MBB, Function *F);
 
+  /// getOrCreateBasicBlock - The block starting at Address in F, created
+  /// if there is none yet. F must be the function being decompiled.
   BasicBlock* getOrCreateBasicBlock(unsigned Address, Function *F);
   BasicBlock* getOrCreateBasicBlock(StringRef BBName, Function *F);
+  /// getLayoutSuccessor - The block that BB falls through to in the original
+  /// code, or NULL if BB is the last one.
+  BasicBlock* getLayoutSuccessor(const BasicBlock *BB) const;
 
   void sortBasicBlock(BasicBlock *BB);
   void splitBasicBlockIntoBlock(Function::iterator Src,
@@ -81,6 +109,7 @@ public:
 
   SelectionDAG* getCurrentDAG() { return DAG; }
   const Disassembler* getDisassembler() const { return Dis; }
+  Disassembler* getDisassembler() { return Dis; }
   void setViewMCDAGs(bool Setting) { ViewMCDAGs = Setting; }
   void setViewIRDAGs(bool Setting) { ViewIRDAGs = Setting; }
   Module* getModule() { return Mod; }
@@ -93,10 +122,44 @@ private:
   bool ViewMCDAGs;
   bool ViewIRDAGs;
   IREmitter *Emitter;
+  /// Limits for the function being decompiled.
+  FunctionBudget Budget;
+
+  /// The blocks of a lifted function, so branches find their targets
+  /// without comparing block names.
+  struct FunctionBlocks {
+    uint64_t Entry;
+    DenseMap<uint64_t, BasicBlock*> ByAddress;
+    DenseMap<const BasicBlock*, uint64_t> Addresses;
+    DenseMap<const BasicBlock*, BasicBlock*> LayoutNext;
+  };
+  DenseMap<const Function*, FunctionBlocks> Blocks;
+  void addBasicBlock(FunctionBlocks &FB, uint64_t Address, BasicBlock *BB);
 
   void printSDNode(std::map<SDValue, std::string> &OpMap,
     std::stack<SDNode *> &NodeStack, SDNode *CurNode, SelectionDAG *DAG);
   void printDAG(SelectionDAG *DAG);
+  /// getImmType - The type of immediate operand OpNo of Opcode.
+  EVT getImmType(unsigned Opcode, unsigned OpNo) const;
+  /// Names of the stack and frame pointer register globals for this target.
+  void getFrameRegisterNames(std::string &SPName, std::string &FPName);
+  /// Registers an external function may read (Uses) and clobber (Defs)
+  /// under the calling convention of this target; empty if unknown.
+  void getCallRegisterNames(std::vector<std::string> &Uses,
+    std::vector<std::string> &Defs);
+  /// foldLiteralLoads - Folds the instructions of F whose operands became
+  /// constants, and loads from constant addresses in read-only memory.
+  void foldLiteralLoads(Function *F);
+  /// findNoReturnFunctions - Marks the functions of the module that never
+  /// return: the library ones by name, then, until nothing changes, lifted
+  /// functions whose every path ends in a call to one. Calls to them end
+  /// their block in unreachable, and decoding stops at them from then on.
+  void findNoReturnFunctions();
+  /// neverReturns - Returns true if no path through F returns.
+  bool neverReturns(const Function *F) const;
+  /// endBlocksAtNoReturnCalls - Puts unreachable after each call to a
+  /// noreturn function in F and deletes the blocks no longer reached.
+  void endBlocksAtNoReturnCalls(Function *F);
 
   /// Error printing
   raw_ostream &Infos, &Errs;
@@ -51,11 +51,15 @@
 #include <map>
 #include <inttypes.h>
 #include <signal.h>
+#include <set>
 #include <sstream>
 #include <unistd.h>
 #include <cstdlib>
+#include "CodeInv/AddressSpace.h"
 #include "CodeInv/MCDirector.h"
 #include "CodeInv/FractureMemoryObject.h"
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/DenseMap.h"
 
 using namespace llvm;
 
@@ -122,6 +126,18 @@ public:
   MachineFunction* getOrCreateFunction(unsigned Address);
 
   MachineFunction* getNearestFunction(unsigned Address);
+  /// \brief A machine function of its own for blocks decoded one at a time,
+  /// outside of any function (see Decompiler::decompileTrace). It is not
+  /// one of getFunctions().
+  MachineFunction* getTraceFunction();
+  /// \brief Frees the blocks decoded into the trace function once they have
+  /// been lifted. getMachineInstr() forgets their instructions, or goes back
+  /// to the ones they replaced.
+  void releaseTraceBlocks();
+  /// Every function disassembled so far, keyed by entry address.
+  const std::map<unsigned, MachineFunction*> &getFunctions() const {
+    return Functions;
+  }
 
   /// \brief Disassembles a specific instruction given the specific object file
   /// offset.
@@ -145,6 +161,10 @@ public:
   /// \brief Symbol accessors
   std::string getSymbolName(unsigned Address);
   const StringRef getFunctionName(unsigned Address) const;
+  /// \brief Returns true if a function starts at Address: one was
+  /// disassembled there or a function symbol names it. Code labels and
+  /// other addresses inside functions do not count.
+  bool isFunctionEntry(unsigned Address) const;
   void getRelocFunctionName(unsigned Address, StringRef &NameRef);
   /// \brief Set the current section reference in the Disassembler
   ///
@@ -159,8 +179,14 @@ public:
   const object::SectionRef getSectionByExpression(StringRef SectionExpression) const;
   const object::SectionRef getSectionByAddress(unsigned Address) const;
   FractureMemoryObject* getCurSectionMemory() const { return CurSectionMemory; }
+  /// Every loaded region of the executable; decoding reads through this, so
+  /// it does not depend on the current section.
+  const AddressSpace &getMemory() const { return Memory; }
   object::ObjectFile* getExecutable() const { return Executable; }
   MCDirector* getMCDirector() const { return MC; }
+  MachineModuleInfo* getMachineModuleInfo() const { return MMI; }
+  /// \brief Per-opcode classes and compact info for the target, may be NULL.
+  const InstrClassInfo* getInstrClassInfo() const { return ICI; }
   Module* getModule() const { return TheModule; }
 
   const MachineInstr* getMachineInstr(unsigned Address) const {
@@ -178,6 +204,24 @@ public:
   }
 
 
+  /// \brief Functions that never return, by entry address. Decoding ends a
+  /// basic block at a call to one, and the function too unless a branch
+  /// reaches past the call.
+  void addNoReturn(uint64_t Address) { NoReturnFunctions.insert(Address); }
+  bool isNoReturn(uint64_t Address) const {
+    return NoReturnFunctions.count(Address) != 0;
+  }
+  /// \brief Returns true if the instruction at Address is a call that was
+  /// decoded as not returning.
+  bool isNoReturnCall(uint64_t Address) const {
+    return NoReturnCalls.count(Address) != 0;
+  }
+  /// \brief Returns true for library functions known not to return, like
+  /// exit, abort and __stack_chk_fail.
+  static bool isNoReturnName(StringRef Name);
+  /// \brief The target of the direct branch or call at Address, if any.
+  bool getBranchTarget(uint64_t Address, uint64_t &Target) const;
+
   std::map<StringRef, uint64_t> getRelocOrigins() { return RelocOrigins; };
   uint64_t getDebugOffset(const DebugLoc &Loc) const;
   DebugLoc* setDebugLoc(uint64_t Address);
@@ -187,17 +231,35 @@ private:
   object::ObjectFile *Executable;
   FractureMemoryObject* CurSectionMemory;
   uint64_t CurSectionEnd;
+  AddressSpace Memory;
   std::map<unsigned, MachineBasicBlock*> BasicBlocks;
   std::map<unsigned, MachineFunction*> Functions;
+  Function *TraceFn;
+  MachineFunction *TraceMF;
   std::map<unsigned, MCInst*> Instructions;
   std::map<unsigned, const MachineInstr*> MachineInstructions;
+  /// Entries of MachineInstructions replaced by trace blocks, put back by
+  /// releaseTraceBlocks.
+  std::map<unsigned, const MachineInstr*> ShadowedInstructions;
   std::map<StringRef, uint64_t> RelocOrigins;
+  std::set<uint64_t> NoReturnFunctions;
+  std::set<uint64_t> NoReturnCalls;
+  /// isNoReturnTarget - Checks Target against the known noreturn functions
+  /// and, by symbol name, against the library ones, remembering a match.
+  bool isNoReturnTarget(uint64_t Target);
 
   MachineModuleInfo *MMI;
   GCModuleInfo *GMI;
   Module *TheModule;
 
   MCDirector *MC;
+  const InstrClassInfo *ICI;
+
+  /// Decoded instructions share one MCInstrDesc per (opcode, size, return)
+  /// instead of each carrying a private copy.
+  DenseMap<unsigned, MCInstrDesc*> Descs;
+  const MCInstrDesc* getInstrDesc(unsigned Opcode, unsigned Size,
+    bool LoadsPC);
 
   /// Error printing
   raw_ostream &Infos, &Errs;
@@ -17,7 +17,13 @@
 #ifndef DUMMYOBJECTFILE_H_
 #define DUMMYOBJECTFILE_H_
 
+#include "CodeInv/AddressSpace.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace llvm {
 namespace object {
@@ -30,11 +36,29 @@ namespace object {
     ~DummyObjectFile();
     */
 
-    DummyObjectFile(std::unique_ptr<MemoryBuffer> &Object, std::error_code &ec);
+    /// Maps Object at Address; a plain raw file is one region at 0 that may
+    /// hold anything.
+    DummyObjectFile(std::unique_ptr<MemoryBuffer> &Object, std::error_code &ec,
+      uint64_t Address = 0, unsigned Perms = fracture::AddressSpace::Read |
+        fracture::AddressSpace::Write | fracture::AddressSpace::Execute);
 
     static ObjectFile *createDummyObjectFile(std::unique_ptr<MemoryBuffer>
       &Object);
 
+    /// addRegion - Maps another blob at Address. Each region shows up as a
+    /// section; Perms is a mask of fracture::AddressSpace::Permissions.
+    void addRegion(std::unique_ptr<MemoryBuffer> Buffer, uint64_t Address,
+      unsigned Perms);
+
+    /// getSectionPerms - The permissions the region behind Sec was added
+    /// with.
+    unsigned getSectionPerms(DataRefImpl Sec) const;
+
+    /// getIfDummy - Obj as a DummyObjectFile, or null. There is no binary
+    /// type of our own to dyn_cast on, so this checks that the format name
+    /// is the string only a DummyObjectFile returns.
+    static const DummyObjectFile *getIfDummy(const ObjectFile *Obj);
+
     virtual bool isRelocatableObject() const {
       return false;
     }
@@ -135,7 +159,7 @@ namespace object {
     }
 
     virtual void moveSectionNext(DataRefImpl &Sec) const {
-      return;
+      ++Sec.d.a;
     }
 
     virtual void moveRelocationNext(DataRefImpl &Rel) const {
@@ -149,7 +173,19 @@ namespace object {
       return getSectionRelBegin(Sec);
     }
 
-
+  private:
+    struct Region {
+      std::unique_ptr<MemoryBuffer> Buffer;
+      uint64_t Address;
+      unsigned Perms;
+      std::string Name;
+    };
+    /// Indexed by DataRefImpl::d.a of a section.
+    std::vector<Region> Regions;
+
+    const Region *getRegion(DataRefImpl Sec) const {
+      return Sec.d.a < Regions.size() ? &Regions[Sec.d.a] : NULL;
+    }
   };
 
 } /* namespace object */
@@ -0,0 +1,87 @@
+//===--- FunctionBudget - Per-function decompilation limits -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Bounds the work the decompiler spends on one function: the number of
+// machine instructions, the number of SDNodes built for its blocks, the
+// number of inverse matcher steps and a wall-clock deadline. Limits are set
+// with -max-function-instrs, -max-function-sdnodes, -max-matcher-steps and
+// -function-deadline-ms; zero means unlimited.
+//
+// Once any limit is hit the budget stays exhausted until the next function.
+// The decompiler then either lifts the rest of the function with one opaque
+// call per instruction or drops the function, see -budget-action.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FUNCTIONBUDGET_H
+#define FUNCTIONBUDGET_H
+
+#include "llvm/Support/DataTypes.h"
+
+#include <chrono>
+
+namespace fracture {
+
+class FunctionBudget {
+public:
+  enum Resource {
+    None,
+    Instructions,
+    SDNodes,
+    MatcherSteps,
+    Deadline
+  };
+
+  FunctionBudget();
+
+  /// start - Reset the counters and the deadline for a new function.
+  void start();
+
+  /// addInstructions/addSDNodes - Charge N units; returns false once the
+  /// budget is exhausted.
+  bool addInstructions(unsigned N);
+  bool addSDNodes(unsigned N);
+  /// step - Charge one matcher step. The clock is only read every few
+  /// hundred steps.
+  bool step() {
+    if (Exhausted != None)
+      return false;
+    if (MaxSteps && ++Steps > MaxSteps)
+      return exhaust(MatcherSteps);
+    if ((++SinceClockCheck & 255) == 0)
+      return checkDeadline();
+    return true;
+  }
+  bool checkDeadline();
+
+  bool isExhausted() const { return Exhausted != None; }
+  Resource getExhausted() const { return Exhausted; }
+  const char *getExhaustedName() const;
+
+  /// shouldSkip - True if an exhausted function is dropped instead of lifted
+  /// in degraded mode.
+  bool shouldSkip() const;
+
+private:
+  uint64_t MaxInstrs, MaxNodes, MaxSteps;
+  uint64_t NumInstrs, NumNodes, Steps;
+  unsigned SinceClockCheck;
+  bool HasDeadline;
+  std::chrono::steady_clock::time_point End;
+  Resource Exhausted;
+
+  bool exhaust(Resource R) {
+    Exhausted = R;
+    return false;
+  }
+};
+
+} // end namespace fracture
+
+#endif /* FUNCTIONBUDGET_H */
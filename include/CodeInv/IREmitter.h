@@ -69,6 +69,11 @@ public:
   }
 
   void endDAG() { assert(EndHandleDAG && "Reached End of DAG and did not see handle node."); }
+
+  /// foldLiteralLoad - The Ty value at Address if it is in a region mapped
+  /// without write permission, or NULL. Pointer-sized values that are the
+  /// entry of a known function come back as references to that function.
+  Constant* foldLiteralLoad(uint64_t Address, Type *Ty);
 protected:
   bool EndHandleDAG;
   Decompiler *Dec;
@@ -81,6 +86,13 @@ protected:
   DenseMap<const SDNode*, Value*> VisitMap;
   StringMap<StringRef> BaseNames;
 
+  /// getPCValue - What the instruction at N reads from the program counter.
+  /// The default is the address of the next instruction, as on x86.
+  virtual uint64_t getPCValue(const SDNode *N);
+  /// getKnownRegister - The value the instruction at N reads from Reg if it
+  /// is known at lift time, or NULL. The base class knows the PC.
+  virtual Constant* getKnownRegister(const SDNode *N, unsigned Reg);
+
   // Visit Functions (Convert SDNode into Instruction/Value)
   virtual Value* visit(const SDNode *N);
   Value* visitCopyFromReg(const SDNode *N);
@@ -161,6 +173,7 @@ protected:
   Value* visitVECTOR_SHUFFLE(const SDNode *N);
   Value* visitRegister(const SDNode *N);
   Value* visitCALL(const SDNode *N);
+  Value* visitMachineNode(const SDNode *N);
 
   /// Error printing
   raw_ostream &Infos, &Errs;
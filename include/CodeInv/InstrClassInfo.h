@@ -0,0 +1,204 @@
+//===--- InstrClassInfo - Per-opcode instruction classes --------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Wraps the <Target>GenInstrClasses.inc bitsets emitted by fracture-tblgen
+// -gen-instr-classes. Each class is a bitset indexed by opcode, so testing
+// an instruction is a single bit test and does not depend on the opcode
+// numbering of the LLVM version we were built against.
+//
+// The same object holds the <Target>GenInstrTable.inc records from
+// -gen-instr-table, a 4 byte per-opcode summary of the MCInstrDesc fields
+// used on the disassembly and DAG building hot paths plus the type of each
+// operand, and the
+// <Target>GenFallbackTable.inc records from -gen-fallback-table describing
+// instructions that have no selection pattern.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INSTRCLASSINFO_H
+#define INSTRCLASSINFO_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/CodeGen/MachineInstr.h"
+#include "llvm/CodeGen/MachineValueType.h"
+#include "llvm/Support/DataTypes.h"
+
+using namespace llvm;
+
+namespace fracture {
+
+/// NOTE: Must match the class order in FractureInstrClassEmitter.cpp.
+enum InstrClass {
+  IC_Nop,             // Architectural nop.
+  IC_Padding,         // Idioms compilers use as alignment filler.
+  IC_Push,            // Stores that push onto the stack.
+  IC_Move,            // Register or immediate moves.
+  IC_ZeroIdiom,       // xor/eor of registers, used to clear a register.
+  IC_Call,
+  IC_Return,
+  IC_IndirectBranch,
+  IC_PCRelLoad,       // Loads whose address can be relative to the PC.
+  IC_NumClasses
+};
+
+/// MachineMemOperand flag the disassembler sets on loads that sign-extend,
+/// so the inverse selector can build a SEXTLOAD.
+static const unsigned MOSignExtend = 1u << MachineMemOperand::MOTargetStartBit;
+
+/// NOTE: Must match the layout in FractureInstrTableEmitter.cpp.
+struct InstrInfoEntry {
+  enum {
+    MayLoad = 1 << 0,
+    MayStore = 1 << 1,
+    Branch = 1 << 2,
+    IndirectBranch = 1 << 3,
+    Return = 1 << 4,
+    Call = 1 << 5,
+    Terminator = 1 << 6,
+    Barrier = 1 << 7
+  };
+
+  /// Set in MemSize for loads that sign-extend to the register width.
+  static const uint8_t MemSignExtend = 1 << 7;
+
+  uint8_t Flags;
+  uint8_t Size;       // Encoding size in bytes, 0 if variable.
+  uint8_t MemSize;    // Width of the memory access in bytes (0 if unknown)
+                      // below MemSignExtend.
+  uint8_t DefsAlign;  // NumDefs in the low nibble, log2(align) + 1 above.
+
+  bool mayLoad() const { return Flags & MayLoad; }
+  bool mayStore() const { return Flags & MayStore; }
+  bool mayAccessMemory() const { return Flags & (MayLoad | MayStore); }
+  bool isBranch() const { return Flags & Branch; }
+  bool isIndirectBranch() const { return Flags & IndirectBranch; }
+  bool isReturn() const { return Flags & Return; }
+  bool isCall() const { return Flags & Call; }
+  bool isTerminator() const { return Flags & Terminator; }
+  bool isBarrier() const { return Flags & Barrier; }
+  unsigned getMemSize() const { return MemSize & ~MemSignExtend; }
+  bool isSignExtendingLoad() const { return MemSize & MemSignExtend; }
+  unsigned getNumDefs() const { return DefsAlign & 0xf; }
+  unsigned getMemAlign() const {
+    return (DefsAlign >> 4) ? 1u << ((DefsAlign >> 4) - 1) : 0;
+  }
+};
+
+/// NOTE: Must match the layout in FracturePatternlessInstrsEmitter.cpp.
+struct FallbackEntry {
+  enum {
+    MayLoad = 1 << 0,
+    MayStore = 1 << 1,
+    SideEffects = 1 << 2,
+    ControlFlow = 1 << 3
+  };
+
+  uint16_t Opcode;
+  uint8_t Flags;
+  uint8_t NumDefs;          // Explicit defs.
+  uint8_t NumUses;          // Explicit uses, including immediates.
+  uint8_t NumImplicitDefs;
+  uint8_t NumImplicitUses;
+
+  bool mayLoad() const { return Flags & MayLoad; }
+  bool mayStore() const { return Flags & MayStore; }
+  bool hasSideEffects() const { return Flags & SideEffects; }
+  bool isControlFlow() const { return Flags & ControlFlow; }
+};
+
+class InstrClassInfo {
+public:
+  InstrClassInfo(const uint64_t *const *Classes, unsigned NumOpcodes,
+                 const InstrInfoEntry *Entries, const uint8_t *OperandTypes,
+                 const uint32_t *OperandTypeIndex,
+                 const FallbackEntry *Fallbacks, unsigned NumFallbacks,
+                 const unsigned *PrologueRegs, unsigned NumPrologueRegs,
+                 unsigned PCReg)
+    : Classes(Classes), NumOpcodes(NumOpcodes), Entries(Entries),
+      OperandTypes(OperandTypes), OperandTypeIndex(OperandTypeIndex),
+      Fallbacks(Fallbacks), NumFallbacks(NumFallbacks),
+      PrologueRegs(PrologueRegs), NumPrologueRegs(NumPrologueRegs),
+      PCReg(PCReg) {}
+
+  /// \brief Returns the compact info record for Opcode, or NULL if the
+  /// opcode is out of range.
+  const InstrInfoEntry *getInfo(unsigned Opcode) const {
+    return Opcode < NumOpcodes ? &Entries[Opcode] : NULL;
+  }
+
+  /// \brief Returns the value type TableGen declares for MachineInstr
+  /// operand OpNo of Opcode, or MVT::Other if there is none (variadic
+  /// operands, predicates).
+  MVT::SimpleValueType getOperandType(unsigned Opcode, unsigned OpNo) const {
+    if (Opcode >= NumOpcodes)
+      return MVT::Other;
+    unsigned Begin = OperandTypeIndex[Opcode];
+    if (OpNo >= OperandTypeIndex[Opcode + 1] - Begin)
+      return MVT::Other;
+    return MVT::SimpleValueType(OperandTypes[Begin + OpNo]);
+  }
+
+  /// \brief Returns the fallback record for Opcode, or NULL if the opcode
+  /// has a selection pattern.
+  const FallbackEntry *getFallback(unsigned Opcode) const;
+
+  bool is(InstrClass C, unsigned Opcode) const {
+    return Opcode < NumOpcodes && ((Classes[C][Opcode / 64] >> (Opcode % 64)) & 1);
+  }
+
+  bool isNop(unsigned Opcode) const { return is(IC_Nop, Opcode); }
+  bool isPush(unsigned Opcode) const { return is(IC_Push, Opcode); }
+  bool isMove(unsigned Opcode) const { return is(IC_Move, Opcode); }
+  bool isZeroIdiom(unsigned Opcode) const { return is(IC_ZeroIdiom, Opcode); }
+  bool isCall(unsigned Opcode) const { return is(IC_Call, Opcode); }
+  bool isReturn(unsigned Opcode) const { return is(IC_Return, Opcode); }
+  bool isIndirectBranch(unsigned Opcode) const {
+    return is(IC_IndirectBranch, Opcode);
+  }
+
+  /// \brief Returns true for nops and for padding idioms. Predicated padding
+  /// only counts on the first condition code, which is what a zero filled
+  /// word decodes to.
+  bool isPadding(const MachineInstr *MI) const;
+
+  /// \brief Returns true if MI is a push that saves one of the target's
+  /// frame registers (LR on ARM, EBP/RBP on x86, the stack pointer on PPC).
+  bool isProloguePush(const MachineInstr *MI) const;
+
+  /// \brief Returns true if MI is a load addressed off the PC.
+  bool isPCRelLoad(const MachineInstr *MI) const;
+
+  /// \brief The program counter register, or 0 if it is not addressable.
+  unsigned getPCReg() const { return PCReg; }
+
+private:
+  const uint64_t *const *Classes;
+  unsigned NumOpcodes;
+  const InstrInfoEntry *Entries;
+  const uint8_t *OperandTypes;
+  const uint32_t *OperandTypeIndex;
+  const FallbackEntry *Fallbacks;
+  unsigned NumFallbacks;
+  const unsigned *PrologueRegs;
+  unsigned NumPrologueRegs;
+  unsigned PCReg;
+};
+
+/// \brief Returns the class table for TripleName, or NULL if the
+/// architecture is not supported.
+const InstrClassInfo *getTargetInstrClassInfo(StringRef TripleName);
+
+/// Defined by the target libraries next to their generated tables.
+const InstrClassInfo *getARMInstrClassInfo();
+const InstrClassInfo *getX86InstrClassInfo();
+const InstrClassInfo *getPPCInstrClassInfo();
+
+} // end namespace fracture
+
+#endif /* INSTRCLASSINFO_H */
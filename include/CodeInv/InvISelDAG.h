@@ -28,6 +28,7 @@
 #include "llvm/Target/TargetInstrInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 
+#include "CodeInv/FunctionBudget.h"
 #include "CodeInv/IREmitter.h"
 
 using namespace llvm;
@@ -176,7 +177,14 @@ public:
   void FixChainOp(SDNode *N);
   SDNode *MorphNode(SDNode *Node, unsigned TargetOpc, SDVTList VTList,
     const SDValue *Ops, unsigned NumOps, unsigned EmitNodeInfo);
+  /// \brief Leaves N, which matched no pattern, for the IREmitter to lift
+  /// as an opaque call. Returns false if fallback lifting is disabled and
+  /// Force is not set.
+  bool SelectFallback(SDNode *N, bool Force = false);
   void CannotYetSelect(SDNode *N);
+  /// \brief Charges matcher steps to Budget. Once it is exhausted every
+  /// remaining machine node is lifted as an opaque call without matching.
+  void setBudget(FunctionBudget *NewBudget) { Budget = NewBudget; }
   void SetDAG(SelectionDAG *NewDAG) { 
     CurDAG = NewDAG; 
     MF = &CurDAG->getMachineFunction();
@@ -207,6 +215,12 @@ public:
     unsigned StartNo = 0) {
     llvm_unreachable("Tblgen should generate the implementation of this!");
   }
+
+private:
+  /// OpcodeOffset - Index of each case of the OPC_SwitchOpcode at the start
+  /// of the matcher table, filled on the first call to InvertCodeCommon.
+  std::vector<unsigned> OpcodeOffset;
+  FunctionBudget *Budget;
 };
 
 /// \brief Selects the correct InvISelDAG engine for the Target.
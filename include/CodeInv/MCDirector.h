@@ -27,6 +27,7 @@
 #include "llvm/MC/MCDisassembler.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCInstrAnalysis.h"
 #include "llvm/MC/MCInstrInfo.h"
 #include "llvm/MC/MCObjectFileInfo.h"
 #include "llvm/MC/MCRegisterInfo.h"
@@ -60,6 +61,8 @@ public:
   /// \param OL - Optimization level (has no effect that we know of)
   /// \param InfoOut - prints out information and warnings, defaults to null.
   /// \param ErrOut - prints out errors, defaults to null.
+  /// \param Ctx - the context lifted code lives in, owned by the caller.
+  ///              Defaults to the global context; give each thread its own.
   MCDirector(std::string TripleName,
                StringRef CPUName = "generic",
                StringRef Features = "",
@@ -68,7 +71,8 @@ public:
                CodeModel::Model CM = CodeModel::Default,
                CodeGenOpt::Level OL = CodeGenOpt::Default,
                raw_ostream &InfoOut = nulls(),
-               raw_ostream &ErrOut = nulls());
+               raw_ostream &ErrOut = nulls(),
+               LLVMContext *Ctx = NULL);
 
   ~MCDirector();
 
@@ -88,6 +92,8 @@ public:
   const MCInstrInfo* getMCInstrInfo() const { return MII; }
   const MCDisassembler* getMCDisassembler() const { return DisAsm; }
   MCInstPrinter* getMCInstPrinter() const { return MIP; }
+  /// Branch and call target evaluation; null if the target has none.
+  const MCInstrAnalysis* getMCInstrAnalysis() const { return MIA; }
 
   EVT getRegType(unsigned RegisterID);
 
@@ -106,6 +112,7 @@ private:
   const MCAsmInfo *AsmInfo;
   const MCInstrInfo *MII;
   MCInstPrinter *MIP;
+  const MCInstrAnalysis *MIA;
   IndexedMap<EVT> RegTypes;
 
   /// Error printing.
@@ -0,0 +1,253 @@
+//===--- ProjectDB - On-disk store of analysis results ----------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A project database keeps what a session computed about a binary: its
+// sections and symbols, the decoded instructions, the CFG and call graph of
+// each decompiled function, names given by the analyst and a bitcode module
+// per lifted function.
+//
+// The file is a header followed by a directory of tables. Every table is an
+// array of fixed-size little-endian records sorted by address, so it is
+// used straight from the mapped file: opening a project reads nothing but
+// the header, and every query is a binary search. Strings and bitcode live
+// in two byte tables that records point into.
+//
+// ProjectDBWriter collects records in memory and writes a new file; it can
+// be seeded from an open ProjectDB so a saved project keeps its contents.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PROJECTDB_H
+#define PROJECTDB_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+using namespace llvm;
+
+namespace fracture {
+
+class Decompiler;
+class Disassembler;
+
+namespace projectdb {
+
+/// Bumped whenever the layout of a record or the header changes; older
+/// files are rejected instead of misread.
+const uint32_t Version = 1;
+
+enum TableKind {
+  TK_Strings,     // NUL terminated strings, RecordSize 1.
+  TK_Blobs,       // Bitcode, RecordSize 1.
+  TK_Sections,
+  TK_Symbols,
+  TK_Instrs,
+  TK_Blocks,
+  TK_Edges,       // CFG edges, sorted by source block.
+  TK_Calls,       // Call graph, sorted by caller.
+  TK_Callers,     // Call graph, sorted by callee.
+  TK_Names,
+  TK_Functions,
+  TK_NumTables
+};
+
+struct Header {
+  char Magic[8];
+  support::ulittle32_t Version;
+  support::ulittle32_t NumTables;
+  support::ulittle32_t Triple;    // String offset.
+  support::ulittle32_t FileName;  // String offset.
+};
+
+struct TableEntry {
+  support::ulittle32_t Kind;
+  support::ulittle32_t RecordSize;
+  support::ulittle64_t Offset;
+  support::ulittle64_t Count;
+};
+
+struct SectionRecord {
+  support::ulittle64_t Address;
+  support::ulittle64_t Size;
+  support::ulittle32_t Name;
+  support::ulittle32_t Flags;     // SF_* below.
+};
+
+enum SectionFlags { SF_Text = 1, SF_Data = 2, SF_BSS = 4 };
+
+struct SymbolRecord {
+  support::ulittle64_t Address;
+  support::ulittle64_t Size;
+  support::ulittle32_t Name;
+  support::ulittle32_t Type;      // object::SymbolRef::Type.
+};
+
+struct InstrRecord {
+  support::ulittle64_t Address;
+  support::ulittle32_t Text;
+  support::ulittle16_t Opcode;
+  support::ulittle16_t Size;
+};
+
+/// Sorted by function, then address, so a function's blocks are adjacent.
+struct BlockRecord {
+  support::ulittle64_t Function;
+  support::ulittle64_t Address;
+  support::ulittle64_t End;       // One past the last instruction.
+};
+
+/// A CFG edge between block addresses, or a call between functions.
+struct EdgeRecord {
+  support::ulittle64_t From;
+  support::ulittle64_t To;
+};
+
+struct NameRecord {
+  support::ulittle64_t Address;
+  support::ulittle32_t Name;
+  support::ulittle32_t Reserved;
+};
+
+struct FunctionRecord {
+  support::ulittle64_t Address;
+  support::ulittle64_t BlobOffset;
+  support::ulittle32_t BlobSize;
+  support::ulittle32_t Name;
+};
+
+} // end namespace projectdb
+
+/// ProjectDB - Read-only view of a project file.
+class ProjectDB {
+public:
+  static ErrorOr<std::unique_ptr<ProjectDB> > open(StringRef Path);
+
+  StringRef getPath() const { return Path; }
+  StringRef getTriple() const;
+  StringRef getFileName() const;
+  StringRef getString(uint32_t Offset) const;
+  StringRef getBitcode(const projectdb::FunctionRecord &F) const;
+
+  ArrayRef<projectdb::SectionRecord> sections() const;
+  ArrayRef<projectdb::SymbolRecord> symbols() const;
+  ArrayRef<projectdb::InstrRecord> instructions() const;
+  ArrayRef<projectdb::BlockRecord> blocks() const;
+  ArrayRef<projectdb::EdgeRecord> edges() const;
+  ArrayRef<projectdb::EdgeRecord> calls() const;
+  ArrayRef<projectdb::EdgeRecord> callers() const;
+  ArrayRef<projectdb::NameRecord> names() const;
+  ArrayRef<projectdb::FunctionRecord> functions() const;
+
+  /// Lookups. Each is a binary search over the mapped table.
+  const projectdb::SectionRecord *findSection(uint64_t Address) const;
+  const projectdb::SymbolRecord *findSymbol(uint64_t Address) const;
+  const projectdb::InstrRecord *findInstruction(uint64_t Address) const;
+  const projectdb::FunctionRecord *findFunction(uint64_t Address) const;
+  ArrayRef<projectdb::InstrRecord> getInstructions(uint64_t Begin,
+    uint64_t End) const;
+  ArrayRef<projectdb::BlockRecord> getBlocks(uint64_t Function) const;
+  ArrayRef<projectdb::EdgeRecord> getSuccessors(uint64_t Block) const;
+  ArrayRef<projectdb::EdgeRecord> getCallees(uint64_t Function) const;
+  ArrayRef<projectdb::EdgeRecord> getCallers(uint64_t Function) const;
+
+  /// getName - The analyst's name for Address, else the symbol name at
+  /// Address, else an empty string.
+  StringRef getName(uint64_t Address) const;
+  /// lookupName - Reverse of getName; returns false if no name matches.
+  bool lookupName(StringRef Name, uint64_t &Address) const;
+
+private:
+  ProjectDB(StringRef NewPath, std::unique_ptr<MemoryBuffer> NewBuffer)
+    : Path(NewPath), Buffer(std::move(NewBuffer)) {}
+
+  std::error_code parse();
+  template <class RecordT>
+  ArrayRef<RecordT> getTable(projectdb::TableKind Kind) const;
+
+  std::string Path;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const projectdb::Header *Hdr;
+  /// Table bounds, indexed by TableKind.
+  const char *TableData[projectdb::TK_NumTables];
+  uint64_t TableCount[projectdb::TK_NumTables];
+};
+
+/// ProjectDBWriter - Collects records and writes a project file.
+class ProjectDBWriter {
+public:
+  void setTarget(StringRef NewTriple, StringRef NewFileName) {
+    Triple = NewTriple;
+    FileName = NewFileName;
+  }
+
+  /// merge - Seed with everything in DB. Records added afterwards for the
+  /// same address replace the ones copied from DB.
+  void merge(const ProjectDB &DB);
+  /// addBinary - Sections and symbols of the disassembler's executable.
+  void addBinary(Disassembler *Dis);
+  /// addFunctions - Instructions of every disassembled function, and the
+  /// CFG, calls and bitcode of the ones the decompiler has lifted.
+  void addFunctions(Disassembler *Dis, Decompiler *Dec);
+
+  void addSection(uint64_t Address, uint64_t Size, StringRef Name,
+    uint32_t Flags);
+  void addSymbol(uint64_t Address, uint64_t Size, StringRef Name,
+    uint32_t Type);
+  void addInstruction(uint64_t Address, unsigned Size, unsigned Opcode,
+    StringRef Text);
+  /// addFunction - Replaces the blocks, edges, calls and bitcode of the
+  /// function at Address.
+  void addFunction(uint64_t Address, StringRef Name, StringRef Bitcode);
+  void addBlock(uint64_t Function, uint64_t Address, uint64_t End);
+  void addEdge(uint64_t From, uint64_t To);
+  void addCall(uint64_t Caller, uint64_t Callee);
+  void setName(uint64_t Address, StringRef Name);
+
+  /// write - Writes the project to Path, replacing it atomically.
+  std::error_code write(StringRef Path) const;
+
+private:
+  struct Sym {
+    uint64_t Size;
+    std::string Name;
+    uint32_t Kind;
+  };
+  struct Instr {
+    unsigned Size;
+    unsigned Opcode;
+    std::string Text;
+  };
+  struct Func {
+    std::string Name;
+    std::string Bitcode;
+  };
+
+  std::string Triple, FileName;
+  /// Keyed by address and name: sections that are not loaded all sit at 0.
+  std::map<std::pair<uint64_t, std::string>, Sym> Sections;
+  std::map<uint64_t, Sym> Symbols;
+  std::map<uint64_t, Instr> Instrs;
+  /// Function -> (block address -> end).
+  std::map<uint64_t, std::map<uint64_t, uint64_t> > Blocks;
+  std::set<std::pair<uint64_t, uint64_t> > Edges, Calls;
+  std::map<uint64_t, std::string> Names;
+  std::map<uint64_t, Func> Functions;
+};
+
+} // end namespace fracture
+
+#endif /* PROJECTDB_H */
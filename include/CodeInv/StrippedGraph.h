@@ -19,6 +19,7 @@
 #define STRIPPEDGRAPH_H
 
 
+#include "CodeInv/InstrClassInfo.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Target/TargetInstrInfo.h"
 #include <list>
@@ -42,6 +43,7 @@ class StrippedGraph {
     StrippedGraph(Disassembler *D, std::string T) {
       DAS = D;
       Triple = T;
+      IC = getTargetInstrClassInfo(T);
     }
     ~StrippedGraph() {
       for (auto &it : AllNodes)
@@ -56,6 +58,7 @@ class StrippedGraph {
   private:
     Disassembler *DAS;
     std::string Triple;
+    const InstrClassInfo *IC;
     std::vector<GraphNode *> HeadNodes;
     std::vector<GraphNode *> NeedsLink;
     std::list<GraphNode *> AllNodes;
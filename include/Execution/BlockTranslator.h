@@ -0,0 +1,155 @@
+//===--- BlockTranslator - block-caching binary translation -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class runs guest code the way a dynamic binary translator does: code
+// is lifted only when execution reaches it. The Decompiler lifts the trace
+// (a superblock of up to MaxBlocks basic blocks) at the guest PC, MCJIT
+// compiles it in a module of its own, and the result is cached by guest
+// address.
+//
+// A translated block works on the register file, an array with one slot per
+// target register, and on guest memory, mapped in one host block at a fixed
+// offset from the guest addresses. It returns to the dispatcher with the
+// guest PC to continue at. Each block keeps a link to the translation of
+// every direct exit once it has been taken, so chained blocks skip the
+// lookup; other transfers go through a small hashed jump cache in front of
+// the map of all translations. Guest calls run the dispatcher recursively
+// and guest returns end it, as in the lifted code. A call to anything that
+// could not be lifted stops the guest and fails the run.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BLOCKTRANSLATOR_H
+#define BLOCKTRANSLATOR_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeInv/Decompiler.h"
+#include "Execution/GuestMemory.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class BlockTranslator {
+public:
+  /// \brief Translates code lifted by Dec, optimized at OptLevel (0-3), in
+  /// traces of up to MaxBlocks basic blocks. Translations are taken out of
+  /// the Decompiler's module.
+  BlockTranslator(Decompiler *Dec, unsigned OptLevel = 0,
+                  unsigned MaxBlocks = 8, raw_ostream &InfoOut = nulls(),
+                  raw_ostream &ErrOut = nulls());
+  ~BlockTranslator();
+
+  /// \brief Check if the execution engine was created.
+  bool isValid() const { return EE != NULL; }
+
+  /// \brief Copies every loaded region of the executable into guest memory
+  /// and adds a zeroed stack of StackSize bytes above them, with the register
+  /// named SPName (if any) pointing at its top. Must be called before
+  /// anything runs; without it guest addresses are host addresses.
+  bool mapMemory(StringRef SPName, unsigned StackSize);
+
+  /// \brief Register file access. Registers are host-endian in their slot and
+  /// values are truncated to the register width.
+  bool setRegister(StringRef RegName, uint64_t Value);
+  bool getRegister(StringRef RegName, uint64_t &Value);
+
+  /// \brief Executes the guest code at Address until it returns.
+  bool run(uint64_t Address);
+
+  /// \brief Executes the guest code at Address Iterations times, restoring
+  /// the input registers before each run. A first, untimed run translates
+  /// the code it reaches.
+  ///
+  /// \returns nanoseconds per run, or a negative value on error.
+  double bench(uint64_t Address, unsigned Iterations);
+
+  /// \brief Prints the translation and dispatch counters.
+  void printStatistics(raw_ostream &OS) const;
+
+private:
+  typedef void (*BlockFn)();
+
+  /// TranslatedBlock - The compiled code for the trace at Address, with a
+  /// link to the translation of each of its exits once it has been taken.
+  struct TranslatedBlock {
+    uint64_t Address;
+    BlockFn Code;
+    std::vector<std::pair<uint64_t, TranslatedBlock*> > Exits;
+  };
+
+  /// NextPC holds this after a guest return.
+  static const uint64_t ReturnPC = ~0ULL;
+  static const unsigned JumpCacheSize = 4096;
+  static const unsigned RegSlotBytes = 64;
+  static const unsigned MaxCallDepth = 4096;
+
+  Decompiler *Dec;
+  ExecutionEngine *EE;
+  unsigned OptLevel, MaxBlocks;
+
+  DenseMap<uint64_t, TranslatedBlock*> Cache;
+  TranslatedBlock *JumpCache[JumpCacheSize];
+
+  /// Guest state. Translated code refers to these by address.
+  std::vector<uint64_t> RegFile;
+  uint64_t NextPC;
+  uint8_t Halted;
+  StringMap<unsigned> RegNums, RegBytes;
+  GuestMemory Guest;
+
+  /// Values written with setRegister, restored before each bench run.
+  StringMap<uint64_t> Inputs;
+  /// Callees that could not be lifted, by the index their call passes.
+  std::vector<std::string> UnliftedNames;
+  bool Failed;
+  unsigned Depth;
+  /// The guest address bench is timing.
+  uint64_t BenchPC;
+
+  /// Counters.
+  uint64_t NumTranslated, NumExecuted, NumChained, NumJumpCacheHits,
+    NumLookups;
+
+  static void callGuest(BlockTranslator *BT, uint64_t Address);
+  static void callUnlifted(BlockTranslator *BT, uint64_t Name);
+  static bool runOnce(void *BT);
+  bool execute(uint64_t Address);
+  TranslatedBlock* lookup(uint64_t Address);
+  TranslatedBlock* follow(TranslatedBlock *TB, uint64_t Address);
+  TranslatedBlock* translate(uint64_t Address);
+  bool rewrite(Function *F, TranslatedBlock *TB);
+  void stop() { Failed = true; Halted = 1; }
+  void *getRegisterAddress(StringRef RegName);
+  Constant *getRegisterSlot(GlobalVariable *GV);
+  static Constant *getHostPointer(uint64_t Address, Type *Ty);
+
+  /// Error printing.
+  raw_ostream &Infos, &Errs;
+  void printInfo(std::string Msg) const {
+    Infos << "BlockTranslator: " << Msg << "\n";
+  }
+  void printError(std::string Msg) const {
+    Errs << "BlockTranslator: " << Msg << "\n";
+    Errs.flush();
+  }
+};
+
+} // end namespace fracture
+
+#endif /* BLOCKTRANSLATOR_H */
@@ -0,0 +1,75 @@
+//===--- GuestMemory - Host memory and timing for guest code ----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// What LiftedRunner and BlockTranslator share to execute guest code on the
+// host: one block of host memory holding a copy of every loaded region of
+// the executable and a stack above them, and the timing loop of their bench
+// methods.
+//
+// Guest memory sits at a fixed offset (getDelta) from the guest addresses.
+// The block stays within 4GB so 32-bit guest addresses reach all of it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GUESTMEMORY_H
+#define GUESTMEMORY_H
+
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/Memory.h"
+
+#include "CodeInv/AddressSpace.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class GuestMemory {
+public:
+  GuestMemory() : Delta(0), StackTop(0) {}
+  ~GuestMemory() { release(); }
+
+  /// \brief Copies every region of Memory into a fresh host block and adds a
+  /// zeroed stack of StackSize bytes above them. Any earlier mapping is
+  /// released first.
+  bool map(const AddressSpace &Memory, unsigned StackSize,
+           std::string &ErrMsg);
+  void release();
+
+  bool isMapped() const { return Block.base() != NULL; }
+  /// \brief Host address minus guest address.
+  uint64_t getDelta() const { return Delta; }
+  /// \brief Guest address for the initial stack pointer, a small red zone
+  /// below the top of the stack.
+  uint64_t getStackTop() const { return StackTop; }
+
+private:
+  sys::MemoryBlock Block;
+  uint64_t Delta, StackTop;
+};
+
+/// InputRegister - Where an input register lives in host memory, how many
+/// bytes of it to restore and the value every timed run starts from.
+struct InputRegister {
+  void *Addr;
+  unsigned Bytes;
+  uint64_t Value;
+};
+
+/// timeRuns - Calls Run(Arg) Iterations times, restoring Inputs before each
+/// call, and returns the nanoseconds per call with the cost of the restores
+/// subtracted. Returns a negative value if Run fails.
+double timeRuns(const std::vector<InputRegister> &Inputs, unsigned Iterations,
+                bool (*Run)(void *), void *Arg);
+
+} // end namespace fracture
+
+#endif /* GUESTMEMORY_H */
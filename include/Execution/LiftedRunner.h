@@ -0,0 +1,127 @@
+//===--- LiftedRunner - JIT execution of lifted functions -------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class JIT-compiles a copy of the lifted module with MCJIT so lifted
+// functions can be executed and timed on the host. Lifted functions are
+// void() functions operating on register globals, so the harness is the
+// register file: callers set input registers, run the function, and read the
+// registers back out. The loaded regions of the executable and a stack can be
+// copied into host memory, in which case guest addresses in the copy are
+// rebased onto it the way BlockTranslator does.
+//
+// Functions that were never lifted (declarations) get a body in the JIT copy
+// that only records the call and returns zero. A run that reaches one fails,
+// since whatever the function would have done to the registers and memory is
+// missing. One that does not return (exit, abort) also stops the run: every
+// caller returns right after it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LIFTEDRUNNER_H
+#define LIFTEDRUNNER_H
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeInv/AddressSpace.h"
+#include "Execution/GuestMemory.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class LiftedRunner {
+public:
+  /// \brief Clones LiftedMod, to be optimized at OptLevel (0-3) and handed
+  /// to MCJIT on first use. The original module is never modified.
+  LiftedRunner(const Module *LiftedMod, unsigned OptLevel = 0,
+               raw_ostream &InfoOut = nulls(), raw_ostream &ErrOut = nulls());
+  ~LiftedRunner();
+
+  /// \brief Check if the lifted module could be cloned, or compiled once it
+  /// has been.
+  bool isValid() const { return JITMod != NULL; }
+
+  /// \brief Runs the standard -O<OptLevel> module pipeline over Mod.
+  static void optimizeModule(Module *Mod, unsigned OptLevel);
+
+  /// \brief Register file access. Registers wider than 64 bits are not
+  /// supported and values are truncated to the register width.
+  bool setRegister(StringRef RegName, uint64_t Value);
+  bool getRegister(StringRef RegName, uint64_t &Value);
+
+  /// \brief Copies every loaded region of Memory into guest memory and adds
+  /// a zeroed stack of StackSize bytes above them, with the register named
+  /// SPName (if any) pointing at its top. Must be called before anything
+  /// else touches the registers or runs; without it guest addresses are
+  /// host addresses.
+  bool mapMemory(const AddressSpace &Memory, StringRef SPName,
+                 unsigned StackSize);
+
+  /// \brief Executes the named function once. Fails if it reached a
+  /// function that was never lifted.
+  bool run(StringRef FnName);
+
+  /// \brief Executes the named function Iterations times, restoring the
+  /// input registers before each call.
+  ///
+  /// \returns nanoseconds per call, or a negative value on error or if a
+  /// function that was never lifted was reached.
+  double bench(StringRef FnName, unsigned Iterations);
+
+private:
+  typedef void (*LiftedFn)();
+
+  ExecutionEngine *EE;
+  Module *JITMod;
+  unsigned OptLevel;
+  GuestMemory Guest;
+  /// Values written with setRegister, restored before each bench iteration.
+  StringMap<uint64_t> Inputs;
+  /// Functions that were never lifted, and how often each was reached.
+  std::vector<std::string> StubNames;
+  std::vector<uint64_t> StubCalls;
+  /// Set by the stubs of functions that do not return.
+  uint8_t Halted;
+
+  /// The function bench is timing.
+  LiftedFn CurFn;
+
+  static void stubCalled(LiftedRunner *LR, unsigned Stub);
+  static bool runOnce(void *LR);
+  bool compile();
+  void rebaseGuestAddresses();
+  void stubDeclarations();
+  void stopAtHalts(SmallPtrSetImpl<Function*> &Halts);
+  bool checkStubCalls();
+  void *getRegisterAddress(StringRef RegName, unsigned &Bytes);
+  LiftedFn getFunction(StringRef FnName);
+
+  /// Error printing.
+  raw_ostream &Infos, &Errs;
+  void printInfo(std::string Msg) const {
+    Infos << "LiftedRunner: " << Msg << "\n";
+  }
+  void printError(std::string Msg) const {
+    Errs << "LiftedRunner: " << Msg << "\n";
+    Errs.flush();
+  }
+};
+
+} // end namespace fracture
+
+#endif /* LIFTEDRUNNER_H */
@@ -0,0 +1,95 @@
+//===--- Recompiler - Native code generation for lifted IR ------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class recompiles a lifted module into native object code for a host
+// triple. The module is optimized with the standard -O2/-O3 pipeline and
+// emitted through the target's TargetMachine, the same way MCDirector sets
+// one up for the guest.
+//
+// For parallel compilation the module is split into partitions by function.
+// Each partition is compiled on its own thread in its own LLVMContext and
+// written to its own object file. Partition 0 owns the register globals; the
+// other partitions reference them as external declarations. Local globals
+// are made hidden under unique names first so they can be shared the same
+// way.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+class Recompiler {
+public:
+  /// \param TripleName - the host triple to generate code for. Defaults to
+  ///                     the triple LLVM was configured for.
+  /// \param CPUName - the name of the host CPU
+  /// \param Features - the features of the host CPU
+  /// \param RM - Relocation model, use Reloc::PIC_ to link a shared library.
+  Recompiler(std::string TripleName = "",
+             StringRef CPUName = "generic",
+             StringRef Features = "",
+             Reloc::Model RM = Reloc::Default,
+             raw_ostream &InfoOut = nulls(),
+             raw_ostream &ErrOut = nulls());
+
+  /// \brief Check if the target was found.
+  bool isValid() const { return TheTarget != NULL; }
+
+  /// \brief Optimizes a copy of Mod and writes it to a single object file.
+  bool compile(const Module *Mod, unsigned OptLevel, StringRef OutFile);
+
+  /// \brief Splits Mod into NumThreads partitions and compiles them
+  /// concurrently into <OutPrefix>.<n>.o.
+  ///
+  /// \param Outputs - the names of the object files that were written.
+  bool compileParallel(const Module *Mod, unsigned OptLevel,
+                       StringRef OutPrefix, unsigned NumThreads,
+                       std::vector<std::string> &Outputs);
+
+private:
+  std::string TripleName, CPU, Features;
+  Reloc::Model RM;
+  const Target *TheTarget;
+
+  /// Compiles partition Part of NumParts, the module bitcode is re-read into
+  /// a private context so this is safe to call from any thread.
+  bool compilePartition(StringRef Bitcode, unsigned Part, unsigned NumParts,
+                        unsigned OptLevel, StringRef OutFile,
+                        std::string &ErrMsg);
+  bool emitObject(Module *Mod, unsigned OptLevel, StringRef OutFile,
+                  std::string &ErrMsg);
+
+  /// Error printing.
+  raw_ostream &Infos, &Errs;
+  void printInfo(std::string Msg) const {
+    Infos << "Recompiler: " << Msg << "\n";
+  }
+  void printError(std::string Msg) const {
+    Errs << "Recompiler: " << Msg << "\n";
+    Errs.flush();
+  }
+};
+
+} // end namespace fracture
+
+#endif /* RECOMPILER_H */
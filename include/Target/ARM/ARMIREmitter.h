@@ -31,6 +31,7 @@ public:
     raw_ostream &ErrOut = nulls());
   ~ARMIREmitter();
 private:
+  virtual uint64_t getPCValue(const SDNode *N);
   virtual Value* visit(const SDNode *N);
   Value* visitWrapper(const SDNode *N);
   Value* visitWrapperPIC(const SDNode *N);
@@ -16,6 +16,7 @@
 #ifndef POWERPCIREMITTER_H
 #define POWERPCIREMITTER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/CodeGen/ISDOpcodes.h"
 #include "PPCISD.h"
 
@@ -31,6 +32,15 @@ public:
     raw_ostream &ErrOut = nulls());
   ~PowerPCIREmitter();
 private:
+  /// TOC base of each function, by entry address, from the .opd function
+  /// descriptors of 64-bit ELFv1 objects. Read on first use.
+  DenseMap<uint64_t, uint64_t> TOCBases;
+  bool ReadDescriptors;
+  void readDescriptors();
+  /// getTOCBase - The TOC base the function holding Address runs with, or 0.
+  uint64_t getTOCBase(uint64_t Address);
+
+  virtual Constant* getKnownRegister(const SDNode *N, unsigned Reg);
   virtual Value* visit(const SDNode *N);
   //Value* visitRET(const SDNode *N);
 };
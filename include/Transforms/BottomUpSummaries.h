@@ -0,0 +1,75 @@
+//===--- BottomUpSummaries - per-function summaries over SCCs ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The walk RegisterSummary and SideEffects share: the strongly connected
+// components of the call graph are visited callees first, every function of
+// a component adds what it does to one summary, and that summary is then
+// recorded for all of them. A function only needs the summaries of its
+// callees in earlier components; calls within its own component are covered
+// by the shared summary.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BOTTOMUPSUMMARIES_H
+#define BOTTOMUPSUMMARIES_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+namespace llvm {
+
+template <class SummaryT>
+class BottomUpSummaries {
+public:
+  virtual ~BottomUpSummaries() {}
+
+protected:
+  DenseMap<const Function *, SummaryT> Summaries;
+
+  /// summarizeModule - Recomputes the summary of every function of M,
+  /// declarations included.
+  void summarizeModule(Module &M) {
+    Summaries.clear();
+    CallGraph CG(M);
+    for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+      const std::vector<CallGraphNode *> &SCC = *I;
+      SummaryT S = getEmptySummary();
+      for (unsigned i = 0, e = SCC.size(); i != e; ++i)
+        if (const Function *F = SCC[i]->getFunction())
+          addFunction(*F, S);
+      for (unsigned i = 0, e = SCC.size(); i != e; ++i)
+        if (const Function *F = SCC[i]->getFunction())
+          Summaries[F] = S;
+    }
+  }
+
+  /// getCalleeSummary - The summary of Callee, or null while its component
+  /// is still being summarized.
+  const SummaryT *getCalleeSummary(const Function *Callee) const {
+    typename DenseMap<const Function *, SummaryT>::const_iterator I =
+      Summaries.find(Callee);
+    return I == Summaries.end() ? NULL : &I->second;
+  }
+
+private:
+  /// getEmptySummary - What a component starts out with.
+  virtual SummaryT getEmptySummary() const = 0;
+  /// addFunction - Adds what F does, calls to earlier components included,
+  /// to the summary S of its component.
+  virtual void addFunction(const Function &F, SummaryT &S) = 0;
+};
+
+} // End namespace llvm
+
+#endif
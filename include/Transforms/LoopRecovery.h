@@ -0,0 +1,30 @@
+//===--- LoopRecovery - normalizes and annotates lifted loops ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This function pass finds the natural loops of a lifted function, gives
+// each one a preheader, a single latch and dedicated exits (via
+// LoopSimplify), and tags its latch with llvm.loop metadata. Where the loop
+// counts a register from a constant to a constant, the trip count is
+// recorded in the metadata and as branch weights on the latch.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LOOPRECOVERY_H
+#define LOOPRECOVERY_H
+
+namespace llvm {
+
+class FunctionPass;
+
+FunctionPass* createLoopRecoveryPass();
+
+} // End namespace llvm
+
+
+#endif
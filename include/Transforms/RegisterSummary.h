@@ -0,0 +1,47 @@
+//===--- RegisterSummary - register effects of lifted calls -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This module pass computes, bottom-up over the call graph, which register
+// globals each lifted function may read and may write, and then keeps every
+// function's registers in SSA values between calls. Around a call only the
+// registers the callee may read or write are written back, and only those it
+// may write are reloaded.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef REGISTERSUMMARY_H
+#define REGISTERSUMMARY_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/DataTypes.h"
+
+#include <string>
+#include <utility>
+
+namespace llvm {
+
+class ModulePass;
+
+/// \param ImportUses - registers an imported function may read under the
+///                     target ABI (arguments and the stack pointer).
+/// \param ImportDefs - registers it may write (results and caller-saved
+///                     registers). With both empty, imported functions are
+///                     assumed to read and write every register.
+/// \param CodeRanges - [begin, end) address ranges of the binary's code. A
+///                     declaration whose "Address" is in one of them is
+///                     code that was not lifted, not an import, and may
+///                     read and write every register.
+ModulePass* createRegisterSummaryPass(ArrayRef<std::string> ImportUses,
+  ArrayRef<std::string> ImportDefs,
+  ArrayRef<std::pair<uint64_t, uint64_t> > CodeRanges);
+
+} // End namespace llvm
+
+
+#endif
@@ -0,0 +1,30 @@
+//===--- SideEffects - memory and unwind effects of functions ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This module pass infers, bottom-up over the call graph, whether each lifted
+// function accesses memory the caller can see, only reads it, or may write
+// it, and whether it can unwind. The results become readnone, readonly and
+// nounwind function attributes so that later passes can move loads and
+// stores across calls.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SIDEEFFECTS_H
+#define SIDEEFFECTS_H
+
+namespace llvm {
+
+class ModulePass;
+
+ModulePass* createSideEffectsPass();
+
+} // End namespace llvm
+
+
+#endif
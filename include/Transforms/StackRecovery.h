@@ -0,0 +1,35 @@
+//===--- StackRecovery - recovers stack frames as allocas -------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This function pass tracks the stack pointer through a lifted function as an
+// offset from its value on entry, partitions the accessed part of the frame
+// into slots, and rewrites stack pointer relative loads and stores to use an
+// alloca per slot. Afterwards mem2reg/SROA can promote spilled locals.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef STACKRECOVERY_H
+#define STACKRECOVERY_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+
+class FunctionPass;
+
+/// \param SPName - name of the stack pointer register global (e.g., "ESP")
+/// \param FPName - name of the frame pointer register global, which is assumed
+///                 to be preserved across calls. May be empty.
+FunctionPass* createStackRecoveryPass(StringRef SPName = "",
+                                      StringRef FPName = "");
+
+} // End namespace llvm
+
+
+#endif
@@ -0,0 +1,226 @@
+//===--- Fracture.cpp - C interface to the decompiler -----------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A handle bundles what fracture-cl keeps in globals: the MCDirector,
+// Disassembler and Decompiler for one object, here a DummyObjectFile over
+// the caller's buffers.
+//
+// Handles share no state of their own, but the library's cl::opt values and
+// STATISTIC counters are process-wide, see Fracture.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CAPI/Fracture.h"
+#include "CodeInv/Decompiler.h"
+#include "CodeInv/Disassembler.h"
+#include "CodeInv/DummyObjectFile.h"
+#include "CodeInv/MCDirector.h"
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <mutex>
+
+using namespace llvm;
+using namespace fracture;
+
+namespace {
+
+struct Handle {
+  Handle() : ErrOut(ErrStr), Obj(NULL), Dec(NULL) {}
+  ~Handle() {
+    // The decompiler owns the disassembler, which owns the director and the
+    // object. Everything lives in Ctx, so it goes last.
+    delete Dec;
+  }
+
+  void clearError() {
+    ErrOut.flush();
+    ErrStr.clear();
+  }
+
+  /// fail - Records Msg as the error of the current call.
+  int fail(StringRef Msg) {
+    ErrOut << Msg << "\n";
+    return 1;
+  }
+
+  std::mutex Lock;
+  LLVMContext Ctx;
+  std::string ErrStr;
+  raw_string_ostream ErrOut;
+  object::DummyObjectFile *Obj;
+  Decompiler *Dec;
+
+  /// Results of the last call.
+  std::vector<std::string> Texts;
+  std::vector<FractureInstruction> Instrs;
+  std::string Bitcode;
+};
+
+std::once_flag InitTargetsFlag;
+
+void initializeTargets() {
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllDisassemblers();
+  InitializeAllTargets();
+}
+
+std::unique_ptr<MemoryBuffer> getRegionBuffer(const uint8_t *Bytes,
+  uint64_t Size) {
+  // No copy, and no NUL terminator to check past the end of the caller's
+  // memory.
+  return std::unique_ptr<MemoryBuffer>(MemoryBuffer::getMemBuffer(
+      StringRef(reinterpret_cast<const char *>(Bytes), Size), "", false));
+}
+
+inline Handle *unwrap(FractureHandleRef H) {
+  return reinterpret_cast<Handle *>(H);
+}
+
+inline FractureHandleRef wrap(Handle *H) {
+  return reinterpret_cast<FractureHandleRef>(H);
+}
+
+} // end anonymous namespace
+
+FractureHandleRef FractureCreateHandle(const char *Triple, const char *CPU,
+  const char *Features, const uint8_t *Bytes, uint64_t Size, uint64_t Base,
+  unsigned Perms) {
+  std::call_once(InitTargetsFlag, initializeTargets);
+
+  // MCDirector does not survive an unknown target, so check first.
+  std::string Err;
+  if (Triple == NULL || Bytes == NULL || Size == 0 ||
+      TargetRegistry::lookupTarget(Triple, Err) == NULL)
+    return NULL;
+
+  Handle *H = new Handle();
+  std::unique_ptr<MemoryBuffer> Buf = getRegionBuffer(Bytes, Size);
+  std::error_code EC;
+  H->Obj = new object::DummyObjectFile(Buf, EC, Base, Perms);
+  MCDirector *MC = new MCDirector(Triple, CPU ? CPU : "generic",
+    Features ? Features : "", TargetOptions(), Reloc::DynamicNoPIC,
+    CodeModel::Default, CodeGenOpt::Default, nulls(), H->ErrOut, &H->Ctx);
+  Disassembler *Dis = new Disassembler(MC, H->Obj, NULL, nulls(), H->ErrOut);
+  H->Dec = new Decompiler(Dis, NULL, nulls(), H->ErrOut);
+  if (!MC->isValid()) {
+    delete H;
+    return NULL;
+  }
+  return wrap(H);
+}
+
+void FractureDisposeHandle(FractureHandleRef H) {
+  delete unwrap(H);
+}
+
+int FractureAddRegion(FractureHandleRef HRef, const uint8_t *Bytes,
+  uint64_t Size, uint64_t Base, unsigned Perms) {
+  Handle *H = unwrap(HRef);
+  std::lock_guard<std::mutex> Guard(H->Lock);
+  H->clearError();
+
+  if (Bytes == NULL || Size == 0 || Base + Size < Base)
+    return H->fail("Region is empty or wraps around the address space.");
+  Disassembler *Dis = H->Dec->getDisassembler();
+  const std::vector<AddressSpace::Region> &Regions =
+    Dis->getMemory().regions();
+  for (unsigned i = 0, e = Regions.size(); i != e; ++i)
+    if (Base < Regions[i].getEnd() && Regions[i].Base < Base + Size)
+      return H->fail("Region overlaps " + Regions[i].Name + ".");
+
+  H->Obj->addRegion(getRegionBuffer(Bytes, Size), Base, Perms);
+  // Rebuilds the disassembler's view of memory.
+  Dis->setExecutable(H->Obj);
+  return 0;
+}
+
+int FractureDisassembleFunction(FractureHandleRef HRef, uint64_t Address,
+  const FractureInstruction **Instrs, size_t *NumInstrs) {
+  Handle *H = unwrap(HRef);
+  std::lock_guard<std::mutex> Guard(H->Lock);
+  H->clearError();
+  H->Texts.clear();
+  H->Instrs.clear();
+
+  Disassembler *Dis = H->Dec->getDisassembler();
+  if (!Dis->getMemory().isExecutable(Address))
+    return H->fail("Address is not in executable memory.");
+  MachineFunction *MF = Dis->disassemble(Address);
+  if (MF == NULL)
+    return H->fail("Unable to disassemble function.");
+
+  MCInstPrinter *IP = Dis->getMCDirector()->getMCInstPrinter();
+  for (MachineFunction::iterator BI = MF->begin(), BE = MF->end(); BI != BE;
+       ++BI) {
+    for (MachineBasicBlock::iterator I = BI->begin(), E = BI->end(); I != E;
+         ++I) {
+      FractureInstruction R;
+      R.Address = Dis->getDebugOffset(I->getDebugLoc());
+      R.Size = I->getDesc().getSize();
+      R.Opcode = I->getOpcode();
+      R.Text = NULL;
+      H->Instrs.push_back(R);
+
+      std::string Str;
+      raw_string_ostream OS(Str);
+      if (MCInst *Inst = Dis->getMCInst(R.Address))
+        IP->printInst(Inst, OS, "");
+      H->Texts.push_back(StringRef(OS.str()).ltrim().str());
+    }
+  }
+  // Texts no longer grows, so its strings stay put.
+  for (unsigned i = 0, e = H->Instrs.size(); i != e; ++i)
+    H->Instrs[i].Text = H->Texts[i].c_str();
+
+  *Instrs = H->Instrs.empty() ? NULL : &H->Instrs[0];
+  *NumInstrs = H->Instrs.size();
+  return 0;
+}
+
+int FractureLiftFunction(FractureHandleRef HRef, uint64_t Address,
+  const char **Bitcode, size_t *Size) {
+  Handle *H = unwrap(HRef);
+  std::lock_guard<std::mutex> Guard(H->Lock);
+  H->clearError();
+  H->Bitcode.clear();
+
+  if (!H->Dec->getDisassembler()->getMemory().isExecutable(Address))
+    return H->fail("Address is not in executable memory.");
+  Function *F = H->Dec->decompileFunction(Address);
+  if (F == NULL || F->empty())
+    return H->fail("Unable to lift function.");
+
+  // Same shape as a batch result: this body, declarations for the rest.
+  std::unique_ptr<Module> M(CloneModule(H->Dec->getModule()));
+  for (Module::iterator FI = M->begin(), FE = M->end(); FI != FE; ++FI)
+    if (FI->getName() != F->getName())
+      FI->deleteBody();
+
+  raw_string_ostream OS(H->Bitcode);
+  WriteBitcodeToFile(M.get(), OS);
+  OS.flush();
+  *Bitcode = H->Bitcode.data();
+  *Size = H->Bitcode.size();
+  return 0;
+}
+
+const char *FractureGetError(FractureHandleRef HRef) {
+  Handle *H = unwrap(HRef);
+  std::lock_guard<std::mutex> Guard(H->Lock);
+  H->ErrOut.flush();
+  return H->ErrStr.c_str();
+}
@@ -0,0 +1,180 @@
+//===--- AddressSpace - Unified view of mapped memory regions ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/AddressSpace.h"
+#include "CodeInv/DummyObjectFile.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/ELF.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace llvm;
+
+namespace fracture {
+
+static bool baseLess(uint64_t Address, const AddressSpace::Region &R) {
+  return Address < R.Base;
+}
+
+bool AddressSpace::addRegion(uint64_t Base, StringRef Bytes, unsigned Perms,
+  StringRef Name, object::SectionRef Section) {
+  if (Bytes.empty() || Base + Bytes.size() < Base)
+    return false;
+
+  std::vector<Region>::iterator I =
+    std::upper_bound(Regions.begin(), Regions.end(), Base, baseLess);
+  // The region before must end at or before Base, the one after must start
+  // at or after our end.
+  if (I != Regions.begin() && (I - 1)->getEnd() > Base)
+    return false;
+  if (I != Regions.end() && I->Base < Base + Bytes.size())
+    return false;
+
+  Region R;
+  R.Base = Base;
+  R.Bytes = Bytes;
+  R.Perms = Perms;
+  R.Name = Name;
+  R.Section = Section;
+  Regions.insert(I, R);
+  return true;
+}
+
+bool AddressSpace::addZeroRegion(uint64_t Base, uint64_t Size,
+  unsigned Perms, StringRef Name, object::SectionRef Section) {
+  if (Size == 0 || Size != size_t(Size))
+    return false;
+  std::shared_ptr<std::string> Zeros(new std::string(Size, '\0'));
+  if (!addRegion(Base, *Zeros, Perms, Name, Section))
+    return false;
+  ZeroFill.push_back(Zeros);
+  return true;
+}
+
+/// getELFPerms - Permissions from the section header flags. ELFObjectFile
+/// keeps a pointer to the header in the section's DataRefImpl.
+template <class ELFT>
+static unsigned getELFPerms(const object::ELFObjectFile<ELFT> *,
+  const object::SectionRef &Section) {
+  typedef typename object::ELFObjectFile<ELFT>::Elf_Shdr Elf_Shdr;
+  const Elf_Shdr *Shdr =
+    reinterpret_cast<const Elf_Shdr *>(Section.getRawDataRefImpl().p);
+  StringRef Name;
+  Section.getName(Name);
+  unsigned Perms = AddressSpace::Read;
+  if (Shdr->sh_flags & ELF::SHF_EXECINSTR)
+    Perms |= AddressSpace::Execute;
+  // The PPC64 .toc is only writable so the loader can relocate it; the
+  // program itself never stores to it.
+  if ((Shdr->sh_flags & ELF::SHF_WRITE) && Name != ".toc")
+    Perms |= AddressSpace::Write;
+  return Perms;
+}
+
+/// getSectionPerms - How the program may access Section at run time.
+static unsigned getSectionPerms(const object::ObjectFile *Obj,
+  const object::SectionRef &Section) {
+  // Checked first: a DummyObjectFile identifies as a 32-bit big endian ELF.
+  if (const object::DummyObjectFile *Dummy =
+      object::DummyObjectFile::getIfDummy(Obj))
+    return Dummy->getSectionPerms(Section.getRawDataRefImpl());
+  if (const object::ELF32LEObjectFile *Elf =
+      dyn_cast<object::ELF32LEObjectFile>(Obj))
+    return getELFPerms(Elf, Section);
+  if (const object::ELF32BEObjectFile *Elf =
+      dyn_cast<object::ELF32BEObjectFile>(Obj))
+    return getELFPerms(Elf, Section);
+  if (const object::ELF64LEObjectFile *Elf =
+      dyn_cast<object::ELF64LEObjectFile>(Obj))
+    return getELFPerms(Elf, Section);
+  if (const object::ELF64BEObjectFile *Elf =
+      dyn_cast<object::ELF64BEObjectFile>(Obj))
+    return getELFPerms(Elf, Section);
+
+  // Other formats: code is executable, everything else may be written.
+  if (Section.isText())
+    return Read | Execute;
+  return Read | Write;
+}
+
+void AddressSpace::addSections(const object::ObjectFile *Obj) {
+  for (object::section_iterator SI = Obj->section_begin(),
+         SE = Obj->section_end(); SI != SE; ++SI) {
+    // Only what is loaded at run time; notes, symbol tables and the like
+    // would all sit at address 0.
+    if (!SI->isText() && !SI->isData() && !SI->isBSS())
+      continue;
+    StringRef Bytes, Name;
+    if (SI->getName(Name))
+      continue;
+    // BSS takes no room in the file, but the program finds it zeroed. The
+    // thread-local .tbss is only a template and has no address of its own.
+    if (SI->isBSS()) {
+      if (!Name.startswith(".tbss"))
+        addZeroRegion(SI->getAddress(), SI->getSize(),
+          getSectionPerms(Obj, *SI), Name, *SI);
+      continue;
+    }
+    if (SI->getContents(Bytes))
+      continue;
+    addRegion(SI->getAddress(), Bytes.substr(0, SI->getSize()),
+      getSectionPerms(Obj, *SI), Name, *SI);
+  }
+}
+
+const AddressSpace::Region *AddressSpace::find(uint64_t Address) const {
+  std::vector<Region>::const_iterator I =
+    std::upper_bound(Regions.begin(), Regions.end(), Address, baseLess);
+  if (I == Regions.begin())
+    return NULL;
+  --I;
+  if (Address - I->Base >= I->Bytes.size())
+    return NULL;
+  return &*I;
+}
+
+ArrayRef<uint8_t> AddressSpace::getBytes(uint64_t Address) const {
+  const Region *R = find(Address);
+  if (R == NULL)
+    return ArrayRef<uint8_t>();
+  StringRef Bytes = R->Bytes.substr(Address - R->Base);
+  return ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(Bytes.data()),
+    Bytes.size());
+}
+
+bool AddressSpace::isReadOnly(uint64_t Address, uint64_t Size) const {
+  while (Size) {
+    const Region *R = find(Address);
+    if (R == NULL || (R->Perms & Write) || !(R->Perms & Read))
+      return false;
+    uint64_t N = std::min<uint64_t>(Size, R->getEnd() - Address);
+    Address += N;
+    Size -= N;
+  }
+  return true;
+}
+
+uint64_t AddressSpace::readBytes(uint8_t *Buf, uint64_t Addr,
+  uint64_t Size) const {
+  // Reads may run across adjacent regions.
+  while (Size) {
+    ArrayRef<uint8_t> Bytes = getBytes(Addr);
+    if (Bytes.empty())
+      return -1;
+    uint64_t N = std::min<uint64_t>(Size, Bytes.size());
+    memcpy(Buf, Bytes.data(), N);
+    Buf += N;
+    Addr += N;
+    Size -= N;
+  }
+  return 0;
+}
+
+} // end namespace fracture
@@ -0,0 +1,301 @@
+//===--- CostModel - Static cycle estimates for decoded code ----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/CostModel.h"
+#include "CodeInv/Disassembler.h"
+#include "CodeInv/MCDirector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetInstrInfo.h"
+
+#include <cmath>
+#include <set>
+
+using namespace llvm;
+
+namespace fracture {
+
+static cl::opt<unsigned> CostLoopTrips("cost-loop-trips",
+  cl::desc("Iterations assumed for every loop when summing the cost of a "
+    "function"),
+  cl::init(8));
+
+CostModel::CostModel(Disassembler *NewDis) : Dis(NewDis) {
+  // Holds the CFG of one function at a time; it is not in any module.
+  LLVMContext *Ctx = Dis->getMCDirector()->getContext();
+  ScratchFn = Function::Create(FunctionType::get(Type::getVoidTy(*Ctx),
+    false), GlobalValue::ExternalLinkage, "fracture.cost");
+  const TargetSubtargetInfo *STI =
+    Dis->getMCDirector()->getTargetMachine()->getSubtargetImpl();
+  SchedModel.init(STI->getSchedModel(), STI, STI->getInstrInfo());
+}
+
+CostModel::~CostModel() {
+  delete ScratchFn;
+}
+
+const char *CostModel::getModelName() const {
+  if (SchedModel.hasInstrSchedModel())
+    return "machine model";
+  if (SchedModel.hasInstrItineraries())
+    return "itineraries";
+  return "default";
+}
+
+void CostModel::estimateSequence(ArrayRef<const MachineInstr *> MIs,
+  unsigned Iterations, SequenceCost &Cost) const {
+  const MCRegisterInfo *MRI = Dis->getMCDirector()->getMCRegisterInfo();
+  // Resource use is kept in the scaled units of TargetSchedModel so that
+  // resources with several units compare directly.
+  std::vector<unsigned> Pressure(SchedModel.getNumProcResourceKinds(), 0);
+  // The cycle at which the last value written to each register unit is
+  // ready, counting from the start of the sequence.
+  DenseMap<unsigned, unsigned> Ready, FirstReady;
+
+  Cost.MicroOps = 0;
+  Cost.Latency = 0;
+  for (unsigned It = 0; It != Iterations; ++It) {
+    for (unsigned i = 0, e = MIs.size(); i != e; ++i) {
+      const MachineInstr *MI = MIs[i];
+      unsigned Start = 0;
+      for (unsigned o = 0, oe = MI->getNumOperands(); o != oe; ++o) {
+        const MachineOperand &MO = MI->getOperand(o);
+        if (!MO.isReg() || MO.getReg() == 0 || !MO.readsReg())
+          continue;
+        for (MCRegUnitIterator U(MO.getReg(), MRI); U.isValid(); ++U) {
+          DenseMap<unsigned, unsigned>::iterator R = Ready.find(*U);
+          if (R != Ready.end())
+            Start = std::max(Start, R->second);
+        }
+      }
+
+      unsigned Done = Start + SchedModel.computeInstrLatency(MI);
+      for (unsigned o = 0, oe = MI->getNumOperands(); o != oe; ++o) {
+        const MachineOperand &MO = MI->getOperand(o);
+        if (!MO.isReg() || MO.getReg() == 0 || !MO.isDef())
+          continue;
+        for (MCRegUnitIterator U(MO.getReg(), MRI); U.isValid(); ++U)
+          Ready[*U] = Done;
+      }
+
+      // Later iterations only matter for what they carry.
+      if (It != 0)
+        continue;
+      Cost.Latency = std::max(Cost.Latency, Done);
+      Cost.MicroOps += SchedModel.getNumMicroOps(MI);
+      if (!SchedModel.hasInstrSchedModel())
+        continue;
+      const MCSchedClassDesc *SC = SchedModel.resolveSchedClass(MI);
+      if (!SC->isValid())
+        continue;
+      for (TargetSchedModel::ProcResIter
+             PI = SchedModel.getWriteProcResBegin(SC),
+             PE = SchedModel.getWriteProcResEnd(SC); PI != PE; ++PI)
+        Pressure[PI->ProcResourceIdx] +=
+          PI->Cycles * SchedModel.getResourceFactor(PI->ProcResourceIdx);
+    }
+    if (It == 0)
+      FirstReady = Ready;
+  }
+
+  unsigned Bound = Cost.MicroOps * SchedModel.getMicroOpFactor();
+  for (unsigned i = 0, e = Pressure.size(); i != e; ++i)
+    Bound = std::max(Bound, Pressure[i]);
+  Cost.Throughput = double(Bound) / SchedModel.getLatencyFactor();
+
+  // A value that becomes ready later on every pass depends on itself
+  // through the previous iteration; how much later is the recurrence.
+  Cost.Recurrence = 0;
+  if (Iterations < 2)
+    return;
+  for (DenseMap<unsigned, unsigned>::iterator I = Ready.begin(),
+         E = Ready.end(); I != E; ++I) {
+    DenseMap<unsigned, unsigned>::iterator F = FirstReady.find(I->first);
+    if (F != FirstReady.end() && I->second > F->second)
+      Cost.Recurrence = std::max(Cost.Recurrence,
+        (I->second - F->second) / (Iterations - 1));
+  }
+}
+
+static bool byHeader(const CostModel::LoopCost &A,
+  const CostModel::LoopCost &B) {
+  if (A.Header != B.Header)
+    return A.Header < B.Header;
+  return A.Depth < B.Depth;
+}
+
+bool CostModel::estimateFunction(uint64_t Address, FunctionCost &Cost) {
+  if (!Dis->getMemory().isExecutable(Address))
+    return false;
+  MachineFunction *MF = Dis->disassemble(Address);
+  if (MF == NULL || MF->empty())
+    return false;
+
+  // The decoded blocks only end at terminators, so branch targets may be in
+  // the middle of one. The CFG is rebuilt over the instructions in address
+  // order, with blocks starting at the entry, at every target and after
+  // every instruction that ends a block.
+  std::map<uint64_t, const MachineInstr *> Code;
+  for (MachineFunction::iterator MBB = MF->begin(), E = MF->end();
+       MBB != E; ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; ++I)
+      Code[Dis->getDebugOffset(I->getDebugLoc())] = &*I;
+  if (Code.empty())
+    return false;
+
+  std::set<uint64_t> Starts;
+  Starts.insert(Code.begin()->first);
+  for (std::map<uint64_t, const MachineInstr *>::iterator I = Code.begin(),
+         E = Code.end(); I != E; ++I) {
+    uint64_t Target;
+    if (I->second->isBranch() && Dis->getBranchTarget(I->first, Target)
+        && Code.count(Target))
+      Starts.insert(Target);
+    std::map<uint64_t, const MachineInstr *>::iterator Next = I;
+    if (++Next != E && (I->second->isTerminator()
+                        || Dis->isNoReturnCall(I->first)))
+      Starts.insert(Next->first);
+  }
+
+  // The blocks have no instructions of their own; they only carry the
+  // edges for the dominator tree and loop info.
+  MachineFunction CFG(ScratchFn, *Dis->getMCDirector()->getTargetMachine(),
+    Address, *Dis->getMachineModuleInfo());
+  std::map<uint64_t, MachineBasicBlock *> Blocks;
+  std::vector<std::vector<const MachineInstr *> > Instrs;
+  std::vector<uint64_t> Addrs;
+  for (std::set<uint64_t>::iterator I = Starts.begin(), E = Starts.end();
+       I != E; ++I) {
+    MachineBasicBlock *MBB = CFG.CreateMachineBasicBlock();
+    CFG.push_back(MBB);
+    Blocks[*I] = MBB;
+    Addrs.push_back(*I);
+  }
+  Instrs.resize(Addrs.size());
+
+  const TargetInstrInfo *TII =
+    Dis->getMCDirector()->getTargetMachine()->getSubtargetImpl()
+      ->getInstrInfo();
+  MachineBasicBlock *MBB = NULL;
+  for (std::map<uint64_t, const MachineInstr *>::iterator I = Code.begin(),
+         E = Code.end(); I != E; ++I) {
+    std::map<uint64_t, MachineBasicBlock *>::iterator B = Blocks.find(I->first);
+    if (B != Blocks.end()) {
+      // Fell through into a new block.
+      if (MBB != NULL && !Instrs[MBB->getNumber()].empty()) {
+        const MachineInstr *Last = Instrs[MBB->getNumber()].back();
+        uint64_t LastAddr = Dis->getDebugOffset(Last->getDebugLoc());
+        if ((!Last->isBarrier() || TII->isPredicated(Last))
+            && !Dis->isNoReturnCall(LastAddr)
+            && !MBB->isSuccessor(B->second))
+          MBB->addSuccessor(B->second);
+      }
+      MBB = B->second;
+    }
+    Instrs[MBB->getNumber()].push_back(I->second);
+    uint64_t Target;
+    if (I->second->isBranch() && Dis->getBranchTarget(I->first, Target)
+        && Blocks.count(Target) && !MBB->isSuccessor(Blocks[Target]))
+      MBB->addSuccessor(Blocks[Target]);
+  }
+
+  Cost.Address = Address;
+  Cost.Name = MF->getName().str();
+  Cost.Blocks.clear();
+  Cost.Loops.clear();
+  Cost.Cycles = 0;
+
+  DominatorTreeBase<MachineBasicBlock> DT(false);
+  DT.recalculate(CFG);
+  LoopInfoBase<MachineBasicBlock, MachineLoop> LI;
+  LI.Analyze(DT);
+
+  for (MachineFunction::iterator BB = CFG.begin(), BE = CFG.end(); BB != BE;
+       ++BB) {
+    // Code after a call that does not return, or after the last return.
+    if (!DT.isReachableFromEntry(BB))
+      continue;
+    const std::vector<const MachineInstr *> &MIs = Instrs[BB->getNumber()];
+    SequenceCost SC;
+    estimateSequence(MIs, 1, SC);
+    BlockCost BC;
+    BC.Address = Addrs[BB->getNumber()];
+    BC.NumInstrs = MIs.size();
+    BC.MicroOps = SC.MicroOps;
+    BC.Throughput = SC.Throughput;
+    BC.Latency = SC.Latency;
+    BC.LoopDepth = LI.getLoopDepth(BB);
+    Cost.Blocks.push_back(BC);
+    Cost.Cycles += BC.getCycles() * std::pow(double(CostLoopTrips),
+      double(BC.LoopDepth));
+  }
+
+  std::vector<MachineLoop *> Worklist(LI.begin(), LI.end());
+  while (!Worklist.empty()) {
+    MachineLoop *L = Worklist.back();
+    Worklist.pop_back();
+    Worklist.insert(Worklist.end(), L->begin(), L->end());
+
+    // One iteration runs the body in the order of the original code.
+    std::map<uint64_t, MachineBasicBlock *> Body;
+    for (MachineLoop::block_iterator BI = L->block_begin(),
+           BE = L->block_end(); BI != BE; ++BI)
+      Body[Addrs[(*BI)->getNumber()]] = *BI;
+    std::vector<const MachineInstr *> MIs;
+    for (std::map<uint64_t, MachineBasicBlock *>::iterator I = Body.begin(),
+           E = Body.end(); I != E; ++I)
+      MIs.insert(MIs.end(), Instrs[I->second->getNumber()].begin(),
+        Instrs[I->second->getNumber()].end());
+
+    SequenceCost SC;
+    estimateSequence(MIs, 2, SC);
+    LoopCost LC;
+    LC.Header = Addrs[L->getHeader()->getNumber()];
+    LC.Depth = L->getLoopDepth();
+    LC.NumBlocks = L->getNumBlocks();
+    LC.NumInstrs = MIs.size();
+    LC.Throughput = SC.Throughput;
+    LC.Recurrence = SC.Recurrence;
+    Cost.Loops.push_back(LC);
+  }
+  std::sort(Cost.Loops.begin(), Cost.Loops.end(), byHeader);
+  return true;
+}
+
+std::error_code CostModel::readProfile(StringRef FileName,
+  std::map<uint64_t, uint64_t> &Weights) {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buf =
+    MemoryBuffer::getFile(FileName);
+  if (std::error_code EC = Buf.getError())
+    return EC;
+
+  SmallVector<StringRef, 64> Lines;
+  Buf.get()->getBuffer().split(Lines, "\n", -1, false);
+  for (unsigned i = 0, e = Lines.size(); i != e; ++i) {
+    StringRef Line = Lines[i].trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+    std::pair<StringRef, StringRef> Addr = getToken(Line);
+    StringRef Count = Addr.second.trim();
+    uint64_t Address, Weight;
+    if (Addr.first.getAsInteger(0, Address) || Count.getAsInteger(0, Weight))
+      return std::make_error_code(std::errc::invalid_argument);
+    Weights[Address] += Weight;
+  }
+  return std::error_code();
+}
+
+} // end namespace fracture
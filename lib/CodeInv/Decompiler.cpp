@@ -21,6 +21,16 @@ using namespace llvm;
 
 #define DEBUG_TYPE "fracture-decompiler"
 
+STATISTIC(NumDegradedFunctions,
+  "Number of functions lifted in degraded mode after exceeding their budget");
+STATISTIC(NumSkippedFunctions,
+  "Number of functions dropped after exceeding their budget");
+STATISTIC(NumFoldedLoads,
+  "Number of loads from read-only memory folded after lifting");
+STATISTIC(NumNoReturnFunctions, "Number of functions found not to return");
+STATISTIC(NumDeadBlocks,
+  "Number of blocks deleted after calls that do not return");
+
 namespace fracture {
 
 Decompiler::Decompiler(Disassembler *NewDis, Module *NewMod, raw_ostream &InfoOut, raw_ostream &ErrOut) :
@@ -37,13 +47,14 @@ Decompiler::Decompiler(Disassembler *NewDis, Module *NewMod, raw_ostream &InfoOu
   //Where is the getTargetInvISelDAG method?
   InvISel = getTargetInvISelDAG(Dis->getMCDirector()->getTargetMachine(), this);
   Emitter = InvISel->getEmitter(this, Infos, Errs);
+  InvISel->setBudget(&Budget);
 }
 
 Decompiler::~Decompiler() {
   delete Emitter;
   delete DAG;
   delete InvISel;
-  delete Context;
+  // Context belongs to the MCDirector's owner.
   delete Mod;
   delete Dis;
 }
@@ -96,24 +107,197 @@ void Decompiler::decompile(unsigned Address) {
       }
     }
   } while (Children.size() != 0); // While there are children, decompile
+
+  findNoReturnFunctions();
+
+  // Every reachable callee is lifted now, so the register effects of each
+  // call are known.
+  std::vector<std::string> CallUses, CallDefs;
+  getCallRegisterNames(CallUses, CallDefs);
+  std::vector<std::pair<uint64_t, uint64_t> > CodeRanges;
+  const std::vector<AddressSpace::Region> &Regions =
+    Dis->getMemory().regions();
+  for (unsigned i = 0, e = Regions.size(); i != e; ++i)
+    if (Regions[i].Perms & AddressSpace::Execute)
+      CodeRanges.push_back(std::make_pair(Regions[i].Base,
+          Regions[i].getEnd()));
+  PassManager PM;
+  PM.add(createRegisterSummaryPass(CallUses, CallDefs, CodeRanges));
+  PM.run(*Mod);
+
+  for (Module::iterator F = Mod->begin(), E = Mod->end(); F != E; ++F)
+    if (!F->isDeclaration())
+      foldLiteralLoads(F);
+
+  // With the bodies final, tell the optimizer which calls leave memory alone.
+  PassManager AttrPM;
+  AttrPM.add(createSideEffectsPass());
+  AttrPM.run(*Mod);
+}
+
+void Decompiler::foldLiteralLoads(Function *F) {
+  // With registers in SSA values, addresses built over several instructions
+  // (PPC addis/ld pairs off the TOC, x86 lea then mov) are constants too.
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
+    Instruction *Inst = &*I++;
+    if (isa<CallInst>(Inst))
+      continue;
+    Constant *C = ConstantFoldInstruction(Inst);
+    LoadInst *LI = dyn_cast<LoadInst>(Inst);
+    ConstantExpr *Ptr =
+      LI ? dyn_cast<ConstantExpr>(LI->getPointerOperand()) : NULL;
+    if (C == NULL && Ptr && Ptr->getOpcode() == Instruction::IntToPtr)
+      if (ConstantInt *Addr = dyn_cast<ConstantInt>(Ptr->getOperand(0)))
+        if ((C = Emitter->foldLiteralLoad(Addr->getZExtValue(),
+               LI->getType())))
+          ++NumFoldedLoads;
+    if (C == NULL)
+      continue;
+    Inst->replaceAllUsesWith(C);
+    Inst->eraseFromParent();
+  }
+}
+
+void Decompiler::findNoReturnFunctions() {
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Module::iterator F = Mod->begin(), E = Mod->end(); F != E; ++F) {
+      if (F->doesNotReturn() || F->isIntrinsic())
+        continue;
+      if (!Disassembler::isNoReturnName(F->getName())
+          && (F->isDeclaration() || !neverReturns(F)))
+        continue;
+      F->setDoesNotReturn();
+      Changed = true;
+      ++NumNoReturnFunctions;
+
+      DenseMap<const Function*, FunctionBlocks>::iterator FB = Blocks.find(F);
+      uint64_t Address;
+      if (FB != Blocks.end())
+        Dis->addNoReturn(FB->second.Entry);
+      else if (F->hasFnAttribute("Address")
+               && !F->getFnAttribute("Address").getValueAsString()
+                 .getAsInteger(10, Address))
+        Dis->addNoReturn(Address);
+    }
+  }
+
+  for (Module::iterator F = Mod->begin(), E = Mod->end(); F != E; ++F)
+    if (!F->isDeclaration())
+      endBlocksAtNoReturnCalls(F);
+}
+
+bool Decompiler::neverReturns(const Function *F) const {
+  // A function cut short by its budget may have lost its returns.
+  if (F->hasFnAttribute("Degraded"))
+    return false;
+  for (Function::const_iterator BB = F->begin(), E = F->end(); BB != E;
+       ++BB) {
+    const TerminatorInst *T = BB->getTerminator();
+    if (T == NULL) {
+      // "end" is empty and never branched to.
+      if (BB->empty() && pred_begin(BB) == pred_end(BB))
+        continue;
+      return false;
+    }
+    if (isa<ReturnInst>(T))
+      return false;
+    if (!isa<UnreachableInst>(T))
+      continue;
+    // Only the unreachable that follows a noreturn call says anything.
+    const CallInst *Last = NULL;
+    for (BasicBlock::const_iterator I = BB->begin(); &*I != T; ++I)
+      if (const CallInst *CI = dyn_cast<CallInst>(I))
+        Last = CI;
+    if (Last == NULL || !Last->doesNotReturn())
+      return false;
+  }
+  return true;
+}
+
+void Decompiler::endBlocksAtNoReturnCalls(Function *F) {
+  bool Changed = false;
+  for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB) {
+    for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+      CallInst *CI = dyn_cast<CallInst>(I);
+      if (CI == NULL || !CI->doesNotReturn())
+        continue;
+      BasicBlock::iterator Next = I;
+      ++Next;
+      if (isa<UnreachableInst>(&*Next))
+        break;
+      // The rest of the block moves out and is deleted below.
+      BB->splitBasicBlock(Next);
+      BB->getTerminator()->eraseFromParent();
+      UnreachableInst *UI = new UnreachableInst(*Context, BB);
+      UI->setDebugLoc(CI->getDebugLoc());
+      Changed = true;
+      break;
+    }
+  }
+  if (!Changed)
+    return;
+
+  // Blocks without a terminator have no successors to walk.
+  SmallPtrSet<BasicBlock*, 32> Reached;
+  std::vector<BasicBlock*> Worklist(1, &F->getEntryBlock());
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.back();
+    Worklist.pop_back();
+    if (Reached.count(BB))
+      continue;
+    Reached.insert(BB);
+    if (TerminatorInst *T = BB->getTerminator())
+      for (unsigned s = 0, se = T->getNumSuccessors(); s != se; ++s)
+        Worklist.push_back(T->getSuccessor(s));
+  }
+
+  // Forget the blocks that go, and fall through past them. "end" stays.
+  FunctionBlocks &FB = Blocks[F];
+  std::vector<BasicBlock*> Dead;
+  for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB)
+    if (!Reached.count(BB) && !BB->empty())
+      Dead.push_back(BB);
+  for (DenseMap<const BasicBlock*, BasicBlock*>::iterator
+         I = FB.LayoutNext.begin(), E = FB.LayoutNext.end(); I != E; ++I)
+    while (I->second && !Reached.count(I->second) && !I->second->empty())
+      I->second = FB.LayoutNext.lookup(I->second);
+  for (unsigned i = 0, e = Dead.size(); i != e; ++i) {
+    DenseMap<const BasicBlock*, uint64_t>::iterator A =
+      FB.Addresses.find(Dead[i]);
+    if (A != FB.Addresses.end()) {
+      FB.ByAddress.erase(A->second);
+      FB.Addresses.erase(A);
+    }
+    FB.LayoutNext.erase(Dead[i]);
+  }
+
+  for (unsigned i = 0, e = Dead.size(); i != e; ++i) {
+    if (TerminatorInst *T = Dead[i]->getTerminator())
+      for (unsigned s = 0, se = T->getNumSuccessors(); s != se; ++s)
+        T->getSuccessor(s)->removePredecessor(Dead[i]);
+    Dead[i]->dropAllReferences();
+  }
+  for (unsigned i = 0, e = Dead.size(); i != e; ++i)
+    Dead[i]->eraseFromParent();
+  NumDeadBlocks += Dead.size();
 }
 
 Function* Decompiler::decompileFunction(unsigned Address) {
-  // Check that Address is inside the current section.
-  // TODO: Find a better way to do this check. What we really care about is
-  // avoiding reads to library calls and areas of memory we can't "see".
-  const object::SectionRef Sect = Dis->getCurrentSection();
-  uint64_t SectStart, SectEnd;
-  SectStart = Sect.getAddress();
-  SectEnd = Sect.getSize();
-  SectEnd += SectStart;
-  if (Address < SectStart || Address > SectEnd) {
-    errs() << "Address out of bounds for section (is this a library call?): "
+  // Avoid reads to library calls and areas of memory we can't "see".
+  if (!Dis->getMemory().isExecutable(Address)) {
+    errs() << "Address is not in mapped code (is this a library call?): "
            << format("%1" PRIx64, Address) << "\n";
     return NULL;
   }
 
+  // The whole function is always decoded, so the cached MachineFunction is
+  // complete; only lifting it is bounded. Decoding still counts against
+  // the deadline.
+  Budget.start();
   MachineFunction *MF = Dis->disassemble(Address);
+  Budget.checkDeadline();
 
   // Get Function Name
   // TODO: Determine Function Type
@@ -126,26 +310,35 @@ Function* Decompiler::decompileFunction(unsigned Address) {
     return F;
   }
 
+  // The body is new, so drop whatever was recorded for an earlier one.
+  FunctionBlocks &FB = Blocks[F];
+  FB = FunctionBlocks();
+  FB.Entry = Address;
+
   // Create a basic block to hold entry point (alloca) information
-  BasicBlock *entry = getOrCreateBasicBlock("entry", F);
+  BasicBlock *entry = BasicBlock::Create(*Context, "entry", F);
 
-  // For each basic block
+  // For each basic block, in the order of the original code.
   MachineFunction::iterator BI = MF->begin(), BE = MF->end();
+  BasicBlock *PrevBB = NULL;
   while (BI != BE) {
-    //outs() << "-----BI------\n";
-    //BI->dump();
+    BasicBlock *BB = BasicBlock::Create(*Context, BI->getName(), F);
     // Add branch from "entry"
-    if (BI == MF->begin()) {
-      entry->getInstList().push_back(
-        BranchInst::Create(getOrCreateBasicBlock(BI->getName(), F)));
-    } else {
-      getOrCreateBasicBlock(BI->getName(), F);
-    }
+    if (BI == MF->begin())
+      entry->getInstList().push_back(BranchInst::Create(BB));
+    if (!BI->empty())
+      addBasicBlock(FB, Dis->getDebugOffset(BI->instr_begin()->getDebugLoc()),
+        BB);
+    if (PrevBB)
+      FB.LayoutNext[PrevBB] = BB;
+    PrevBB = BB;
     ++BI;
   }
 
   BI = MF->begin();
   while (BI != BE) {
+    if (Budget.isExhausted() && Budget.shouldSkip())
+      break;
     BI->dump();
     if (decompileBasicBlock(BI, F) == NULL) {
       printError("Unable to decompile basic block!");
@@ -153,29 +346,35 @@ Function* Decompiler::decompileFunction(unsigned Address) {
     ++BI;
   }
 
+  if (Budget.isExhausted()) {
+    std::string Reason = std::string(Budget.getExhaustedName()) + " exceeded";
+    if (Budget.shouldSkip()) {
+      printError("Skipping " + F->getName().str() + ": " + Reason + ".");
+      Blocks.erase(F);
+      F->deleteBody();
+      ++NumSkippedFunctions;
+      return NULL;
+    }
+    printInfo(F->getName().str() + ": " + Reason +
+      ", the rest of it is lifted as opaque calls.");
+    F->addFnAttr("Degraded", Budget.getExhaustedName());
+    ++NumDegradedFunctions;
+  }
+
   // During Decompilation, did any "in-between" basic blocks get created?
   // Nothing ever splits the entry block, so we skip it.
+  const FunctionBlocks &Lifted = Blocks[F];
   for (Function::iterator I = ++F->begin(), E = F->end(); I != E; ++I) {
     if (!(I->empty())) {
       continue;
     }
 
-    // Right now, the only way to get the right offset is to parse its name
-    // it sucks, but it works.
+    // "end" and "entry" have no address and can be empty.
+    DenseMap<const BasicBlock*, uint64_t>::const_iterator AI =
+      Lifted.Addresses.find(I);
+    if (AI == Lifted.Addresses.end()) continue;
+    uint64_t BBAddr = AI->second;
     StringRef Name = I->getName();
-    if (Name == "end" || Name == "entry") continue; // these can be empty
-
-    size_t Off = F->getName().size() + 1;
-    size_t Size = Name.size() - Off;
-
-    //outs() << "-----I------\n";
-    //outs() << "Name: " << Name << " Offset: " << Off << " Size: " << Size << "\n";
-    //I->dump();
-
-    StringRef BBAddrStr = Name.substr(Off, Size);
-    unsigned long long BBAddr;
-    getAsUnsignedInteger(BBAddrStr, 10, BBAddr);
-    BBAddr += Address;
     DEBUG(errs() << "Split Target: " << Name << "\t Address: "
                  << BBAddr << "\n");
     // split Block at AddrStr
@@ -226,12 +425,112 @@ Function* Decompiler::decompileFunction(unsigned Address) {
   //Line below adds decompiler optimization.  Function pass manager for optimization.
   //    This is where to focus for type recovery.
   // FPM.add(createPromoteMemoryToRegisterPass()); // See Scalar.h for more.
-  //FPM.add(createTypeRecoveryPass());
+  std::string SPName, FPName;
+  getFrameRegisterNames(SPName, FPName);
+  FPM.add(createStackRecoveryPass(SPName, FPName));
+  FPM.add(createTypeRecoveryPass());
+  FPM.add(createLoopRecoveryPass());
   FPM.run(*F);
 
   return F;
 }
 
+EVT Decompiler::getImmType(unsigned Opcode, unsigned OpNo) const {
+  // Typed as the instruction declares the operand, so the pattern that
+  // produced it matches on the first try.
+  const InstrClassInfo *ICI = Dis->getInstrClassInfo();
+  MVT VT = ICI ? ICI->getOperandType(Opcode, OpNo) : MVT::Other;
+  if (VT == MVT::iPTR)
+    VT = MVT::getIntegerVT(
+      8 * Dis->getMCDirector()->getMCAsmInfo()->getPointerSize());
+  // Predicates, condition codes and the like have no type of their own.
+  return VT.isScalarInteger() ? EVT(VT) : EVT(MVT::i32);
+}
+
+void Decompiler::getFrameRegisterNames(std::string &SPName,
+  std::string &FPName) {
+  TargetMachine *TM = Dis->getMCDirector()->getTargetMachine();
+  const TargetSubtargetInfo *STI = TM->getSubtargetImpl();
+  const TargetRegisterInfo *TRI = STI->getRegisterInfo();
+  unsigned SPReg =
+    STI->getTargetLowering()->getStackPointerRegisterToSaveRestore();
+  SPName = SPReg ? TRI->getName(SPReg) : "";
+
+  // The frame register depends on the function (hasFP), so use the register
+  // each ABI reserves for it.
+  switch (Triple(TM->getTargetTriple()).getArch()) {
+    default:                  FPName = ""; break;
+    case Triple::x86:         FPName = "EBP"; break;
+    case Triple::x86_64:      FPName = "RBP"; break;
+    case Triple::arm:
+    case Triple::armeb:       FPName = "R11"; break;
+    case Triple::thumb:
+    case Triple::thumbeb:     FPName = "R7"; break;
+    case Triple::ppc:
+    case Triple::ppc64:
+    case Triple::ppc64le:     FPName = "R31"; break;
+  }
+}
+
+void Decompiler::getCallRegisterNames(std::vector<std::string> &Uses,
+  std::vector<std::string> &Defs) {
+  // What the C calling convention of each target lets a function read and
+  // clobber. Sub-registers are globals of their own, so both names go in.
+  static const char *const X86Uses[] = { "ESP" };
+  static const char *const X86Defs[] = { "EAX", "ECX", "EDX", "EFLAGS" };
+  static const char *const X86_64Uses[] = {
+    "RDI", "RSI", "RDX", "RCX", "R8", "R9", "RAX", "RSP",
+    "EDI", "ESI", "EDX", "ECX", "R8D", "R9D", "EAX", "ESP"
+  };
+  static const char *const X86_64Defs[] = {
+    "RAX", "RCX", "RDX", "RSI", "RDI", "R8", "R9", "R10", "R11",
+    "EAX", "ECX", "EDX", "ESI", "EDI", "R8D", "R9D", "R10D", "R11D", "EFLAGS"
+  };
+  static const char *const ARMUses[] = { "R0", "R1", "R2", "R3", "SP" };
+  static const char *const ARMDefs[] = {
+    "R0", "R1", "R2", "R3", "R12", "LR", "CPSR"
+  };
+  static const char *const PPCUses[] = {
+    "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10",
+    "X1", "X2", "X3", "X4", "X5", "X6", "X7", "X8", "X9", "X10"
+  };
+  static const char *const PPCDefs[] = {
+    "R0", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10", "R11", "R12",
+    "X0", "X3", "X4", "X5", "X6", "X7", "X8", "X9", "X10", "X11", "X12",
+    "CR0", "CR1", "CR5", "CR6", "CR7", "LR", "LR8", "CTR", "CTR8", "XER"
+  };
+
+  Uses.clear();
+  Defs.clear();
+  TargetMachine *TM = Dis->getMCDirector()->getTargetMachine();
+  switch (Triple(TM->getTargetTriple()).getArch()) {
+    default:
+      // Nothing known; calls read and write every register.
+      break;
+    case Triple::x86:
+      Uses.assign(X86Uses, array_endof(X86Uses));
+      Defs.assign(X86Defs, array_endof(X86Defs));
+      break;
+    case Triple::x86_64:
+      Uses.assign(X86_64Uses, array_endof(X86_64Uses));
+      Defs.assign(X86_64Defs, array_endof(X86_64Defs));
+      break;
+    case Triple::arm:
+    case Triple::armeb:
+    case Triple::thumb:
+    case Triple::thumbeb:
+      Uses.assign(ARMUses, array_endof(ARMUses));
+      Defs.assign(ARMDefs, array_endof(ARMDefs));
+      break;
+    case Triple::ppc:
+    case Triple::ppc64:
+    case Triple::ppc64le:
+      Uses.assign(PPCUses, array_endof(PPCUses));
+      Defs.assign(PPCDefs, array_endof(PPCDefs));
+      break;
+  }
+}
+
 void Decompiler::sortBasicBlock(BasicBlock *BB) {
   BasicBlock::InstListType *Cur = &BB->getInstList();
   BasicBlock::InstListType::iterator P, I, E, S;
@@ -276,6 +575,16 @@ void Decompiler::splitBasicBlockIntoBlock(Function::iterator Src,
          "Trying to get me to create degenerate basic block!");
 
   Tgt->moveAfter(Src);
+  // Tgt now holds the tail of Src, so it is what Src used to fall through to.
+  DenseMap<const Function*, FunctionBlocks>::iterator FI =
+    Blocks.find(Src->getParent());
+  if (FI != Blocks.end()) {
+    FunctionBlocks &FB = FI->second;
+    BasicBlock *Next = FB.LayoutNext.lookup(Src);
+    if (Next)
+      FB.LayoutNext[Tgt] = Next;
+    FB.LayoutNext[Src] = Tgt;
+  }
 
   // Move all of the specified instructions from the original basic block into
   // the new basic block.
@@ -312,13 +621,121 @@ void Decompiler::splitBasicBlockIntoBlock(Function::iterator Src,
 
 void Decompiler::printInstructions(formatted_raw_ostream &Out,
   unsigned Address) {
-  Out << *(decompileFunction(Address));
+  Function *F = decompileFunction(Address);
+  if (F == NULL) {
+    printError("Unable to decompile function at " +
+      Twine::utohexstr(Address).str() + ".");
+    return;
+  }
+  Out << *F;
+}
+
+Function* Decompiler::decompileTrace(unsigned Address, unsigned MaxBlocks) {
+  if (!Dis->getMemory().isExecutable(Address)) {
+    printError("Address is not in mapped code: " +
+      Twine::utohexstr(Address).str());
+    return NULL;
+  }
+
+  // Decode breadth first from Address, so the blocks nearest to it make it
+  // into the trace.
+  MachineFunction *MF = Dis->getTraceFunction();
+  std::vector<MachineBasicBlock*> MBBs;
+  std::vector<uint64_t> Starts, Ends;
+  std::vector<uint64_t> Queue(1, Address);
+  std::set<uint64_t> Seen;
+  for (unsigned i = 0; i != Queue.size() && MBBs.size() < MaxBlocks; ++i) {
+    uint64_t Start = Queue[i];
+    if (!Seen.insert(Start).second || !Dis->getMemory().isExecutable(Start))
+      continue;
+    unsigned Size = 0;
+    MachineBasicBlock *MBB = Dis->decodeBasicBlock(Start, MF, Size);
+    if (MBB->empty())
+      continue;
+    MBBs.push_back(MBB);
+    Starts.push_back(Start);
+    Ends.push_back(Start + Size);
+
+    const MachineInstr *Last = &*MBB->instr_rbegin();
+    uint64_t LastAddr = Dis->getDebugOffset(Last->getDebugLoc());
+    uint64_t Target;
+    if (Last->isBranch() && Dis->getBranchTarget(LastAddr, Target))
+      Queue.push_back(Target);
+    if (!Last->isBarrier() && !Last->isReturn()
+        && !Dis->isNoReturnCall(LastAddr))
+      Queue.push_back(Start + Size);
+  }
+  if (MBBs.empty()) {
+    Dis->releaseTraceBlocks();
+    printError("Unable to decode a block at " +
+      Twine::utohexstr(Address).str());
+    return NULL;
+  }
+
+  std::string FName = "fracture.tb." + Twine::utohexstr(Address).str();
+  FunctionType *FType = FunctionType::get(Type::getPrimitiveType(*Context,
+      Type::VoidTyID), false);
+  Function *F = cast<Function>(Mod->getOrInsertFunction(FName, FType));
+  if (!F->empty())
+    F->deleteBody();
+
+  // Branches may go anywhere, backwards included, so the blocks are looked
+  // up from address 0.
+  Budget.start();
+  FunctionBlocks &FB = Blocks[F];
+  FB = FunctionBlocks();
+  FB.Entry = 0;
+  BasicBlock *Entry = BasicBlock::Create(*Context, "entry", F);
+  std::vector<BasicBlock*> BBs;
+  for (unsigned i = 0, e = MBBs.size(); i != e; ++i) {
+    BBs.push_back(BasicBlock::Create(*Context, MBBs[i]->getName(), F));
+    addBasicBlock(FB, Starts[i], BBs.back());
+  }
+  BranchInst::Create(BBs[0], Entry);
+  // A fall-through successor outside the trace is one of its exits.
+  for (unsigned i = 0, e = MBBs.size(); i != e; ++i)
+    FB.LayoutNext[BBs[i]] = getOrCreateBasicBlock(Ends[i], F);
+
+  for (unsigned i = 0, e = MBBs.size(); i != e; ++i)
+    if (decompileBasicBlock(MBBs[i], F) == NULL)
+      printError("Unable to decompile basic block!");
+  // The machine code is not needed again; a later trace decodes afresh.
+  Dis->releaseTraceBlocks();
+
+  // Blocks that were branched to but not decoded are where control leaves.
+  Type *Int64 = Type::getInt64Ty(*Context);
+  Constant *Exit = Mod->getOrInsertFunction("fracture.exit",
+    FunctionType::get(Type::getVoidTy(*Context), Int64, false));
+  for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB) {
+    if (BB->getTerminator() != NULL)
+      continue;
+    BasicBlock *Next = BB->empty() ? NULL : FB.LayoutNext.lookup(BB);
+    if (Next != NULL) {
+      BranchInst::Create(Next, BB);
+      continue;
+    }
+    DenseMap<const BasicBlock*, uint64_t>::iterator AI = FB.Addresses.find(BB);
+    if (!BB->empty() || AI == FB.Addresses.end()) {
+      new UnreachableInst(*Context, BB);
+      continue;
+    }
+    CallInst::Create(Exit, ConstantInt::get(Int64, AI->second), "", BB);
+    ReturnInst::Create(*Context, BB);
+  }
+  Blocks.erase(F);
+
+  DEBUG(dbgs() << FName << ": " << MBBs.size() << " blocks\n");
+  return F;
 }
 
 BasicBlock* Decompiler::decompileBasicBlock(MachineBasicBlock *MBB,
   Function *F) {
   // Create a Selection DAG of MachineSDNodes
   DAG = createDAGFromMachineBasicBlock(MBB);
+  // A block that goes over the budget is lifted with opaque calls, as is
+  // every block after it.
+  Budget.addInstructions(MBB->size());
+  Budget.addSDNodes(DAG->allnodes_size());
 
   if (ViewMCDAGs) {
     MBB->print(Infos);
@@ -372,7 +789,12 @@ BasicBlock* Decompiler::decompileBasicBlock(MachineBasicBlock *MBB,
   }
 
   // Create a new basic block (if necessary)
-  BasicBlock *BB = getOrCreateBasicBlock(MBB->getName(), F);
+  BasicBlock *BB;
+  if (MBB->empty())
+    BB = getOrCreateBasicBlock(MBB->getName(), F);
+  else
+    BB = getOrCreateBasicBlock(
+      Dis->getDebugOffset(MBB->instr_begin()->getDebugLoc()), F);
 
   // Convert the SDNodes into instructions inside the basic block
   // Infos << "OP_END: " << ISD::BUILTIN_OP_END << "\n";
@@ -393,6 +815,14 @@ BasicBlock* Decompiler::decompileBasicBlock(MachineBasicBlock *MBB,
   Emitter->endDAG();
   free(DAG);
 
+  // Decoding ended the block at a call that does not return.
+  if (BB->getTerminator() == NULL && !MBB->empty()
+      && Dis->isNoReturnCall(
+        Dis->getDebugOffset(MBB->instr_rbegin()->getDebugLoc()))) {
+    UnreachableInst *UI = new UnreachableInst(*Context, BB);
+    UI->setDebugLoc(MBB->instr_rbegin()->getDebugLoc());
+  }
+
   return BB;
 }
 
@@ -408,6 +838,7 @@ SelectionDAG* Decompiler::createDAGFromMachineBasicBlock(
   std::pair<SDValue, SDValue> NullVal;
   IndexedMap<std::pair<SDValue, SDValue> > Deps;
   Deps.grow(Dis->getMCDirector()->getMCRegisterInfo()->getNumRegs());
+  const InstrClassInfo *ICI = Dis->getInstrClassInfo();
   for (MachineBasicBlock::iterator I = MBB->instr_begin(), E = MBB->instr_end();
        I != E; ++I) {
     // Need these (in this order) to create an SDNode for the inst
@@ -417,8 +848,15 @@ SelectionDAG* Decompiler::createDAGFromMachineBasicBlock(
     SmallVector<SDValue, 8> Ops;
 
     // Detect Chain node and add prevNode to ops list
+    // NOTE: Instructions that load the PC are patched into returns by the
+    // disassembler, but they are loads, so the table flags still chain them.
     bool isChain = false;
-    if (I->mayLoad() || I->mayStore() || I->isBranch() || I->isReturn()
+    const InstrInfoEntry *Info = ICI ? ICI->getInfo(OpCode) : NULL;
+    if (Info != NULL) {
+      isChain = (Info->Flags & (InstrInfoEntry::MayLoad
+          | InstrInfoEntry::MayStore | InstrInfoEntry::Branch
+          | InstrInfoEntry::Return | InstrInfoEntry::Call)) != 0;
+    } else if (I->mayLoad() || I->mayStore() || I->isBranch() || I->isReturn()
       || I->isCall()) {
       isChain = true;
     }
@@ -445,11 +883,8 @@ SelectionDAG* Decompiler::createDAGFromMachineBasicBlock(
         }
         continue;
       } else if (MOp->isImm()) {
-        // FIXME: Using MVT::i32 here is kinda messed up, we should be able
-        // to detect what type it is.
-        // As it stands, this will cause Inverse dag selector to fail to match
-        // on 64 bit instructions.
-        Ops.push_back(DAG->getConstant(MOp->getImm(), EVT(MVT::i32), false));
+        Ops.push_back(DAG->getConstant(MOp->getImm(), getImmType(OpCode, i),
+            false));
       } else {
         Ops.push_back(DAG->getUNDEF(EVT(MVT::i32)));
       }
@@ -519,36 +954,53 @@ SelectionDAG* Decompiler::createDAGFromMachineBasicBlock(
 }
 
 BasicBlock* Decompiler::getOrCreateBasicBlock(unsigned Address, Function *F) {
-  // Grab offset from the first basic block in the function
-  BasicBlock *FB =
-    getOrCreateBasicBlock(StringRef(Twine(F->getName() + "+0").str()), F);
-  if (FB->begin() == FB->end()) {
-    printError("Cannot find by address when BasicBlock '+0' is empty!");
+  DenseMap<const Function*, FunctionBlocks>::iterator FI = Blocks.find(F);
+  if (FI == Blocks.end()) {
+    printError("Cannot find by address in a function that is not lifted!");
     return NULL;
   }
-  uint64_t FuncAddr = getBasicBlockAddress(FB);
+  FunctionBlocks &FB = FI->second;
 
-  // Get Target block offset (and check if the bb is inside this func!)
-  if (FuncAddr > Address) {
+  // Check if the bb is inside this func!
+  if (FB.Entry > Address) {
     printError("Address is before the function starts!");
     // TODO: What do we do in this situation?
     return NULL;
   }
 
-  uint64_t TBAddr = Address - FuncAddr;
+  DenseMap<uint64_t, BasicBlock*>::iterator BI = FB.ByAddress.find(Address);
+  if (BI != FB.ByAddress.end())
+    return BI->second;
+
+  // Every block decoded for this function is already in the map, so this one
+  // is a branch into the middle of one; it is split off at the end.
   std::string TBName;
-  // Find and/or create the basic block
   raw_string_ostream TBOut(TBName);
-  TBOut << F->getName() << "+" << TBAddr;
+  TBOut << F->getName() << "+" << (Address - FB.Entry);
+  BasicBlock *BB = BasicBlock::Create(*Context, TBOut.str(), F);
+  addBasicBlock(FB, Address, BB);
+  return BB;
+}
 
-  return getOrCreateBasicBlock(StringRef(TBOut.str()), F);
+void Decompiler::addBasicBlock(FunctionBlocks &FB, uint64_t Address,
+  BasicBlock *BB) {
+  FB.ByAddress[Address] = BB;
+  FB.Addresses[BB] = Address;
+}
+
+BasicBlock* Decompiler::getLayoutSuccessor(const BasicBlock *BB) const {
+  DenseMap<const Function*, FunctionBlocks>::const_iterator FI =
+    Blocks.find(BB->getParent());
+  if (FI == Blocks.end())
+    return NULL;
+  return FI->second.LayoutNext.lookup(BB);
 }
 
 BasicBlock* Decompiler::getOrCreateBasicBlock(StringRef BBName, Function *F) {
   // Set this basic block as the target
   BasicBlock *BBTgt = NULL;
   Function::iterator BI = F->begin(), BE = F->end();
-  while (BI->getName() != BBName && BI != BE) ++BI;
+  while (BI != BE && BI->getName() != BBName) ++BI;
   if (BI == BE) {
     BBTgt =
       BasicBlock::Create(*(Dis->getMCDirector()->getContext()), BBName, F);
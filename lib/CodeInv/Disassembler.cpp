@@ -15,6 +15,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "CodeInv/Disassembler.h"
+#include "llvm/ADT/STLExtras.h"
 
 using namespace llvm;
 
@@ -22,8 +23,10 @@ namespace fracture {
 
 Disassembler::Disassembler(MCDirector *NewMC, object::ObjectFile *NewExecutable,
   Module *NewModule, raw_ostream &InfoOut, raw_ostream &ErrOut)
-  : Infos(InfoOut), Errs(ErrOut) {
+  : TraceFn(NULL), TraceMF(NULL), Infos(InfoOut),
+    Errs(ErrOut) {
   MC = NewMC;
+  ICI = getTargetInstrClassInfo(MC->getTargetMachine()->getTargetTriple());
   setExecutable(NewExecutable);
   // If the module is null then create a new one
   if (NewModule == NULL) {
@@ -45,6 +48,8 @@ Disassembler::Disassembler(MCDirector *NewMC, object::ObjectFile *NewExecutable,
 Disassembler::~Disassembler() {
   // Note: BasicBlocks and Functions are also a part of TheModule, but we
   // still check to make sure they get deleted anyway.
+  delete TraceMF;
+  delete TraceFn;
   delete MC;
   delete TheModule;
   delete GMI;
@@ -72,6 +77,10 @@ Disassembler::~Disassembler() {
   }
 
 
+  for (DenseMap<unsigned, MCInstrDesc*>::iterator I = Descs.begin(),
+         E = Descs.end(); I != E; ++I)
+    delete I->second;
+
   delete CurSectionMemory;
   delete Executable;
 }
@@ -83,13 +92,27 @@ MachineFunction* Disassembler::disassemble(unsigned Address) {
     // Decode basic blocks until end of function
     unsigned Size = 0;
     MachineBasicBlock *MBB;
+    // The furthest forward branch target seen; the function goes at least
+    // that far even past a call that does not return.
+    uint64_t Reach = 0;
+    bool EndsFunction = false;
     do {
       unsigned MBBSize = 0;
       MBB = decodeBasicBlock(Address+Size, MF, MBBSize);
       Size += MBBSize;
-    } while (Address+Size < CurSectionEnd && MBB->size() > 0
-      && !(MBB->instr_rbegin()->isReturn()));
-    if (Address+Size < CurSectionEnd && MBB->size() > 0) {
+      for (MachineBasicBlock::iterator I = MBB->begin(), E = MBB->end();
+           I != E; ++I) {
+        uint64_t Target;
+        if (I->isBranch()
+            && getBranchTarget(getDebugOffset(I->getDebugLoc()), Target))
+          Reach = std::max(Reach, Target);
+      }
+      EndsFunction = MBB->size() > 0 && (MBB->instr_rbegin()->isReturn()
+        || (isNoReturnCall(getDebugOffset(MBB->instr_rbegin()->getDebugLoc()))
+          && Reach < Address+Size));
+    } while (Memory.isExecutable(Address+Size) && MBB->size() > 0
+      && !EndsFunction);
+    if (Memory.isExecutable(Address+Size) && MBB->size() > 0) {
       // FIXME: This can be shoved into the loop above to improve performance
       MachineFunction *NextMF =
         getNearestFunction(getDebugOffset(MBB->instr_rbegin()->getDebugLoc()));
@@ -120,21 +143,36 @@ MachineBasicBlock* Disassembler::decodeBasicBlock(unsigned Address,
 
   // NOTE: Might also need SectAddr...
   Size = 0;
-  while (Address+Size < (unsigned) CurSectionEnd) {
+  while (Memory.isExecutable(Address+Size)) {
     unsigned CurAddr = Address+Size;
     Size += std::max(unsigned(1), decodeInstruction(CurAddr, MBB));
     MachineInstr* MI = NULL;
     if (MBB->size() != 0) {
       MI = &(*MBB->instr_rbegin());
+      // Trace blocks do not last, keep what they replace.
+      if (MF == TraceMF) {
+        std::map<unsigned, const MachineInstr*>::iterator Old =
+          MachineInstructions.find(CurAddr);
+        if (Old != MachineInstructions.end()
+            && Old->second->getParent()->getParent() != TraceMF)
+          ShadowedInstructions[CurAddr] = Old->second;
+      }
       MachineInstructions[CurAddr] = MI;
     }
     if (MI != NULL && MI->isTerminator()) {
       break;
     }
+    // Whatever follows a call that does not return is not reached from it.
+    uint64_t Target;
+    if (MI != NULL && MI->isCall() && getBranchTarget(CurAddr, Target)
+        && isNoReturnTarget(Target)) {
+      NoReturnCalls.insert(CurAddr);
+      break;
+    }
   }
 
-  if (Address >= CurSectionEnd) {
-    printInfo("Reached end of current section!");
+  if (!Memory.isExecutable(Address+Size)) {
+    printInfo("Reached end of executable memory!");
   }
 
   return MBB;
@@ -145,15 +183,14 @@ unsigned Disassembler::decodeInstruction(unsigned Address,
   // Disassemble instruction
   const MCDisassembler *DA = MC->getMCDisassembler();
   uint64_t InstSize;
+  // Bytes from the instruction to the end of its region, whichever section
+  // that is.
+  ArrayRef<uint8_t> NewBytes = Memory.getBytes(Address);
+  if (NewBytes.empty()) {
+    printError("Address is not mapped, instruction decode failed!");
+    return 1;
+  }
   MCInst *Inst = new MCInst();
-  ArrayRef<uint8_t> Bytes(
-      (uint8_t*)CurSectionMemory->getBytes().data(),
-      (size_t)CurSectionMemory->getBytes().size());
-  // Chop any bytes off before instuction address that we don't need.
-  uint64_t NewAddr = Address - CurSectionMemory->getBase();
-  ArrayRef<uint8_t> NewBytes((uint8_t*)(Bytes.data() + NewAddr), 
-                             //Bytes.data() + Bytes.size() - NewAddr);
-                             (size_t)(Bytes.size() - NewAddr));
   // Replace nulls() with outs() for stack tracing
   if (!(DA->getInstruction(*Inst, InstSize, NewBytes, Address,
         nulls(), nulls()))) {
@@ -172,25 +209,24 @@ unsigned Disassembler::decodeInstruction(unsigned Address,
 
   // Recover Instruction information
   const MCInstrInfo *MII = MC->getMCInstrInfo();
-  MCInstrDesc *MCID = new MCInstrDesc(MII->get(Inst->getOpcode()));
-  MCID->Size = InstSize;
+  unsigned Opcode = Inst->getOpcode();
+  const InstrInfoEntry *Info = ICI ? ICI->getInfo(Opcode) : NULL;
 
   // Check if the instruction can load to program counter and mark it as a Ret
   // FIXME: Better analysis would be to see if the PC value references memory
   // sent as a parameter or set locally in the function, but that would need to
   // happen after decompilation. In either case, this is definitely a BB
   // terminator or branch!
-  if (MCID->mayLoad()
-    && MCID->mayAffectControlFlow(*Inst, *MC->getMCRegisterInfo())) {
-    MCID->Flags |= (1 << MCID::Return);
-    MCID->Flags |= (1 << MCID::Terminator);
-  }
+  bool MayLoad = Info ? Info->mayLoad() : MII->get(Opcode).mayLoad();
+  bool LoadsPC = MayLoad && MII->get(Opcode).mayAffectControlFlow(*Inst,
+    *MC->getMCRegisterInfo());
+  const MCInstrDesc *MCID = getInstrDesc(Opcode, InstSize, LoadsPC);
 
 
   // Recover MachineInstr representation
   DebugLoc *Location = setDebugLoc(Address);
   MachineInstrBuilder MIB = BuildMI(Block, *Location, *MCID);
-  unsigned int numDefs = MCID->getNumDefs();
+  unsigned int numDefs = Info ? Info->getNumDefs() : MCID->getNumDefs();
   for (unsigned int i = 0; i < Inst->getNumOperands(); i++) {
     MCOperand MCO = Inst->getOperand(i);
     // FIXME: This hack is a workaround for the assert in MachineInstr.cpp:653,
@@ -235,20 +271,26 @@ unsigned Disassembler::decodeInstruction(unsigned Address,
   // NOTE: I tried MCOpInfo here, and it appearst o be NULL
   // ... at least for ARM.
   unsigned flags = 0;
-  if (MCID->mayLoad())
+  if (Info ? Info->mayLoad() : MCID->mayLoad())
     flags |= MachineMemOperand::MOLoad;
-  if (MCID->mayStore())
+  if (Info ? Info->mayStore() : MCID->mayStore())
     flags |= MachineMemOperand::MOStore;
   if (flags != 0) {
     // Constant* cInt = ConstantInt::get(Type::getInt64Ty(ctx), MCO.getImm());
     // Value *Val = ConstantExpr::getIntToPtr(cInt,
     // PointerType::getUnqual(Type::getInt32Ty(ctx)));
-    // FIXME: note size of 4 is known to be bad for
-    // some targets
+    // The access width comes from the instruction table; a pointer sized
+    // access is the best guess when it is unknown.
+    unsigned MemSize = Info ? Info->getMemSize() : 0;
+    if (MemSize == 0)
+      MemSize = MC->getMCAsmInfo()->getPointerSize();
+    unsigned MemAlign = Info ? Info->getMemAlign() : 0;
+    if (Info && Info->isSignExtendingLoad())
+      flags |= MOSignExtend;
 
     //Copy & paste set getImm to zero
     MachineMemOperand* MMO = new MachineMemOperand(
-      MachinePointerInfo(), flags, 4, 0);	//MCO.getImm()
+      MachinePointerInfo(), flags, MemSize, MemAlign);	//MCO.getImm()
     MIB.addMemOperand(MMO);
     //outs() << "Name: " << MII->getName(Inst->getOpcode()) << " Flags: " << flags << "\n";
   }
@@ -258,6 +300,23 @@ unsigned Disassembler::decodeInstruction(unsigned Address,
   return ((unsigned)InstSize);
 }
 
+const MCInstrDesc* Disassembler::getInstrDesc(unsigned Opcode, unsigned Size,
+  bool LoadsPC) {
+  // Instruction sizes are well below 128 bytes on every target we support.
+  unsigned Key = (Opcode << 8) | ((Size & 0x7f) << 1) | LoadsPC;
+  MCInstrDesc *&MCID = Descs[Key];
+  if (MCID != NULL)
+    return MCID;
+
+  MCID = new MCInstrDesc(MC->getMCInstrInfo()->get(Opcode));
+  MCID->Size = Size;
+  if (LoadsPC) {
+    MCID->Flags |= (1 << MCID::Return);
+    MCID->Flags |= (1 << MCID::Terminator);
+  }
+  return MCID;
+}
+
 DebugLoc* Disassembler::setDebugLoc(uint64_t Address) {
   // Note: Location stores offset of instruction, which is really a perverse
   //       misuse of this field.
@@ -279,6 +338,52 @@ DebugLoc* Disassembler::setDebugLoc(uint64_t Address) {
   return Location;
 }
 
+bool Disassembler::getBranchTarget(uint64_t Address, uint64_t &Target) const {
+  const MCInstrAnalysis *MIA = MC->getMCInstrAnalysis();
+  MCInst *Inst = getMCInst(Address);
+  const MachineInstr *MI = getMachineInstr(Address);
+  if (MIA == NULL || Inst == NULL || MI == NULL)
+    return false;
+  return MIA->evaluateBranch(*Inst, Address, MI->getDesc().getSize(), Target);
+}
+
+bool Disassembler::isNoReturnName(StringRef Name) {
+  static const char *const Names[] = {
+    "abort", "exit", "_exit", "_Exit", "quick_exit", "pthread_exit",
+    "longjmp", "_longjmp", "siglongjmp", "__longjmp_chk",
+    "err", "errx", "verr", "verrx",
+    "__assert_fail", "__assert_perror_fail", "__assert_rtn", "__assert",
+    "__stack_chk_fail", "__chk_fail", "__fortify_fail",
+    "__cxa_throw", "__cxa_rethrow", "__cxa_bad_cast", "__cxa_bad_typeid",
+    "__cxa_pure_virtual", "_Unwind_Resume", "_ZSt9terminatev",
+    "__libc_start_main"
+  };
+  // Imports show up as name@plt or name@GLIBC_2.2.5.
+  Name = Name.split('@').first;
+  for (unsigned i = 0, e = array_lengthof(Names); i != e; ++i)
+    if (Name == Names[i])
+      return true;
+  return false;
+}
+
+bool Disassembler::isNoReturnTarget(uint64_t Target) {
+  if (isNoReturn(Target))
+    return true;
+  // Stubs named by relocation, then symbols.
+  for (std::map<StringRef, uint64_t>::const_iterator I = RelocOrigins.begin(),
+         E = RelocOrigins.end(); I != E; ++I) {
+    if (I->second == Target && isNoReturnName(I->first)) {
+      addNoReturn(Target);
+      return true;
+    }
+  }
+  if (Executable != NULL && isNoReturnName(getSymbolName(Target))) {
+    addNoReturn(Target);
+    return true;
+  }
+  return false;
+}
+
 MachineFunction* Disassembler::getOrCreateFunction(unsigned Address) {
   MachineFunction *MF = getNearestFunction(Address);
   if (MF == NULL) {
@@ -294,6 +399,52 @@ MachineFunction* Disassembler::getOrCreateFunction(unsigned Address) {
   return MF;
 }
 
+MachineFunction* Disassembler::getTraceFunction() {
+  if (TraceMF == NULL) {
+    // The function is not in TheModule, so nothing mistakes it for code.
+    FunctionType *FTy = FunctionType::get(
+      Type::getPrimitiveType(TheModule->getContext(), Type::VoidTyID), false);
+    TraceFn = Function::Create(FTy, GlobalValue::ExternalLinkage,
+      "fracture.traces");
+    TraceMF = new MachineFunction(TraceFn, *MC->getTargetMachine(), 0, *MMI);
+  }
+  return TraceMF;
+}
+
+void Disassembler::releaseTraceBlocks() {
+  if (TraceMF == NULL)
+    return;
+
+  for (MachineFunction::iterator MBB = TraceMF->begin(), E = TraceMF->end();
+       MBB != E; ++MBB) {
+    for (MachineBasicBlock::instr_iterator I = MBB->instr_begin(),
+           IE = MBB->instr_end(); I != IE; ++I) {
+      unsigned Address = getDebugOffset(I->getDebugLoc());
+      std::map<unsigned, const MachineInstr*>::iterator MI =
+        MachineInstructions.find(Address);
+      if (MI == MachineInstructions.end() || MI->second != &*I)
+        continue;
+      std::map<unsigned, const MachineInstr*>::iterator Old =
+        ShadowedInstructions.find(Address);
+      if (Old != ShadowedInstructions.end())
+        MI->second = Old->second;
+      else
+        MachineInstructions.erase(MI);
+    }
+  }
+  ShadowedInstructions.clear();
+
+  // Each block has a parentless BasicBlock holding its name.
+  std::vector<const BasicBlock*> Names;
+  while (!TraceMF->empty()) {
+    Names.push_back(TraceMF->front().getBasicBlock());
+    TraceMF->erase(TraceMF->begin());
+  }
+  TraceMF->RenumberBlocks();
+  for (unsigned i = 0, e = Names.size(); i != e; ++i)
+    delete Names[i];
+}
+
 MachineFunction* Disassembler::getNearestFunction(unsigned Address) {
   if (Functions.size() == 0) {
     return NULL;
@@ -306,7 +457,7 @@ MachineFunction* Disassembler::getNearestFunction(unsigned Address) {
       FuncItr++;
       continue;
     }
-    if (FuncItr->first <= Address && Address < CurSectionEnd) {
+    if (FuncItr->first <= Address && Memory.isExecutable(Address)) {
       // Does this address fit there?
       MachineInstr* LastInstr =
         &(*((FuncItr->second->rbegin())->instr_rbegin()));
@@ -385,7 +536,7 @@ void Disassembler::printInstruction(formatted_raw_ostream &Out,
   unsigned Size = Inst->getDesc().getSize();
   // TODO: replace the Bytes with something memory safe (StringRef??)
   uint8_t *Bytes = new uint8_t(Size);
-  int NumRead = CurSectionMemory->readBytes(Bytes, Address, Size);
+  int NumRead = Memory.readBytes(Bytes, Address, Size);
   if (NumRead < 0) {
     printError("Unable to read current section memory!");
     return;
@@ -451,6 +602,8 @@ void Disassembler::setExecutable(object::ObjectFile* NewExecutable) {
   // need to evaluate if this is necessary. We should *not* change the MC API
   // settings to match those of the executable.
   Executable = NewExecutable;
+  Memory.clear();
+  Memory.addSections(Executable);
 }
 
 std::string Disassembler::getSymbolName(unsigned Address) {
@@ -528,6 +681,23 @@ void Disassembler::getRelocFunctionName(unsigned Address, StringRef &NameRef) {
     NameRef = RelName;
 }
 
+bool Disassembler::isFunctionEntry(unsigned Address) const {
+  if (Functions.count(Address))
+    return true;
+  if (Executable == NULL)
+    return false;
+  uint64_t SymAddr;
+  for (object::symbol_iterator I = Executable->symbols().begin(),
+         E = Executable->symbols().end(); I != E; ++I) {
+    object::SymbolRef::Type SymbolTy;
+    if (I->getType(SymbolTy) || SymbolTy != object::SymbolRef::ST_Function)
+      continue;
+    if (!I->getAddress(SymAddr) && (unsigned)SymAddr == Address)
+      return true;
+  }
+  return false;
+}
+
 const StringRef Disassembler::getFunctionName(unsigned Address) const {
   uint64_t SymAddr;
   std::error_code ec;
@@ -664,6 +834,11 @@ const object::SectionRef Disassembler::getSectionByName(StringRef SectionName)
 
 const object::SectionRef Disassembler::getSectionByAddress(unsigned Address)
   const {
+  if (const AddressSpace::Region *R = Memory.find(Address))
+    if (R->Section.getObject() != NULL)
+      return R->Section;
+
+  // Sections that are not mapped, like .bss.
   std::error_code ec;
   for (object::section_iterator si = Executable->section_begin(), se =
          Executable->section_end(); si != se; ++si) {
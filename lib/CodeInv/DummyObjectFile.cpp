@@ -7,7 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// Represents a raw binary file.
+// Represents a raw binary file, or a firmware image made of several raw
+// blobs each mapped at its own address. Every blob is a section.
 //
 // Note: Could also use the ancestor class Binary for this feature, but we did
 //       not do that because we want to add ObjectFile capabilities so that we
@@ -18,7 +19,8 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "DummyObjectFile.h"
+#include "CodeInv/DummyObjectFile.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ADT/SmallVector.h"
 
@@ -27,16 +29,30 @@ namespace llvm {
 namespace object {
 
   DummyObjectFile::DummyObjectFile(std::unique_ptr<MemoryBuffer> &Object,
-    std::error_code& ec) : ObjectFile(Binary::ID_ELF32B,
-      std::move(Object)->getMemBufferRef()) {
+    std::error_code& ec, uint64_t Address, unsigned Perms)
+    : ObjectFile(Binary::ID_ELF32B, Object->getMemBufferRef()) {
     // NOTE: Figure out if using ID_ELF32B breaks anything.
     //       We want it to ID as an object, but we don't want it to try to
     //       disassemble as an ELF...We may have to change the LLVM base code.
     // this->Data.swap(Object);
     // this->TypeID = Binary::ID_ELF32B;
+    addRegion(std::move(Object), Address, Perms);
     ec = object_error::success;
   }
 
+  void DummyObjectFile::addRegion(std::unique_ptr<MemoryBuffer> Buffer,
+    uint64_t Address, unsigned Perms) {
+    Region R;
+    R.Buffer = std::move(Buffer);
+    R.Address = Address;
+    R.Perms = Perms;
+    // Named like ELF sections so lookups for "text" find the code.
+    R.Name = (Perms & fracture::AddressSpace::Execute) ? ".text" : ".data";
+    if (!Regions.empty())
+      R.Name += "." + utostr(Regions.size());
+    Regions.push_back(std::move(R));
+  }
+
   // Ideally, the following should be in the objectfile namespace but
   // we did not want to change the base llvm.
   ObjectFile* DummyObjectFile::createDummyObjectFile(
@@ -67,15 +83,14 @@ namespace object {
 
   section_iterator DummyObjectFile::begin_sections() const {
     DataRefImpl ret;
-    ret.p = intptr_t(this->Data.getBufferStart());
+    ret.d.a = 0;
     return section_iterator(SectionRef(ret, this));
   }
 
   section_iterator DummyObjectFile::end_sections() const {
-    //DataRefImpl ret;
-    //ret.p = intptr_t(0);
-    //return section_iterator(SectionRef(ret, this));
-	 return begin_sections();
+    DataRefImpl ret;
+    ret.d.a = Regions.size();
+    return section_iterator(SectionRef(ret, this));
   }
 
   uint8_t DummyObjectFile::getBytesInAddress() const {
@@ -83,9 +98,22 @@ namespace object {
     return 4;
   }
 
+  static const char DummyFormatName[] = "<unknown format>-<unknown-arch>";
+
   StringRef DummyObjectFile::getFileFormatName() const {
     // TODO: Implement based on target?
-    return "<unknown format>-<unknown-arch>";
+    return DummyFormatName;
+  }
+
+  const DummyObjectFile *DummyObjectFile::getIfDummy(const ObjectFile *Obj) {
+    if (Obj == NULL || Obj->getFileFormatName().data() != DummyFormatName)
+      return NULL;
+    return static_cast<const DummyObjectFile *>(Obj);
+  }
+
+  unsigned DummyObjectFile::getSectionPerms(DataRefImpl Sec) const {
+    const Region *R = getRegion(Sec);
+    return R ? R->Perms : 0;
   }
 
   unsigned DummyObjectFile::getArch() const {
@@ -167,38 +195,36 @@ namespace object {
 
   std::error_code DummyObjectFile::getSectionNext(DataRefImpl Sec,
                                              SectionRef& Res) const {
-    DataRefImpl ret;
-    ret.p = intptr_t(0);
-    Res = SectionRef(ret, this);
-    // TODO: Implement
-    //Res = end_sections();
+    moveSectionNext(Sec);
+    Res = SectionRef(Sec, this);
     return object_error::success;
   }
 
   std::error_code DummyObjectFile::getSectionName(DataRefImpl Sec,
                                              StringRef& Res) const {
-    MemoryBuffer *Buf = reinterpret_cast<MemoryBuffer*>(Sec.p);
-    Res = Buf->getBufferIdentifier();
-    //Res = StringRef("<unknown>");
+    const Region *R = getRegion(Sec);
+    if (R == NULL)
+      return object_error::parse_failed;
+    Res = R->Name;
     return object_error::success;
   }
 
   uint64_t DummyObjectFile::getSectionAddress(DataRefImpl Sec) const {
-    // TODO: Implement
-    return 0;
+    const Region *R = getRegion(Sec);
+    return R ? R->Address : 0;
   }
 
   uint64_t DummyObjectFile::getSectionSize(DataRefImpl Sec) const {
-    // TODO: we will need a custom section type if we want to add sections
-    MemoryBuffer *Buf = reinterpret_cast<MemoryBuffer*>(Sec.p);
-    return Buf->getBufferSize();
+    const Region *R = getRegion(Sec);
+    return R ? R->Buffer->getBufferSize() : 0;
   }
 
   std::error_code DummyObjectFile::getSectionContents(DataRefImpl Sec,
                                                  StringRef& Res) const {
-    MemoryBuffer *Buf = reinterpret_cast<MemoryBuffer*>(Sec.p);
-    Res = Buf->getBuffer();
-    //Res = StringRef("None");
+    const Region *R = getRegion(Sec);
+    if (R == NULL)
+      return object_error::parse_failed;
+    Res = R->Buffer->getBuffer();
     return object_error::success;
   }
 
@@ -208,18 +234,17 @@ namespace object {
   }
 
   bool DummyObjectFile::isSectionText(DataRefImpl Sec) const {
-    // TODO: Implement
-    return true;
+    const Region *R = getRegion(Sec);
+    return R && (R->Perms & fracture::AddressSpace::Execute);
   }
 
   bool DummyObjectFile::isSectionData(DataRefImpl Sec) const {
-    // TODO: Implement
-    return true;
+    const Region *R = getRegion(Sec);
+    return R && !(R->Perms & fracture::AddressSpace::Execute);
   }
 
   bool DummyObjectFile::isSectionBSS(DataRefImpl Sec) const {
-    // TODO: Implement
-    return true;
+    return false;
   }
 
   std::error_code DummyObjectFile::isSectionRequiredForExecution(DataRefImpl Sec,
@@ -243,8 +268,9 @@ namespace object {
 
   std::error_code DummyObjectFile::isSectionReadOnlyData(DataRefImpl Sec,
                                                     bool& Res) const {
-    // TODO: Implement
-    Res = false;
+    const Region *R = getRegion(Sec);
+    Res = R && !(R->Perms & (fracture::AddressSpace::Write |
+        fracture::AddressSpace::Execute));
     return object_error::success;
   }
 
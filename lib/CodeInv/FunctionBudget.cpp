@@ -0,0 +1,107 @@
+//===--- FunctionBudget - Per-function decompilation limits -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/FunctionBudget.h"
+#include "llvm/Support/CommandLine.h"
+
+using namespace llvm;
+
+namespace fracture {
+
+static cl::opt<unsigned> MaxFunctionInstrs("max-function-instrs",
+  cl::desc("Machine instructions decompiled per function before degrading "
+    "(0 = unlimited)"),
+  cl::init(0));
+
+static cl::opt<unsigned> MaxFunctionSDNodes("max-function-sdnodes",
+  cl::desc("SDNodes built per function before degrading (0 = unlimited)"),
+  cl::init(0));
+
+static cl::opt<unsigned> MaxMatcherSteps("max-matcher-steps",
+  cl::desc("Inverse matcher steps per function before degrading "
+    "(0 = unlimited)"),
+  cl::init(0));
+
+static cl::opt<unsigned> FunctionDeadlineMs("function-deadline-ms",
+  cl::desc("Wall-clock milliseconds per function before degrading "
+    "(0 = unlimited)"),
+  cl::init(0));
+
+enum BudgetAction { BA_Degrade, BA_Skip };
+
+static cl::opt<BudgetAction> OverBudgetAction("budget-action",
+  cl::desc("What to do with a function that exceeds its budget"),
+  cl::values(
+    clEnumValN(BA_Degrade, "degrade",
+      "Lift the rest of the function as opaque calls"),
+    clEnumValN(BA_Skip, "skip", "Drop the function with a diagnostic"),
+    clEnumValEnd),
+  cl::init(BA_Degrade));
+
+FunctionBudget::FunctionBudget() {
+  start();
+}
+
+void FunctionBudget::start() {
+  // Options are read here so a budget constructed before the command line
+  // is parsed still picks them up for the next function.
+  MaxInstrs = MaxFunctionInstrs;
+  MaxNodes = MaxFunctionSDNodes;
+  MaxSteps = MaxMatcherSteps;
+  NumInstrs = NumNodes = Steps = 0;
+  SinceClockCheck = 0;
+  HasDeadline = FunctionDeadlineMs != 0;
+  if (HasDeadline)
+    End = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(FunctionDeadlineMs);
+  Exhausted = None;
+}
+
+bool FunctionBudget::addInstructions(unsigned N) {
+  if (Exhausted != None)
+    return false;
+  NumInstrs += N;
+  if (MaxInstrs && NumInstrs > MaxInstrs)
+    return exhaust(Instructions);
+  return true;
+}
+
+bool FunctionBudget::addSDNodes(unsigned N) {
+  if (Exhausted != None)
+    return false;
+  NumNodes += N;
+  if (MaxNodes && NumNodes > MaxNodes)
+    return exhaust(SDNodes);
+  return checkDeadline();
+}
+
+bool FunctionBudget::checkDeadline() {
+  if (Exhausted != None)
+    return false;
+  if (HasDeadline && std::chrono::steady_clock::now() >= End)
+    return exhaust(Deadline);
+  return true;
+}
+
+const char *FunctionBudget::getExhaustedName() const {
+  switch (Exhausted) {
+  case None:          return "none";
+  case Instructions:  return "instruction limit";
+  case SDNodes:       return "SDNode limit";
+  case MatcherSteps:  return "matcher step limit";
+  case Deadline:      return "deadline";
+  }
+  return "unknown";
+}
+
+bool FunctionBudget::shouldSkip() const {
+  return OverBudgetAction == BA_Skip;
+}
+
+} // end namespace fracture
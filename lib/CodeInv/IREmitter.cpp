@@ -16,18 +16,22 @@
 
 #include "CodeInv/IREmitter.h"
 #include "CodeInv/Decompiler.h"
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/Statistic.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "iremitter"
 
+STATISTIC(NumFoldedLiterals, "Number of loads from read-only memory folded");
+
 namespace fracture {
 
 IREmitter::IREmitter(Decompiler *TheDec, raw_ostream &InfoOut,
   raw_ostream &ErrOut) : Infos(InfoOut), Errs(ErrOut) {
   Dec = TheDec;
   DAG = Dec->getCurrentDAG();
-  IRB = new IRBuilder<>(getGlobalContext());
+  IRB = new IRBuilder<>(Dec->getModule()->getContext());
   RegMap.grow(Dec->getDisassembler()->getMCDirector()->getMCRegisterInfo(
      )->getNumRegs());
 }
@@ -125,6 +129,57 @@ StringRef IREmitter::getInstructionName(const SDNode *N) {
   return StringRef();
 }
 
+uint64_t IREmitter::getPCValue(const SDNode *N) {
+  Disassembler *Dis = Dec->getDisassembler();
+  uint64_t Address = Dis->getDebugOffset(N->getDebugLoc());
+  const MachineInstr *MI = Dis->getMachineInstr(Address);
+  return Address + (MI ? MI->getDesc().getSize() : 0);
+}
+
+Constant* IREmitter::getKnownRegister(const SDNode *N, unsigned Reg) {
+  const InstrClassInfo *ICI = Dec->getDisassembler()->getInstrClassInfo();
+  if (ICI == NULL || ICI->getPCReg() == 0 || Reg != ICI->getPCReg())
+    return NULL;
+  return ConstantInt::get(
+    N->getValueType(0).getTypeForEVT(IRB->getContext()), getPCValue(N));
+}
+
+Constant* IREmitter::foldLiteralLoad(uint64_t Address, Type *Ty) {
+  Disassembler *Dis = Dec->getDisassembler();
+  unsigned Bits = Ty->getPrimitiveSizeInBits();
+  if (Ty->isVectorTy() || Bits == 0 || Bits % 8 != 0 || Bits > 64)
+    return NULL;
+  unsigned Size = Bits / 8;
+  uint8_t Bytes[8];
+  if (!Dis->getMemory().isReadOnly(Address, Size)
+      || Dis->getMemory().readBytes(Bytes, Address, Size))
+    return NULL;
+
+  bool Little = Dis->getMCDirector()->getMCAsmInfo()->isLittleEndian();
+  uint64_t Val = 0;
+  for (unsigned i = 0; i != Size; ++i)
+    Val |= uint64_t(Bytes[Little ? i : Size - 1 - i]) << (8 * i);
+
+  // A pointer to the start of a function is a function pointer; referring
+  // to the function lets calls through it become direct. Other code
+  // addresses (labels, jump table entries) stay plain integers.
+  unsigned PtrBits =
+    8 * Dis->getMCDirector()->getMCAsmInfo()->getPointerSize();
+  if (Ty->isIntegerTy(PtrBits) && Dis->getMemory().isExecutable(Val)
+      && Dis->isFunctionEntry(Val)) {
+    LLVMContext &Ctx = Dec->getModule()->getContext();
+    FunctionType *FT = FunctionType::get(Type::getVoidTy(Ctx), false);
+    AttributeSet AS;
+    AS = AS.addAttribute(Ctx, AttributeSet::FunctionIndex, "Address",
+      Twine(Val).str());
+    Constant *F = Dec->getModule()->getOrInsertFunction(
+      Dis->getFunctionName(Val), FT, AS);
+    return ConstantExpr::getPtrToInt(F, Ty);
+  }
+  return ConstantExpr::getBitCast(
+    ConstantInt::get(IntegerType::get(Ty->getContext(), Bits), Val), Ty);
+}
+
 Value* IREmitter::visit(const SDNode *N) {
   // Note: Extenders of this class should probably copy the following block
   // Also note, however, that it is up to the visit function wether to save to
@@ -140,6 +195,9 @@ Value* IREmitter::visit(const SDNode *N) {
   DEBUG(Infos << "\n");
   DEBUG(Infos << format("%1" PRIx64, Dec->getDisassembler()->getDebugOffset(N->getDebugLoc())) << "\n");
 
+  if (N->isMachineOpcode())
+    return visitMachineNode(N);
+
   switch (N->getOpcode()) {
     default:{
       errs() << "OpCode: " << N->getOpcode() << "\n";
@@ -241,6 +299,16 @@ Value* IREmitter::visitCopyFromReg(const SDNode *N) {
     return NULL;
   }
 
+  // Registers known at lift time, like the program counter, come out as
+  // constants, and so do the addresses computed from them.
+  const RegisterSDNode *R = dyn_cast<RegisterSDNode>(N->getOperand(1));
+  if (R != NULL) {
+    if (Constant *Res = getKnownRegister(N, R->getReg())) {
+      VisitMap[N] = Res;
+      return Res;
+    }
+  }
+
   Value *RegVal = visitRegister(N->getOperand(1).getNode());
   if (RegVal == NULL) {
     errs() << "visitCopyFromReg: Invalid Register!\n";
@@ -266,6 +334,10 @@ Value* IREmitter::visitCopyToReg(const SDNode *N) {
     return NULL;
   }
 
+  // Opaque calls for instructions with several defs return a struct.
+  if (V->getType()->isStructTy())
+    V = IRB->CreateExtractValue(V, N->getOperand(2).getResNo());
+
   //errs() << "V:\t" <<"Output Type: " << V->getType()->getScalarSizeInBits() <<"\n";
   //V->dump();
   //errs() << "RegVal:\t" <<"Output Type: " << RegVal->getType()->getScalarSizeInBits() <<"\n";
@@ -280,7 +352,7 @@ Value* IREmitter::visitCopyToReg(const SDNode *N) {
 Value* IREmitter::visitConstant(const SDNode *N) {
   if (const ConstantSDNode *CSDN = dyn_cast<ConstantSDNode>(N)) {
     Value *Res = Constant::getIntegerValue(
-      N->getValueType(0).getTypeForEVT(getGlobalContext()),
+      N->getValueType(0).getTypeForEVT(IRB->getContext()),
       CSDN->getAPIntValue());
     VisitMap[N] = Res;
     return Res;
@@ -306,8 +378,9 @@ Value* IREmitter::visitADD(const SDNode *N) {
     BaseName = getBaseValueName(Op1->getName());
   }
   StringRef Name = getIndexedValueName(BaseName);
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateAdd(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateAdd(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -325,8 +398,9 @@ Value* IREmitter::visitSUB(const SDNode *N) {
   }
   StringRef Name = getIndexedValueName(BaseName);
   //outs() << "IREmitter::visitSUB: " << Name.str() << " op0 op1 " << Op0 << " "<< Op1 << "\n";
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateSub(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateSub(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -349,8 +423,9 @@ Value* IREmitter::visitMUL(const SDNode *N) {
   }
   StringRef Name = getIndexedValueName(BaseName);
   //outs() << "IREmitter::visitSUB: " << Name.str() << " op0 op1 " << Op0 << " "<< Op1 << "\n";
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateMul(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateMul(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -380,8 +455,9 @@ Value* IREmitter::visitAND(const SDNode *N) {
   }
   StringRef Name = getIndexedValueName(BaseName);
   //outs() << "IREmitter::visitXOR: " << Name.str() << " op0 op1 " << Op0 << " "<< Op1 << "\n";
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateAnd(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateAnd(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -396,8 +472,9 @@ Value* IREmitter::visitOR(const SDNode *N) {
     BaseName = getBaseValueName(Op1->getName());
   }
   StringRef Name = getIndexedValueName(BaseName);
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateOr(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateOr(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -414,8 +491,9 @@ Value* IREmitter::visitXOR(const SDNode *N) {
   }
   StringRef Name = getIndexedValueName(BaseName);
   //outs() << "IREmitter::visitXOR: " << Name.str() << " op0 op1 " << Op0 << " "<< Op1 << "\n";
-  Instruction *Res = dyn_cast<Instruction>(IRB->CreateXor(Op0, Op1, Name));
-  Res->setDebugLoc(N->getDebugLoc());
+  Value *Res = IRB->CreateXor(Op0, Op1, Name);
+  if (Instruction *I = dyn_cast<Instruction>(Res))
+    I->setDebugLoc(N->getDebugLoc());
   VisitMap[N] = Res;
   return Res;
 }
@@ -495,13 +573,46 @@ Value* IREmitter::visitLOAD(const SDNode *N) {
   StringRef BaseName = getBaseValueName(Addr->getName());
   StringRef Name = getIndexedValueName(BaseName);
 
+  // Extending loads read only the memory width.
+  const LoadSDNode *LN = dyn_cast<LoadSDNode>(N);
+  bool IsExt = LN && LN->getExtensionType() != ISD::NON_EXTLOAD;
+  Type *MemTy = IsExt ?
+    LN->getMemoryVT().getTypeForEVT(IRB->getContext()) : NULL;
+
+  // Literal pools and other read-only data fold to what they hold.
+  if (ConstantInt *CAddr = dyn_cast<ConstantInt>(Addr)) {
+    Type *ResTy = N->getValueType(0).getTypeForEVT(IRB->getContext());
+    if (Constant *C = foldLiteralLoad(CAddr->getZExtValue(),
+          MemTy ? MemTy : ResTy)) {
+      if (IsExt)
+        C = LN->getExtensionType() == ISD::SEXTLOAD ?
+          ConstantExpr::getSExt(C, ResTy) : ConstantExpr::getZExt(C, ResTy);
+      ++NumFoldedLiterals;
+      VisitMap[N] = C;
+      return C;
+    }
+  }
+
   if (!Addr->getType()->isPointerTy()) {
-    Addr = IRB->CreateIntToPtr(Addr, Addr->getType()->getPointerTo(), Name);
-    (dyn_cast<Instruction>(Addr))->setDebugLoc(N->getDebugLoc());
+    Addr = IRB->CreateIntToPtr(Addr,
+      MemTy ? MemTy->getPointerTo() : Addr->getType()->getPointerTo(), Name);
+    if (Instruction *I = dyn_cast<Instruction>(Addr))
+      I->setDebugLoc(N->getDebugLoc());
+  } else if (MemTy && Addr->getType() != MemTy->getPointerTo()) {
+    Addr = IRB->CreateBitCast(Addr, MemTy->getPointerTo(), Name);
   }
   Name = getIndexedValueName(BaseName);
   Instruction *Res = IRB->CreateLoad(Addr, Name);
   Res->setDebugLoc(N->getDebugLoc());
+  if (IsExt) {
+    Type *ResTy = N->getValueType(0).getTypeForEVT(IRB->getContext());
+    Value *Ext = LN->getExtensionType() == ISD::SEXTLOAD ?
+      IRB->CreateSExt(Res, ResTy) : IRB->CreateZExt(Res, ResTy);
+    if (Instruction *ExtI = dyn_cast<Instruction>(Ext)) {
+      ExtI->setDebugLoc(N->getDebugLoc());
+      Res = ExtI;
+    }
+  }
   VisitMap[N] = Res;
   return Res;
 }
@@ -524,7 +635,17 @@ Value* IREmitter::visitSTORE(const SDNode *N) {
     //errs() << "-----Dump2\n";
     //Addr->dump();
     //N->getDebugLoc().dump(getGlobalContext());
-    (dyn_cast<Instruction>(Addr))->setDebugLoc(N->getDebugLoc());
+    if (Instruction *I = dyn_cast<Instruction>(Addr))
+      I->setDebugLoc(N->getDebugLoc());
+  }
+
+  // Truncating stores write only the memory width.
+  const StoreSDNode *SN = dyn_cast<StoreSDNode>(N);
+  if (SN && SN->isTruncatingStore()) {
+    Type *MemTy = SN->getMemoryVT().getTypeForEVT(IRB->getContext());
+    StoreVal = IRB->CreateTrunc(StoreVal, MemTy);
+    if (Addr->getType() != MemTy->getPointerTo())
+      Addr = IRB->CreateBitCast(Addr, MemTy->getPointerTo(), Name);
   }
 
   Instruction *Res = IRB->CreateStore(StoreVal, Addr);
@@ -556,7 +677,8 @@ Value* IREmitter::visitRegister(const SDNode *N) {
       DAG ? DAG->getTarget().getSubtargetImpl()->getRegisterInfo() : 0);
     RegName = RP.str().substr(1, RegName.size());
 
-    Type* Ty = R->getValueType(0).getTypeForEVT(getGlobalContext());
+    Type* Ty = R->getValueType(0).getTypeForEVT(
+      Dec->getModule()->getContext());
 
     Reg = Dec->getModule()->getGlobalVariable(RegName);
     if (Reg == NULL) {
@@ -611,4 +733,85 @@ Value* IREmitter::visitCALL(const SDNode *N) {
   return NULL;
 }
 
+Value* IREmitter::visitMachineNode(const SDNode *N) {
+  // Machine nodes only get here when the inverse selector could not match
+  // them (see InvISelDAG::SelectFallback). Emit a call to an opaque function
+  // that takes the register and immediate operands and returns the register
+  // defs, so the dataflow around the instruction stays correct.
+  const Disassembler *Dis = Dec->getDisassembler();
+  const MCInstrInfo *MII = Dis->getMCDirector()->getMCInstrInfo();
+  unsigned Opcode = N->getMachineOpcode();
+  LLVMContext &Ctx = Dec->getModule()->getContext();
+
+  SmallVector<Value*, 8> Args;
+  SmallVector<Type*, 8> ArgTys;
+  for (unsigned i = 0, e = N->getNumOperands(); i != e; ++i) {
+    SDValue Op = N->getOperand(i);
+    EVT VT = Op.getValueType();
+    if (VT == MVT::Other || VT == MVT::Glue)
+      continue;
+    Value *V = visit(Op.getNode());
+    if (V == NULL)
+      V = UndefValue::get(VT.getTypeForEVT(Ctx));
+    else if (V->getType()->isStructTy())
+      V = IRB->CreateExtractValue(V, Op.getResNo());
+    Args.push_back(V);
+    ArgTys.push_back(V->getType());
+  }
+
+  // Register defs come first in the node's values, so result i of the
+  // struct is value i of the node.
+  SmallVector<Type*, 4> ResTys;
+  for (unsigned i = 0, e = N->getNumValues(); i != e; ++i) {
+    EVT VT = N->getValueType(i);
+    if (VT != MVT::Other && VT != MVT::Glue)
+      ResTys.push_back(VT.getTypeForEVT(Ctx));
+  }
+  Type *RetTy = Type::getVoidTy(Ctx);
+  if (ResTys.size() == 1)
+    RetTy = ResTys[0];
+  else if (ResTys.size() > 1)
+    RetTy = StructType::get(Ctx, ResTys);
+
+  // Patternless instructions are described by the fallback table, the
+  // others failed to match and we fall back on the instruction descriptor.
+  bool MayLoad, MayStore, SideEffects, ControlFlow;
+  const InstrClassInfo *ICI = Dis->getInstrClassInfo();
+  if (const FallbackEntry *FB = ICI ? ICI->getFallback(Opcode) : NULL) {
+    MayLoad = FB->mayLoad();
+    MayStore = FB->mayStore();
+    ControlFlow = FB->isControlFlow();
+    SideEffects = FB->hasSideEffects() || ControlFlow;
+  } else {
+    const MCInstrDesc &Desc = MII->get(Opcode);
+    MayLoad = Desc.mayLoad();
+    MayStore = Desc.mayStore();
+    ControlFlow = Desc.isCall() || Desc.isBranch() || Desc.isReturn()
+      || Desc.isTerminator();
+    SideEffects = Desc.hasUnmodeledSideEffects() || ControlFlow;
+  }
+
+  // A branch or call that could not be lifted still transfers control, and
+  // may leave by unwinding.
+  AttributeSet AS;
+  if (!ControlFlow)
+    AS = AS.addAttribute(Ctx, AttributeSet::FunctionIndex,
+      Attribute::NoUnwind);
+  if (!MayStore && !SideEffects)
+    AS = AS.addAttribute(Ctx, AttributeSet::FunctionIndex,
+      MayLoad ? Attribute::ReadOnly : Attribute::ReadNone);
+
+  std::string FName = "fracture.opaque." + MII->getName(Opcode).str();
+  printInfo("Lifting " + MII->getName(Opcode).str() + " as an opaque call");
+  Constant *Proto = Dec->getModule()->getOrInsertFunction(FName,
+    FunctionType::get(RetTy, ArgTys, false), AS);
+
+  CallInst *Call = IRB->CreateCall(Proto, Args);
+  if (!RetTy->isVoidTy() && ResTys.size() == 1)
+    Call->setName(getInstructionName(N));
+  Call->setDebugLoc(N->getDebugLoc());
+  VisitMap[N] = RetTy->isVoidTy() ? NULL : Call;
+  return VisitMap[N];
+}
+
 } // End namespace fracture
@@ -0,0 +1,87 @@
+//===--- InstrClassInfo - Per-opcode instruction classes --------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Target independent queries on top of the generated instruction classes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/Triple.h"
+#include <algorithm>
+
+namespace fracture {
+
+const InstrClassInfo *getTargetInstrClassInfo(StringRef TripleName) {
+  switch (Triple(TripleName).getArch()) {
+    case Triple::arm:
+    case Triple::armeb:
+    case Triple::thumb:
+    case Triple::thumbeb:
+      return getARMInstrClassInfo();
+    case Triple::x86:
+    case Triple::x86_64:
+      return getX86InstrClassInfo();
+    case Triple::ppc:
+    case Triple::ppc64:
+    case Triple::ppc64le:
+      return getPPCInstrClassInfo();
+    default:
+      return NULL;
+  }
+}
+
+static bool compareFallbackOpcode(const FallbackEntry &E, unsigned Opcode) {
+  return E.Opcode < Opcode;
+}
+
+const FallbackEntry *InstrClassInfo::getFallback(unsigned Opcode) const {
+  const FallbackEntry *E = std::lower_bound(Fallbacks,
+    Fallbacks + NumFallbacks, Opcode, compareFallbackOpcode);
+  if (E == Fallbacks + NumFallbacks || E->Opcode != Opcode)
+    return NULL;
+  return E;
+}
+
+bool InstrClassInfo::isPadding(const MachineInstr *MI) const {
+  unsigned Opcode = MI->getOpcode();
+  if (isNop(Opcode))
+    return true;
+  if (!is(IC_Padding, Opcode))
+    return false;
+  int PredIdx = MI->findFirstPredOperandIdx();
+  return PredIdx == -1 || MI->getOperand(PredIdx).getImm() == 0;
+}
+
+bool InstrClassInfo::isProloguePush(const MachineInstr *MI) const {
+  if (!isPush(MI->getOpcode()))
+    return false;
+  for (MachineInstr::const_mop_iterator MO = MI->operands_begin(),
+         E = MI->operands_end(); MO != E; ++MO) {
+    if (!MO->isReg())
+      continue;
+    for (unsigned i = 0; i != NumPrologueRegs; ++i)
+      if (MO->getReg() == PrologueRegs[i])
+        return true;
+  }
+  return false;
+}
+
+bool InstrClassInfo::isPCRelLoad(const MachineInstr *MI) const {
+  if (!is(IC_PCRelLoad, MI->getOpcode()))
+    return false;
+  if (PCReg == 0 || MI->getDesc().hasImplicitUseOfPhysReg(PCReg))
+    return true;
+  for (MachineInstr::const_mop_iterator MO = MI->operands_begin(),
+         E = MI->operands_end(); MO != E; ++MO)
+    if (MO->isReg() && MO->getReg() == PCReg)
+      return true;
+  return false;
+}
+
+} // end namespace fracture
@@ -15,10 +15,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "CodeInv/InvISelDAG.h"
+#include "CodeInv/InstrClassInfo.h"
 #include "Target/ARM/ARMInvISelDAG.h"
 #include "Target/X86/X86InvISelDAG.h"
 #include "Target/PowerPC/PPCInvISelDAG.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/Support/CommandLine.h"
 
 //#include "StringRef.h"
 
@@ -53,6 +55,7 @@ InvISelDAG::InvISelDAG(const TargetMachine &TMC,
   TLI = TMC.getSubtargetImpl()->getTargetLowering();
   TM = &TMC;
   Dec = TheDec;
+  Budget = NULL;
 }
 
 
@@ -61,6 +64,14 @@ InvISelDAG::InvISelDAG(const TargetMachine &TMC,
 // STATISTIC(NumFastIselBlocks, "Number of blocks selected entirely by fast isel");
 // STATISTIC(NumDAGBlocks, "Number of blocks selected using DAG");
 STATISTIC(NumDAGIselRetries,"Number of times dag isel has to try another path");
+STATISTIC(NumFallbackLifts, "Number of instructions lifted as opaque calls");
+STATISTIC(NumOverBudgetLifts,
+  "Number of instructions lifted as opaque calls after the budget ran out");
+
+static cl::opt<bool> FallbackLift("fallback-lift",
+  cl::desc("Lift instructions the inverse selector cannot match as opaque "
+    "calls instead of aborting"),
+  cl::init(true));
 
 
 /// GetVBR - decode a vbr encoding whose top bit is set.
@@ -642,6 +653,13 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
 
   assert(NodeToMatch->isMachineOpcode() && "Node already selected!");
 
+  // Out of budget for this function: don't even try to match.
+  if (Budget && Budget->isExhausted()) {
+    SelectFallback(NodeToMatch, true);
+    ++NumOverBudgetLifts;
+    return 0;
+  }
+
   // Set up the node stack with NodeToMatch as the only node on the stack.
   SmallVector<SDValue, 8> NodeStack;
   SDValue N = SDValue(NodeToMatch, 0);
@@ -689,13 +707,10 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
   // OpcodeOffset table.
   unsigned MatcherIndex = 0;
 
-  std::vector<unsigned> OpcodeOffset; // Was global, put here to make following
-                                      // code happy...
-
   if (!OpcodeOffset.empty()) {
     // Already computed the OpcodeOffset table, just index into it.
-    if (N.getOpcode() < OpcodeOffset.size())
-      MatcherIndex = OpcodeOffset[N.getOpcode()];
+    if (TgtOpc < OpcodeOffset.size())
+      MatcherIndex = OpcodeOffset[TgtOpc];
     DEBUG(errs() << "  Initial Opcode index to " << MatcherIndex << "\n");
 
   } else if (MatcherTable[0] == OPC_SwitchOpcode) {
@@ -720,8 +735,8 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
     }
 
     // Okay, do the lookup for the first opcode.
-    if (N.getOpcode() < OpcodeOffset.size())
-      MatcherIndex = OpcodeOffset[N.getOpcode()];
+    if (TgtOpc < OpcodeOffset.size())
+      MatcherIndex = OpcodeOffset[TgtOpc];
   }
 
   while (1) {
@@ -730,6 +745,15 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
     unsigned CurrentOpcodeIndex = MatcherIndex;
 #endif
     BuiltinOpcodes Opcode = (BuiltinOpcodes)MatcherTable[MatcherIndex++];
+    // Only charge the checks: once the first node is emitted the match
+    // always completes, and until then the node can still be lifted as is.
+    if (Opcode < OPC_EmitInteger && Budget && !Budget->step()) {
+      DEBUG(errs() << "  Out of budget (" << Budget->getExhaustedName()
+                   << ")\n");
+      SelectFallback(NodeToMatch, true);
+      ++NumOverBudgetLifts;
+      return 0;
+    }
     switch (Opcode) {
     case OPC_Scope: {
       // Okay, the semantics of this operation are that we should push a scope
@@ -871,7 +895,10 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
       continue;
 
     case OPC_SwitchOpcode: {
-      unsigned CurNodeOpcode = N.getOpcode();
+      // Target opcodes are stored in the table like OPC_CheckOpcode does.
+      uint16_t CurNodeOpcode = N.getOpcode();
+      if (N->isMachineOpcode())
+        CurNodeOpcode = ~CurNodeOpcode;
       unsigned SwitchStart = MatcherIndex-1; (void)SwitchStart;
       unsigned CaseSize;
       while (1) {
@@ -1207,21 +1234,38 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
         } else {
           MMO = *(SrcNode->memoperands_begin());
         }
+        // Accesses narrower than the register become extending loads and
+        // truncating stores of the real width.
+        EVT MemVT;
+        if (MMO != NULL)
+          MemVT = EVT::getIntegerVT(*CurDAG->getContext(), MMO->getSize() * 8);
         if (TargetOpc == ISD::STORE) {
-          Res = (CurDAG->getStore(InputChain, SDLoc(NodeToMatch), Ops[0], 
-              Ops[1], MMO)).getNode();
+          EVT ValVT = Ops[0].getValueType();
+          if (MMO && ValVT.isScalarInteger() && MemVT.bitsLT(ValVT))
+            Res = (CurDAG->getTruncStore(InputChain, SDLoc(NodeToMatch),
+                Ops[0], Ops[1], MemVT, MMO)).getNode();
+          else
+            Res = (CurDAG->getStore(InputChain, SDLoc(NodeToMatch), Ops[0],
+                Ops[1], MMO)).getNode();
         }
         if (TargetOpc == ISD::LOAD) {
           // Ops[0] - chain, Ops[1] - src register, Ops[2] offImm
           EVT LdType = NodeToMatch->getValueType(0);
-          // unsigned Alignment = TLI->getDataLayout()->getABITypeAlignment(
-          //   NodeToMatch->getType());
-          // NOTE: Selection/DAG handles Alignment = 0;.
-          unsigned Alignment = 0;
-          Res = (CurDAG->getLoad(LdType, SDLoc(NodeToMatch), InputChain, Ops[0],
-              MachinePointerInfo::getConstantPool(), 
-              false, false, true, //FIXME: Just guessing on these.
-              Alignment)).getNode();
+          if (MMO && LdType.isScalarInteger() && MemVT.bitsLT(LdType)) {
+            ISD::LoadExtType ExtType = (MMO->getFlags() & MOSignExtend)
+              ? ISD::SEXTLOAD : ISD::ZEXTLOAD;
+            Res = (CurDAG->getExtLoad(ExtType, SDLoc(NodeToMatch),
+                LdType, InputChain, Ops[0], MemVT, MMO)).getNode();
+          } else {
+            // unsigned Alignment = TLI->getDataLayout()->getABITypeAlignment(
+            //   NodeToMatch->getType());
+            // NOTE: Selection/DAG handles Alignment = 0;.
+            unsigned Alignment = 0;
+            Res = (CurDAG->getLoad(LdType, SDLoc(NodeToMatch), InputChain,
+                Ops[0], MachinePointerInfo::getConstantPool(),
+                false, false, true, //FIXME: Just guessing on these.
+                Alignment)).getNode();
+          }
         }
         RecordedNodes.clear();
         for (unsigned i = 0, e = VTs.size(); i != e; ++i) {
@@ -1413,7 +1457,8 @@ SDNode* InvISelDAG::InvertCodeCommon(SDNode *NodeToMatch,
     ++NumDAGIselRetries;
     while (1) {
       if (MatchScopes.empty()) {
-        CannotYetSelect(NodeToMatch);
+        if (!SelectFallback(NodeToMatch))
+          CannotYetSelect(NodeToMatch);
         return 0;
       }
 
@@ -1573,6 +1618,19 @@ void InvISelDAG::SelectInlineAsmMemoryOperands(std::vector<SDValue> &Ops) {
     Ops.push_back(InOps.back());
 }
 
+bool InvISelDAG::SelectFallback(SDNode *N, bool Force) {
+  if ((!FallbackLift && !Force) || !N->isMachineOpcode())
+    return false;
+
+  // The machine node already carries the register uses and defs of the
+  // instruction, so leave it in place for IREmitter::visitMachineNode.
+  DEBUG(errs() << "Fallback lift: ";
+        N->dump(CurDAG));
+  N->setNodeId(-1);
+  ++NumFallbackLifts;
+  return true;
+}
+
 void InvISelDAG::CannotYetSelect(SDNode *N) {
   std::string msg;
   raw_string_ostream Msg(msg);
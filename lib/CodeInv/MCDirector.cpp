@@ -29,13 +29,14 @@ MCDirector::MCDirector(std::string TripleName,
   CodeModel::Model CM,
   CodeGenOpt::Level OL,
   raw_ostream &InfoOut,
-  raw_ostream &ErrOut) : Infos(InfoOut), Errs(ErrOut) {
+  raw_ostream &ErrOut,
+  LLVMContext *Ctx) : Infos(InfoOut), Errs(ErrOut) {
 
   printInfo("Using Triple: " + TripleName);
   printInfo("Using CPU: " + CPUName.str());
   printInfo("Using Features: " + Features.str());
 
-  LLVMCtx = &getGlobalContext();
+  LLVMCtx = Ctx ? Ctx : &getGlobalContext();
 
   // TargetOptions
   TOpts = new TargetOptions(TargetOpts);
@@ -63,12 +64,6 @@ MCDirector::MCDirector(std::string TripleName,
     printError("Unable to create SubtargetInfo.");
   }
 
-  // MCDisassembler
-  DisAsm = TheTarget->createMCDisassembler(*STI, *MCCtx);
-  if (DisAsm == NULL) {
-    printError("Unable to create MCDisassembler.");
-  }
-
   // MCRegisterInfo
   MRI = TheTarget->createMCRegInfo(TripleName);
   if (MRI == NULL) {
@@ -91,6 +86,12 @@ MCDirector::MCDirector(std::string TripleName,
   // for MCObjectFileInfo
   MCOFI->InitMCObjectFileInfo(TripleName, RM, CM, *MCCtx);
 
+  // MCDisassembler
+  DisAsm = TheTarget->createMCDisassembler(*STI, *MCCtx);
+  if (DisAsm == NULL) {
+    printError("Unable to create MCDisassembler.");
+  }
+
   // MCInstrInfo
   MII = TheTarget->createMCInstrInfo();
   if (MII == NULL) {
@@ -104,9 +105,13 @@ MCDirector::MCDirector(std::string TripleName,
     printError("No instruction printer for target.");
   }
   MIP->setPrintImmHex(1);
+
+  // MCInstrAnalysis, optional
+  MIA = MII ? TheTarget->createMCInstrAnalysis(MII) : NULL;
 }
 
 MCDirector::~MCDirector() {
+  delete MIA;
   delete MIP;
   delete MII;
   delete AsmInfo;
@@ -116,7 +121,7 @@ MCDirector::~MCDirector() {
   delete DisAsm;
   delete STI;
   delete TM;
-  delete TheTarget;
+  // TheTarget belongs to the TargetRegistry.
   delete TOpts;
   delete LLVMCtx;
 }
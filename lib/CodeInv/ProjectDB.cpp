@@ -0,0 +1,648 @@
+//===--- ProjectDB - On-disk store of analysis results ----------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/ProjectDB.h"
+#include "CodeInv/Decompiler.h"
+#include "CodeInv/Disassembler.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/Object/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "fracture-projectdb"
+
+namespace fracture {
+
+using namespace projectdb;
+
+static const char Magic[8] = { 'F', 'R', 'A', 'C', 'T', 'D', 'B', '\0' };
+
+/// Expected record size of each table, indexed by TableKind.
+static const size_t RecordSizes[TK_NumTables] = {
+  1, 1, sizeof(SectionRecord), sizeof(SymbolRecord), sizeof(InstrRecord),
+  sizeof(BlockRecord), sizeof(EdgeRecord), sizeof(EdgeRecord),
+  sizeof(EdgeRecord), sizeof(NameRecord), sizeof(FunctionRecord)
+};
+
+//===----------------------------------------------------------------------===//
+// ProjectDB
+//===----------------------------------------------------------------------===//
+
+ErrorOr<std::unique_ptr<ProjectDB> > ProjectDB::open(StringRef Path) {
+  // No null terminator needed, which lets large files be mapped.
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buf =
+    MemoryBuffer::getFile(Path, -1, false);
+  if (std::error_code EC = Buf.getError())
+    return EC;
+  std::unique_ptr<ProjectDB> DB(new ProjectDB(Path, std::move(Buf.get())));
+  if (std::error_code EC = DB->parse())
+    return EC;
+  return std::move(DB);
+}
+
+std::error_code ProjectDB::parse() {
+  StringRef Data = Buffer->getBuffer();
+  if (Data.size() < sizeof(Header) ||
+      memcmp(Data.data(), Magic, sizeof(Magic)) != 0)
+    return object::object_error::parse_failed;
+  Hdr = reinterpret_cast<const Header *>(Data.data());
+  if (Hdr->Version != Version)
+    return make_error_code(std::errc::not_supported);
+
+  for (unsigned i = 0; i != TK_NumTables; ++i) {
+    TableData[i] = NULL;
+    TableCount[i] = 0;
+  }
+
+  uint64_t NumTables = Hdr->NumTables;
+  if (NumTables > (Data.size() - sizeof(Header)) / sizeof(TableEntry))
+    return object::object_error::parse_failed;
+  const TableEntry *Dir =
+    reinterpret_cast<const TableEntry *>(Data.data() + sizeof(Header));
+  for (uint64_t i = 0; i != NumTables; ++i) {
+    uint32_t Kind = Dir[i].Kind;
+    uint64_t Offset = Dir[i].Offset, Count = Dir[i].Count;
+    if (Kind >= TK_NumTables || Dir[i].RecordSize != RecordSizes[Kind])
+      return object::object_error::parse_failed;
+    if (Offset > Data.size() ||
+        Count > (Data.size() - Offset) / RecordSizes[Kind])
+      return object::object_error::parse_failed;
+    TableData[Kind] = Data.data() + Offset;
+    TableCount[Kind] = Count;
+  }
+
+  // getString relies on the string table ending in a terminator.
+  if (TableCount[TK_Strings] == 0 ||
+      TableData[TK_Strings][TableCount[TK_Strings] - 1] != '\0')
+    return object::object_error::parse_failed;
+  return std::error_code();
+}
+
+template <class RecordT>
+ArrayRef<RecordT> ProjectDB::getTable(TableKind Kind) const {
+  return ArrayRef<RecordT>(reinterpret_cast<const RecordT *>(TableData[Kind]),
+    TableCount[Kind]);
+}
+
+StringRef ProjectDB::getTriple() const { return getString(Hdr->Triple); }
+StringRef ProjectDB::getFileName() const { return getString(Hdr->FileName); }
+
+StringRef ProjectDB::getString(uint32_t Offset) const {
+  if (Offset >= TableCount[TK_Strings])
+    return StringRef();
+  return StringRef(TableData[TK_Strings] + Offset);
+}
+
+StringRef ProjectDB::getBitcode(const FunctionRecord &F) const {
+  uint64_t Offset = F.BlobOffset, Size = F.BlobSize;
+  if (Offset > TableCount[TK_Blobs] || Size > TableCount[TK_Blobs] - Offset)
+    return StringRef();
+  return StringRef(TableData[TK_Blobs] + Offset, Size);
+}
+
+ArrayRef<SectionRecord> ProjectDB::sections() const {
+  return getTable<SectionRecord>(TK_Sections);
+}
+ArrayRef<SymbolRecord> ProjectDB::symbols() const {
+  return getTable<SymbolRecord>(TK_Symbols);
+}
+ArrayRef<InstrRecord> ProjectDB::instructions() const {
+  return getTable<InstrRecord>(TK_Instrs);
+}
+ArrayRef<BlockRecord> ProjectDB::blocks() const {
+  return getTable<BlockRecord>(TK_Blocks);
+}
+ArrayRef<EdgeRecord> ProjectDB::edges() const {
+  return getTable<EdgeRecord>(TK_Edges);
+}
+ArrayRef<EdgeRecord> ProjectDB::calls() const {
+  return getTable<EdgeRecord>(TK_Calls);
+}
+ArrayRef<EdgeRecord> ProjectDB::callers() const {
+  return getTable<EdgeRecord>(TK_Callers);
+}
+ArrayRef<NameRecord> ProjectDB::names() const {
+  return getTable<NameRecord>(TK_Names);
+}
+ArrayRef<FunctionRecord> ProjectDB::functions() const {
+  return getTable<FunctionRecord>(TK_Functions);
+}
+
+/// Records keyed by a leading Address field.
+template <class RecordT>
+static const RecordT *findExact(ArrayRef<RecordT> Table, uint64_t Address) {
+  const RecordT *I = std::lower_bound(Table.begin(), Table.end(), Address,
+    [](const RecordT &R, uint64_t A) { return R.Address < A; });
+  if (I == Table.end() || I->Address != Address)
+    return NULL;
+  return I;
+}
+
+/// Records with an Address and Size; returns the one containing Address.
+template <class RecordT>
+static const RecordT *findContaining(ArrayRef<RecordT> Table,
+  uint64_t Address) {
+  const RecordT *I = std::upper_bound(Table.begin(), Table.end(), Address,
+    [](uint64_t A, const RecordT &R) { return A < R.Address; });
+  if (I == Table.begin())
+    return NULL;
+  --I;
+  if (I->Address != Address && Address - I->Address >= I->Size)
+    return NULL;
+  return I;
+}
+
+static ArrayRef<EdgeRecord> edgesFrom(ArrayRef<EdgeRecord> Table,
+  uint64_t From) {
+  const EdgeRecord *B = std::lower_bound(Table.begin(), Table.end(), From,
+    [](const EdgeRecord &R, uint64_t A) { return R.From < A; });
+  const EdgeRecord *E = std::upper_bound(B, Table.end(), From,
+    [](uint64_t A, const EdgeRecord &R) { return A < R.From; });
+  return ArrayRef<EdgeRecord>(B, E);
+}
+
+const SectionRecord *ProjectDB::findSection(uint64_t Address) const {
+  return findContaining(sections(), Address);
+}
+
+const SymbolRecord *ProjectDB::findSymbol(uint64_t Address) const {
+  return findContaining(symbols(), Address);
+}
+
+const InstrRecord *ProjectDB::findInstruction(uint64_t Address) const {
+  return findExact(instructions(), Address);
+}
+
+const FunctionRecord *ProjectDB::findFunction(uint64_t Address) const {
+  return findExact(functions(), Address);
+}
+
+ArrayRef<InstrRecord> ProjectDB::getInstructions(uint64_t Begin,
+  uint64_t End) const {
+  ArrayRef<InstrRecord> Table = instructions();
+  auto Less = [](const InstrRecord &R, uint64_t A) { return R.Address < A; };
+  const InstrRecord *B = std::lower_bound(Table.begin(), Table.end(), Begin,
+    Less);
+  const InstrRecord *E = std::lower_bound(B, Table.end(), End, Less);
+  return ArrayRef<InstrRecord>(B, E);
+}
+
+ArrayRef<BlockRecord> ProjectDB::getBlocks(uint64_t Function) const {
+  ArrayRef<BlockRecord> Table = blocks();
+  const BlockRecord *B = std::lower_bound(Table.begin(), Table.end(), Function,
+    [](const BlockRecord &R, uint64_t F) { return R.Function < F; });
+  const BlockRecord *E = std::upper_bound(B, Table.end(), Function,
+    [](uint64_t F, const BlockRecord &R) { return F < R.Function; });
+  return ArrayRef<BlockRecord>(B, E);
+}
+
+ArrayRef<EdgeRecord> ProjectDB::getSuccessors(uint64_t Block) const {
+  return edgesFrom(edges(), Block);
+}
+
+ArrayRef<EdgeRecord> ProjectDB::getCallees(uint64_t Function) const {
+  return edgesFrom(calls(), Function);
+}
+
+ArrayRef<EdgeRecord> ProjectDB::getCallers(uint64_t Function) const {
+  return edgesFrom(callers(), Function);
+}
+
+StringRef ProjectDB::getName(uint64_t Address) const {
+  if (const NameRecord *N = findExact(names(), Address))
+    return getString(N->Name);
+  if (const FunctionRecord *F = findExact(functions(), Address))
+    return getString(F->Name);
+  if (const SymbolRecord *S = findExact(symbols(), Address))
+    return getString(S->Name);
+  return StringRef();
+}
+
+bool ProjectDB::lookupName(StringRef Name, uint64_t &Address) const {
+  // Names are not indexed; this is only used to resolve user input.
+  for (const NameRecord &N : names())
+    if (getString(N.Name) == Name) {
+      Address = N.Address;
+      return true;
+    }
+  for (const FunctionRecord &F : functions())
+    if (getString(F.Name) == Name) {
+      Address = F.Address;
+      return true;
+    }
+  for (const SymbolRecord &S : symbols())
+    if (getString(S.Name) == Name) {
+      Address = S.Address;
+      return true;
+    }
+  return false;
+}
+
+//===----------------------------------------------------------------------===//
+// ProjectDBWriter
+//===----------------------------------------------------------------------===//
+
+void ProjectDBWriter::merge(const ProjectDB &DB) {
+  setTarget(DB.getTriple(), DB.getFileName());
+  for (const SectionRecord &S : DB.sections())
+    addSection(S.Address, S.Size, DB.getString(S.Name), S.Flags);
+  for (const SymbolRecord &S : DB.symbols())
+    addSymbol(S.Address, S.Size, DB.getString(S.Name), S.Type);
+  for (const InstrRecord &I : DB.instructions())
+    addInstruction(I.Address, I.Size, I.Opcode, DB.getString(I.Text));
+  for (const FunctionRecord &F : DB.functions())
+    addFunction(F.Address, DB.getString(F.Name), DB.getBitcode(F));
+  for (const BlockRecord &B : DB.blocks())
+    addBlock(B.Function, B.Address, B.End);
+  for (const EdgeRecord &E : DB.edges())
+    addEdge(E.From, E.To);
+  for (const EdgeRecord &E : DB.calls())
+    addCall(E.From, E.To);
+  for (const NameRecord &N : DB.names())
+    setName(N.Address, DB.getString(N.Name));
+}
+
+void ProjectDBWriter::addBinary(Disassembler *Dis) {
+  const object::ObjectFile *Obj = Dis->getExecutable();
+  setTarget(Dis->getMCDirector()->getTargetMachine()->getTargetTriple(),
+    Obj->getFileName());
+
+  for (const object::SectionRef &S : Obj->sections()) {
+    StringRef Name;
+    if (S.getName(Name))
+      continue;
+    uint32_t Flags = 0;
+    if (S.isText())
+      Flags |= SF_Text;
+    if (S.isData())
+      Flags |= SF_Data;
+    if (S.isBSS())
+      Flags |= SF_BSS;
+    addSection(S.getAddress(), S.getSize(), Name, Flags);
+  }
+
+  for (const object::SymbolRef &S : Obj->symbols()) {
+    StringRef Name;
+    uint64_t Address, Size;
+    object::SymbolRef::Type Type;
+    if (S.getName(Name) || S.getAddress(Address) || S.getSize(Size) ||
+        S.getType(Type))
+      continue;
+    if (Name.empty() || Address == object::UnknownAddressOrSize)
+      continue;
+    if (Size == object::UnknownAddressOrSize)
+      Size = 0;
+    addSymbol(Address, Size, Name, Type);
+  }
+}
+
+void ProjectDBWriter::addFunctions(Disassembler *Dis, Decompiler *Dec) {
+  MCInstPrinter *MIP = Dis->getMCDirector()->getMCInstPrinter();
+  Module *Mod = Dec->getModule();
+  const std::map<unsigned, MachineFunction*> &MFs = Dis->getFunctions();
+  for (std::map<unsigned, MachineFunction*>::const_iterator I = MFs.begin(),
+         E = MFs.end(); I != E; ++I) {
+    MachineFunction *MF = I->second;
+    for (MachineFunction::iterator MBB = MF->begin(), BE = MF->end();
+         MBB != BE; ++MBB) {
+      for (MachineBasicBlock::iterator MI = MBB->begin(), ME = MBB->end();
+           MI != ME; ++MI) {
+        uint64_t Address = Dis->getDebugOffset(MI->getDebugLoc());
+        std::string Text;
+        raw_string_ostream OS(Text);
+        if (MCInst *Inst = Dis->getMCInst(Address))
+          MIP->printInst(Inst, OS, "");
+        addInstruction(Address, MI->getDesc().getSize(), MI->getOpcode(),
+          StringRef(OS.str()).trim());
+      }
+    }
+
+    Function *F = Mod->getFunction(MF->getName());
+    if (F == NULL || F->empty())
+      continue;
+
+    // A standalone module with only this function's body, as the batch
+    // driver writes them.
+    std::unique_ptr<Module> M(CloneModule(Mod));
+    for (Module::iterator FI = M->begin(), FE = M->end(); FI != FE; ++FI)
+      if (FI->getName() != F->getName())
+        FI->deleteBody();
+    std::string Bitcode;
+    raw_string_ostream BCOS(Bitcode);
+    WriteBitcodeToFile(M.get(), BCOS);
+    addFunction(I->first, F->getName(), BCOS.str());
+
+    // Blocks are addressed by their first instruction. The entry block only
+    // holds the allocas the decompiler adds, and the preheaders and exits
+    // added by loop recovery only a branch, so they have no address.
+    std::map<BasicBlock *, uint64_t> BlockAddrs;
+    for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+      if (BB->empty() || BB == F->begin() ||
+          BB->begin()->getDebugLoc().isUnknown())
+        continue;
+      uint64_t Start = Dec->getBasicBlockAddress(BB), Last = Start;
+      for (BasicBlock::iterator Inst = BB->begin(), IE = BB->end();
+           Inst != IE; ++Inst)
+        if (!Inst->getDebugLoc().isUnknown())
+          Last = std::max(Last, Dis->getDebugOffset(Inst->getDebugLoc()));
+      const MachineInstr *LastMI = Dis->getMachineInstr(Last);
+      addBlock(I->first, Start,
+        Last + (LastMI ? LastMI->getDesc().getSize() : 0));
+      BlockAddrs[BB] = Start;
+    }
+
+    for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+      std::map<BasicBlock *, uint64_t>::iterator From = BlockAddrs.find(BB);
+      if (From == BlockAddrs.end())
+        continue;
+      for (succ_iterator SI = succ_begin(BB), SE = succ_end(BB); SI != SE;
+           ++SI) {
+        // Edges run through blocks without an address to the next one.
+        BasicBlock *Succ = *SI;
+        for (unsigned Hops = 0; !BlockAddrs.count(Succ) && Hops != 4; ++Hops) {
+          TerminatorInst *TI = Succ->getTerminator();
+          if (TI == NULL || TI->getNumSuccessors() != 1)
+            break;
+          Succ = TI->getSuccessor(0);
+        }
+        std::map<BasicBlock *, uint64_t>::iterator To = BlockAddrs.find(Succ);
+        if (To != BlockAddrs.end())
+          addEdge(From->second, To->second);
+      }
+      for (BasicBlock::iterator Inst = BB->begin(), IE = BB->end();
+           Inst != IE; ++Inst) {
+        CallInst *CI = dyn_cast<CallInst>(Inst);
+        if (CI == NULL || CI->getCalledFunction() == NULL ||
+            !CI->getCalledFunction()->hasFnAttribute("Address"))
+          continue;
+        uint64_t Callee;
+        if (!CI->getCalledFunction()->getFnAttribute("Address")
+            .getValueAsString().getAsInteger(10, Callee))
+          addCall(I->first, Callee);
+      }
+    }
+  }
+}
+
+void ProjectDBWriter::addSection(uint64_t Address, uint64_t Size,
+  StringRef Name, uint32_t Flags) {
+  Sym &S = Sections[std::make_pair(Address, Name.str())];
+  S.Size = Size;
+  S.Name = Name;
+  S.Kind = Flags;
+}
+
+void ProjectDBWriter::addSymbol(uint64_t Address, uint64_t Size,
+  StringRef Name, uint32_t Type) {
+  Sym &S = Symbols[Address];
+  S.Size = Size;
+  S.Name = Name;
+  S.Kind = Type;
+}
+
+void ProjectDBWriter::addInstruction(uint64_t Address, unsigned Size,
+  unsigned Opcode, StringRef Text) {
+  Instr &I = Instrs[Address];
+  I.Size = Size;
+  I.Opcode = Opcode;
+  I.Text = Text;
+}
+
+void ProjectDBWriter::addFunction(uint64_t Address, StringRef Name,
+  StringRef Bitcode) {
+  // Drop what an earlier version of this function contributed.
+  std::map<uint64_t, uint64_t> &Old = Blocks[Address];
+  for (std::map<uint64_t, uint64_t>::iterator I = Old.begin(), E = Old.end();
+       I != E; ++I)
+    Edges.erase(Edges.lower_bound(std::make_pair(I->first, uint64_t(0))),
+      Edges.lower_bound(std::make_pair(I->first + 1, uint64_t(0))));
+  Old.clear();
+  Calls.erase(Calls.lower_bound(std::make_pair(Address, uint64_t(0))),
+    Calls.lower_bound(std::make_pair(Address + 1, uint64_t(0))));
+
+  Func &F = Functions[Address];
+  F.Name = Name;
+  F.Bitcode = Bitcode;
+}
+
+void ProjectDBWriter::addBlock(uint64_t Function, uint64_t Address,
+  uint64_t End) {
+  Blocks[Function][Address] = End;
+}
+
+void ProjectDBWriter::addEdge(uint64_t From, uint64_t To) {
+  Edges.insert(std::make_pair(From, To));
+}
+
+void ProjectDBWriter::addCall(uint64_t Caller, uint64_t Callee) {
+  Calls.insert(std::make_pair(Caller, Callee));
+}
+
+void ProjectDBWriter::setName(uint64_t Address, StringRef Name) {
+  if (Name.empty())
+    Names.erase(Address);
+  else
+    Names[Address] = Name;
+}
+
+namespace {
+/// StringTable - Interns strings for the TK_Strings table. Offset 0 is the
+/// empty string.
+class StringTable {
+  std::string Data;
+  StringMap<uint32_t> Offsets;
+public:
+  StringTable() : Data(1, '\0') { Offsets[""] = 0; }
+  uint32_t get(StringRef S) {
+    StringMap<uint32_t>::iterator I = Offsets.find(S);
+    if (I != Offsets.end())
+      return I->second;
+    uint32_t Offset = Data.size();
+    Data.append(S.begin(), S.end());
+    Data.push_back('\0');
+    Offsets[S] = Offset;
+    return Offset;
+  }
+  StringRef data() const { return Data; }
+};
+} // end anonymous namespace
+
+template <class RecordT>
+static StringRef asBytes(const std::vector<RecordT> &Records) {
+  return StringRef(reinterpret_cast<const char *>(Records.data()),
+    Records.size() * sizeof(RecordT));
+}
+
+std::error_code ProjectDBWriter::write(StringRef Path) const {
+  StringTable Strings;
+  std::string Blobs;
+
+  std::vector<SectionRecord> SectionRecs;
+  for (std::map<std::pair<uint64_t, std::string>, Sym>::const_iterator
+         I = Sections.begin(), E = Sections.end(); I != E; ++I) {
+    SectionRecord R;
+    R.Address = I->first.first;
+    R.Size = I->second.Size;
+    R.Name = Strings.get(I->second.Name);
+    R.Flags = I->second.Kind;
+    SectionRecs.push_back(R);
+  }
+
+  std::vector<SymbolRecord> SymbolRecs;
+  for (std::map<uint64_t, Sym>::const_iterator I = Symbols.begin(),
+         E = Symbols.end(); I != E; ++I) {
+    SymbolRecord R;
+    R.Address = I->first;
+    R.Size = I->second.Size;
+    R.Name = Strings.get(I->second.Name);
+    R.Type = I->second.Kind;
+    SymbolRecs.push_back(R);
+  }
+
+  std::vector<InstrRecord> InstrRecs;
+  for (std::map<uint64_t, Instr>::const_iterator I = Instrs.begin(),
+         E = Instrs.end(); I != E; ++I) {
+    InstrRecord R;
+    R.Address = I->first;
+    R.Text = Strings.get(I->second.Text);
+    R.Opcode = I->second.Opcode;
+    R.Size = I->second.Size;
+    InstrRecs.push_back(R);
+  }
+
+  std::vector<BlockRecord> BlockRecs;
+  for (std::map<uint64_t, std::map<uint64_t, uint64_t> >::const_iterator
+         I = Blocks.begin(), E = Blocks.end(); I != E; ++I) {
+    for (std::map<uint64_t, uint64_t>::const_iterator B = I->second.begin(),
+           BE = I->second.end(); B != BE; ++B) {
+      BlockRecord R;
+      R.Function = I->first;
+      R.Address = B->first;
+      R.End = B->second;
+      BlockRecs.push_back(R);
+    }
+  }
+
+  std::vector<EdgeRecord> EdgeRecs, CallRecs, CallerRecs;
+  for (std::set<std::pair<uint64_t, uint64_t> >::const_iterator
+         I = Edges.begin(), E = Edges.end(); I != E; ++I) {
+    EdgeRecord R;
+    R.From = I->first;
+    R.To = I->second;
+    EdgeRecs.push_back(R);
+  }
+  std::set<std::pair<uint64_t, uint64_t> > Reversed;
+  for (std::set<std::pair<uint64_t, uint64_t> >::const_iterator
+         I = Calls.begin(), E = Calls.end(); I != E; ++I) {
+    EdgeRecord R;
+    R.From = I->first;
+    R.To = I->second;
+    CallRecs.push_back(R);
+    Reversed.insert(std::make_pair(I->second, I->first));
+  }
+  for (std::set<std::pair<uint64_t, uint64_t> >::const_iterator
+         I = Reversed.begin(), E = Reversed.end(); I != E; ++I) {
+    EdgeRecord R;
+    R.From = I->first;
+    R.To = I->second;
+    CallerRecs.push_back(R);
+  }
+
+  std::vector<NameRecord> NameRecs;
+  for (std::map<uint64_t, std::string>::const_iterator I = Names.begin(),
+         E = Names.end(); I != E; ++I) {
+    NameRecord R;
+    R.Address = I->first;
+    R.Name = Strings.get(I->second);
+    R.Reserved = 0;
+    NameRecs.push_back(R);
+  }
+
+  std::vector<FunctionRecord> FunctionRecs;
+  for (std::map<uint64_t, Func>::const_iterator I = Functions.begin(),
+         E = Functions.end(); I != E; ++I) {
+    FunctionRecord R;
+    R.Address = I->first;
+    R.BlobOffset = Blobs.size();
+    R.BlobSize = I->second.Bitcode.size();
+    R.Name = Strings.get(I->second.Name);
+    Blobs += I->second.Bitcode;
+    FunctionRecs.push_back(R);
+  }
+
+  Header Hdr;
+  memcpy(Hdr.Magic, Magic, sizeof(Magic));
+  Hdr.Version = Version;
+  Hdr.NumTables = TK_NumTables;
+  Hdr.Triple = Strings.get(Triple);
+  Hdr.FileName = Strings.get(FileName);
+
+  // Collected after every string has been interned.
+  StringRef Tables[TK_NumTables];
+  Tables[TK_Strings] = Strings.data();
+  Tables[TK_Blobs] = Blobs;
+  Tables[TK_Sections] = asBytes(SectionRecs);
+  Tables[TK_Symbols] = asBytes(SymbolRecs);
+  Tables[TK_Instrs] = asBytes(InstrRecs);
+  Tables[TK_Blocks] = asBytes(BlockRecs);
+  Tables[TK_Edges] = asBytes(EdgeRecs);
+  Tables[TK_Calls] = asBytes(CallRecs);
+  Tables[TK_Callers] = asBytes(CallerRecs);
+  Tables[TK_Names] = asBytes(NameRecs);
+  Tables[TK_Functions] = asBytes(FunctionRecs);
+
+  // Tables start on 8 byte boundaries so mapped records are aligned.
+  TableEntry Dir[TK_NumTables];
+  uint64_t Offset = sizeof(Header) + sizeof(Dir);
+  for (unsigned i = 0; i != TK_NumTables; ++i) {
+    Offset = RoundUpToAlignment(Offset, 8);
+    Dir[i].Kind = i;
+    Dir[i].RecordSize = RecordSizes[i];
+    Dir[i].Offset = Offset;
+    Dir[i].Count = Tables[i].size() / RecordSizes[i];
+    Offset += Tables[i].size();
+  }
+
+  std::string TmpPath = Path.str() + ".tmp";
+  {
+    std::error_code EC;
+    raw_fd_ostream Out(TmpPath, EC, sys::fs::F_None);
+    if (EC)
+      return EC;
+    Out.write(reinterpret_cast<const char *>(&Hdr), sizeof(Hdr));
+    Out.write(reinterpret_cast<const char *>(Dir), sizeof(Dir));
+    for (unsigned i = 0; i != TK_NumTables; ++i) {
+      for (uint64_t Pad = Dir[i].Offset - Out.tell(); Pad; --Pad)
+        Out << '\0';
+      Out << Tables[i];
+    }
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      sys::fs::remove(TmpPath);
+      return make_error_code(std::errc::io_error);
+    }
+  }
+  if (std::error_code EC = sys::fs::rename(TmpPath, Path)) {
+    sys::fs::remove(TmpPath);
+    return EC;
+  }
+  return std::error_code();
+}
+
+} // end namespace fracture
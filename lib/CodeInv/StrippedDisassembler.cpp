@@ -17,6 +17,7 @@
 
 #include "CodeInv/StrippedDisassembler.h"
 #include "CodeInv/StrippedGraph.h"
+#include "CodeInv/InstrClassInfo.h"
 
 using namespace llvm;
 
@@ -55,7 +56,7 @@ uint64_t StrippedDisassembler::getHexAddress(MachineBasicBlock::iterator II) {
   unsigned Address = DAS->getDebugOffset(II->getDebugLoc());
   unsigned Size = II->getDesc().getSize();
   uint8_t *Bytes = new uint8_t(Size);
-  DAS->getCurSectionMemory()->readBytes(Bytes, Address, Size);
+  DAS->getMemory().readBytes(Bytes, Address, Size);
   for (unsigned i = (Size/2); i >= 1; --i) {
     sin << std::uppercase << std::hex << static_cast<int>(Bytes[i-1]);
     mn.append(sin.str());
@@ -189,14 +190,23 @@ void StrippedDisassembler::findStrippedMain() {
     outs() << "Warning: starting at " << DAS->getDebugOffset(II->getDebugLoc())
            << " instead of " << symbAddr << ".\n";
   }
+  const InstrClassInfo *IC = getTargetInstrClassInfo(TripleName);
+  if (IC == NULL) {
+    outs() << "No instruction classes for " << TripleName << "\n";
+    return;
+  }
   if(TripleName.find("arm") != std::string::npos){
+    // _start clears fp/lr, pushes its arguments, then loads the addresses of
+    // main and __libc_csu_init from the literal pool.
     while (BI != BE) {
-      if(II->getOpcode() == 192 || II->getOpcode() == 152){
+      if(IC->isMove(II->getOpcode())){
         ++II;
         ++II;
-        if(II->getOpcode() == 449 || II->getOpcode() == 415) {
+        if(IC->isPush(II->getOpcode())) {
+          bool PrevPCRelLoad = false;
           while (BI != BE) {
-            if(II->getOpcode() == 197 && pre == 197){
+            bool CurPCRelLoad = IC->isPCRelLoad(&*II);
+            if(CurPCRelLoad && PrevPCRelLoad){
               for(int x = 0; x < 4; x++)
                 ++II;
               Address = getHexAddress(II);
@@ -205,7 +215,7 @@ void StrippedDisassembler::findStrippedMain() {
               return;
             }
 
-            pre = II->getOpcode();
+            PrevPCRelLoad = CurPCRelLoad;
             ++II;
 
           }
@@ -223,7 +233,7 @@ void StrippedDisassembler::findStrippedMain() {
 
   else if((TripleName.find("i386") != std::string::npos) || (TripleName.find("x86") != std::string::npos)) {
     while(BI != BE) {
-      if(II->getOpcode() >= 8472 && II->getOpcode() <= 8511)
+      if(IC->isZeroIdiom(II->getOpcode()))
         break;
       ++II;
       if (II == IE) {
@@ -233,7 +243,7 @@ void StrippedDisassembler::findStrippedMain() {
       }
     }
     while(BI != BE) {
-      if(II->getOpcode() >= 353 && II->getOpcode() <= 361) {
+      if(IC->isCall(II->getOpcode())) {
           outs() << "Intel main address is: " << pre << "\n";
           mainAddr = pre;
           return;
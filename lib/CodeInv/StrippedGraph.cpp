@@ -166,29 +166,8 @@ bool StrippedGraph::isSuccessorLoop(GraphNode *Node) {
 MachineInstr *StrippedGraph::bypassNops(GraphNode *Node) {
   for (MachineBasicBlock::iterator MI = Node->NodeBlock->instr_begin();
        MI != Node->NodeBlock->instr_end(); MI++) {
-    unsigned opcode = MI->getOpcode();
-    if (Triple.find("i386") != std::string::npos ||
-        Triple.find("x86_64") != std::string::npos) {
-
-      if (opcode >= 1817 && opcode <= 1819) // NOOP
-        continue;
-      if (opcode >= 8451 && opcode <= 8463) // XCH
-        continue;
-      if (opcode >= 1213 && opcode <= 1216) // LEA
-        continue;
-    }
-    if (Triple.find("arm") != std::string::npos) {
-      if (opcode >= 42 && opcode <= 45 &&  // ANDEQ
-          MI->getOperand(MI->findFirstPredOperandIdx()).getImm() == 0)
-        continue;
-      if (opcode >= 244 && opcode <= 245 &&  // MULEQ
-          MI->getOperand(MI->findFirstPredOperandIdx()).getImm() == 0)
-        continue;
-      if (opcode >= 155 && opcode <= 198 &&  // LDREQ
-
-          MI->getOperand(MI->findFirstPredOperandIdx()).getImm() == 0)
-        continue;
-    }
+    if (IC != NULL && IC->isPadding(&*MI))
+      continue;
     return &(*MI);
   }
   return NULL;
@@ -218,20 +197,10 @@ bool StrippedGraph::isConditionalTerminator(GraphNode *Node) {
 
 bool StrippedGraph::isFunctionBegin(GraphNode *Node) {
   MachineInstr *begin = bypassNops(Node);
-  if (Triple.find("arm") != std::string::npos)
-    if (begin->getOpcode() >= 412 && begin->getOpcode() <= 417)
-      for (MachineInstr::mop_iterator mop = begin->operands_begin();
-           mop != begin->operands_end(); ++mop)
-        if (mop->isReg() && mop->getReg() == 10)
-          return true;
-  if (Triple.find("i386") != std::string::npos ||
-      Triple.find("x86_64") != std::string::npos)
-    if (begin->getOpcode() >= 2227 && begin->getOpcode() <= 2261)
-      for (MachineInstr::mop_iterator mop = begin->operands_begin();
-           mop != begin->operands_end(); ++mop)
-        if (mop->isReg() && (mop->getReg() == 20 || mop->getReg() == 36)
-            && !PrevNode->NodeBlock->instr_rbegin()->isConditionalBranch())
-          return true;
-  return false;
+  if (begin == NULL || IC == NULL || !IC->isProloguePush(begin))
+    return false;
+  // A frame register push on the fall through path of a conditional branch
+  // is a spill, not a prologue.
+  return !PrevNode->NodeBlock->instr_rbegin()->isConditionalBranch();
 }
 } // end namespace fracture
@@ -0,0 +1,458 @@
+//===--- BlockTranslator - block-caching binary translation -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class runs guest code by lifting, compiling and caching it one trace
+// at a time as execution reaches it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Execution/BlockTranslator.h"
+#include "Execution/LiftedRunner.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace llvm;
+
+namespace fracture {
+
+BlockTranslator::BlockTranslator(Decompiler *NewDec, unsigned NewOptLevel,
+  unsigned NewMaxBlocks, raw_ostream &InfoOut, raw_ostream &ErrOut)
+  : Dec(NewDec), EE(NULL), OptLevel(std::min(NewOptLevel, 3u)),
+    MaxBlocks(std::max(NewMaxBlocks, 1u)), NextPC(0), Halted(0),
+    Failed(false), Depth(0), BenchPC(0), NumTranslated(0), NumExecuted(0),
+    NumChained(0), NumJumpCacheHits(0), NumLookups(0), Infos(InfoOut),
+    Errs(ErrOut) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  memset(JumpCache, 0, sizeof(JumpCache));
+
+  // One slot per target register, wide enough for vector registers.
+  const MCRegisterInfo *MRI =
+    Dec->getDisassembler()->getMCDirector()->getMCRegisterInfo();
+  RegFile.assign(MRI->getNumRegs() * RegSlotBytes / sizeof(uint64_t), 0);
+  for (unsigned Reg = 1, e = MRI->getNumRegs(); Reg != e; ++Reg)
+    RegNums[MRI->getName(Reg)] = Reg;
+
+  CodeGenOpt::Level CGOpt = CodeGenOpt::Default;
+  switch (OptLevel) {
+    case 0: CGOpt = CodeGenOpt::None; break;
+    case 1: CGOpt = CodeGenOpt::Less; break;
+    case 2: CGOpt = CodeGenOpt::Default; break;
+    case 3: CGOpt = CodeGenOpt::Aggressive; break;
+  }
+
+  // Translations are added to the engine one module at a time.
+  Module *Host = new Module("fracture.dbt", Dec->getModule()->getContext());
+  Host->setTargetTriple(sys::getProcessTriple());
+  std::string ErrMsg;
+  EE = EngineBuilder(std::unique_ptr<Module>(Host))
+    .setErrorStr(&ErrMsg)
+    .setEngineKind(EngineKind::JIT)
+    .setOptLevel(CGOpt)
+    .create();
+  if (EE == NULL)
+    printError("Unable to create MCJIT engine: " + ErrMsg);
+}
+
+BlockTranslator::~BlockTranslator() {
+  // The execution engine owns the translated modules.
+  delete EE;
+  for (DenseMap<uint64_t, TranslatedBlock*>::iterator I = Cache.begin(),
+         E = Cache.end(); I != E; ++I)
+    delete I->second;
+}
+
+bool BlockTranslator::mapMemory(StringRef SPName, unsigned StackSize) {
+  if (!Cache.empty()) {
+    printError("Guest memory must be mapped before anything runs.");
+    return false;
+  }
+  std::string ErrMsg;
+  if (!Guest.map(Dec->getDisassembler()->getMemory(), StackSize, ErrMsg)) {
+    printError(ErrMsg);
+    return false;
+  }
+  return SPName.empty() || setRegister(SPName, Guest.getStackTop());
+}
+
+void *BlockTranslator::getRegisterAddress(StringRef RegName) {
+  StringMap<unsigned>::iterator I = RegNums.find(RegName);
+  if (I == RegNums.end()) {
+    printError("Unknown register " + RegName.str() + ".");
+    return NULL;
+  }
+  return (uint8_t*)&RegFile[0] + I->getValue() * RegSlotBytes;
+}
+
+// NOTE: Like LiftedRunner, values are copied as host-endian integers, which
+// is how the translated code loads and stores the register slots.
+bool BlockTranslator::setRegister(StringRef RegName, uint64_t Value) {
+  void *Addr = getRegisterAddress(RegName);
+  if (Addr == NULL)
+    return false;
+  memset(Addr, 0, RegSlotBytes);
+  memcpy(Addr, &Value, sizeof(Value));
+  Inputs[RegName] = Value;
+  return true;
+}
+
+bool BlockTranslator::getRegister(StringRef RegName, uint64_t &Value) {
+  void *Addr = getRegisterAddress(RegName);
+  if (Addr == NULL)
+    return false;
+  // Registers no translation has used yet are reported whole.
+  unsigned Bytes = RegBytes.lookup(RegName);
+  if (Bytes == 0 || Bytes > sizeof(Value))
+    Bytes = sizeof(Value);
+  Value = 0;
+  memcpy(&Value, Addr, Bytes);
+  return true;
+}
+
+Constant *BlockTranslator::getHostPointer(uint64_t Address, Type *Ty) {
+  return ConstantExpr::getIntToPtr(
+    ConstantInt::get(Type::getInt64Ty(Ty->getContext()), Address), Ty);
+}
+
+Constant *BlockTranslator::getRegisterSlot(GlobalVariable *GV) {
+  unsigned Bits = GV->getType()->getElementType()->getPrimitiveSizeInBits();
+  if (Bits == 0 || Bits > RegSlotBytes * 8) {
+    printError("Register " + GV->getName().str() + " has unsupported width.");
+    return NULL;
+  }
+  void *Addr = getRegisterAddress(GV->getName());
+  if (Addr == NULL)
+    return NULL;
+  RegBytes[GV->getName()] = (Bits + 7) / 8;
+  return getHostPointer((uintptr_t)Addr, GV->getType());
+}
+
+void BlockTranslator::callGuest(BlockTranslator *BT, uint64_t Address) {
+  BT->execute(Address);
+}
+
+void BlockTranslator::callUnlifted(BlockTranslator *BT, uint64_t Name) {
+  BT->printError("Reached " + BT->UnliftedNames[Name] + ", which could not "
+    "be lifted; its effects would be missing, so the guest is stopped.");
+  BT->stop();
+}
+
+bool BlockTranslator::run(uint64_t Address) {
+  if (EE == NULL)
+    return false;
+  Failed = false;
+  Halted = 0;
+  return execute(Address);
+}
+
+bool BlockTranslator::execute(uint64_t Address) {
+  if (Halted)
+    return !Failed;
+  if (Depth == MaxCallDepth) {
+    printError("Guest calls nest too deeply.");
+    stop();
+    return false;
+  }
+
+  ++Depth;
+  TranslatedBlock *TB = lookup(Address);
+  while (TB != NULL) {
+    TB->Code();
+    ++NumExecuted;
+    if (Halted || NextPC == ReturnPC)
+      break;
+    TB = follow(TB, NextPC);
+  }
+  --Depth;
+  return !Failed;
+}
+
+BlockTranslator::TranslatedBlock*
+BlockTranslator::follow(TranslatedBlock *TB, uint64_t Address) {
+  for (unsigned i = 0, e = TB->Exits.size(); i != e; ++i) {
+    if (TB->Exits[i].first != Address)
+      continue;
+    if (TB->Exits[i].second != NULL) {
+      ++NumChained;
+      return TB->Exits[i].second;
+    }
+    return TB->Exits[i].second = lookup(Address);
+  }
+  return lookup(Address);
+}
+
+BlockTranslator::TranslatedBlock*
+BlockTranslator::lookup(uint64_t Address) {
+  // Instructions are at least 2-byte aligned on every target but x86.
+  unsigned Slot =
+    (Address ^ (Address >> 2) ^ (Address >> 14)) & (JumpCacheSize - 1);
+  TranslatedBlock *TB = JumpCache[Slot];
+  if (TB != NULL && TB->Address == Address) {
+    ++NumJumpCacheHits;
+    return TB;
+  }
+
+  ++NumLookups;
+  DenseMap<uint64_t, TranslatedBlock*>::iterator I = Cache.find(Address);
+  TB = I != Cache.end() ? I->second : translate(Address);
+  if (TB == NULL) {
+    stop();
+    return NULL;
+  }
+  JumpCache[Slot] = TB;
+  return TB;
+}
+
+BlockTranslator::TranslatedBlock*
+BlockTranslator::translate(uint64_t Address) {
+  Function *F = Dec->decompileTrace(Address, MaxBlocks);
+  if (F == NULL) {
+    printError("Unable to translate the code at " +
+      Twine::utohexstr(Address).str() + ".");
+    return NULL;
+  }
+
+  // The trace leaves the Decompiler's module for a module of its own.
+  Module *TBMod = new Module(F->getName(), F->getContext());
+  TBMod->setTargetTriple(sys::getProcessTriple());
+  TBMod->setDataLayout(EE->getDataLayout());
+  F->removeFromParent();
+  TBMod->getFunctionList().push_back(F);
+
+  TranslatedBlock *TB = new TranslatedBlock();
+  TB->Address = Address;
+  TB->Code = NULL;
+
+  std::string VerifyErr;
+  raw_string_ostream VerifyOS(VerifyErr);
+  if (!rewrite(F, TB) || verifyModule(*TBMod, &VerifyOS)) {
+    printError("Translation of " + F->getName().str() + " is not valid IR:\n"
+      + VerifyOS.str());
+    delete TBMod;
+    delete TB;
+    return NULL;
+  }
+  LiftedRunner::optimizeModule(TBMod, OptLevel);
+
+  std::string FName = F->getName();
+  EE->addModule(std::unique_ptr<Module>(TBMod));
+  TB->Code = (BlockFn)EE->getFunctionAddress(FName);
+  if (TB->Code == NULL) {
+    printError("Unable to compile " + FName + ".");
+    delete TB;
+    return NULL;
+  }
+
+  Cache[Address] = TB;
+  ++NumTranslated;
+  return TB;
+}
+
+static bool isExitCall(const Instruction *I) {
+  const CallInst *CI = dyn_cast_or_null<CallInst>(I);
+  return CI && CI->getCalledFunction()
+    && CI->getCalledFunction()->getName() == "fracture.exit";
+}
+
+bool BlockTranslator::rewrite(Function *F, TranslatedBlock *TB) {
+  Module *M = F->getParent();
+  LLVMContext &Ctx = F->getContext();
+  const AddressSpace &Memory = Dec->getDisassembler()->getMemory();
+  uint64_t GuestDelta = Guest.getDelta();
+  Type *Int8 = Type::getInt8Ty(Ctx);
+  Type *Int64 = Type::getInt64Ty(Ctx);
+  Constant *NextPCPtr = getHostPointer((uintptr_t)&NextPC,
+    Int64->getPointerTo());
+  Constant *HaltedPtr = getHostPointer((uintptr_t)&Halted,
+    Int8->getPointerTo());
+  Constant *Returned = ConstantInt::get(Int64, ReturnPC);
+  Type *CallGuestArgs[] = { Type::getInt8PtrTy(Ctx), Int64 };
+  Type *CallGuestTy = FunctionType::get(Type::getVoidTy(Ctx), CallGuestArgs,
+    false)->getPointerTo();
+  Constant *CallGuest = getHostPointer((uintptr_t)&callGuest, CallGuestTy);
+  Constant *CallUnlifted = getHostPointer((uintptr_t)&callUnlifted,
+    CallGuestTy);
+  Constant *Self = getHostPointer((uintptr_t)this, Type::getInt8PtrTy(Ctx));
+
+  std::vector<Instruction*> Insts;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+    Insts.push_back(&*I);
+
+  // The exits end in a return too; any other return is a guest return.
+  for (unsigned i = 0, e = Insts.size(); i != e; ++i)
+    if (isa<ReturnInst>(Insts[i]) && !isExitCall(Insts[i]->getPrevNode()))
+      new StoreInst(Returned, NextPCPtr, Insts[i]);
+
+  BasicBlock *StopBB = NULL;
+  for (unsigned i = 0, e = Insts.size(); i != e; ++i) {
+    Instruction *I = Insts[i];
+
+    // Guest addresses and code pointers folded into constants at lift time.
+    for (unsigned o = 0, oe = I->getNumOperands(); o != oe; ++o) {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(I->getOperand(o));
+      if (CE == NULL)
+        continue;
+      if (CE->getOpcode() == Instruction::IntToPtr) {
+        if (ConstantInt *A = dyn_cast<ConstantInt>(CE->getOperand(0)))
+          I->setOperand(o,
+            getHostPointer(A->getZExtValue() + GuestDelta, CE->getType()));
+        continue;
+      }
+      Function *Fn = CE->getOpcode() == Instruction::PtrToInt
+        ? dyn_cast<Function>(CE->getOperand(0)->stripPointerCasts()) : NULL;
+      uint64_t Target;
+      if (CE->getOpcode() == Instruction::PtrToInt && Fn != NULL
+          && Fn->hasFnAttribute("Address")
+          && !Fn->getFnAttribute("Address").getValueAsString()
+            .getAsInteger(10, Target))
+        I->setOperand(o, ConstantInt::get(CE->getType(), Target));
+    }
+
+    if (IntToPtrInst *ITP = dyn_cast<IntToPtrInst>(I)) {
+      if (GuestDelta == 0)
+        continue;
+      IRBuilder<> IRB(ITP);
+      Value *A = IRB.CreateAdd(IRB.CreateZExtOrTrunc(ITP->getOperand(0),
+        Int64), ConstantInt::get(Int64, GuestDelta));
+      Value *Ptr = IRB.CreateIntToPtr(A, ITP->getType());
+      ITP->replaceAllUsesWith(Ptr);
+      ITP->eraseFromParent();
+      continue;
+    }
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+      if (GlobalVariable *GV = dyn_cast<GlobalVariable>(LI->getOperand(0))) {
+        Constant *Slot = getRegisterSlot(GV);
+        if (Slot == NULL)
+          return false;
+        LI->setOperand(0, Slot);
+      }
+      continue;
+    }
+    if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+      if (GlobalVariable *GV = dyn_cast<GlobalVariable>(SI->getOperand(1))) {
+        Constant *Slot = getRegisterSlot(GV);
+        if (Slot == NULL)
+          return false;
+        SI->setOperand(1, Slot);
+      }
+      continue;
+    }
+
+    // After a call that does not return, the guest is done.
+    if (isa<UnreachableInst>(I)) {
+      new StoreInst(ConstantInt::get(Int8, 1), HaltedPtr, I);
+      new StoreInst(Returned, NextPCPtr, I);
+      ReturnInst::Create(Ctx, NULL, I);
+      I->eraseFromParent();
+      continue;
+    }
+
+    CallInst *CI = dyn_cast<CallInst>(I);
+    Function *Callee = CI ? CI->getCalledFunction() : NULL;
+    if (Callee == NULL)
+      continue;
+
+    uint64_t Target;
+    if (isExitCall(CI)) {
+      Target = cast<ConstantInt>(CI->getArgOperand(0))->getZExtValue();
+      new StoreInst(ConstantInt::get(Int64, Target), NextPCPtr, CI);
+      bool Known = false;
+      for (unsigned x = 0, xe = TB->Exits.size(); x != xe; ++x)
+        Known |= TB->Exits[x].first == Target;
+      if (!Known)
+        TB->Exits.push_back(std::make_pair(Target, (TranslatedBlock*)NULL));
+      CI->eraseFromParent();
+      continue;
+    }
+
+    if (Callee->isIntrinsic()) {
+      CI->setCalledFunction(M->getOrInsertFunction(Callee->getName(),
+        Callee->getFunctionType(), Callee->getAttributes()));
+      continue;
+    }
+
+    // Opaque instructions and code outside the executable cannot be run.
+    // As in LiftedRunner, reaching one fails the run instead of skipping it.
+    CallInst *Call;
+    if (!Callee->hasFnAttribute("Address")
+        || Callee->getFnAttribute("Address").getValueAsString()
+          .getAsInteger(10, Target)
+        || !Memory.isExecutable(Target)) {
+      Value *Args[] = { Self, ConstantInt::get(Int64, UnliftedNames.size()) };
+      UnliftedNames.push_back(Callee->getName());
+      Call = CallInst::Create(CallUnlifted, Args, "", CI);
+    } else {
+      Value *Args[] = { Self, ConstantInt::get(Int64, Target) };
+      Call = CallInst::Create(CallGuest, Args, "", CI);
+    }
+    Call->setDebugLoc(CI->getDebugLoc());
+    if (!CI->use_empty())
+      CI->replaceAllUsesWith(Constant::getNullValue(CI->getType()));
+    CI->eraseFromParent();
+
+    // The guest may have stopped inside the call.
+    if (StopBB == NULL) {
+      StopBB = BasicBlock::Create(Ctx, "stop", F);
+      new StoreInst(Returned, NextPCPtr, StopBB);
+      ReturnInst::Create(Ctx, StopBB);
+    }
+    BasicBlock *BB = Call->getParent();
+    BasicBlock *Cont = BB->splitBasicBlock(++BasicBlock::iterator(Call));
+    BB->getTerminator()->eraseFromParent();
+    IRBuilder<> IRB(BB);
+    IRB.CreateCondBr(IRB.CreateICmpNE(IRB.CreateLoad(HaltedPtr),
+      ConstantInt::get(Int8, 0)), StopBB, Cont);
+  }
+  return true;
+}
+
+bool BlockTranslator::runOnce(void *BT) {
+  BlockTranslator *Self = (BlockTranslator*)BT;
+  return Self->run(Self->BenchPC);
+}
+
+double BlockTranslator::bench(uint64_t Address, unsigned Iterations) {
+  if (Iterations == 0 || !run(Address))
+    return -1.0;
+
+  // Resolve the input register addresses once, so the timed loop only pays
+  // for the copies.
+  std::vector<InputRegister> Regs;
+  for (StringMap<uint64_t>::iterator I = Inputs.begin(), E = Inputs.end();
+       I != E; ++I) {
+    InputRegister R;
+    R.Addr = getRegisterAddress(I->getKey());
+    R.Bytes = sizeof(uint64_t);
+    R.Value = I->getValue();
+    Regs.push_back(R);
+  }
+
+  BenchPC = Address;
+  return timeRuns(Regs, Iterations, &runOnce, this);
+}
+
+void BlockTranslator::printStatistics(raw_ostream &OS) const {
+  OS << NumTranslated << " traces translated, " << NumExecuted
+     << " executed\n"
+     << NumChained << " chained exits, " << NumJumpCacheHits
+     << " jump cache hits, " << NumLookups << " translation map lookups\n";
+}
+
+} // end namespace fracture
@@ -0,0 +1,103 @@
+//===--- GuestMemory - Host memory and timing for guest code ----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The guest memory mapping and bench timing loop shared by LiftedRunner and
+// BlockTranslator.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Execution/GuestMemory.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+
+#include <chrono>
+#include <string.h>
+
+using namespace llvm;
+
+namespace fracture {
+
+bool GuestMemory::map(const AddressSpace &Memory, unsigned StackSize,
+  std::string &ErrMsg) {
+  const std::vector<AddressSpace::Region> &Regions = Memory.regions();
+  if (Regions.empty()) {
+    ErrMsg = "The executable has no loaded regions.";
+    return false;
+  }
+
+  // Regions are sorted and do not overlap. The stack goes right above them.
+  uint64_t PageSize = sys::Process::getPageSize();
+  uint64_t Low = Regions.front().Base & ~(PageSize - 1);
+  uint64_t High = RoundUpToAlignment(Regions.back().getEnd(), PageSize);
+  uint64_t Size = High - Low + RoundUpToAlignment(StackSize, PageSize);
+  if (Size > (1ULL << 32)) {
+    ErrMsg = "Guest memory spans more than 4GB.";
+    return false;
+  }
+
+  release();
+  // Fresh anonymous pages are zeroed, and untouched ones cost nothing.
+  std::error_code EC;
+  Block = sys::Memory::allocateMappedMemory(Size, NULL,
+    sys::Memory::MF_READ | sys::Memory::MF_WRITE, EC);
+  if (EC) {
+    ErrMsg = "Unable to allocate guest memory: " + EC.message();
+    Block = sys::MemoryBlock();
+    return false;
+  }
+  uint8_t *Base = (uint8_t*)Block.base();
+  Delta = (uint64_t)(uintptr_t)Base - Low;
+  for (unsigned i = 0, e = Regions.size(); i != e; ++i)
+    memcpy(Base + (Regions[i].Base - Low), Regions[i].Bytes.data(),
+      Regions[i].Bytes.size());
+  // Leave a small red zone above the initial stack pointer.
+  StackTop = Low + Size - 64;
+  return true;
+}
+
+void GuestMemory::release() {
+  if (Block.base() != NULL)
+    sys::Memory::releaseMappedMemory(Block);
+  Block = sys::MemoryBlock();
+  Delta = 0;
+  StackTop = 0;
+}
+
+static void restoreInputs(const std::vector<InputRegister> &Inputs) {
+  for (unsigned r = 0, e = Inputs.size(); r != e; ++r)
+    memcpy(Inputs[r].Addr, &Inputs[r].Value, Inputs[r].Bytes);
+}
+
+double timeRuns(const std::vector<InputRegister> &Inputs, unsigned Iterations,
+  bool (*Run)(void *), void *Arg) {
+  typedef std::chrono::steady_clock Clock;
+
+  // Calibrate the cost of restoring the inputs so it can be subtracted.
+  Clock::time_point Start = Clock::now();
+  for (unsigned i = 0; i != Iterations; ++i)
+    restoreInputs(Inputs);
+  Clock::duration Overhead = Clock::now() - Start;
+
+  Start = Clock::now();
+  for (unsigned i = 0; i != Iterations; ++i) {
+    restoreInputs(Inputs);
+    if (!Run(Arg))
+      return -1.0;
+  }
+  Clock::duration Total = Clock::now() - Start;
+
+  double Ns =
+    std::chrono::duration<double, std::nano>(Total - Overhead).count();
+  if (Ns < 0)
+    Ns = 0;
+  return Ns / Iterations;
+}
+
+} // end namespace fracture
@@ -0,0 +1,426 @@
+//===--- LiftedRunner - JIT execution of lifted functions -------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class JIT-compiles a copy of the lifted module with MCJIT so lifted
+// functions can be executed and timed on the host.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Execution/LiftedRunner.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+using namespace llvm;
+
+namespace fracture {
+
+LiftedRunner::LiftedRunner(const Module *LiftedMod, unsigned NewOptLevel,
+  raw_ostream &InfoOut, raw_ostream &ErrOut)
+  : EE(NULL), JITMod(NULL), OptLevel(std::min(NewOptLevel, 3u)),
+    Halted(0), CurFn(NULL), Infos(InfoOut), Errs(ErrOut) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  JITMod = CloneModule(LiftedMod);
+}
+
+LiftedRunner::~LiftedRunner() {
+  // The execution engine owns JITMod once it exists.
+  if (EE != NULL)
+    delete EE;
+  else
+    delete JITMod;
+}
+
+/// compile - Finishes the JIT copy and hands it to MCJIT. Guest memory has
+/// to be in place by now, since the rebased addresses are baked into the
+/// code.
+bool LiftedRunner::compile() {
+  if (EE != NULL)
+    return true;
+  if (JITMod == NULL)
+    return false;
+
+  if (Guest.isMapped())
+    rebaseGuestAddresses();
+  stubDeclarations();
+
+  std::string VerifyErr;
+  raw_string_ostream VerifyOS(VerifyErr);
+  if (verifyModule(*JITMod, &VerifyOS)) {
+    printError("Lifted module is not valid IR:\n" + VerifyOS.str());
+    delete JITMod;
+    JITMod = NULL;
+    return false;
+  }
+
+  optimizeModule(JITMod, OptLevel);
+
+  CodeGenOpt::Level CGOpt = CodeGenOpt::Default;
+  switch (OptLevel) {
+    case 0: CGOpt = CodeGenOpt::None; break;
+    case 1: CGOpt = CodeGenOpt::Less; break;
+    case 2: CGOpt = CodeGenOpt::Default; break;
+    case 3: CGOpt = CodeGenOpt::Aggressive; break;
+  }
+
+  std::string ErrMsg;
+  EE = EngineBuilder(std::unique_ptr<Module>(JITMod))
+    .setErrorStr(&ErrMsg)
+    .setEngineKind(EngineKind::JIT)
+    .setOptLevel(CGOpt)
+    .create();
+  if (EE == NULL) {
+    // The engine took ownership of JITMod, even on failure.
+    JITMod = NULL;
+    printError("Unable to create MCJIT engine: " + ErrMsg);
+    return false;
+  }
+  EE->finalizeObject();
+  return true;
+}
+
+void LiftedRunner::optimizeModule(Module *Mod, unsigned OptLevel) {
+  if (OptLevel == 0)
+    return;
+
+  PassManagerBuilder PMB;
+  PMB.OptLevel = OptLevel;
+  PMB.SizeLevel = 0;
+  if (OptLevel > 1)
+    PMB.Inliner = createFunctionInliningPass(OptLevel, 0);
+  PMB.LoopVectorize = OptLevel > 1;
+  PMB.SLPVectorize = OptLevel > 1;
+
+  FunctionPassManager FPM(Mod);
+  PMB.populateFunctionPassManager(FPM);
+  FPM.doInitialization();
+  for (Module::iterator F = Mod->begin(), E = Mod->end(); F != E; ++F)
+    FPM.run(*F);
+  FPM.doFinalization();
+
+  PassManager MPM;
+  PMB.populateModulePassManager(MPM);
+  MPM.run(*Mod);
+}
+
+static Constant *getHostPointer(uint64_t Address, Type *Ty) {
+  return ConstantExpr::getIntToPtr(
+    ConstantInt::get(Type::getInt64Ty(Ty->getContext()), Address), Ty);
+}
+
+void LiftedRunner::rebaseGuestAddresses() {
+  Type *Int64 = Type::getInt64Ty(JITMod->getContext());
+  uint64_t GuestDelta = Guest.getDelta();
+  for (Module::iterator F = JITMod->begin(), FE = JITMod->end(); F != FE;
+       ++F) {
+    std::vector<Instruction*> Insts;
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+      Insts.push_back(&*I);
+
+    for (unsigned i = 0, e = Insts.size(); i != e; ++i) {
+      Instruction *I = Insts[i];
+
+      // Guest addresses and code pointers folded into constants at lift
+      // time, as in BlockTranslator.
+      for (unsigned o = 0, oe = I->getNumOperands(); o != oe; ++o) {
+        ConstantExpr *CE = dyn_cast<ConstantExpr>(I->getOperand(o));
+        if (CE == NULL)
+          continue;
+        if (CE->getOpcode() == Instruction::IntToPtr) {
+          if (ConstantInt *A = dyn_cast<ConstantInt>(CE->getOperand(0)))
+            I->setOperand(o,
+              getHostPointer(A->getZExtValue() + GuestDelta, CE->getType()));
+          continue;
+        }
+        if (CE->getOpcode() != Instruction::PtrToInt)
+          continue;
+        Function *Fn =
+          dyn_cast<Function>(CE->getOperand(0)->stripPointerCasts());
+        uint64_t Target;
+        if (Fn != NULL
+            && Fn->hasFnAttribute("Address")
+            && !Fn->getFnAttribute("Address").getValueAsString()
+              .getAsInteger(10, Target))
+          I->setOperand(o, ConstantInt::get(CE->getType(), Target));
+      }
+
+      IntToPtrInst *ITP = dyn_cast<IntToPtrInst>(I);
+      if (ITP == NULL)
+        continue;
+      IRBuilder<> IRB(ITP);
+      Value *A = IRB.CreateAdd(IRB.CreateZExtOrTrunc(ITP->getOperand(0),
+        Int64), ConstantInt::get(Int64, GuestDelta));
+      Value *Ptr = IRB.CreateIntToPtr(A, ITP->getType());
+      ITP->replaceAllUsesWith(Ptr);
+      ITP->eraseFromParent();
+    }
+  }
+}
+
+void LiftedRunner::stubCalled(LiftedRunner *LR, unsigned Stub) {
+  ++LR->StubCalls[Stub];
+}
+
+void LiftedRunner::stubDeclarations() {
+  LLVMContext &Ctx = JITMod->getContext();
+  Type *Int8 = Type::getInt8Ty(Ctx);
+  Type *Int32 = Type::getInt32Ty(Ctx);
+  Type *StubCalledArgs[] = { Type::getInt8PtrTy(Ctx), Int32 };
+  Constant *StubCalled = getHostPointer((uintptr_t)&stubCalled,
+    FunctionType::get(Type::getVoidTy(Ctx), StubCalledArgs, false)
+      ->getPointerTo());
+  Constant *Self = getHostPointer((uintptr_t)this, Type::getInt8PtrTy(Ctx));
+  Constant *HaltedPtr = getHostPointer((uintptr_t)&Halted,
+    Int8->getPointerTo());
+
+  // Opaque instructions take operands and produce values, so every
+  // signature is stubbed; results are zero, as in BlockTranslator.
+  SmallPtrSet<Function*, 8> Halts;
+  for (Module::iterator F = JITMod->begin(), E = JITMod->end(); F != E; ++F) {
+    if (!F->isDeclaration() || F->isIntrinsic())
+      continue;
+    printInfo("Stubbing unlifted function " + F->getName().str());
+    BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F);
+    Value *Args[] = { Self, ConstantInt::get(Int32, StubNames.size()) };
+    CallInst::Create(StubCalled, Args, "", BB);
+    // Calls to exit, abort and the like end the run instead.
+    if (F->doesNotReturn()) {
+      new StoreInst(ConstantInt::get(Int8, 1), HaltedPtr, BB);
+      Halts.insert(F);
+    }
+    Type *RetTy = F->getReturnType();
+    ReturnInst::Create(Ctx,
+      RetTy->isVoidTy() ? NULL : Constant::getNullValue(RetTy), BB);
+    F->setLinkage(GlobalValue::InternalLinkage);
+    StubNames.push_back(F->getName());
+  }
+  StubCalls.assign(StubNames.size(), 0);
+  stopAtHalts(Halts);
+}
+
+/// stopAtHalts - The stubs in Halts set Halted and return. Every caller,
+/// direct or not, returns as soon as it sees Halted after such a call, so
+/// the run unwinds instead of falling into the unreachable the decompiler
+/// put after it.
+void LiftedRunner::stopAtHalts(SmallPtrSetImpl<Function*> &Halts) {
+  if (Halts.empty())
+    return;
+  LLVMContext &Ctx = JITMod->getContext();
+  Type *Int8 = Type::getInt8Ty(Ctx);
+  Constant *HaltedPtr = getHostPointer((uintptr_t)&Halted,
+    Int8->getPointerTo());
+
+  // Whatever calls a function that may halt may halt too.
+  bool Changed;
+  do {
+    Changed = false;
+    for (Module::iterator F = JITMod->begin(), E = JITMod->end(); F != E;
+         ++F) {
+      if (Halts.count(F))
+        continue;
+      for (inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+        CallInst *CI = dyn_cast<CallInst>(&*I);
+        if (CI && CI->getCalledFunction()
+            && Halts.count(CI->getCalledFunction())) {
+          Halts.insert(F);
+          Changed = true;
+          break;
+        }
+      }
+    }
+  } while (Changed);
+
+  for (Module::iterator F = JITMod->begin(), E = JITMod->end(); F != E; ++F) {
+    // They return now, so the optimizer must not assume otherwise.
+    if (Halts.count(F))
+      F->removeFnAttr(Attribute::NoReturn);
+    std::vector<CallInst*> Calls;
+    for (inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+      CallInst *CI = dyn_cast<CallInst>(&*I);
+      if (CI && CI->getCalledFunction()
+          && Halts.count(CI->getCalledFunction()))
+        Calls.push_back(CI);
+    }
+    if (Calls.empty())
+      continue;
+
+    Type *RetTy = F->getReturnType();
+    BasicBlock *StopBB = BasicBlock::Create(Ctx, "halted", F);
+    ReturnInst::Create(Ctx,
+      RetTy->isVoidTy() ? NULL : Constant::getNullValue(RetTy), StopBB);
+    for (unsigned i = 0, e = Calls.size(); i != e; ++i) {
+      CallInst *CI = Calls[i];
+      CI->removeAttribute(AttributeSet::FunctionIndex, Attribute::NoReturn);
+      BasicBlock *BB = CI->getParent();
+      BasicBlock::iterator Next = CI;
+      ++Next;
+      // Nothing follows a call that does not return.
+      if (isa<UnreachableInst>(&*Next)) {
+        Next->eraseFromParent();
+        BranchInst::Create(StopBB, BB);
+        continue;
+      }
+      BasicBlock *Cont = BB->splitBasicBlock(Next);
+      BB->getTerminator()->eraseFromParent();
+      IRBuilder<> IRB(BB);
+      IRB.CreateCondBr(IRB.CreateICmpNE(IRB.CreateLoad(HaltedPtr),
+        ConstantInt::get(Int8, 0)), StopBB, Cont);
+    }
+  }
+}
+
+/// checkStubCalls - Returns false, naming them, if any function that was
+/// never lifted was reached since the counts were last cleared.
+bool LiftedRunner::checkStubCalls() {
+  bool Clean = true;
+  for (unsigned i = 0, e = StubCalls.size(); i != e; ++i) {
+    if (StubCalls[i] == 0)
+      continue;
+    printError("Reached unlifted function " + StubNames[i] + " " +
+      Twine(StubCalls[i]).str() + " time(s); its effects are missing, so "
+      "the results cannot be trusted.");
+    Clean = false;
+  }
+  return Clean;
+}
+
+void *LiftedRunner::getRegisterAddress(StringRef RegName, unsigned &Bytes) {
+  if (!compile())
+    return NULL;
+  GlobalVariable *GV = JITMod->getGlobalVariable(RegName);
+  if (GV == NULL) {
+    printError("Unknown register " + RegName.str() +
+      ". It is not used by any lifted function.");
+    return NULL;
+  }
+  Type *Ty = GV->getType()->getElementType();
+  unsigned Bits = Ty->getPrimitiveSizeInBits();
+  if (Bits == 0 || Bits > 64) {
+    printError("Register " + RegName.str() + " has unsupported width.");
+    return NULL;
+  }
+  Bytes = (Bits + 7) / 8;
+  return (void*)EE->getGlobalValueAddress(RegName);
+}
+
+// NOTE: Register values are copied as host-endian integers, which matches
+// the layout MCJIT gives the register globals.
+bool LiftedRunner::setRegister(StringRef RegName, uint64_t Value) {
+  unsigned Bytes;
+  void *Addr = getRegisterAddress(RegName, Bytes);
+  if (Addr == NULL)
+    return false;
+  memcpy(Addr, &Value, Bytes);
+  Inputs[RegName] = Value;
+  return true;
+}
+
+bool LiftedRunner::getRegister(StringRef RegName, uint64_t &Value) {
+  unsigned Bytes;
+  void *Addr = getRegisterAddress(RegName, Bytes);
+  if (Addr == NULL)
+    return false;
+  Value = 0;
+  memcpy(&Value, Addr, Bytes);
+  return true;
+}
+
+bool LiftedRunner::mapMemory(const AddressSpace &Memory, StringRef SPName,
+  unsigned StackSize) {
+  if (EE != NULL) {
+    printError("Guest memory must be mapped before anything runs.");
+    return false;
+  }
+  if (JITMod == NULL)
+    return false;
+  std::string ErrMsg;
+  if (!Guest.map(Memory, StackSize, ErrMsg)) {
+    printError(ErrMsg);
+    return false;
+  }
+  return SPName.empty() || setRegister(SPName, Guest.getStackTop());
+}
+
+LiftedRunner::LiftedFn LiftedRunner::getFunction(StringRef FnName) {
+  if (!compile())
+    return NULL;
+  Function *F = JITMod->getFunction(FnName);
+  if (F == NULL || F->isDeclaration()) {
+    printError("No lifted function named " + FnName.str() +
+      ". Decompile it first.");
+    return NULL;
+  }
+  if (!F->getReturnType()->isVoidTy() || !F->arg_empty()) {
+    printError("Function " + FnName.str() + " is not a lifted void() function.");
+    return NULL;
+  }
+  return (LiftedFn)EE->getFunctionAddress(FnName);
+}
+
+bool LiftedRunner::run(StringRef FnName) {
+  LiftedFn Fn = getFunction(FnName);
+  if (Fn == NULL)
+    return false;
+  StubCalls.assign(StubCalls.size(), 0);
+  Halted = 0;
+  Fn();
+  if (Halted)
+    printInfo(FnName.str() + " stopped at a call that does not return.");
+  return checkStubCalls();
+}
+
+bool LiftedRunner::runOnce(void *LR) {
+  LiftedRunner *Self = (LiftedRunner*)LR;
+  Self->Halted = 0;
+  Self->CurFn();
+  return true;
+}
+
+double LiftedRunner::bench(StringRef FnName, unsigned Iterations) {
+  LiftedFn Fn = getFunction(FnName);
+  if (Fn == NULL || Iterations == 0)
+    return -1.0;
+
+  StubCalls.assign(StubCalls.size(), 0);
+
+  // Resolve the input register addresses once, so the timed loop only pays
+  // for the copies.
+  std::vector<InputRegister> Regs;
+  for (StringMap<uint64_t>::iterator I = Inputs.begin(), E = Inputs.end();
+       I != E; ++I) {
+    InputRegister R;
+    R.Addr = getRegisterAddress(I->getKey(), R.Bytes);
+    R.Value = I->getValue();
+    Regs.push_back(R);
+  }
+
+  CurFn = Fn;
+  double Ns = timeRuns(Regs, Iterations, &runOnce, this);
+  if (!checkStubCalls())
+    return -1.0;
+  return Ns;
+}
+
+} // end namespace fracture
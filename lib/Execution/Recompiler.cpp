@@ -0,0 +1,207 @@
+//===--- Recompiler - Native code generation for lifted IR ------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class recompiles a lifted module into native object code for a host
+// triple.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Execution/Recompiler.h"
+#include "Execution/LiftedRunner.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+
+#include <memory>
+#include <thread>
+
+using namespace llvm;
+
+namespace fracture {
+
+Recompiler::Recompiler(std::string TripleName, StringRef CPUName,
+  StringRef Features, Reloc::Model RM, raw_ostream &InfoOut,
+  raw_ostream &ErrOut) : TripleName(TripleName), CPU(CPUName),
+  Features(Features), RM(RM), TheTarget(NULL), Infos(InfoOut), Errs(ErrOut) {
+  if (this->TripleName.empty())
+    this->TripleName = sys::getDefaultTargetTriple();
+  this->TripleName = Triple::normalize(this->TripleName);
+
+  std::string ErrMsg;
+  TheTarget = TargetRegistry::lookupTarget(this->TripleName, ErrMsg);
+  if (TheTarget == NULL)
+    printError("Unable to find target for " + this->TripleName + ": " + ErrMsg);
+  else
+    printInfo("Using host triple: " + this->TripleName);
+}
+
+bool Recompiler::compile(const Module *Mod, unsigned OptLevel,
+  StringRef OutFile) {
+  std::vector<std::string> Outputs;
+  return compileParallel(Mod, OptLevel, OutFile, 1, Outputs);
+}
+
+bool Recompiler::compileParallel(const Module *Mod, unsigned OptLevel,
+  StringRef OutPrefix, unsigned NumThreads, std::vector<std::string> &Outputs) {
+  if (!isValid())
+    return false;
+  if (NumThreads == 0)
+    NumThreads = 1;
+
+  // LLVMContext is not thread safe, so every partition gets a private copy of
+  // the module by round-tripping it through bitcode.
+  std::string Bitcode;
+  raw_string_ostream BCOS(Bitcode);
+  WriteBitcodeToFile(Mod, BCOS);
+  BCOS.flush();
+
+  Outputs.clear();
+  if (NumThreads == 1) {
+    Outputs.push_back(OutPrefix);
+  } else {
+    for (unsigned i = 0; i != NumThreads; ++i)
+      Outputs.push_back(OutPrefix.str() + "." + utostr(i) + ".o");
+  }
+
+  std::vector<std::string> ErrMsgs(NumThreads);
+  std::vector<char> Succeeded(NumThreads, 0);
+  std::vector<std::thread> Workers;
+  for (unsigned i = 0; i != NumThreads; ++i) {
+    Workers.push_back(std::thread([&, i]() {
+      Succeeded[i] = compilePartition(Bitcode, i, NumThreads, OptLevel,
+        Outputs[i], ErrMsgs[i]);
+    }));
+  }
+  for (unsigned i = 0; i != NumThreads; ++i)
+    Workers[i].join();
+
+  // Report in partition order so output does not depend on scheduling.
+  bool Result = true;
+  for (unsigned i = 0; i != NumThreads; ++i) {
+    if (Succeeded[i]) {
+      printInfo("Wrote " + Outputs[i]);
+      continue;
+    }
+    printError(Outputs[i] + ": " + ErrMsgs[i]);
+    Result = false;
+  }
+  return Result;
+}
+
+bool Recompiler::compilePartition(StringRef Bitcode, unsigned Part,
+  unsigned NumParts, unsigned OptLevel, StringRef OutFile,
+  std::string &ErrMsg) {
+  LLVMContext Ctx;
+  std::unique_ptr<MemoryBuffer> Buf(
+    MemoryBuffer::getMemBuffer(Bitcode, "", false));
+  ErrorOr<Module*> ModOrErr = parseBitcodeFile(Buf->getMemBufferRef(), Ctx);
+  if (std::error_code EC = ModOrErr.getError()) {
+    ErrMsg = EC.message();
+    return false;
+  }
+  std::unique_ptr<Module> M(ModOrErr.get());
+
+  // Functions are dealt out round-robin. Local functions cannot be
+  // referenced across objects, so every partition keeps its own copy.
+  unsigned Idx = 0;
+  for (Module::iterator F = M->begin(), E = M->end(); F != E; ++F) {
+    if (F->isDeclaration() || F->hasLocalLinkage())
+      continue;
+    if (Idx++ % NumParts != Part)
+      F->deleteBody();
+  }
+
+  // A local variable would get one copy per object, and functions in
+  // different partitions would no longer share it. Promote each to a hidden
+  // global with a name of its own; every partition parses the same bitcode,
+  // so they all pick the same names. It is then defined in partition 0 only,
+  // like the other globals.
+  if (NumParts > 1) {
+    unsigned LocalIdx = 0;
+    for (Module::global_iterator G = M->global_begin(), E = M->global_end();
+         G != E; ++G) {
+      if (G->isDeclaration() || !G->hasLocalLinkage())
+        continue;
+      G->setName("fracture.local." + utostr(LocalIdx++) + "." +
+        G->getName());
+      G->setLinkage(GlobalValue::ExternalLinkage);
+      G->setVisibility(GlobalValue::HiddenVisibility);
+    }
+  }
+
+  if (Part != 0) {
+    for (Module::global_iterator G = M->global_begin(), E = M->global_end();
+         G != E; ++G) {
+      if (G->isDeclaration() || G->hasLocalLinkage())
+        continue;
+      G->setInitializer(NULL);
+      G->setLinkage(GlobalValue::ExternalLinkage);
+    }
+  }
+
+  return emitObject(M.get(), OptLevel, OutFile, ErrMsg);
+}
+
+bool Recompiler::emitObject(Module *Mod, unsigned OptLevel, StringRef OutFile,
+  std::string &ErrMsg) {
+  CodeGenOpt::Level CGOpt = CodeGenOpt::Default;
+  switch (OptLevel) {
+    case 0: CGOpt = CodeGenOpt::None; break;
+    case 1: CGOpt = CodeGenOpt::Less; break;
+    case 2: CGOpt = CodeGenOpt::Default; break;
+    default: CGOpt = CodeGenOpt::Aggressive; break;
+  }
+
+  std::unique_ptr<TargetMachine> TM(TheTarget->createTargetMachine(TripleName,
+      CPU, Features, TargetOptions(), RM, CodeModel::Default, CGOpt));
+  if (!TM) {
+    ErrMsg = "Unable to create TargetMachine.";
+    return false;
+  }
+
+  Mod->setTargetTriple(TripleName);
+  Mod->setDataLayout(TM->getSubtargetImpl()->getDataLayout());
+
+  std::string VerifyErr;
+  raw_string_ostream VerifyOS(VerifyErr);
+  if (verifyModule(*Mod, &VerifyOS)) {
+    ErrMsg = "Lifted module is not valid IR:\n" + VerifyOS.str();
+    return false;
+  }
+
+  LiftedRunner::optimizeModule(Mod, OptLevel);
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutFile, EC, sys::fs::F_None);
+  if (EC) {
+    ErrMsg = EC.message();
+    return false;
+  }
+  formatted_raw_ostream FOS(Out);
+
+  PassManager PM;
+  PM.add(new DataLayoutPass());
+  if (TM->addPassesToEmitFile(PM, FOS, TargetMachine::CGFT_ObjectFile)) {
+    ErrMsg = "Target does not support object file emission.";
+    return false;
+  }
+  PM.run(*Mod);
+  return true;
+}
+
+} // end namespace fracture
@@ -15,6 +15,7 @@
 
 #include "Target/ARM/ARMIREmitter.h"
 #include "CodeInv/Decompiler.h"
+#include "CodeInv/InstrClassInfo.h"
 #include "ARMBaseInfo.h"
 
 using namespace llvm;
@@ -32,6 +33,21 @@ ARMIREmitter::~ARMIREmitter() {
   // Nothing to do here
 }
 
+uint64_t ARMIREmitter::getPCValue(const SDNode *N) {
+  Disassembler *Dis = Dec->getDisassembler();
+  uint64_t Address = Dis->getDebugOffset(N->getDebugLoc());
+  Triple::ArchType Arch = Triple(
+    Dis->getMCDirector()->getTargetMachine()->getTargetTriple()).getArch();
+  if (Arch != Triple::thumb && Arch != Triple::thumbeb)
+    return Address + 8;
+  // Thumb literal loads and adr work from the word-aligned PC.
+  const MachineInstr *MI = Dis->getMachineInstr(Address);
+  const InstrClassInfo *ICI = Dis->getInstrClassInfo();
+  if (MI && ICI && ICI->isPCRelLoad(MI))
+    return (Address + 4) & ~3ULL;
+  return Address + 4;
+}
+
 Value* ARMIREmitter::visit(const SDNode *N) {
   // return the parent if we are in IR only territory
   if (N->getOpcode() <= ISD::BUILTIN_OP_END) return IREmitter::visit(N);
@@ -258,15 +274,9 @@ Value* ARMIREmitter::visitBRCOND(const SDNode *N) {
   }
 
   // If not a conditional branch, find the successor block and look at CC
-  BasicBlock *NextBB = NULL;
-  Function::iterator BI = F->begin(), BE= F->end();
-  while (BI != BE && BI->getName() != CurBB->getName()) ++BI;
-  ++BI;
-  if (BI == BE) {               // NOTE: This should never happen...
+  BasicBlock *NextBB = Dec->getLayoutSuccessor(CurBB);
+  if (NextBB == NULL)           // NOTE: This should never happen...
     NextBB = Dec->getOrCreateBasicBlock("end", F);
-  } else {
-    NextBB = &(*BI);
-  }
 
 
   SDNode *CPSR = N->getOperand(2)->getOperand(1).getNode();
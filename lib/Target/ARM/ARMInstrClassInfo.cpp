@@ -0,0 +1,38 @@
+//===- ARMInstrClassInfo.cpp - ARM instruction classes -----------*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Instantiates the generated ARM instruction class bitsets and info table.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "ARMBaseInfo.h"
+
+using namespace llvm;
+
+namespace fracture {
+
+#include "ARMGenInstrClasses.inc"
+#include "ARMGenInstrTable.inc"
+#include "ARMGenFallbackTable.inc"
+
+// Prologues push the link register.
+static const unsigned ARMPrologueRegs[] = { ARM::LR };
+
+const InstrClassInfo *getARMInstrClassInfo() {
+  static const InstrClassInfo Info(ARMInstrClasses::Classes,
+    ARMInstrClasses::NumOpcodes, ARMInstrTable::Entries,
+    ARMInstrTable::OperandTypes, ARMInstrTable::OperandTypeIndex,
+    ARMFallback::Entries, array_lengthof(ARMFallback::Entries),
+    ARMPrologueRegs, array_lengthof(ARMPrologueRegs), ARM::PC);
+  return &Info;
+}
+
+} // end namespace fracture
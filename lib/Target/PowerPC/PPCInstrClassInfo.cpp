@@ -0,0 +1,38 @@
+//===- PPCInstrClassInfo.cpp - PPC instruction classes -----------*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Instantiates the generated PPC instruction class bitsets and info table.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "PowerPCBaseInfo.h"
+
+using namespace llvm;
+
+namespace fracture {
+
+#include "PPCGenInstrClasses.inc"
+#include "PPCGenInstrTable.inc"
+#include "PPCGenFallbackTable.inc"
+
+// Prologues store the back chain with stwu/stdu r1.
+static const unsigned PPCPrologueRegs[] = { PPC::R1, PPC::X1 };
+
+const InstrClassInfo *getPPCInstrClassInfo() {
+  static const InstrClassInfo Info(PPCInstrClasses::Classes,
+    PPCInstrClasses::NumOpcodes, PPCInstrTable::Entries,
+    PPCInstrTable::OperandTypes, PPCInstrTable::OperandTypeIndex,
+    PPCFallback::Entries, array_lengthof(PPCFallback::Entries),
+    PPCPrologueRegs, array_lengthof(PPCPrologueRegs), 0);
+  return &Info;
+}
+
+} // end namespace fracture
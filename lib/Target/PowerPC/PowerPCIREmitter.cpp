@@ -16,6 +16,7 @@
 #include "Target/PowerPC/PowerPCIREmitter.h"
 #include "CodeInv/Decompiler.h"
 #include "PowerPCBaseInfo.h"
+#include "llvm/Support/Endian.h"
 
 using namespace llvm;
 
@@ -24,7 +25,8 @@ using namespace llvm;
 namespace fracture {
 
 PowerPCIREmitter::PowerPCIREmitter(Decompiler *TheDec, raw_ostream &InfoOut,
-  raw_ostream &ErrOut) : IREmitter(TheDec, InfoOut, ErrOut) {
+  raw_ostream &ErrOut) : IREmitter(TheDec, InfoOut, ErrOut),
+  ReadDescriptors(false) {
   // Nothing to do here
 }
 
@@ -32,6 +34,53 @@ PowerPCIREmitter::~PowerPCIREmitter() {
   // Nothing to do here
 }
 
+void PowerPCIREmitter::readDescriptors() {
+  ReadDescriptors = true;
+  // Each descriptor is the entry point, the TOC base and an environment
+  // pointer, all doublewords.
+  const AddressSpace &Memory = Dec->getDisassembler()->getMemory();
+  const std::vector<AddressSpace::Region> &Regions = Memory.regions();
+  for (unsigned i = 0, e = Regions.size(); i != e; ++i) {
+    if (Regions[i].Name != ".opd")
+      continue;
+    StringRef Bytes = Regions[i].Bytes;
+    for (uint64_t Off = 0; Off + 24 <= Bytes.size(); Off += 24) {
+      uint64_t Entry = support::endian::read64be(Bytes.data() + Off);
+      uint64_t TOC = support::endian::read64be(Bytes.data() + Off + 8);
+      if (TOC != 0 && Memory.isExecutable(Entry))
+        TOCBases[Entry] = TOC;
+    }
+  }
+  DEBUG(Infos << "Read " << TOCBases.size() << " TOC bases.\n");
+}
+
+uint64_t PowerPCIREmitter::getTOCBase(uint64_t Address) {
+  if (!ReadDescriptors)
+    readDescriptors();
+  if (TOCBases.empty())
+    return 0;
+  Disassembler *Dis = Dec->getDisassembler();
+  MachineFunction *MF = Dis->getNearestFunction(Address);
+  if (MF == NULL || MF->empty() || MF->front().empty())
+    return 0;
+  uint64_t Entry = Dis->getDebugOffset(MF->front().front().getDebugLoc());
+  DenseMap<uint64_t, uint64_t>::iterator I = TOCBases.find(Entry);
+  return I == TOCBases.end() ? 0 : I->second;
+}
+
+Constant* PowerPCIREmitter::getKnownRegister(const SDNode *N, unsigned Reg) {
+  // r2 holds the function's TOC base throughout; after a call that may
+  // switch TOCs the caller reloads it from its save slot.
+  if (Reg != PPC::X2)
+    return IREmitter::getKnownRegister(N, Reg);
+  uint64_t TOC =
+    getTOCBase(Dec->getDisassembler()->getDebugOffset(N->getDebugLoc()));
+  if (TOC == 0)
+    return NULL;
+  return ConstantInt::get(
+    N->getValueType(0).getTypeForEVT(IRB->getContext()), TOC);
+}
+
 Value* PowerPCIREmitter::visit(const SDNode *N) {
   // return the parent if we are in IR only territory
   if (N->getOpcode() <= ISD::BUILTIN_OP_END){
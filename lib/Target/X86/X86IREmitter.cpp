@@ -370,15 +370,9 @@ Value* X86IREmitter::visitBRCOND(const SDNode *N) {
   (dyn_cast<Instruction>(Cmp))->setDebugLoc(N->getOperand(2)->getDebugLoc());
 
   // If not a conditional branch, find the successor block and look at CC
-  BasicBlock *NextBB = NULL;
-  Function::iterator BI = F->begin(), BE= F->end();
-  while (BI != BE && BI->getName() != CurBB->getName()) ++BI;
-  ++BI;
-  if (BI == BE) {               // NOTE: This should never happen...
+  BasicBlock *NextBB = Dec->getLayoutSuccessor(CurBB);
+  if (NextBB == NULL)           // NOTE: This should never happen...
     NextBB = Dec->getOrCreateBasicBlock("end", F);
-  } else {
-    NextBB = &(*BI);
-  }
 
   // Conditional branch
   Instruction *Br = IRB->CreateCondBr(Cmp, BBTgt, NextBB);
@@ -519,15 +513,9 @@ Value* X86IREmitter::visitBRCONDAdvanced(const SDNode *N) {
   (dyn_cast<Instruction>(Cmp))->setDebugLoc(N->getOperand(2)->getDebugLoc());
 
   // If not a conditional branch, find the successor block and look at CC
-  BasicBlock *NextBB = NULL;
-  Function::iterator BI = F->begin(), BE= F->end();
-  while (BI != BE && BI->getName() != CurBB->getName()) ++BI;
-  ++BI;
-  if (BI == BE) {               // NOTE: This should never happen...
+  BasicBlock *NextBB = Dec->getLayoutSuccessor(CurBB);
+  if (NextBB == NULL)           // NOTE: This should never happen...
     NextBB = Dec->getOrCreateBasicBlock("end", F);
-  } else {
-    NextBB = &(*BI);
-  }
 
   // Conditional branch
   Instruction *Br = IRB->CreateCondBr(Cmp, BBTgt, NextBB);
@@ -541,8 +529,35 @@ Value* X86IREmitter::visitRET_FLAG(const SDNode *N){
 Value* X86IREmitter::visitREP_STOS(const SDNode *N) { llvm_unreachable("visitREP_STOS Unimplemented X86 visit..."); return NULL; }
 Value* X86IREmitter::visitREP_MOVS(const SDNode *N) { llvm_unreachable("visitREP_MOVS Unimplemented X86 visit..."); return NULL; }
 Value* X86IREmitter::visitGlobalBaseReg(const SDNode *N) { llvm_unreachable("visitGlobalBaseReg Unimplemented X86 visit..."); return NULL; }
-Value* X86IREmitter::visitWrapper(const SDNode *N) { llvm_unreachable("visitWrapper Unimplemented X86 visit..."); return NULL; }
-Value* X86IREmitter::visitWrapperRIP(const SDNode *N) { llvm_unreachable("visitWrapperRIP Unimplemented X86 visit..."); return NULL; }
+
+Value* X86IREmitter::visitWrapper(const SDNode *N) {
+  // Operand 0 - the absolute address
+  const ConstantSDNode *Addr = dyn_cast<ConstantSDNode>(N->getOperand(0));
+  if (!Addr) {
+    printError("visitWrapper: Not a constant address!");
+    return NULL;
+  }
+  Value *Res = ConstantInt::get(
+    N->getValueType(0).getTypeForEVT(IRB->getContext()),
+    Addr->getZExtValue());
+  VisitMap[N] = Res;
+  return Res;
+}
+
+Value* X86IREmitter::visitWrapperRIP(const SDNode *N) {
+  // Operand 0 - the displacement from the next instruction
+  const ConstantSDNode *Disp = dyn_cast<ConstantSDNode>(N->getOperand(0));
+  if (!Disp) {
+    printError("visitWrapperRIP: Not a constant displacement!");
+    return NULL;
+  }
+  Value *Res = ConstantInt::get(
+    N->getValueType(0).getTypeForEVT(IRB->getContext()),
+    getPCValue(N) + Disp->getSExtValue());
+  VisitMap[N] = Res;
+  return Res;
+}
+
 Value* X86IREmitter::visitMOVDQ2Q(const SDNode *N) { llvm_unreachable("visitMOVDQ2Q Unimplemented X86 visit..."); return NULL; }
 Value* X86IREmitter::visitMMX_MOVD2W(const SDNode *N) { llvm_unreachable("visitMMX_MOVD2W Unimplemented X86 visit..."); return NULL; }
 Value* X86IREmitter::visitPEXTRB(const SDNode *N) { llvm_unreachable("visitPEXTRB Unimplemented X86 visit..."); return NULL; }
@@ -0,0 +1,38 @@
+//===- X86InstrClassInfo.cpp - X86 instruction classes -----------*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Instantiates the generated X86 instruction class bitsets and info table.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeInv/InstrClassInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "X86BaseInfo.h"
+
+using namespace llvm;
+
+namespace fracture {
+
+#include "X86GenInstrClasses.inc"
+#include "X86GenInstrTable.inc"
+#include "X86GenFallbackTable.inc"
+
+// Prologues push the frame pointer.
+static const unsigned X86PrologueRegs[] = { X86::EBP, X86::RBP };
+
+const InstrClassInfo *getX86InstrClassInfo() {
+  static const InstrClassInfo Info(X86InstrClasses::Classes,
+    X86InstrClasses::NumOpcodes, X86InstrTable::Entries,
+    X86InstrTable::OperandTypes, X86InstrTable::OperandTypeIndex,
+    X86Fallback::Entries, array_lengthof(X86Fallback::Entries),
+    X86PrologueRegs, array_lengthof(X86PrologueRegs), X86::RIP);
+  return &Info;
+}
+
+} // end namespace fracture
@@ -0,0 +1,408 @@
+//===--- LoopRecovery - normalizes and annotates lifted loops ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This function pass gives the optimizer the loop structure of a lifted
+// function. LoopSimplify runs first and puts every natural loop in canonical
+// form: a preheader, one back edge and exits that are only reached from the
+// loop. Each loop then gets its own llvm.loop node, which is where LICM, the
+// unroller and the vectorizer look for and record loop hints.
+//
+// Registers are globals in lifted code, so a counted loop looks like
+//
+//   preheader:  store i32 0, i32* @R3
+//   latch:      %1 = load i32* @R3
+//               %2 = add i32 %1, 1
+//               store i32 %2, i32* @R3
+//               %3 = icmp slt i32 %2, 10
+//               br i1 %3, label %header, label %exit
+//
+// When the latch is the only exit, the register is stored once per
+// iteration (in the latch) and nothing in the loop is a call, the trip count
+// follows from the start value, step and bound. It is recorded as
+// !{!"fracture.loop.trip_count", i64 N} in the loop node and as branch
+// weights on the latch.
+//
+// Irreducible regions (cycles with more than one entry) are not natural
+// loops and are left as they are; the function is marked with an
+// "IrreducibleLoops" attribute giving their number.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "looprecovery"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+#include "Transforms/LoopRecovery.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumLoops, "Number of natural loops annotated");
+STATISTIC(NumTripCounts, "Number of loops with a recovered trip count");
+STATISTIC(NumIrreducible, "Number of irreducible regions left as they are");
+
+namespace {
+
+struct LoopRecovery : public FunctionPass {
+  static char ID;
+  LoopRecovery() : FunctionPass(ID) {
+    // Nothing else registers what we require before the pass manager looks
+    // it up.
+    PassRegistry &Registry = *PassRegistry::getPassRegistry();
+    initializeDominatorTreeWrapperPassPass(Registry);
+    initializeLoopInfoPass(Registry);
+    initializeLoopSimplifyPass(Registry);
+  }
+
+  virtual bool runOnFunction(Function &F);
+
+  // LoopSimplify changes the CFG before we run; we only add metadata.
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequiredID(LoopSimplifyID);
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfo>();
+    AU.setPreservesCFG();
+  }
+
+private:
+  unsigned countIrreducibleRegions(Function &F);
+  void annotateLoop(Loop *L);
+  bool getTripCount(Loop *L, uint64_t &TripCount);
+};
+
+} // end anonymous namespace
+
+char LoopRecovery::ID = 0;
+
+static RegisterPass<LoopRecovery> X("LoopRecovery", "Loop recovery",
+                                    false /* Only looks at CFG */,
+                                    false /* Analysis Pass */);
+
+FunctionPass* llvm::createLoopRecoveryPass() {
+  return new LoopRecovery();
+}
+
+bool LoopRecovery::runOnFunction(Function &F) {
+  bool Changed = false;
+
+  if (unsigned N = countIrreducibleRegions(F)) {
+    DEBUG(dbgs() << F.getName() << ": " << N << " irreducible regions\n");
+    F.addFnAttr("IrreducibleLoops", utostr(N));
+    NumIrreducible += N;
+    Changed = true;
+  }
+
+  LoopInfo &LI = getAnalysis<LoopInfo>();
+  std::vector<Loop *> Worklist(LI.begin(), LI.end());
+  while (!Worklist.empty()) {
+    Loop *L = Worklist.back();
+    Worklist.pop_back();
+    Worklist.insert(Worklist.end(), L->begin(), L->end());
+    // Already done if the function was run through us before.
+    if (L->getLoopID() != NULL || L->getLoopLatch() == NULL)
+      continue;
+    annotateLoop(L);
+    Changed = true;
+  }
+  return Changed;
+}
+
+/// countIrreducibleRegions - A cycle is a natural loop only if it is
+/// entered through one block, its header.
+unsigned LoopRecovery::countIrreducibleRegions(Function &F) {
+  unsigned N = 0;
+  for (scc_iterator<Function *> I = scc_begin(&F); !I.isAtEnd(); ++I) {
+    if (!I.hasLoop())
+      continue;
+    const std::vector<BasicBlock *> &SCC = *I;
+    SmallPtrSet<BasicBlock *, 16> InSCC(SCC.begin(), SCC.end());
+    unsigned Entries = 0;
+    for (unsigned i = 0, e = SCC.size(); i != e; ++i) {
+      BasicBlock *BB = SCC[i];
+      if (BB == &F.getEntryBlock()) {
+        ++Entries;
+        continue;
+      }
+      for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE;
+           ++PI) {
+        if (!InSCC.count(*PI)) {
+          ++Entries;
+          break;
+        }
+      }
+    }
+    if (Entries > 1)
+      ++N;
+  }
+  return N;
+}
+
+void LoopRecovery::annotateLoop(Loop *L) {
+  LLVMContext &Ctx = L->getHeader()->getContext();
+  SmallVector<Metadata *, 2> MDs;
+  // The first operand refers to the node itself, which keeps loop nodes
+  // distinct.
+  MDs.push_back(NULL);
+
+  uint64_t TripCount;
+  if (getTripCount(L, TripCount)) {
+    DEBUG(dbgs() << "Loop at " << L->getHeader()->getName() << " runs "
+                 << TripCount << " times\n");
+    Metadata *Hint[] = {
+      MDString::get(Ctx, "fracture.loop.trip_count"),
+      ConstantAsMetadata::get(
+        ConstantInt::get(Type::getInt64Ty(Ctx), TripCount))
+    };
+    MDs.push_back(MDNode::get(Ctx, Hint));
+
+    // Block frequencies, and the passes that use them, read trip counts from
+    // the weights of the back edge against the exit.
+    BranchInst *BI = cast<BranchInst>(L->getLoopLatch()->getTerminator());
+    uint32_t Back = std::min<uint64_t>(TripCount - 1,
+      std::numeric_limits<uint32_t>::max());
+    MDBuilder MDB(Ctx);
+    BI->setMetadata(LLVMContext::MD_prof,
+      BI->getSuccessor(0) == L->getHeader() ?
+        MDB.createBranchWeights(Back, 1) : MDB.createBranchWeights(1, Back));
+    ++NumTripCounts;
+  }
+
+  MDNode *LoopID = MDNode::get(Ctx, MDs);
+  LoopID->replaceOperandWith(0, LoopID);
+  L->setLoopID(LoopID);
+  ++NumLoops;
+}
+
+/// getRegister - The register global that V was loaded from, or NULL.
+static GlobalVariable *getRegister(Value *V) {
+  if (LoadInst *Load = dyn_cast<LoadInst>(V))
+    return dyn_cast<GlobalVariable>(Load->getPointerOperand());
+  return NULL;
+}
+
+/// getStep - If V is Reg, as loaded in L, plus or minus a constant, the
+/// signed step.
+static bool getStep(Value *V, GlobalVariable *Reg, Loop *L, int64_t &Step) {
+  BinaryOperator *BO = dyn_cast<BinaryOperator>(V);
+  if (BO == NULL)
+    return false;
+  Value *LHS = BO->getOperand(0), *RHS = BO->getOperand(1);
+  if (BO->getOpcode() == Instruction::Add && isa<ConstantInt>(LHS))
+    std::swap(LHS, RHS);
+  ConstantInt *C = dyn_cast<ConstantInt>(RHS);
+  if (C == NULL || getRegister(LHS) != Reg || C->getBitWidth() > 64 ||
+      !L->contains(cast<Instruction>(LHS)))
+    return false;
+  if (BO->getOpcode() == Instruction::Add)
+    Step = C->getSExtValue();
+  else if (BO->getOpcode() == Instruction::Sub)
+    Step = -C->getSExtValue();
+  else
+    return false;
+  return Step != 0;
+}
+
+static bool holds(ICmpInst::Predicate Pred, int64_t LHS, int64_t RHS) {
+  // Unsigned operands were zero extended into range, so signed compares
+  // give the same answer.
+  switch (Pred) {
+  case ICmpInst::ICMP_EQ:  return LHS == RHS;
+  case ICmpInst::ICMP_NE:  return LHS != RHS;
+  case ICmpInst::ICMP_SLT:
+  case ICmpInst::ICMP_ULT: return LHS < RHS;
+  case ICmpInst::ICMP_SLE:
+  case ICmpInst::ICMP_ULE: return LHS <= RHS;
+  case ICmpInst::ICMP_SGT:
+  case ICmpInst::ICMP_UGT: return LHS > RHS;
+  case ICmpInst::ICMP_SGE:
+  case ICmpInst::ICMP_UGE: return LHS >= RHS;
+  default:                 return false;
+  }
+}
+
+bool LoopRecovery::getTripCount(Loop *L, uint64_t &TripCount) {
+  BasicBlock *Latch = L->getLoopLatch();
+  BasicBlock *Preheader = L->getLoopPreheader();
+  if (Preheader == NULL || L->getExitingBlock() != Latch)
+    return false;
+  BranchInst *BI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (BI == NULL || !BI->isConditional())
+    return false;
+  ICmpInst *Cmp = dyn_cast<ICmpInst>(BI->getCondition());
+  if (Cmp == NULL)
+    return false;
+
+  // The condition for going round again, with the counter on the left.
+  ICmpInst::Predicate Pred = Cmp->getPredicate();
+  if (BI->getSuccessor(0) != L->getHeader())
+    Pred = ICmpInst::getInversePredicate(Pred);
+  Value *Counter = Cmp->getOperand(0);
+  ConstantInt *Bound = dyn_cast<ConstantInt>(Cmp->getOperand(1));
+  if (Bound == NULL) {
+    Counter = Cmp->getOperand(1);
+    Bound = dyn_cast<ConstantInt>(Cmp->getOperand(0));
+    Pred = ICmpInst::getSwappedPredicate(Pred);
+  }
+  if (Bound == NULL || Bound->getBitWidth() > 64)
+    return false;
+
+  // The counter is compared either as loaded or as about to be stored.
+  GlobalVariable *Reg = getRegister(Counter);
+  if (Reg == NULL)
+    for (Value::user_iterator UI = Counter->user_begin(),
+           UE = Counter->user_end(); UI != UE; ++UI)
+      if (StoreInst *SI = dyn_cast<StoreInst>(*UI))
+        if (SI->getValueOperand() == Counter)
+          Reg = dyn_cast<GlobalVariable>(SI->getPointerOperand());
+  if (Reg == NULL)
+    return false;
+
+  // Exactly one update per iteration, and no callee that could change it.
+  StoreInst *Update = NULL;
+  for (Loop::block_iterator BB = L->block_begin(), BE = L->block_end();
+       BB != BE; ++BB) {
+    for (BasicBlock::iterator I = (*BB)->begin(), E = (*BB)->end(); I != E;
+         ++I) {
+      if (isa<CallInst>(I) || isa<InvokeInst>(I))
+        return false;
+      StoreInst *SI = dyn_cast<StoreInst>(I);
+      if (SI == NULL || SI->getPointerOperand() != Reg)
+        continue;
+      if (Update != NULL || SI->getParent() != Latch)
+        return false;
+      Update = SI;
+    }
+  }
+  int64_t Step;
+  if (Update == NULL || !getStep(Update->getValueOperand(), Reg, L, Step))
+    return false;
+
+  // Compared after the update, the counter is one step ahead.
+  bool AfterUpdate = Counter == Update->getValueOperand();
+  if (!AfterUpdate) {
+    Instruction *CounterInst = cast<Instruction>(Counter);
+    if (getRegister(Counter) != Reg || !L->contains(CounterInst))
+      return false;
+    if (CounterInst->getParent() == Latch)
+      for (BasicBlock::iterator I = Update, E = Latch->end(); I != E; ++I)
+        if (&*I == CounterInst)
+          AfterUpdate = true;
+  }
+
+  // The start value is the constant last stored before the loop, on the one
+  // path that leads to it.
+  ConstantInt *Init = NULL;
+  BasicBlock *BB = Preheader;
+  for (unsigned Depth = 0; BB != NULL && Init == NULL && Depth != 8;
+       ++Depth, BB = BB->getSinglePredecessor()) {
+    for (BasicBlock::iterator I = BB->end(), E = BB->begin(); I != E;) {
+      --I;
+      if (isa<CallInst>(I) || isa<InvokeInst>(I))
+        return false;
+      StoreInst *SI = dyn_cast<StoreInst>(I);
+      if (SI == NULL || SI->getPointerOperand() != Reg)
+        continue;
+      Init = dyn_cast<ConstantInt>(SI->getValueOperand());
+      if (Init == NULL)
+        return false;
+      break;
+    }
+  }
+  if (Init == NULL || Init->getBitWidth() != Bound->getBitWidth())
+    return false;
+
+  // Work in 64 bits on values far from its limits, then check that the
+  // counter never left the range of its own width.
+  unsigned Width = Bound->getBitWidth();
+  bool Signed = !ICmpInst::isUnsigned(Pred);
+  const int64_t Limit = int64_t(1) << 40;
+  int64_t Min = Signed ? -(int64_t(1) << std::min(Width - 1, 62u)) : 0;
+  int64_t Max = Width > 62 ? Limit :
+    (int64_t(1) << (Signed ? Width - 1 : Width)) - 1;
+  if (!Signed && (Init->getValue().getActiveBits() > 41 ||
+                  Bound->getValue().getActiveBits() > 41))
+    return false;
+  int64_t Start = Signed ? Init->getSExtValue() : Init->getZExtValue();
+  int64_t End = Signed ? Bound->getSExtValue() : Bound->getZExtValue();
+  if (Start > Limit || Start < -Limit || End > Limit || End < -Limit ||
+      Step > Limit || Step < -Limit)
+    return false;
+
+  // First is the value compared in the first iteration, Last the one that
+  // ends the loop K iterations later.
+  int64_t First = Start + (AfterUpdate ? Step : 0);
+  if (First < Min || First > Max)
+    return false;
+  if (!holds(Pred, First, End)) {
+    TripCount = 1;
+    return true;
+  }
+
+  int64_t K;
+  switch (Pred) {
+  default:
+    return false;
+  case ICmpInst::ICMP_EQ:
+    K = 1;
+    break;
+  case ICmpInst::ICMP_NE:
+    if ((End - First) % Step != 0 || (End - First) / Step <= 0)
+      return false;
+    K = (End - First) / Step;
+    break;
+  case ICmpInst::ICMP_SLT:
+  case ICmpInst::ICMP_ULT:
+    if (Step < 0)
+      return false;
+    K = (End - First + Step - 1) / Step;
+    break;
+  case ICmpInst::ICMP_SLE:
+  case ICmpInst::ICMP_ULE:
+    if (Step < 0)
+      return false;
+    K = (End - First) / Step + 1;
+    break;
+  case ICmpInst::ICMP_SGT:
+  case ICmpInst::ICMP_UGT:
+    if (Step > 0)
+      return false;
+    K = (First - End - Step - 1) / -Step;
+    break;
+  case ICmpInst::ICMP_SGE:
+  case ICmpInst::ICMP_UGE:
+    if (Step > 0)
+      return false;
+    K = (First - End) / -Step + 1;
+    break;
+  }
+  int64_t Last = First + K * Step;
+  if (Last < Min || Last > Max || holds(Pred, Last, End))
+    return false;
+  TripCount = K + 1;
+  return true;
+}
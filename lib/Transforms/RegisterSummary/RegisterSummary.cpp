@@ -0,0 +1,353 @@
+//===--- RegisterSummary - register effects of lifted calls -----*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Every lifted function is void() and works on one global per register, so
+// LLVM has to assume that a call reads and writes all of them: each register
+// write before a call stays a store and each read after it a load.
+//
+// This pass summarizes, for every function, the registers it may read (Uses)
+// and may write (Defs), its callees included. Functions are visited
+// bottom-up over the call graph; the functions of a cycle share one summary.
+// Summaries are flow-insensitive. Imported functions get the registers the
+// target ABI lets them read and clobber, the opaque calls for unmatched
+// instructions touch no registers (they take theirs as arguments and return
+// values), and indirect calls and declarations of code in the binary that
+// was not lifted touch all of them.
+//
+// Each function then gets one local slot per register it accesses. Slots
+// are loaded from the globals on entry. A slot is written back before a
+// call only if the function wrote the register and the callee may read or
+// write it, and reloaded after a call only if the callee may write the
+// register. Defs is only what a callee may write, so the global has to be
+// current for the paths where the callee leaves it alone. At
+// a return, every register the function wrote is written back. The slots
+// are promoted to SSA values right away.
+//
+// Functions are done once (they are marked "RegistersLocalized"), so a
+// function lifted later should not change the summary of an earlier callee.
+// Within one decompile call all reachable callees are lifted first.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "registersummary"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "Transforms/BottomUpSummaries.h"
+#include "Transforms/RegisterSummary.h"
+
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumLocalized, "Number of functions with registers in SSA values");
+STATISTIC(NumStoresAvoided, "Number of register write-backs avoided at calls");
+STATISTIC(NumReloadsAvoided, "Number of register reloads avoided after calls");
+
+namespace {
+
+/// Summary - The registers a function may read and may write.
+struct Summary {
+  BitVector Uses, Defs;
+};
+
+struct RegisterSummary : public ModulePass, private BottomUpSummaries<Summary> {
+  static char ID;
+  RegisterSummary(ArrayRef<std::string> Uses = ArrayRef<std::string>(),
+                  ArrayRef<std::string> Defs = ArrayRef<std::string>(),
+                  ArrayRef<std::pair<uint64_t, uint64_t> > Code =
+                    ArrayRef<std::pair<uint64_t, uint64_t> >())
+    : ModulePass(ID), ImportUseNames(Uses.begin(), Uses.end()),
+      ImportDefNames(Defs.begin(), Defs.end()),
+      CodeRanges(Code.begin(), Code.end()) {}
+
+  virtual bool runOnModule(Module &M);
+
+  // Loads, stores and slots are added, the CFG is left alone.
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.setPreservesCFG();
+  }
+
+private:
+  std::vector<std::string> ImportUseNames, ImportDefNames;
+  std::vector<std::pair<uint64_t, uint64_t> > CodeRanges;
+  std::vector<GlobalVariable *> Regs;
+  DenseMap<const Value *, unsigned> RegIndex;
+  Summary ImportSummary;
+  Summary AllRegs;
+
+  /// getRegister - The index of the register global Ptr, or -1.
+  int getRegister(const Value *Ptr) const {
+    DenseMap<const Value *, unsigned>::const_iterator I = RegIndex.find(Ptr);
+    return I == RegIndex.end() ? -1 : int(I->second);
+  }
+  virtual Summary getEmptySummary() const;
+  bool isImport(const Function *F) const;
+  void addCallee(const CallInst *CI, Summary &S) const;
+  virtual void addFunction(const Function &F, Summary &S);
+  bool localize(Function &F);
+};
+
+} // end anonymous namespace
+
+char RegisterSummary::ID = 0;
+
+static RegisterPass<RegisterSummary> X("RegisterSummary",
+                                       "Register use/def summaries",
+                                       false /* Only looks at CFG */,
+                                       false /* Analysis Pass */);
+
+ModulePass* llvm::createRegisterSummaryPass(ArrayRef<std::string> ImportUses,
+  ArrayRef<std::string> ImportDefs,
+  ArrayRef<std::pair<uint64_t, uint64_t> > CodeRanges) {
+  return new RegisterSummary(ImportUses, ImportDefs, CodeRanges);
+}
+
+/// isRegister - The emitter makes one global per register and only ever
+/// loads and stores it whole.
+static bool isRegister(const GlobalVariable &GV) {
+  if (GV.isConstant() || !GV.getType()->getElementType()->isSingleValueType())
+    return false;
+  for (Value::const_user_iterator UI = GV.user_begin(), UE = GV.user_end();
+       UI != UE; ++UI) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(*UI)) {
+      if (LI->isVolatile())
+        return false;
+    } else if (const StoreInst *SI = dyn_cast<StoreInst>(*UI)) {
+      if (SI->isVolatile() || SI->getPointerOperand() != &GV)
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RegisterSummary::runOnModule(Module &M) {
+  Regs.clear();
+  RegIndex.clear();
+  for (Module::global_iterator GI = M.global_begin(), GE = M.global_end();
+       GI != GE; ++GI) {
+    if (!isRegister(*GI))
+      continue;
+    RegIndex[GI] = Regs.size();
+    Regs.push_back(GI);
+  }
+  if (Regs.empty())
+    return false;
+
+  AllRegs = getEmptySummary();
+  AllRegs.Uses.set();
+  AllRegs.Defs.set();
+  ImportSummary = getEmptySummary();
+  if (ImportUseNames.empty() && ImportDefNames.empty())
+    ImportSummary = AllRegs;
+  for (unsigned i = 0, e = ImportUseNames.size(); i != e; ++i) {
+    int R = getRegister(M.getGlobalVariable(ImportUseNames[i]));
+    if (R != -1)
+      ImportSummary.Uses.set(R);
+  }
+  for (unsigned i = 0, e = ImportDefNames.size(); i != e; ++i) {
+    int R = getRegister(M.getGlobalVariable(ImportDefNames[i]));
+    if (R != -1)
+      ImportSummary.Defs.set(R);
+  }
+
+  summarizeModule(M);
+
+  bool Changed = false;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if (!F->isDeclaration())
+      Changed |= localize(*F);
+  return Changed;
+}
+
+Summary RegisterSummary::getEmptySummary() const {
+  Summary S;
+  S.Uses.resize(Regs.size());
+  S.Defs.resize(Regs.size());
+  return S;
+}
+
+/// isImport - Returns true if the declaration F is not code of the binary:
+/// it has no address, or one outside the binary's code.
+bool RegisterSummary::isImport(const Function *F) const {
+  uint64_t Address;
+  if (!F->hasFnAttribute("Address")
+      || F->getFnAttribute("Address").getValueAsString()
+           .getAsInteger(10, Address))
+    return true;
+  for (unsigned i = 0, e = CodeRanges.size(); i != e; ++i)
+    if (Address >= CodeRanges[i].first && Address < CodeRanges[i].second)
+      return false;
+  return true;
+}
+
+void RegisterSummary::addCallee(const CallInst *CI, Summary &S) const {
+  // Indirect calls and inline asm could do anything.
+  const Function *Callee = CI->getCalledFunction();
+  if (Callee == NULL) {
+    S.Uses |= AllRegs.Uses;
+    S.Defs |= AllRegs.Defs;
+    return;
+  }
+  if (const Summary *CalleeSummary = getCalleeSummary(Callee)) {
+    S.Uses |= CalleeSummary->Uses;
+    S.Defs |= CalleeSummary->Defs;
+  }
+}
+
+void RegisterSummary::addFunction(const Function &F, Summary &S) {
+  if (F.isDeclaration()) {
+    // Intrinsics and opaque instructions get their register operands as
+    // arguments.
+    if (F.isIntrinsic() || F.onlyReadsMemory()
+        || F.getName().startswith("fracture.opaque."))
+      return;
+    // Code that was not lifted may do anything; only imports keep to the
+    // ABI.
+    const Summary &Callee = isImport(&F) ? ImportSummary : AllRegs;
+    S.Uses |= Callee.Uses;
+    S.Defs |= Callee.Defs;
+    return;
+  }
+  for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(&*I)) {
+      int R = getRegister(LI->getPointerOperand());
+      if (R != -1)
+        S.Uses.set(R);
+    } else if (const StoreInst *SI = dyn_cast<StoreInst>(&*I)) {
+      int R = getRegister(SI->getPointerOperand());
+      if (R != -1)
+        S.Defs.set(R);
+    } else if (const CallInst *CI = dyn_cast<CallInst>(&*I)) {
+      addCallee(CI, S);
+    }
+  }
+}
+
+bool RegisterSummary::localize(Function &F) {
+  if (F.hasFnAttribute("RegistersLocalized"))
+    return false;
+  F.addFnAttr("RegistersLocalized");
+
+  std::vector<Instruction *> Accesses, Calls, Returns;
+  BitVector Used(Regs.size()), Written(Regs.size());
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(&*I)) {
+      int R = getRegister(LI->getPointerOperand());
+      if (R == -1)
+        continue;
+      Used.set(R);
+      Accesses.push_back(LI);
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(&*I)) {
+      int R = getRegister(SI->getPointerOperand());
+      if (R == -1)
+        continue;
+      Used.set(R);
+      Written.set(R);
+      Accesses.push_back(SI);
+    } else if (isa<CallInst>(&*I)) {
+      Calls.push_back(&*I);
+    } else if (isa<ReturnInst>(&*I)) {
+      Returns.push_back(&*I);
+    }
+  }
+  BasicBlock &Entry = F.getEntryBlock();
+  if (Used.none() || Entry.getTerminator() == NULL)
+    return true;
+
+  // One slot per register, loaded from the global on entry.
+  std::vector<AllocaInst *> Slots(Regs.size(), NULL), Allocas;
+  std::vector<LoadInst *> EntryLoads;
+  Instruction *EntryEnd = Entry.getTerminator();
+  for (int R = Used.find_first(); R != -1; R = Used.find_next(R)) {
+    GlobalVariable *GV = Regs[R];
+    AllocaInst *Slot = new AllocaInst(GV->getType()->getElementType(),
+      GV->getName(), Entry.getFirstInsertionPt());
+    LoadInst *Init = new LoadInst(GV, "", EntryEnd);
+    new StoreInst(Init, Slot, EntryEnd);
+    Slots[R] = Slot;
+    Allocas.push_back(Slot);
+    EntryLoads.push_back(Init);
+  }
+
+  for (unsigned i = 0, e = Accesses.size(); i != e; ++i) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(Accesses[i]))
+      LI->setOperand(0, Slots[getRegister(LI->getPointerOperand())]);
+    else
+      Accesses[i]->setOperand(1,
+        Slots[getRegister(cast<StoreInst>(Accesses[i])->getPointerOperand())]);
+  }
+
+  // Until a callee may write it, a register the function never wrote still
+  // holds the value of its slot.
+  for (unsigned i = 0, e = Calls.size(); i != e; ++i) {
+    CallInst *CI = cast<CallInst>(Calls[i]);
+    Summary Callee = getEmptySummary();
+    addCallee(CI, Callee);
+    Instruction *After = ++BasicBlock::iterator(CI);
+    for (int R = Used.find_first(); R != -1; R = Used.find_next(R)) {
+      GlobalVariable *GV = Regs[R];
+      if (Written.test(R)) {
+        if (Callee.Uses.test(R) || Callee.Defs.test(R)) {
+          LoadInst *V = new LoadInst(Slots[R], "", CI);
+          StoreInst *S = new StoreInst(V, GV, CI);
+          V->setDebugLoc(CI->getDebugLoc());
+          S->setDebugLoc(CI->getDebugLoc());
+        } else {
+          ++NumStoresAvoided;
+        }
+      }
+      if (Callee.Defs.test(R)) {
+        LoadInst *V = new LoadInst(GV, "", After);
+        StoreInst *S = new StoreInst(V, Slots[R], After);
+        V->setDebugLoc(CI->getDebugLoc());
+        S->setDebugLoc(CI->getDebugLoc());
+      } else {
+        ++NumReloadsAvoided;
+      }
+    }
+  }
+
+  // The caller sees the registers in the globals.
+  for (unsigned i = 0, e = Returns.size(); i != e; ++i) {
+    for (int R = Written.find_first(); R != -1; R = Written.find_next(R)) {
+      LoadInst *V = new LoadInst(Slots[R], "", Returns[i]);
+      StoreInst *S = new StoreInst(V, Regs[R], Returns[i]);
+      V->setDebugLoc(Returns[i]->getDebugLoc());
+      S->setDebugLoc(Returns[i]->getDebugLoc());
+    }
+  }
+
+  DominatorTree DT;
+  DT.recalculate(F);
+  PromoteMemToReg(Allocas, DT);
+
+  // Registers written before they are read no longer need their entry load.
+  for (unsigned i = 0, e = EntryLoads.size(); i != e; ++i)
+    if (EntryLoads[i]->use_empty())
+      EntryLoads[i]->eraseFromParent();
+
+  DEBUG(dbgs() << F.getName() << ": " << Used.count() << " registers in SSA, "
+               << Calls.size() << " calls\n");
+  ++NumLocalized;
+  return true;
+}
@@ -0,0 +1,198 @@
+//===--- SideEffects - memory and unwind effects of functions ---*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Lifted functions only carry the "Address" attribute, so LLVM assumes that
+// every call to one reads and writes all memory and may unwind.
+//
+// This pass visits the functions bottom-up over the call graph and works out
+// what each one does to memory its callers can see: nothing, only reads, or
+// may write. Slots of the function's own frame (the allocas made by
+// StackRecovery and RegisterSummary) are private to it, and so are loads from
+// constant globals, so they do not count. Register globals do: a function
+// that writes a register is not readonly. The functions of a cycle share one
+// result.
+//
+// A lifted function can only unwind through a call, so it is nounwind unless
+// it calls something that may unwind: an external function not known to be
+// nounwind, an indirect call, or a branch or call that was lifted as an
+// opaque call (the emitter leaves nounwind off those).
+//
+// Writes that only reach arguments or the caller's stack are treated as
+// writes; LLVM has no attribute for them.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sideeffects"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Transforms/BottomUpSummaries.h"
+#include "Transforms/SideEffects.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumReadNone, "Number of functions marked readnone");
+STATISTIC(NumReadOnly, "Number of functions marked readonly");
+STATISTIC(NumNoUnwind, "Number of functions marked nounwind");
+
+namespace {
+
+/// MemoryEffect - Ordered from least to most, so effects merge with max.
+enum MemoryEffect { NoMemory, ReadsMemory, WritesMemory };
+
+/// Summary - What a function may do that its callers can see.
+struct Summary {
+  MemoryEffect Memory;
+  bool MayUnwind;
+  Summary() : Memory(NoMemory), MayUnwind(false) {}
+  void add(MemoryEffect M, bool Unwind) {
+    Memory = std::max(Memory, M);
+    MayUnwind |= Unwind;
+  }
+};
+
+struct SideEffects : public ModulePass, private BottomUpSummaries<Summary> {
+  static char ID;
+  SideEffects() : ModulePass(ID) {}
+
+  virtual bool runOnModule(Module &M);
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.setPreservesAll();
+  }
+
+private:
+  virtual Summary getEmptySummary() const { return Summary(); }
+  void addCallee(ImmutableCallSite CS, Summary &S) const;
+  virtual void addFunction(const Function &F, Summary &S);
+  bool annotate(Function &F, const Summary &S);
+};
+
+} // end anonymous namespace
+
+char SideEffects::ID = 0;
+
+static RegisterPass<SideEffects> X("SideEffects",
+                                   "Function side effect attributes",
+                                   false /* Only looks at CFG */,
+                                   false /* Analysis Pass */);
+
+ModulePass* llvm::createSideEffectsPass() {
+  return new SideEffects();
+}
+
+/// isPrivateMemory - Returns true if nothing outside the function can see
+/// the memory Ptr points to, or it never changes.
+static bool isPrivateMemory(const Value *Ptr) {
+  const Value *Obj = GetUnderlyingObject(Ptr);
+  if (isa<AllocaInst>(Obj))
+    return true;
+  if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Obj))
+    return GV->isConstant();
+  return false;
+}
+
+bool SideEffects::runOnModule(Module &M) {
+  summarizeModule(M);
+
+  bool Changed = false;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if (!F->isDeclaration())
+      Changed |= annotate(*F, Summaries[F]);
+  return Changed;
+}
+
+void SideEffects::addCallee(ImmutableCallSite CS, Summary &S) const {
+  // Indirect calls and inline asm could do anything.
+  const Function *Callee = CS.getCalledFunction();
+  if (Callee == NULL) {
+    S.add(WritesMemory, true);
+    return;
+  }
+  if (Callee->isDeclaration()) {
+    MemoryEffect M = WritesMemory;
+    if (CS.doesNotAccessMemory())
+      M = NoMemory;
+    else if (CS.onlyReadsMemory())
+      M = ReadsMemory;
+    S.add(M, !CS.doesNotThrow());
+    return;
+  }
+  if (const Summary *CalleeSummary = getCalleeSummary(Callee))
+    S.add(CalleeSummary->Memory, CalleeSummary->MayUnwind);
+}
+
+void SideEffects::addFunction(const Function &F, Summary &S) {
+  if (F.isDeclaration())
+    return;
+  for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (S.Memory == WritesMemory && S.MayUnwind)
+      break;
+    if (const LoadInst *LI = dyn_cast<LoadInst>(&*I)) {
+      if (!LI->isUnordered())
+        S.add(WritesMemory, false);
+      else if (!isPrivateMemory(LI->getPointerOperand()))
+        S.add(ReadsMemory, false);
+    } else if (const StoreInst *SI = dyn_cast<StoreInst>(&*I)) {
+      if (!SI->isUnordered() || !isPrivateMemory(SI->getPointerOperand()))
+        S.add(WritesMemory, false);
+    } else if (isa<CallInst>(&*I) || isa<InvokeInst>(&*I)) {
+      addCallee(ImmutableCallSite(&*I), S);
+    } else if (isa<ResumeInst>(&*I)) {
+      S.add(NoMemory, true);
+    } else if (I->mayWriteToMemory()) {
+      S.add(WritesMemory, false);
+    } else if (I->mayReadFromMemory()) {
+      S.add(ReadsMemory, false);
+    }
+  }
+}
+
+bool SideEffects::annotate(Function &F, const Summary &S) {
+  // Functions are summarized again when more of the program is lifted, and
+  // a body may have changed since, so earlier results are dropped first.
+  bool WasReadNone = F.doesNotAccessMemory();
+  bool WasReadOnly = !WasReadNone && F.onlyReadsMemory();
+  bool WasNoUnwind = F.doesNotThrow();
+  F.removeFnAttr(Attribute::ReadNone);
+  F.removeFnAttr(Attribute::ReadOnly);
+  F.removeFnAttr(Attribute::NoUnwind);
+
+  if (S.Memory == NoMemory) {
+    F.setDoesNotAccessMemory();
+    ++NumReadNone;
+  } else if (S.Memory == ReadsMemory) {
+    F.setOnlyReadsMemory();
+    ++NumReadOnly;
+  }
+  if (!S.MayUnwind) {
+    F.setDoesNotThrow();
+    ++NumNoUnwind;
+  }
+
+  DEBUG(dbgs() << F.getName() << ": "
+               << (S.Memory == NoMemory ? "readnone" :
+                   S.Memory == ReadsMemory ? "readonly" : "writes memory")
+               << (S.MayUnwind ? "" : ", nounwind") << "\n");
+  return WasReadNone != F.doesNotAccessMemory()
+    || WasReadOnly != (!F.doesNotAccessMemory() && F.onlyReadsMemory())
+    || WasNoUnwind != F.doesNotThrow();
+}
@@ -0,0 +1,388 @@
+//===--- StackRecovery - recovers stack frames as allocas -------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This function pass looks at LLVM IR from the Decompiler and replaces stack
+// traffic through the stack pointer register global with allocas.
+//
+// The stack pointer is tracked as a constant delta from its value on entry,
+// with a forward dataflow over the register globals so that frame pointers
+// (e.g., mov ebp, esp) and push/pop sequences are followed across blocks.
+// Accesses below the entry stack pointer are grouped into slots of
+// overlapping accesses, and each slot becomes its own alloca.
+//
+// The pass is conservative. It gives up on the whole function if the stack
+// pointer ever becomes unknown (e.g., realignment) or an access has no known
+// size, and it leaves alone any slot whose address escapes or that a callee
+// could read as an outgoing argument. The outgoing arguments of a call are
+// the run of stores, made in its block since the previous call, that covers
+// the stack upwards from the stack pointer at the call without a gap. That
+// holds both for pushed arguments and for arguments stored into space the
+// prologue reserved.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "stackrecovery"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Transforms/StackRecovery.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumFrames, "Number of stack frames recovered");
+STATISTIC(NumSlots, "Number of stack slots turned into allocas");
+STATISTIC(NumAccesses, "Number of stack accesses rewritten");
+
+namespace {
+
+typedef DenseMap<const GlobalVariable*, int64_t> RegState;
+
+/// StackAccess - A load or store at a known offset from the entry SP.
+struct StackAccess {
+  Instruction *Inst;
+  int64_t Offset;
+  unsigned Size;
+};
+
+struct StackRecovery : public FunctionPass {
+  static char ID;
+  StackRecovery(StringRef SP = "", StringRef FP = "")
+    : FunctionPass(ID), SPName(SP), FPName(FP) {}
+
+  virtual bool runOnFunction(Function &F);
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.setPreservesCFG();
+  }
+
+private:
+  std::string SPName, FPName;
+  const GlobalVariable *SP, *FP;
+
+  // Results of the final walk.
+  DenseMap<const Value*, int64_t> Deltas;
+  std::vector<StackAccess> Accesses;
+  /// [begin, end) of the outgoing arguments of each call.
+  std::vector<std::pair<int64_t, int64_t> > OutgoingAreas;
+  int64_t LowestEscape;
+
+  bool walkBlock(BasicBlock *BB, RegState &State, bool Record);
+  bool getDelta(const Value *V, int64_t &D) const {
+    DenseMap<const Value*, int64_t>::const_iterator It = Deltas.find(V);
+    if (It == Deltas.end())
+      return false;
+    D = It->second;
+    return true;
+  }
+  void escape(int64_t D) { LowestEscape = std::min(LowestEscape, D); }
+  bool isExcluded(int64_t Begin, int64_t End) const;
+}; // end of struct StackRecovery
+
+static unsigned getAccessSize(Type *Ty) {
+  unsigned Bits = Ty->getPrimitiveSizeInBits();
+  return (Bits == 0 || Bits % 8 != 0) ? 0 : Bits / 8;
+}
+
+/// getOutgoingEnd - The end of the outgoing argument area of a call made
+/// with the stack pointer at CallDelta: the top of the stores in Stores
+/// that cover the stack from CallDelta upwards without a gap.
+static int64_t getOutgoingEnd(int64_t CallDelta,
+  std::vector<std::pair<int64_t, int64_t> > Stores) {
+  std::sort(Stores.begin(), Stores.end());
+  int64_t End = CallDelta;
+  for (unsigned i = 0, e = Stores.size(); i != e; ++i) {
+    if (Stores[i].second <= CallDelta)
+      continue;
+    if (Stores[i].first > End)
+      break;
+    End = std::max(End, Stores[i].second);
+  }
+  return End;
+}
+
+/// Returns false if the stack pointer is lost somewhere in the block.
+bool StackRecovery::walkBlock(BasicBlock *BB, RegState &State, bool Record) {
+  // Stack stores since the block entry or the last call, as [begin, end).
+  std::vector<std::pair<int64_t, int64_t> > Stores;
+  for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+    int64_t D;
+    // Forget what an earlier, less constrained visit concluded.
+    Deltas.erase(I);
+    if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+      Value *Ptr = LI->getPointerOperand();
+      if (GlobalVariable *GV = dyn_cast<GlobalVariable>(Ptr)) {
+        RegState::iterator It = State.find(GV);
+        if (It != State.end())
+          Deltas[LI] = It->second;
+        else if (GV == SP)
+          return false;
+      } else if (Record && getDelta(Ptr, D)) {
+        StackAccess A = { LI, D, getAccessSize(LI->getType()) };
+        Accesses.push_back(A);
+      }
+      continue;
+    }
+
+    if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+      Value *Val = SI->getValueOperand(), *Ptr = SI->getPointerOperand();
+      bool ValIsStack = getDelta(Val, D);
+      if (GlobalVariable *GV = dyn_cast<GlobalVariable>(Ptr)) {
+        if (ValIsStack) {
+          State[GV] = D;
+          // A frame address handed to any other register may be passed on.
+          if (Record && GV != SP && GV != FP)
+            escape(D);
+        } else {
+          if (GV == SP)
+            return false;
+          State.erase(GV);
+        }
+        continue;
+      }
+      if (Record && ValIsStack)
+        escape(D);
+      int64_t PD;
+      if (Record && getDelta(Ptr, PD)) {
+        StackAccess A = { SI, PD, getAccessSize(Val->getType()) };
+        Accesses.push_back(A);
+        Stores.push_back(std::make_pair(PD, PD + A.Size));
+      }
+      continue;
+    }
+
+    if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
+      ConstantInt *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+      Value *X = BO->getOperand(0);
+      if (C == NULL && BO->getOpcode() == Instruction::Add) {
+        C = dyn_cast<ConstantInt>(BO->getOperand(0));
+        X = BO->getOperand(1);
+      }
+      if (C == NULL || C->getBitWidth() > 64 || !getDelta(X, D))
+        continue;
+      if (BO->getOpcode() == Instruction::Add)
+        Deltas[BO] = D + C->getSExtValue();
+      else if (BO->getOpcode() == Instruction::Sub && X == BO->getOperand(0))
+        Deltas[BO] = D - C->getSExtValue();
+      continue;
+    }
+
+    if (isa<IntToPtrInst>(I) || isa<BitCastInst>(I) || isa<PtrToIntInst>(I)) {
+      if (getDelta(I->getOperand(0), D))
+        Deltas[I] = D;
+      continue;
+    }
+
+    if (CallInst *CI = dyn_cast<CallInst>(I)) {
+      // Callees follow the ABI: only SP and FP survive the call.
+      RegState Saved;
+      if (State.count(SP)) Saved[SP] = State[SP];
+      if (FP && State.count(FP)) Saved[FP] = State[FP];
+      State.swap(Saved);
+      if (Record) {
+        if (State.count(SP)) {
+          int64_t CallDelta = State[SP];
+          OutgoingAreas.push_back(std::make_pair(CallDelta,
+              getOutgoingEnd(CallDelta, Stores)));
+        }
+        for (unsigned i = 0, e = CI->getNumArgOperands(); i != e; ++i)
+          if (getDelta(CI->getArgOperand(i), D))
+            escape(D);
+        Stores.clear();
+      }
+      continue;
+    }
+  }
+  return true;
+}
+
+bool StackRecovery::isExcluded(int64_t Begin, int64_t End) const {
+  // Incoming arguments and the return address belong to the caller.
+  if (End > 0)
+    return true;
+  // Anything at or above an escaped address may be reached through it.
+  if (End > LowestEscape)
+    return true;
+  for (unsigned i = 0, e = OutgoingAreas.size(); i != e; ++i)
+    if (Begin < OutgoingAreas[i].second && End > OutgoingAreas[i].first)
+      return true;
+  return false;
+}
+
+} // end anonymous namespace
+
+char StackRecovery::ID = 0;
+
+static RegisterPass<StackRecovery> X("StackRecovery", "Stack frame recovery",
+                                     false /* Only looks at CFG */,
+                                     false /* Analysis Pass */);
+
+FunctionPass* llvm::createStackRecoveryPass(StringRef SPName,
+                                            StringRef FPName) {
+  return new StackRecovery(SPName, FPName);
+}
+
+bool StackRecovery::runOnFunction(Function &F) {
+  if (F.isDeclaration())
+    return false;
+
+  Module *M = F.getParent();
+  SP = SPName.empty() ? NULL : M->getGlobalVariable(SPName);
+  FP = FPName.empty() ? NULL : M->getGlobalVariable(FPName);
+  if (SP == NULL)
+    return false;
+
+  // Forward dataflow: a register keeps its delta at a block entry only if
+  // every visited predecessor agrees on it.
+  DenseMap<BasicBlock*, RegState> EntryStates;
+  std::vector<BasicBlock*> WorkList;
+  EntryStates[&F.getEntryBlock()][SP] = 0;
+  WorkList.push_back(&F.getEntryBlock());
+  Deltas.clear();
+  while (!WorkList.empty()) {
+    BasicBlock *BB = WorkList.back();
+    WorkList.pop_back();
+    RegState State = EntryStates[BB];
+    if (!walkBlock(BB, State, false)) {
+      DEBUG(dbgs() << "StackRecovery: lost SP in " << BB->getName() << "\n");
+      return false;
+    }
+    for (succ_iterator SI = succ_begin(BB), SE = succ_end(BB); SI != SE; ++SI) {
+      DenseMap<BasicBlock*, RegState>::iterator It = EntryStates.find(*SI);
+      if (It == EntryStates.end()) {
+        EntryStates[*SI] = State;
+        WorkList.push_back(*SI);
+        continue;
+      }
+      RegState &Succ = It->second;
+      bool Changed = false;
+      std::vector<const GlobalVariable*> Drop;
+      for (RegState::iterator RI = Succ.begin(), RE = Succ.end(); RI != RE;
+           ++RI) {
+        RegState::iterator Other = State.find(RI->first);
+        if (Other == State.end() || Other->second != RI->second)
+          Drop.push_back(RI->first);
+      }
+      for (unsigned i = 0, e = Drop.size(); i != e; ++i) {
+        Succ.erase(Drop[i]);
+        Changed = true;
+      }
+      if (Changed)
+        WorkList.push_back(*SI);
+    }
+  }
+
+  // Final walk with the fixed entry states to collect the accesses.
+  Deltas.clear();
+  Accesses.clear();
+  OutgoingAreas.clear();
+  LowestEscape = std::numeric_limits<int64_t>::max();
+  for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
+    if (!EntryStates.count(BB))
+      continue;
+    RegState State = EntryStates[BB];
+    walkBlock(BB, State, true);
+  }
+
+  // An access of unknown size could overlap any slot.
+  for (unsigned i = 0, e = Accesses.size(); i != e; ++i)
+    if (Accesses[i].Size == 0) {
+      DEBUG(dbgs() << "StackRecovery: access of unknown size at "
+                   << Accesses[i].Offset << " in " << F.getName() << "\n");
+      return false;
+    }
+
+  // Group overlapping accesses into slots.
+  std::vector<StackAccess> Sorted;
+  for (unsigned i = 0, e = Accesses.size(); i != e; ++i)
+    if (Accesses[i].Offset < 0)
+      Sorted.push_back(Accesses[i]);
+  std::sort(Sorted.begin(), Sorted.end(),
+    [](const StackAccess &A, const StackAccess &B) {
+      return A.Offset < B.Offset;
+    });
+
+  bool Changed = false;
+  Instruction *AllocaPt = F.getEntryBlock().getFirstInsertionPt();
+  LLVMContext &Ctx = F.getContext();
+  for (unsigned Begin = 0, e = Sorted.size(); Begin != e; ) {
+    int64_t SlotBegin = Sorted[Begin].Offset;
+    int64_t SlotEnd = SlotBegin + Sorted[Begin].Size;
+    unsigned End = Begin + 1;
+    while (End != e && Sorted[End].Offset < SlotEnd) {
+      SlotEnd = std::max(SlotEnd, Sorted[End].Offset + Sorted[End].Size);
+      ++End;
+    }
+
+    if (isExcluded(SlotBegin, SlotEnd)) {
+      Begin = End;
+      continue;
+    }
+
+    // A slot that is always accessed whole with one type gets that type, so
+    // mem2reg can promote it directly. Otherwise it is a byte array.
+    Type *SlotTy = NULL;
+    for (unsigned i = Begin; i != End; ++i) {
+      Instruction *I = Sorted[i].Inst;
+      Type *Ty = isa<LoadInst>(I) ? I->getType()
+        : cast<StoreInst>(I)->getValueOperand()->getType();
+      if (Sorted[i].Offset != SlotBegin ||
+          (int64_t)Sorted[i].Size != SlotEnd - SlotBegin ||
+          (SlotTy != NULL && SlotTy != Ty)) {
+        SlotTy = NULL;
+        break;
+      }
+      SlotTy = Ty;
+    }
+    bool Typed = SlotTy != NULL;
+    if (!Typed)
+      SlotTy = ArrayType::get(Type::getInt8Ty(Ctx), SlotEnd - SlotBegin);
+
+    AllocaInst *Slot = new AllocaInst(SlotTy, "stack" + Twine(SlotBegin),
+      AllocaPt);
+    ++NumSlots;
+
+    for (unsigned i = Begin; i != End; ++i) {
+      Instruction *I = Sorted[i].Inst;
+      unsigned PtrIdx = isa<LoadInst>(I) ? 0 : 1;
+      Type *PtrTy = I->getOperand(PtrIdx)->getType();
+      Value *Ptr = Slot;
+      if (!Typed) {
+        Value *Idxs[] = {
+          ConstantInt::get(Type::getInt32Ty(Ctx), 0),
+          ConstantInt::get(Type::getInt32Ty(Ctx), Sorted[i].Offset - SlotBegin)
+        };
+        Ptr = GetElementPtrInst::CreateInBounds(Slot, Idxs, "", I);
+      }
+      if (Ptr->getType() != PtrTy)
+        Ptr = new BitCastInst(Ptr, PtrTy, "", I);
+      I->setOperand(PtrIdx, Ptr);
+      ++NumAccesses;
+    }
+    Changed = true;
+    Begin = End;
+  }
+
+  if (Changed)
+    ++NumFrames;
+  return Changed;
+}
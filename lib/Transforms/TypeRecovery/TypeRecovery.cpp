@@ -13,80 +13,431 @@
 // Works only at the function level. It may be necessary to make this global
 // across the entire decompiled program output.
 //
-// NOTE: Does not do anything useful yet. Placeholder for now.
+// Types are recovered with a unification based constraint solver that runs
+// in near-linear time, so it is cheap enough to run on every lifted function.
+// The recovered pointer types are then used to turn inttoptr address
+// arithmetic into GEPs off typed base pointers, which alias analysis (and so
+// LICM, GVN and the vectorizers) can reason about.
 //
 // Author: Richard Carback (rtc1032) <rcarback@draper.com>
 // Date: January 15, 2014
 //===----------------------------------------------------------------------===//
 
+#define DEBUG_TYPE "typerecovery"
+
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "Transforms/TypeRecovery.h"
 
-#include <list>
+#include <iterator>
+#include <vector>
 
 using namespace llvm;
 
+STATISTIC(NumTypeVars, "Number of type variables created");
+STATISTIC(NumPointers, "Number of values recovered as pointers");
+STATISTIC(NumGEPs, "Number of inttoptr address computations made GEPs");
+
 namespace {
 
+/// TypeSolver - Unification based type inference over a single function.
+///
+/// Every value that takes part in a constraint gets a type variable. Type
+/// variables live in a union-find forest, and each one may point at the
+/// variable describing what it points to, in the style of Steensgaard's
+/// analysis. Each instruction is visited once and each def-use edge adds at
+/// most one union, so solving is near-linear in the size of the function.
+///
+/// Register globals are ordinary memory here: the register contents are the
+/// pointee of the global, so values stored to and loaded from the same
+/// register end up in the same class across blocks.
+class TypeSolver {
+  struct TypeVar {
+    unsigned Parent;
+    unsigned Rank;
+    /// Variable for the memory this one points to, or NoVar.
+    unsigned Pointee;
+    bool IsPointer;
+    bool IsInt;
+    /// Width of accesses through this pointer, 0 until one is seen and
+    /// ~0U once accesses of different widths are seen.
+    unsigned AccessBits;
+  };
+  static const unsigned NoVar = ~0U;
+
+  std::vector<TypeVar> Vars;
+  DenseMap<const Value*, unsigned> VarMap;
+
+  unsigned newVar() {
+    TypeVar TV = { (unsigned)Vars.size(), 0, NoVar, false, false, 0 };
+    Vars.push_back(TV);
+    ++NumTypeVars;
+    return TV.Parent;
+  }
+
+  unsigned getVar(const Value *V) {
+    DenseMap<const Value*, unsigned>::iterator It = VarMap.find(V);
+    if (It != VarMap.end())
+      return It->second;
+    unsigned Var = newVar();
+    VarMap[V] = Var;
+    return Var;
+  }
+
+  unsigned find(unsigned V) {
+    unsigned Root = V;
+    while (Vars[Root].Parent != Root)
+      Root = Vars[Root].Parent;
+    // Path compression.
+    while (Vars[V].Parent != Root) {
+      unsigned Next = Vars[V].Parent;
+      Vars[V].Parent = Root;
+      V = Next;
+    }
+    return Root;
+  }
+
+  unsigned getPointee(unsigned V) {
+    V = find(V);
+    if (Vars[V].Pointee == NoVar) {
+      unsigned P = newVar();
+      Vars[V].Pointee = P;
+    }
+    return find(Vars[V].Pointee);
+  }
+
+  static unsigned mergeBits(unsigned A, unsigned B) {
+    if (A == 0) return B;
+    if (B == 0 || A == B) return A;
+    return ~0U;
+  }
+
+  /// Merges two classes. Merging two pointers merges what they point to as
+  /// well, which is done with an explicit worklist to avoid deep recursion.
+  void unify(unsigned A, unsigned B) {
+    std::vector<std::pair<unsigned, unsigned> > WorkList;
+    WorkList.push_back(std::make_pair(A, B));
+    while (!WorkList.empty()) {
+      unsigned X = find(WorkList.back().first);
+      unsigned Y = find(WorkList.back().second);
+      WorkList.pop_back();
+      if (X == Y)
+        continue;
+      if (Vars[X].Rank < Vars[Y].Rank)
+        std::swap(X, Y);
+      if (Vars[X].Rank == Vars[Y].Rank)
+        ++Vars[X].Rank;
+      Vars[Y].Parent = X;
+      Vars[X].IsPointer |= Vars[Y].IsPointer;
+      Vars[X].IsInt |= Vars[Y].IsInt;
+      Vars[X].AccessBits = mergeBits(Vars[X].AccessBits, Vars[Y].AccessBits);
+      if (Vars[X].Pointee == NoVar)
+        Vars[X].Pointee = Vars[Y].Pointee;
+      else if (Vars[Y].Pointee != NoVar)
+        WorkList.push_back(std::make_pair(Vars[X].Pointee, Vars[Y].Pointee));
+    }
+  }
+
+  void markAccess(const Value *Ptr, Type *AccessTy) {
+    unsigned V = find(getVar(Ptr));
+    Vars[V].IsPointer = true;
+    Vars[V].AccessBits = mergeBits(Vars[V].AccessBits,
+      AccessTy->getPrimitiveSizeInBits());
+  }
+
+  void markInt(const Value *Val) {
+    Vars[find(getVar(Val))].IsInt = true;
+  }
+
+  void visit(Instruction *I);
+
+public:
+  void solve(Function &F) {
+    Vars.clear();
+    VarMap.clear();
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+      visit(&*I);
+  }
+
+  /// \brief True when V is only ever used as an address.
+  bool isPointer(const Value *V) {
+    DenseMap<const Value*, unsigned>::iterator It = VarMap.find(V);
+    if (It == VarMap.end())
+      return false;
+    const TypeVar &TV = Vars[find(It->second)];
+    return TV.IsPointer && !TV.IsInt;
+  }
+
+  /// \brief Returns the recovered type of V, or V's own type when nothing
+  /// better is known. Pointers to memory accessed with mixed widths are i8*.
+  Type *getType(const Value *V) {
+    if (!isPointer(V))
+      return V->getType();
+    const TypeVar &TV = Vars[find(VarMap.find(V)->second)];
+    LLVMContext &Ctx = V->getContext();
+    Type *ElemTy = NULL;
+    if (TV.AccessBits == 0 || TV.AccessBits == ~0U)
+      ElemTy = Type::getInt8Ty(Ctx);
+    else
+      ElemTy = Type::getIntNTy(Ctx, TV.AccessBits);
+    return PointerType::getUnqual(ElemTy);
+  }
+};
+
+void TypeSolver::visit(Instruction *I) {
+  switch (I->getOpcode()) {
+    default:
+      break;
+    case Instruction::Load: {
+      LoadInst *LI = cast<LoadInst>(I);
+      markAccess(LI->getPointerOperand(), LI->getType());
+      unify(getVar(LI), getPointee(getVar(LI->getPointerOperand())));
+      break;
+    }
+    case Instruction::Store: {
+      StoreInst *SI = cast<StoreInst>(I);
+      Value *Val = SI->getValueOperand();
+      markAccess(SI->getPointerOperand(), Val->getType());
+      if (!isa<Constant>(Val))
+        unify(getVar(Val), getPointee(getVar(SI->getPointerOperand())));
+      break;
+    }
+    case Instruction::IntToPtr:
+    case Instruction::PtrToInt:
+    case Instruction::BitCast:
+      unify(getVar(I), getVar(I->getOperand(0)));
+      break;
+    case Instruction::PHI:
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i)
+        if (!isa<Constant>(I->getOperand(i)))
+          unify(getVar(I), getVar(I->getOperand(i)));
+      break;
+    case Instruction::Select:
+      for (unsigned i = 1; i != 3; ++i)
+        if (!isa<Constant>(I->getOperand(i)))
+          unify(getVar(I), getVar(I->getOperand(i)));
+      break;
+    // Adding a constant offset or masking for alignment keeps the base.
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::And: {
+      Value *LHS = I->getOperand(0), *RHS = I->getOperand(1);
+      if (isa<ConstantInt>(RHS) && !isa<Constant>(LHS))
+        unify(getVar(I), getVar(LHS));
+      else if (isa<ConstantInt>(LHS) && !isa<Constant>(RHS) &&
+               I->getOpcode() != Instruction::Sub)
+        unify(getVar(I), getVar(RHS));
+      else if (I->getOpcode() == Instruction::Sub)
+        markInt(I); // Pointer difference.
+      break;
+    }
+    case Instruction::Mul:
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+    case Instruction::Xor:
+      markInt(I);
+      break;
+  }
+}
+
 struct TypeRecovery : public FunctionPass {
   static char ID;
   TypeRecovery() : FunctionPass(ID) {}
 
   virtual bool runOnFunction(Function &F);
 
-  // We don't modify the program, so we preserve all analyses
+  // Address arithmetic is rewritten in place, the CFG is left alone.
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
-    AU.setPreservesAll();
+    AU.setPreservesCFG();
   }
+
+private:
+  TypeSolver Solver;
 }; // end of struct TypeRecovery
 
+/// I2PInfo - An integer address split into Base + Index * Scale + Offset.
+///
+/// Generally, the pattern we are looking for is:
+///  Load
+///   BinOp
+///    BinOp
+///     Binop
+///      ...
+///       IntToPtr
+///        Load
+///         Misc. ...
+///          Store
+/// We want to turn the BinOps to 2nd load into a GEP instruction.
+/// We have to verify:
+///   - Nothing but BinOps between the Load and IntToPtr instruction.
+///   - All BinOps have to result in an aligned offset and divides cleanly by
+///     1, 2, 4, or 8 based on variable size (e.g., i32 load indicates an int)
+///   - Every IntToPtr has to have the same size, otherwise we are dealing with
+///     a struct/class or stack passed variables
+/// Offsets that do not divide cleanly fall back to byte (i8) addressing.
 struct I2PInfo {
-  std::vector<BinaryOperator*> BinOps;
-  LoadInst* StartLoad;
-  LoadInst* EndLoad;
-
-
-
-  // Generally, the pattern we are looking for is:
-  //  Load
-  //   BinOp
-  //    BinOp
-  //     Binop
-  //      ...
-  //       IntToPtr
-  //        Load
-  //         Misc. ...
-  //          Store
-  // We want to turn the BinOps to 2nd load into a GEP instruction.
-  // We have to verify:
-  //   - Nothing but BinOps between the Load and IntToPtr instruction.
-  //   - All BinOps have to result in an aligned offset and divides cleanly by
-  //     1, 2, 4, or 8 based on variable size (e.g., i32 load indicates an int)
-  //   - Every IntToPtr has to have the same size, otherwise we are dealing with
-  //     a struct/class or stack passed variables
-  // Note that there may be ops in between which use all or part of the binop
-  // e.g., usually when loading from the stack or allocating space the stack
-  // pointer gets modified with a binop (and reversed at the end).
+  Value *Base;
+  Value *Index;
+  uint64_t Scale;
+  int64_t Offset;
+
+  /// Returns the scale if V is (X << C) or (X * C), setting Idx to X.
+  static uint64_t getScale(Value *V, Value *&Idx) {
+    BinaryOperator *BO = dyn_cast<BinaryOperator>(V);
+    if (BO == NULL)
+      return 0;
+    ConstantInt *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    if (C == NULL || C->getBitWidth() > 64)
+      return 0;
+    uint64_t S = 0;
+    if (BO->getOpcode() == Instruction::Shl && C->getZExtValue() < 64)
+      S = 1ULL << C->getZExtValue();
+    else if (BO->getOpcode() == Instruction::Mul)
+      S = C->getZExtValue();
+    if (S != 0)
+      Idx = BO->getOperand(0);
+    return S;
+  }
+
   void AnalyzeIntToPtr(IntToPtrInst *IP) {
-    // Build up the use chain 
-    return;
+    Base = IP->getOperand(0);
+    Index = NULL;
+    Scale = 0;
+    Offset = 0;
+    // Base and Offset before the scaled index was split off, for when the
+    // rest of the chain cannot be split and the index has to stay in Base.
+    Value *UnscaledBase = NULL;
+    int64_t UnscaledOffset = 0;
+    while (BinaryOperator *BO = dyn_cast<BinaryOperator>(Base)) {
+      Value *LHS = BO->getOperand(0), *RHS = BO->getOperand(1);
+      ConstantInt *CL = dyn_cast<ConstantInt>(LHS);
+      ConstantInt *CR = dyn_cast<ConstantInt>(RHS);
+      if (BO->getOpcode() == Instruction::Add && CR && CR->getBitWidth() <= 64) {
+        Offset += CR->getSExtValue();
+        Base = LHS;
+      } else if (BO->getOpcode() == Instruction::Add && CL &&
+                 CL->getBitWidth() <= 64) {
+        Offset += CL->getSExtValue();
+        Base = RHS;
+      } else if (BO->getOpcode() == Instruction::Sub && CR &&
+                 CR->getBitWidth() <= 64) {
+        Offset -= CR->getSExtValue();
+        Base = LHS;
+      } else if (BO->getOpcode() == Instruction::Add && Index == NULL &&
+                 (Scale = getScale(RHS, Index)) != 0) {
+        UnscaledBase = Base;
+        UnscaledOffset = Offset;
+        Base = LHS;
+      } else if (BO->getOpcode() == Instruction::Add && Index == NULL &&
+                 (Scale = getScale(LHS, Index)) != 0) {
+        UnscaledBase = Base;
+        UnscaledOffset = Offset;
+        Base = RHS;
+      } else {
+        if (Index != NULL) {
+          Base = UnscaledBase;
+          Offset = UnscaledOffset;
+        }
+        Index = NULL;
+        Scale = 0;
+        break;
+      }
+    }
   }
+};
+
+/// Rewrites inttoptr(Base + Index * Scale + Offset) into a GEP off a typed
+/// base pointer, so alias analysis can see that accesses at different
+/// offsets from the same base do not overlap. One base pointer is made per
+/// (Base, element type) and placed right after the base is defined.
+class GEPRewriter {
+  TypeSolver &Solver;
+  DenseMap<std::pair<Value*, Type*>, Value*> BasePtrs;
 
+  Value *getBasePtr(Value *Base, Type *ElemTy);
+
+public:
+  GEPRewriter(TypeSolver &S) : Solver(S) {}
+  bool rewrite(IntToPtrInst *IP);
 };
 
-void AnalyzeVar(Instruction* Alloca, int depth = 0) {
-  if (depth == 0) outs() << ">" << *Alloca << "\n";
-  for (Value::use_iterator UI = Alloca->use_begin(), E = Alloca->use_end();
-       UI != E; ++UI) {
-    Instruction *User = cast<Instruction>(*UI);
-    for (unsigned int i = 0, e = depth; i != e; ++i) outs() << "=";
-    outs() << "=>" << *User << "\n";
-    AnalyzeVar(User, depth+1);
+Value *GEPRewriter::getBasePtr(Value *Base, Type *ElemTy) {
+  std::pair<Value*, Type*> Key(Base, ElemTy);
+  DenseMap<std::pair<Value*, Type*>, Value*>::iterator It = BasePtrs.find(Key);
+  if (It != BasePtrs.end())
+    return It->second;
+
+  Instruction *I = cast<Instruction>(Base);
+  Instruction *InsertPt = NULL;
+  if (isa<PHINode>(I))
+    InsertPt = I->getParent()->getFirstInsertionPt();
+  else
+    InsertPt = std::next(BasicBlock::iterator(I));
+  Value *Ptr = new IntToPtrInst(Base, ElemTy->getPointerTo(),
+    Base->getName() + ".ptr", InsertPt);
+  BasePtrs[Key] = Ptr;
+  return Ptr;
+}
 
+bool GEPRewriter::rewrite(IntToPtrInst *IP) {
+  I2PInfo Info;
+  Info.AnalyzeIntToPtr(IP);
+  // Nothing to fold, or the base is not defined by an instruction.
+  if (Info.Base == IP->getOperand(0) || !isa<Instruction>(Info.Base))
+    return false;
+
+  PointerType *RecoveredTy = dyn_cast<PointerType>(Solver.getType(Info.Base));
+  if (RecoveredTy == NULL)
+    RecoveredTy = IP->getType();
+  Type *ElemTy = RecoveredTy->getElementType();
+  unsigned Bits = ElemTy->getPrimitiveSizeInBits();
+  if (Bits == 0 || Bits % 8 != 0)
+    return false;
+  int64_t ElemSize = Bits / 8;
+
+  if (Info.Index != NULL && (int64_t)Info.Scale != ElemSize)
+    return false;
+  if (Info.Offset % ElemSize != 0) {
+    if (Info.Index != NULL)
+      return false;
+    ElemTy = Type::getInt8Ty(IP->getContext());
+    ElemSize = 1;
   }
+
+  Value *BasePtr = getBasePtr(Info.Base, ElemTy);
+
+  Type *IdxTy = Info.Base->getType();
+  std::vector<Value*> Idxs;
+  if (Info.Index != NULL)
+    Idxs.push_back(Info.Index);
+  if (Info.Offset != 0 || Idxs.empty())
+    Idxs.push_back(ConstantInt::get(IdxTy, Info.Offset / ElemSize, true));
+
+  Value *Ptr = BasePtr;
+  for (unsigned i = 0, e = Idxs.size(); i != e; ++i)
+    Ptr = GetElementPtrInst::Create(Ptr, Idxs[i], IP->getName(), IP);
+  if (Ptr->getType() != IP->getType())
+    Ptr = new BitCastInst(Ptr, IP->getType(), IP->getName(), IP);
+  if (Instruction *PI = dyn_cast<Instruction>(Ptr))
+    PI->setDebugLoc(IP->getDebugLoc());
+
+  IP->replaceAllUsesWith(Ptr);
+  IP->eraseFromParent();
+  return true;
 }
 
 } // end anonymous namespace
@@ -106,56 +457,33 @@ bool TypeRecovery::runOnFunction(Function &F) {
     return false;
   }
 
-  BasicBlock *BBEntry = &F.getEntryBlock();
-  std::list<Instruction*> WorkList;
-  // Note that the last inst in the basic block is a jump
-  for (BasicBlock::iterator I = BBEntry->begin(), E = --BBEntry->end();
-       I != E; ++I) {
-    if (isa<AllocaInst>(I)) {
-      // WorkList.push_back(I);
-      AnalyzeVar(I);
-    }
-  }
+  Solver.solve(F);
 
-  // if (WorkList.empty()) {
-  //   break;
-  // }
+  std::vector<IntToPtrInst*> I2Ps;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (!isa<IntToPtrInst>(&*I) && !isa<AllocaInst>(&*I))
+      continue;
+    if (Solver.isPointer(&*I))
+      ++NumPointers;
+    DEBUG(dbgs() << "TypeRecovery: " << *Solver.getType(&*I) << " <- "
+                 << *I << "\n");
+    if (IntToPtrInst *IP = dyn_cast<IntToPtrInst>(&*I))
+      I2Ps.push_back(IP);
+  }
 
-  
-  // First, do a pass that converts
+  // Convert
   //  (store var1, inttoptr (add var2, *))
   // to:
   //  (store var1, var2[whatever])
   // And also does the same for load patterns.
-  // This requires us to convert var2 into a pointer of appropriate size (int*)
-  // if 32 bits, (char*) if 8, and so on.
-  // That requires some constraint solving, to make sure the offset is a mult.
-  // of the bitsize, or it could be a struct pointer with different types in it.
-
-  // Walk the function and record:
-  //   - find any vars loaded/used before def, these are parameters of some form
-  //   - find the last store/def of all vars
-
-  uint64_t NumStores = 0;
-  // For starters, take anything that's offset an add/sub from a register
-  // and make it a GEP.
-  // TODO: Figure out if this really belongs in the IREmitter.
-  for (Function::iterator BB = F.begin(), BBE = F.end(); BB != BBE; ++BB) {
-    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
-      IntToPtrInst *I2P = dyn_cast<IntToPtrInst>(I);
-
-      if (I2P == NULL) {
-        continue;
-      }
-      Value* Op1 = I2P->getOperand(0);
-      if (isa<LoadInst>(Op1) || isa<BinaryOperator>(Op1)) {
-        NumStores++;
-      }
+  bool Changed = false;
+  GEPRewriter Rewriter(Solver);
+  for (unsigned i = 0, e = I2Ps.size(); i != e; ++i) {
+    if (Rewriter.rewrite(I2Ps[i])) {
+      ++NumGEPs;
+      Changed = true;
     }
   }
 
-  outs() << "Num Loads and Stores: " << NumStores << "\n";
-
-
-  return false;
+  return Changed;
 }
@@ -0,0 +1,16 @@
+; Runs batch over the ARM build of fib.ll, then again over the same output
+; directory, which must take every result from the checkpoint.
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %S/fib.ll
+; RUN: rm -rf %t.out
+; RUN: printf 'batch %t.out -j 2\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1 2>&1 | FileCheck %s --check-prefix=FIRST
+; RUN: FileCheck %s --check-prefix=CHECKPOINT < %t.out/batch.checkpoint
+; RUN: printf 'batch %t.out -j 2\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1 2>&1 | FileCheck %s --check-prefix=RESUME
+
+; FIRST-NOT: Resuming
+; FIRST: BatchDriver: {{[0-9]+}} decompiled, {{[0-9]+}} skipped, {{[0-9]+}} failed, 0 not attempted.
+
+; CHECKPOINT-DAG: {{done|skip|fail}} 0xf0 fib
+; CHECKPOINT-DAG: {{done|skip|fail}} 0x130 fastfib
+
+; RESUME: BatchDriver: Resuming: {{[0-9]+}} of {{[0-9]+}} functions already in the checkpoint.
+; RESUME-NOT: decompiled,
@@ -0,0 +1,15 @@
+; Lifts fastfib from the ARM build of fib.ll with a budget of three
+; instructions, first degrading the rest of the function to opaque calls,
+; then dropping it.
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %S/fib.ll
+; RUN: printf 'decompile fastfib\nq\n' | fracture-cl -arch=arm -mattr=v6 -max-function-instrs=3 %t1 2>&1 | FileCheck %s --check-prefix=DEGRADE
+; RUN: printf 'decompile fastfib\nq\n' | fracture-cl -arch=arm -mattr=v6 -max-function-instrs=3 -budget-action=skip %t1 2>&1 | FileCheck %s --check-prefix=SKIP
+
+; DEGRADE: fastfib: instruction limit exceeded, the rest of it is lifted as opaque calls.
+; DEGRADE: define void @fastfib() #{{[0-9]+}}
+; DEGRADE: call {{.*}}@fracture.opaque.
+
+; SKIP: Skipping fastfib: instruction limit exceeded.
+; SKIP-NOT: define void @fastfib()
+; SKIP: Unable to decompile function at 130.
+; SKIP-NOT: define void @fastfib()
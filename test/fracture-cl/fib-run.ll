@@ -0,0 +1,6 @@
+; Lifts fastfib out of the ARM build of fib.ll and runs it under the JIT,
+; with its stack traffic going to the mapped guest memory.
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %S/fib.ll
+; RUN: fracture-cl -arch=arm -mattr=v6 %t1 < %S/fib-run.cmds | FileCheck %s
+; CHECK: R0       = 0x00000037
+; CHECK-NEXT: PASS: 0 of 1 registers differ
@@ -0,0 +1,14 @@
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %s
+; RUN: printf 'decompile magic\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1 | FileCheck %s
+
+; ARMv6 has no movw, so the constant is loaded from the literal pool that
+; follows the function. The PC-relative load folds to the value it reads.
+; CHECK-LABEL: define void @magic()
+; CHECK-NOT: inttoptr
+; CHECK: store i32 305419896, i32* @R0
+; CHECK: ret void
+
+define i32 @magic() nounwind {
+entry:
+  ret i32 305419896
+}
@@ -0,0 +1,54 @@
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %s
+; RUN: printf 'decompile sum16\nsave %t.sum16.ll\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1
+; RUN: FileCheck %s --check-prefix=COUNTED < %t.sum16.ll
+; RUN: printf 'decompile sumn\nsave %t.sumn.ll\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1
+; RUN: FileCheck %s --check-prefix=UNCOUNTED < %t.sumn.ll
+
+; sum16 runs its loop 16 times: the latch carries the trip count in its
+; branch weights and in the loop node.
+; COUNTED-LABEL: define void @sum16()
+; COUNTED: br i1 {{.*}}, !prof ![[WEIGHTS:[0-9]+]], !llvm.loop ![[LOOP:[0-9]+]]
+; COUNTED-NOT: "IrreducibleLoops"
+; COUNTED-DAG: ![[WEIGHTS]] = !{!"branch_weights", i32 {{15|1}}, i32 {{1|15}}}
+; COUNTED-DAG: ![[LOOP]] = {{(distinct )?}}!{![[LOOP]], ![[HINT:[0-9]+]]}
+; COUNTED-DAG: ![[HINT]] = !{!"fracture.loop.trip_count", i64 16}
+
+; sumn stops at its argument, so its loop is marked but has no count.
+; UNCOUNTED-LABEL: define void @sumn()
+; UNCOUNTED-NOT: !prof
+; UNCOUNTED: br i1 {{.*}}, !llvm.loop ![[LOOP:[0-9]+]]
+; UNCOUNTED-NOT: "IrreducibleLoops"
+; UNCOUNTED: ![[LOOP]] = {{(distinct )?}}!{![[LOOP]]}
+; UNCOUNTED-NOT: fracture.loop.trip_count
+
+define i32 @sum16() nounwind {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %sum = phi i32 [ 0, %entry ], [ %add, %loop ]
+  %add = add i32 %sum, %i
+  %inc = add i32 %i, 1
+  %cmp = icmp ne i32 %inc, 16
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %add
+}
+
+define i32 @sumn(i32 %n) nounwind {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %sum = phi i32 [ 0, %entry ], [ %add, %loop ]
+  %add = add i32 %sum, %i
+  %inc = add i32 %i, 1
+  %cmp = icmp ult i32 %inc, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %add
+}
@@ -0,0 +1,30 @@
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %s
+; RUN: printf 'decompile check\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1 | FileCheck %s
+
+; abort is known not to return, so the block that calls it ends there
+; rather than running on into whatever follows the call.
+; CHECK-LABEL: define void @check()
+; CHECK: call void @abort()
+; CHECK-NEXT: unreachable
+
+; Internal, so the call to it is resolved in the object.
+define internal void @abort() noreturn nounwind {
+entry:
+  br label %spin
+
+spin:
+  br label %spin
+}
+
+define i32 @check(i32 %x) nounwind {
+entry:
+  %cmp = icmp eq i32 %x, 0
+  br i1 %cmp, label %fail, label %ok
+
+fail:
+  call void @abort() noreturn nounwind
+  unreachable
+
+ok:
+  ret i32 %x
+}
@@ -0,0 +1,16 @@
+; Decompiles fib from the ARM build of fib.ll. Its registers live in SSA
+; values, and only go through the register globals around its calls: those
+; it wrote are stored before a call, and those the call may change are
+; loaded again after it.
+; RUN: llc -filetype=obj -march=arm -mattr=v6 -o %t1 < %S/fib.ll
+; RUN: printf 'decompile fib\nq\n' | fracture-cl -arch=arm -mattr=v6 %t1 | FileCheck %s
+
+; CHECK-LABEL: define void @fib()
+; CHECK-NOT: ret void
+; CHECK: store i32 {{.*}}, i32* @R0
+; CHECK-NOT: ret void
+; CHECK: call void @
+; CHECK-NOT: ret void
+; CHECK: load i32* @R0
+; CHECK: store i32 {{.*}}, i32* @R0
+; CHECK: ret void
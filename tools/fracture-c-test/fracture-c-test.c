@@ -0,0 +1,108 @@
+/*===--- fracture-c-test.c - Driver for the C interface ---------*- C -*-===*\
+|*                                                                            *|
+|*              Fracture: The Draper Decompiler Infrastructure                *|
+|*                                                                            *|
+|* This file is distributed under the University of Illinois Open Source      *|
+|* License. See LICENSE.TXT for details.                                      *|
+|*                                                                            *|
+|*===----------------------------------------------------------------------===*|
+|*                                                                            *|
+|* Exercises the C interface for the lit tests. Each input line holds a       *|
+|* triple and the bytes of a function in hex; they are mapped as executable   *|
+|* memory at BASE and the function is printed either as instructions          *|
+|* (--disassemble) or as the IR it lifts to (--lift). Lines starting with '#' *|
+|* are skipped.                                                               *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+#include "CAPI/Fracture.h"
+#include "llvm-c/BitReader.h"
+#include "llvm-c/Core.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASE 0x1000
+#define MAX_BYTES 1024
+
+static int disassemble(FractureHandleRef H) {
+  const FractureInstruction *Instrs;
+  size_t NumInstrs, i;
+  if (FractureDisassembleFunction(H, BASE, &Instrs, &NumInstrs))
+    return 1;
+  for (i = 0; i != NumInstrs; ++i)
+    printf("%08" PRIx64 ": %s\n", Instrs[i].Address, Instrs[i].Text);
+  return 0;
+}
+
+static int lift(FractureHandleRef H) {
+  const char *Bitcode;
+  size_t Size;
+  LLVMContextRef Ctx;
+  LLVMMemoryBufferRef Buf;
+  LLVMModuleRef M;
+  char *Msg, *IR;
+  int Failed;
+
+  if (FractureLiftFunction(H, BASE, &Bitcode, &Size))
+    return 1;
+  /* The bitcode must stand on its own, so read it in a context of our own. */
+  Ctx = LLVMContextCreate();
+  Buf = LLVMCreateMemoryBufferWithMemoryRange(Bitcode, Size, "lifted", 0);
+  Failed = LLVMParseBitcodeInContext(Ctx, Buf, &M, &Msg);
+  if (Failed) {
+    fprintf(stderr, "Invalid bitcode: %s\n", Msg);
+    LLVMDisposeMessage(Msg);
+  } else {
+    IR = LLVMPrintModuleToString(M);
+    fputs(IR, stdout);
+    LLVMDisposeMessage(IR);
+    LLVMDisposeModule(M);
+  }
+  LLVMDisposeMemoryBuffer(Buf);
+  LLVMContextDispose(Ctx);
+  return Failed;
+}
+
+int main(int argc, char **argv) {
+  char Line[4096];
+  uint8_t Bytes[MAX_BYTES];
+  int Lift, Failed = 0;
+
+  if (argc != 2 || (strcmp(argv[1], "--disassemble") != 0 &&
+                    strcmp(argv[1], "--lift") != 0)) {
+    fprintf(stderr, "usage: %s --disassemble|--lift < input\n", argv[0]);
+    return 2;
+  }
+  Lift = strcmp(argv[1], "--lift") == 0;
+
+  while (fgets(Line, sizeof(Line), stdin) != NULL) {
+    char *Triple, *Tok;
+    size_t Size = 0;
+    FractureHandleRef H;
+
+    if (Line[0] == '#')
+      continue;
+    Triple = strtok(Line, " \t\r\n");
+    if (Triple == NULL)
+      continue;
+    while ((Tok = strtok(NULL, " \t\r\n")) != NULL && Size != MAX_BYTES)
+      Bytes[Size++] = (uint8_t)strtoul(Tok, NULL, 16);
+
+    H = FractureCreateHandle(Triple, NULL, NULL, Bytes, Size, BASE,
+                             FracturePermRead | FracturePermExecute);
+    if (H == NULL) {
+      printf("ERROR: Unable to create a handle for %s\n", Triple);
+      Failed = 1;
+      continue;
+    }
+    if (Lift ? lift(H) : disassemble(H)) {
+      printf("ERROR: %s", FractureGetError(H));
+      Failed = 1;
+    }
+    FractureDisposeHandle(H);
+  }
+  return Failed;
+}
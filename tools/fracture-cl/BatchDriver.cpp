@@ -0,0 +1,423 @@
+//===--- BatchDriver.cpp - Sharded batch decompilation ----------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The parent hands functions to idle workers one address at a time over a
+// pipe and reads back a one byte status. A worker that dies closes its end of
+// the result pipe, which is how the parent notices the crash; the function it
+// was given is then recorded as failed and never handed out again. A worker
+// still busy when its function's time is up is killed and handled the same
+// way.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BatchDriver.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "CodeInv/Decompiler.h"
+#include "CodeInv/Disassembler.h"
+
+#include <algorithm>
+#include <deque>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace fracture {
+
+static bool readFully(int FD, void *Buf, size_t Size) {
+  char *Ptr = static_cast<char *>(Buf);
+  while (Size) {
+    ssize_t N = ::read(FD, Ptr, Size);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Ptr += N;
+    Size -= N;
+  }
+  return true;
+}
+
+static bool writeFully(int FD, const void *Buf, size_t Size) {
+  const char *Ptr = static_cast<const char *>(Buf);
+  while (Size) {
+    ssize_t N = ::write(FD, Ptr, Size);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Ptr += N;
+    Size -= N;
+  }
+  return true;
+}
+
+/// describeExit - Turn a waitpid status into checkpoint text.
+static std::string describeExit(int WStatus) {
+  std::string Result;
+  raw_string_ostream OS(Result);
+  if (WIFSIGNALED(WStatus))
+    OS << "signal " << WTERMSIG(WStatus);
+  else if (WIFEXITED(WStatus))
+    OS << "exit " << WEXITSTATUS(WStatus);
+  else
+    OS << "unknown";
+  return OS.str();
+}
+
+BatchDriver::BatchDriver(Disassembler *NewDis, Decompiler *NewDec,
+  StringRef NewOutDir, unsigned NewNumWorkers, unsigned NewTimeout,
+  raw_ostream &InfoOut, raw_ostream &ErrOut) : Dis(NewDis), Dec(NewDec),
+  OutDir(NewOutDir), NumWorkers(NewNumWorkers ? NewNumWorkers : 1),
+  Timeout(NewTimeout), CheckpointFD(-1), Infos(InfoOut), Errs(ErrOut) {
+  SmallString<256> Path(OutDir);
+  sys::path::append(Path, "batch.checkpoint");
+  CheckpointPath = Path.str();
+}
+
+void BatchDriver::loadCheckpoint() {
+  Finished.clear();
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buf =
+    MemoryBuffer::getFile(CheckpointPath);
+  if (Buf.getError())
+    return;
+
+  // An interrupted run can leave a partial last line; anything that does not
+  // parse is ignored and that function is simply done again.
+  SmallVector<StringRef, 256> Lines;
+  Buf.get()->getBuffer().split(Lines, "\n", -1, false);
+  for (unsigned i = 0, e = Lines.size(); i != e; ++i) {
+    std::pair<StringRef, StringRef> Kind = Lines[i].split(' ');
+    StringRef AddrStr = Kind.second.split(' ').first;
+    uint64_t Address;
+    if (AddrStr.getAsInteger(0, Address))
+      continue;
+    if (Kind.first == "done" || Kind.first == "skip")
+      Finished[Address] = true;
+    else if (Kind.first == "fail")
+      Finished[Address] = false;
+  }
+}
+
+bool BatchDriver::openCheckpoint() {
+  std::error_code EC = sys::fs::openFileForWrite(CheckpointPath, CheckpointFD,
+    sys::fs::F_Append | sys::fs::F_Text);
+  if (EC) {
+    printError("Unable to open " + CheckpointPath + ": " + EC.message());
+    CheckpointFD = -1;
+    return false;
+  }
+  // Terminate a partial line left by an interrupted run.
+  off_t End = ::lseek(CheckpointFD, 0, SEEK_END);
+  if (End > 0) {
+    char Last = '\n';
+    if (::pread(CheckpointFD, &Last, 1, End - 1) == 1 && Last != '\n')
+      writeFully(CheckpointFD, "\n", 1);
+  }
+  return true;
+}
+
+void BatchDriver::recordResult(const FunctionEntry &Entry, StringRef Result,
+  StringRef Reason) {
+  std::string Line;
+  raw_string_ostream OS(Line);
+  OS << Result << " " << format("0x%" PRIx64, Entry.first) << " "
+     << Entry.second;
+  if (!Reason.empty())
+    OS << " " << Reason;
+  OS << "\n";
+  OS.flush();
+  // Written with one write() and synced so a crash of the shell itself
+  // cannot lose or tear a record.
+  if (!writeFully(CheckpointFD, Line.data(), Line.size()) ||
+      ::fsync(CheckpointFD) != 0)
+    printError("Unable to update " + CheckpointPath + ": " + strerror(errno));
+}
+
+bool BatchDriver::spawnWorker(Worker &W) {
+  int Cmd[2], Res[2];
+  if (::pipe(Cmd) != 0)
+    return false;
+  if (::pipe(Res) != 0) {
+    ::close(Cmd[0]);
+    ::close(Cmd[1]);
+    return false;
+  }
+
+  // Anything still buffered would be printed again by the child.
+  outs().flush();
+  errs().flush();
+
+  pid_t Pid = ::fork();
+  if (Pid < 0) {
+    ::close(Cmd[0]); ::close(Cmd[1]);
+    ::close(Res[0]); ::close(Res[1]);
+    return false;
+  }
+
+  if (Pid == 0) {
+    // Drop the parent's ends of the other workers' pipes, or a retired
+    // worker would never see end-of-file on its command pipe.
+    for (unsigned i = 0, e = Workers.size(); i != e; ++i)
+      if (&Workers[i] != &W)
+        retireWorker(Workers[i]);
+    if (CheckpointFD != -1)
+      ::close(CheckpointFD);
+    ::close(Cmd[1]);
+    ::close(Res[0]);
+    runWorker(Cmd[0], Res[1]);
+    // Never returns to the shell; skip destructors shared with the parent.
+    outs().flush();
+    ::_exit(0);
+  }
+
+  ::close(Cmd[0]);
+  ::close(Res[1]);
+  W.Pid = Pid;
+  W.CmdFD = Cmd[1];
+  W.ResFD = Res[0];
+  W.Current = -1;
+  return true;
+}
+
+void BatchDriver::retireWorker(Worker &W) {
+  if (W.CmdFD != -1)
+    ::close(W.CmdFD);
+  if (W.ResFD != -1)
+    ::close(W.ResFD);
+  W.CmdFD = W.ResFD = -1;
+  W.Current = -1;
+}
+
+/// getPollTimeout - Milliseconds until the first busy worker runs out of
+/// time, or -1 to wait for ever.
+int BatchDriver::getPollTimeout() const {
+  if (Timeout == 0)
+    return -1;
+  Clock::time_point Now = Clock::now();
+  Clock::duration Limit = std::chrono::seconds(Timeout);
+  int Result = -1;
+  for (unsigned i = 0, e = Workers.size(); i != e; ++i) {
+    const Worker &W = Workers[i];
+    if (W.Pid == 0 || W.Current == -1)
+      continue;
+    Clock::duration Left = W.Started + Limit - Now;
+    long long Ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      Left).count();
+    // Round up so the worker is really out of time when poll returns.
+    Ms = std::max(0LL, Ms + 1);
+    if (Result == -1 || Ms < Result)
+      Result = (int)std::min<long long>(Ms, INT_MAX);
+  }
+  return Result;
+}
+
+void BatchDriver::runWorker(int CmdFD, int ResFD) {
+  uint64_t Address;
+  while (readFully(CmdFD, &Address, sizeof(Address))) {
+    uint8_t Status = decompileOne(Address);
+    outs().flush();
+    if (!writeFully(ResFD, &Status, sizeof(Status)))
+      break;
+  }
+}
+
+BatchDriver::WorkerStatus BatchDriver::decompileOne(uint64_t Address) {
+  Dis->setSection(Dis->getSectionByAddress(Address));
+  Function *F = Dec->decompileFunction(Address);
+  if (F == NULL || F->empty())
+    return StatusSkipped;
+
+  // Write a standalone module holding only this function's body; everything
+  // it calls or references stays as a declaration.
+  std::unique_ptr<Module> M(CloneModule(Dec->getModule()));
+  for (Module::iterator FI = M->begin(), FE = M->end(); FI != FE; ++FI)
+    if (FI->getName() != F->getName())
+      FI->deleteBody();
+
+  SmallString<256> Path(OutDir);
+  sys::path::append(Path, utohexstr(Address) + ".ll");
+  std::string TmpPath = Path.str().str() + ".tmp";
+  {
+    std::error_code EC;
+    raw_fd_ostream Out(TmpPath, EC, sys::fs::F_Text);
+    if (EC) {
+      printError("Unable to write " + TmpPath + ": " + EC.message());
+      return StatusSkipped;
+    }
+    Out << *M;
+  }
+  // Renamed into place so a crash never leaves a truncated .ll behind.
+  if (sys::fs::rename(TmpPath, Path.str()))
+    return StatusSkipped;
+
+  // Later functions only need the declaration.
+  F->deleteBody();
+  return StatusDone;
+}
+
+unsigned BatchDriver::run(const std::vector<FunctionEntry> &Functions) {
+  if (std::error_code EC = sys::fs::create_directories(OutDir)) {
+    printError("Unable to create " + OutDir + ": " + EC.message());
+    return 0;
+  }
+  loadCheckpoint();
+
+  std::deque<unsigned> Pending;
+  unsigned NumResumed = 0;
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i) {
+    if (Finished.count(Functions[i].first))
+      ++NumResumed;
+    else
+      Pending.push_back(i);
+  }
+  if (NumResumed)
+    printInfo("Resuming: " + utostr(NumResumed) + " of " +
+      utostr(Functions.size()) + " functions already in the checkpoint.");
+  if (Pending.empty())
+    return 0;
+  if (!openCheckpoint())
+    return 0;
+
+  // A worker that dies between jobs must not take the shell with it.
+  void (*OldPipeHandler)(int) = ::signal(SIGPIPE, SIG_IGN);
+
+  Workers.assign(std::min<size_t>(NumWorkers, Pending.size()), Worker());
+  for (unsigned i = 0, e = Workers.size(); i != e; ++i)
+    if (!spawnWorker(Workers[i]))
+      printError("Unable to start worker: " + std::string(strerror(errno)));
+
+  unsigned NumDone = 0, NumSkipped = 0, NumFailed = 0;
+  std::vector<struct pollfd> PollFDs;
+  std::vector<unsigned> PollWorkers;
+  while (true) {
+    // Hand out work to idle workers, and let them go once there is none.
+    for (unsigned i = 0, e = Workers.size(); i != e; ++i) {
+      Worker &W = Workers[i];
+      if (W.Pid == 0 || W.Current != -1)
+        continue;
+      if (Pending.empty()) {
+        retireWorker(W);
+        ::waitpid(W.Pid, NULL, 0);
+        W.Pid = 0;
+        continue;
+      }
+      unsigned Index = Pending.front();
+      uint64_t Address = Functions[Index].first;
+      if (!writeFully(W.CmdFD, &Address, sizeof(Address))) {
+        // Died while idle; not the fault of this function.
+        retireWorker(W);
+        ::waitpid(W.Pid, NULL, 0);
+        W.Pid = 0;
+        if (!spawnWorker(W))
+          printError("Unable to restart worker.");
+        continue;
+      }
+      Pending.pop_front();
+      W.Current = Index;
+      W.Started = Clock::now();
+    }
+
+    PollFDs.clear();
+    PollWorkers.clear();
+    for (unsigned i = 0, e = Workers.size(); i != e; ++i) {
+      if (Workers[i].Pid == 0 || Workers[i].Current == -1)
+        continue;
+      struct pollfd P;
+      P.fd = Workers[i].ResFD;
+      P.events = POLLIN;
+      P.revents = 0;
+      PollFDs.push_back(P);
+      PollWorkers.push_back(i);
+    }
+    if (PollFDs.empty())
+      break;
+
+    if (::poll(&PollFDs[0], PollFDs.size(), getPollTimeout()) < 0) {
+      if (errno == EINTR)
+        continue;
+      printError("poll failed: " + std::string(strerror(errno)));
+      break;
+    }
+
+    Clock::time_point Now = Clock::now();
+    for (unsigned p = 0, pe = PollFDs.size(); p != pe; ++p) {
+      Worker &W = Workers[PollWorkers[p]];
+      const FunctionEntry &Entry = Functions[W.Current];
+      if (!PollFDs[p].revents) {
+        if (Timeout == 0 || Now - W.Started < std::chrono::seconds(Timeout))
+          continue;
+        // Out of time: blame the function like a crash.
+        ::kill(W.Pid, SIGKILL);
+        retireWorker(W);
+        ::waitpid(W.Pid, NULL, 0);
+        W.Pid = 0;
+        std::string Why = "timeout " + utostr(Timeout) + "s";
+        recordResult(Entry, "fail", Why);
+        printError(Entry.second + " (0x" + utohexstr(Entry.first) +
+          ") took longer than " + utostr(Timeout) + "s, killed its worker.");
+        ++NumFailed;
+        if (!Pending.empty() && !spawnWorker(W))
+          printError("Unable to restart worker.");
+        continue;
+      }
+      uint8_t Status;
+      if (readFully(W.ResFD, &Status, sizeof(Status))) {
+        if (Status == StatusDone) {
+          recordResult(Entry, "done");
+          ++NumDone;
+        } else {
+          recordResult(Entry, "skip");
+          ++NumSkipped;
+        }
+        W.Current = -1;
+        continue;
+      }
+
+      // The worker went away mid-function: blame the function, replace the
+      // worker with a fresh fork of the pre-loaded shell.
+      int WStatus = 0;
+      retireWorker(W);
+      ::waitpid(W.Pid, &WStatus, 0);
+      W.Pid = 0;
+      std::string Why = describeExit(WStatus);
+      recordResult(Entry, "fail", Why);
+      printError(Entry.second + " (0x" + utohexstr(Entry.first) +
+        ") crashed its worker: " + Why);
+      ++NumFailed;
+      if (!Pending.empty() && !spawnWorker(W))
+        printError("Unable to restart worker.");
+    }
+  }
+
+  Workers.clear();
+  ::signal(SIGPIPE, OldPipeHandler);
+  ::close(CheckpointFD);
+  CheckpointFD = -1;
+
+  printInfo(utostr(NumDone) + " decompiled, " + utostr(NumSkipped) +
+    " skipped, " + utostr(NumFailed) + " failed, " + utostr(Pending.size()) +
+    " not attempted.");
+  return NumFailed;
+}
+
+} // end namespace fracture
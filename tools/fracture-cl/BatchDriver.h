@@ -0,0 +1,114 @@
+//===--- BatchDriver.h - Sharded batch decompilation ------------*- C++ -*-===//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Decompiles a list of functions with a pool of worker processes forked from
+// the shell after the binary is loaded, so every worker starts from the same
+// pre-loaded state. A worker that crashes, or spends longer than the timeout
+// on one function, only loses the function it was working on: that function
+// is recorded as failed and a fresh worker takes its place.
+//
+// Each finished function is written to <outdir>/<address>.ll and appended to
+// <outdir>/batch.checkpoint, which a later run reads to skip work that has
+// already been done.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BATCHDRIVER_H_
+#define BATCHDRIVER_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace fracture {
+
+class Decompiler;
+class Disassembler;
+
+class BatchDriver {
+public:
+  /// A function to decompile: its entry address and symbol name.
+  typedef std::pair<uint64_t, std::string> FunctionEntry;
+
+  /// Workers get Timeout seconds per function, or forever if it is 0.
+  BatchDriver(Disassembler *NewDis, Decompiler *NewDec, llvm::StringRef OutDir,
+    unsigned NumWorkers, unsigned Timeout = 0,
+    llvm::raw_ostream &InfoOut = llvm::nulls(),
+    llvm::raw_ostream &ErrOut = llvm::nulls());
+
+  ///===-------------------------------------------------------------------===//
+  /// run - Decompile every function not already in the checkpoint.
+  ///
+  /// @param Functions - the functions to decompile.
+  /// @return the number of functions that crashed their worker or ran out
+  /// of time.
+  ///
+  unsigned run(const std::vector<FunctionEntry> &Functions);
+
+private:
+  /// Status a worker reports back for each function.
+  enum WorkerStatus {
+    StatusDone = 0,   ///< IR written to the output directory.
+    StatusSkipped = 1 ///< The decompiler did not produce a function.
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Worker {
+    pid_t Pid;
+    int CmdFD;
+    int ResFD;
+    /// Index into Functions of the function in flight, or -1 when idle.
+    int Current;
+    /// When the function in flight was handed out.
+    Clock::time_point Started;
+    Worker() : Pid(0), CmdFD(-1), ResFD(-1), Current(-1) {}
+  };
+
+  Disassembler *Dis;
+  Decompiler *Dec;
+  std::string OutDir;
+  std::string CheckpointPath;
+  unsigned NumWorkers;
+  unsigned Timeout;
+  /// Addresses recorded in the checkpoint, mapped to whether they succeeded.
+  llvm::DenseMap<uint64_t, bool> Finished;
+  int CheckpointFD;
+  std::vector<Worker> Workers;
+
+  void loadCheckpoint();
+  bool openCheckpoint();
+  void recordResult(const FunctionEntry &Entry, llvm::StringRef Result,
+    llvm::StringRef Reason = "");
+
+  bool spawnWorker(Worker &W);
+  void retireWorker(Worker &W);
+  int getPollTimeout() const;
+  void runWorker(int CmdFD, int ResFD);
+  WorkerStatus decompileOne(uint64_t Address);
+
+  /// Error printing
+  llvm::raw_ostream &Infos, &Errs;
+  void printInfo(std::string Msg) const {
+    Infos << "BatchDriver: " << Msg << "\n";
+  }
+  void printError(std::string Msg) const {
+    Errs << "BatchDriver: " << Msg << "\n";
+    Errs.flush();
+  }
+};
+
+} // end namespace fracture
+
+#endif /* BATCHDRIVER_H_ */
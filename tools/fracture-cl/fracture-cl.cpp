@@ -18,6 +18,7 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/CodeGen/GCMetadata.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
@@ -63,11 +64,19 @@
 #include <iomanip>
 #include <stdio.h>
 #include <fstream>
+#include <thread>
+#include "BatchDriver.h"
 #include "BinFun.h"
-#include "DummyObjectFile.h"
+#include "CodeInv/AddressSpace.h"
+#include "CodeInv/CostModel.h"
 #include "CodeInv/Decompiler.h"
 #include "CodeInv/Disassembler.h"
+#include "CodeInv/DummyObjectFile.h"
+#include "CodeInv/ProjectDB.h"
 #include "CodeInv/StrippedDisassembler.h"
+#include "Execution/BlockTranslator.h"
+#include "Execution/LiftedRunner.h"
+#include "Execution/Recompiler.h"
 //#include "CodeInv/InvISelDAG.h"
 //#include "CodeInv/MCDirector.h"
 #include "Commands/Commands.h"
@@ -95,6 +104,9 @@ Decompiler *DEC = 0;
 StrippedDisassembler *SDAS = 0;
 std::unique_ptr<object::ObjectFile> TempExecutable;
 bool isStripped = false;
+std::unique_ptr<ProjectDB> Project;
+/// Names given with "project name" that have not been saved yet.
+std::map<uint64_t, std::string> ProjectNames;
 
 //Command Line Options
 cl::opt<std::string> TripleName("triple",
@@ -106,6 +118,10 @@ cl::opt<std::string> ArchName("arch",
 cl::opt<std::string> InputFileName(cl::Positional, cl::desc("<input file>"),
     cl::init("-"));
 
+cl::opt<std::string> MCPU("mcpu",
+    cl::desc("Target CPU whose scheduling model the cost command uses"),
+    cl::value_desc("cpu-name"), cl::init("generic"));
+
 cl::list<std::string> MAttrs("mattr", cl::CommaSeparated,
     cl::desc("Target specific attributes"), cl::value_desc("a1,+a2,-a3,..."));
 
@@ -121,6 +137,15 @@ static cl::opt<bool> StrippedBinary("stripped", cl::Hidden,
 static cl::opt<bool> printGraph("print-graph", cl::Hidden,
     cl::desc("Print graph for stripped file, must also enable stripped command"));
 
+static cl::opt<std::string> ProjectFileName("project",
+    cl::desc("Open a project database saved with 'project save'"),
+    cl::value_desc("filename"));
+
+static cl::list<std::string> RegionSpecs("region",
+    cl::desc("Map part of a raw file at an address instead of loading the "
+        "input file; may be repeated. PERMS is a subset of rwx"),
+    cl::value_desc("file[:offset[:size]]@vaddr[:perms]"));
+
 
 static bool error(std::error_code ec) {
   if (!ec)
@@ -130,14 +155,97 @@ static bool error(std::error_code ec) {
   return true;
 }
 
+/// haveBinary - Returns true if a binary is loaded. Otherwise, e.g. in a
+/// -project session without one, prints an error for Command.
+static bool haveBinary(StringRef Command) {
+  if (DAS != NULL && DEC != NULL)
+    return true;
+  errs() << Command << ": no binary loaded, use 'load <file>' first.\n";
+  return false;
+}
+
+///===---------------------------------------------------------------------===//
+/// loadRegions     - Builds a raw object out of the -region options, e.g. the
+/// flash and boot ROM dumps of a firmware image, and sets the ObjectFile.
+/// Every region is mapped from its file rather than read.
+///
+static std::error_code loadRegions() {
+  std::unique_ptr<object::DummyObjectFile> Obj;
+  AddressSpace Space;
+  for (unsigned i = 0, e = RegionSpecs.size(); i != e; ++i) {
+    StringRef Spec = RegionSpecs[i];
+    std::pair<StringRef, StringRef> Where = Spec.rsplit('@');
+    std::pair<StringRef, StringRef> Addr = Where.second.split(':');
+    StringRef File = Where.first, OffStr, SizeStr;
+    std::tie(File, OffStr) = File.split(':');
+    std::tie(OffStr, SizeStr) = OffStr.split(':');
+
+    uint64_t Offset = 0, Size = 0, VAddr = 0, FileSize = 0;
+    unsigned Perms = 0;
+    bool Bad = Where.second.empty() || File.empty()
+      || Addr.first.getAsInteger(0, VAddr)
+      || (!OffStr.empty() && OffStr.getAsInteger(0, Offset))
+      || (!SizeStr.empty() && SizeStr.getAsInteger(0, Size));
+    StringRef PermStr = Addr.second.empty() ? "rwx" : Addr.second;
+    for (unsigned j = 0; j != PermStr.size(); ++j) {
+      switch (PermStr[j]) {
+        case 'r': Perms |= AddressSpace::Read; break;
+        case 'w': Perms |= AddressSpace::Write; break;
+        case 'x': Perms |= AddressSpace::Execute; break;
+        default: Bad = true; break;
+      }
+    }
+    if (Bad) {
+      errs() << ProgramName << ": Bad region '" << Spec
+             << "', expected file[:offset[:size]]@vaddr[:perms].\n";
+      return make_error_code(std::errc::invalid_argument);
+    }
+
+    if (std::error_code EC = sys::fs::file_size(File, FileSize)) {
+      errs() << ProgramName << ": No such file or directory: '" << File
+             << "'.\n";
+      return EC;
+    }
+    if (SizeStr.empty())
+      Size = Offset < FileSize ? FileSize - Offset : 0;
+    if (Size == 0 || Offset + Size > FileSize) {
+      errs() << ProgramName << ": Region '" << Spec
+             << "' is empty or runs past the end of the file.\n";
+      return make_error_code(std::errc::invalid_argument);
+    }
+
+    ErrorOr<std::unique_ptr<MemoryBuffer> > Buf =
+      MemoryBuffer::getFileSlice(File, Size, Offset);
+    if (std::error_code EC = Buf.getError()) {
+      errs() << ProgramName << ": Bad Memory!: '" << File << "'.\n";
+      return EC;
+    }
+    if (!Space.addRegion(VAddr, Buf.get()->getBuffer(), Perms, Spec)) {
+      errs() << ProgramName << ": Region '" << Spec
+             << "' overlaps an earlier region.\n";
+      return make_error_code(std::errc::invalid_argument);
+    }
+
+    if (!Obj) {
+      std::error_code EC;
+      Obj.reset(new object::DummyObjectFile(Buf.get(), EC, VAddr, Perms));
+    } else {
+      Obj->addRegion(std::move(Buf.get()), VAddr, Perms);
+    }
+  }
+
+  TempExecutable.reset(Obj.release());
+  return std::error_code();
+}
+
 ///===---------------------------------------------------------------------===//
-/// loadBinary      - Tries to open the file and set the ObjectFile.
+/// openBinary      - Tries to open the file and set the ObjectFile.
 /// NOTE: Binary is a subclass of ObjectFile, but Binary multiply inherits
 /// from Archive as well, and we want objects in a format with sections.
 ///
 /// @param FileName - The name of the file to open.
 ///
-static std::error_code loadBinary(StringRef FileName) {
+static std::error_code openBinary(StringRef FileName) {
   // File should be stdin or it should exist.
   if (FileName != "-" && !sys::fs::exists(FileName)) {
     errs() << ProgramName << ": No such file or directory: '" << FileName.data()
@@ -172,6 +280,21 @@ static std::error_code loadBinary(StringRef FileName) {
     }
   }
 
+  return std::error_code();
+}
+
+///===---------------------------------------------------------------------===//
+/// loadBinary      - Sets the ObjectFile from the file, or from the -region
+/// options when there are any, and initializes the disassembler for it.
+///
+/// @param FileName - The name of the file to open.
+///
+static std::error_code loadBinary(StringRef FileName) {
+  std::error_code EC =
+    RegionSpecs.empty() ? openBinary(FileName) : loadRegions();
+  if (EC)
+    return EC;
+
   // Initialize the Disassembler
   std::string FeaturesStr;
   if (MAttrs.size()) {
@@ -195,11 +318,10 @@ static std::error_code loadBinary(StringRef FileName) {
 
   TripleName = TT.str();
 
+  // The decompiler owns the disassembler, which owns the director.
   delete DEC;
-  delete DAS;
-  delete MCD;
 
-  MCD = new MCDirector(TripleName, "generic", FeaturesStr,
+  MCD = new MCDirector(TripleName, MCPU, FeaturesStr,
     TargetOptions(), Reloc::DynamicNoPIC, CodeModel::Default, CodeGenOpt::Default,
     outs(), errs());
   DAS = new Disassembler(MCD, TempExecutable.release(), NULL, outs(), outs());
@@ -235,6 +357,46 @@ static void printHelp(std::vector<std::string> &CommandLine) {
         outs() << "? - Displays usable commands and descriptions "
                << "of their uses\n\n\n";
         break;
+      case  str2int("batch") :
+        outs() << "batch - Decompile every function in the binary\n"
+               << "USAGE:\n"
+               << "\tbatch [OUTDIR] [-j WORKERS] [-timeout SECONDS]\n"
+               << "DESCRIPTION:\n"
+               << "\tDecompile each function symbol with WORKERS processes "
+               << "(default: one per\n\tcore) and write it to "
+               << "OUTDIR/<address>.ll. A function that crashes\n\tits "
+               << "worker, or takes longer than SECONDS (default 300, 0 for "
+               << "no\n\tlimit), is skipped and a new worker is started. "
+               << "Progress is kept in\n\tOUTDIR/batch.checkpoint; running "
+               << "batch again resumes where the last\n\trun stopped and "
+               << "does not retry failed functions.\n\n\n";
+        break;
+      case  str2int("bench") :
+        outs() << "bench - Time a decompiled function under the JIT\n"
+               << "USAGE:\n"
+               << "\tbench [FUNCNAME] [-O<n>] [-n COUNT] [-dbt] "
+               << "[-superblock N] [REG=VALUE ...]\n\t[expect REG=VALUE ...]\n"
+               << "DESCRIPTION:\n"
+               << "\tJIT-compile the decompiled module at the given "
+               << "optimization level,\n\tcall the function COUNT times "
+               << "with the given input registers and\n\treport ns/call. "
+               << "Registers listed after expect are checked\n\tagainst "
+               << "their reference values. See run for -dbt.\n\n\n";
+        break;
+      case  str2int("cost") :
+        outs() << "cost - Estimate the cycles of the original machine code\n"
+               << "USAGE:\n"
+               << "\tcost [FUNCNAME or FUNCADDRESS] [-profile FILE] "
+               << "[-n COUNT]\n"
+               << "DESCRIPTION:\n"
+               << "\tEstimate throughput and latency of every block and "
+               << "loop of a function\n\tfrom the scheduling model of the "
+               << "-mcpu CPU. Without a function,\n\trank all functions by "
+               << "estimated cycles, times their weight in the\n\tprofile "
+               << "if one is given (lines of ADDRESS WEIGHT; functions not\n"
+               << "\tin it are left out). -n shows only the first COUNT.\n"
+               << "\tLoops are assumed to run -cost-loop-trips times.\n\n\n";
+        break;
       case  str2int("decompile") :
         outs() << "decompile - Decompile a given function\n"
                << "USAGE:\n"
@@ -267,9 +429,54 @@ static void printHelp(std::vector<std::string> &CommandLine) {
                << "\tLoad a given binary into Fracture while Fracture is "
                << "already running\n\n\n";
         break;
+      case  str2int("project") :
+        outs() << "project - Save, reopen and query a project database\n"
+               << "USAGE:\n"
+               << "\tproject open FILE | save FILE | info | functions\n"
+               << "\tproject dis|cfg|calls|ir [FUNCNAME or FUNCADDRESS]\n"
+               << "\tproject name [ADDRESS] [NAME]\n"
+               << "DESCRIPTION:\n"
+               << "\tsave writes the sections, symbols, disassembly, CFGs, "
+               << "call graph,\n\tnames and lifted IR of this session "
+               << "(and of the open project)\n\tto FILE. The other "
+               << "subcommands answer from the open project\n\twithout "
+               << "analyzing the binary again. name sets an analyst name,\n"
+               << "\tkept on the next save.\n\n\n";
+        break;
       case  str2int("quit") :
         outs() << "quit - Terminate the application\n\n\n";
         break;
+      case  str2int("recompile") :
+        outs() << "recompile - Compile decompiled LLVM IR to native code\n"
+               << "USAGE:\n"
+               << "\trecompile [FILENAME] [-O<n>] [-triple TRIPLE] "
+               << "[-mcpu CPU] [-j THREADS] [-fPIC]\n"
+               << "DESCRIPTION:\n"
+               << "\tOptimize the decompiled module (default -O2) and write "
+               << "an object file\n\tfor the host, or the given triple. With "
+               << "-mcpu the code is tuned for\n\tCPU instead of a generic "
+               << "one of its target. With -j the functions\n\tare split "
+               << "across THREADS objects named FILENAME.<n>.o and compiled "
+               << "in\n\tparallel. Use -fPIC for objects that go into a "
+               << "shared library.\n\n\n";
+        break;
+      case  str2int("run") :
+        outs() << "run - Execute a decompiled function under the JIT\n"
+               << "USAGE:\n"
+               << "\trun [FUNCNAME] [-O<n>] [-dbt] [-superblock N] "
+               << "[REG=VALUE ...]\n\t[expect REG=VALUE ...]\n"
+               << "DESCRIPTION:\n"
+               << "\tJIT-compile the decompiled module, set the input "
+               << "registers and run\n\tthe function once. Registers listed "
+               << "after expect are printed and\n\tcompared against their "
+               << "reference values. The run fails if it reaches\n\ta "
+               << "function that was not decompiled. With -dbt, nothing "
+               << "needs\n\tto be decompiled first: code is lifted and "
+               << "compiled in traces "
+               << "of up\n\tto N basic blocks (default 8) as execution "
+               << "reaches it, against a\n\tcopy of the binary's "
+               << "memory.\n\n\n";
+        break;
       case  str2int("save") :
         outs() << "save - Save LLVM IR to a file\n"
                << "USAGE:\n"
@@ -421,6 +628,8 @@ static bool nameLookupAddr(StringRef funcName, uint64_t &Address) {
 /// @param Executable - The executable under analysis.
 ///
 static void runDecompileCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("decompile"))
+    return;
   uint64_t Address;
   StringRef FunctionName;
 
@@ -458,6 +667,8 @@ static void runDecompileCommand(std::vector<std::string> &CommandLine) {
 /// @param Executable - The executable under analysis.
 ///
 static void runDisassembleCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("disassemble"))
+    return;
   uint64_t NumInstrs, Address, NumInstrsPrinted;
   StringRef FunctionName;
 
@@ -505,6 +716,8 @@ static void runDisassembleCommand(std::vector<std::string> &CommandLine) {
 }
 
 static void runSectionsCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("sections"))
+    return;
   outs() << "Sections:\n"
          << "Idx Name               Size      Address          Type\n";
   std::error_code ec;
@@ -866,6 +1079,8 @@ static void dumpCOFFSymbols(const object::COFFObjectFile *coff,
 }
 
 static void runSymbolsCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("symbols"))
+    return;
   if (CommandLine.size() < 2) {
     outs() << "Did not understand section name or address.\n";
     return;
@@ -921,6 +1136,8 @@ static void runSymbolsCommand(std::vector<std::string> &CommandLine) {
 /// runSaveCommand - Saves current module to a .ll file
 ///
 static void runSaveCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("save"))
+    return;
   if (CommandLine.size() != 2) {
     outs() << "usage: save <filename.ll>\n";
     return;
@@ -946,6 +1163,8 @@ static void runQuitCommand(std::vector<std::string> &CommandLine) {
 }
 
 static void runDumpCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("dump"))
+    return;
   uint64_t NumLinesToDump, Address;
   StringRef NumLinesRef;
 
@@ -1021,6 +1240,690 @@ static void runDumpCommand(std::vector<std::string> &CommandLine) {
   }
 }
 
+typedef std::vector<std::pair<std::string, uint64_t> > RegisterValues;
+
+///===---------------------------------------------------------------------===//
+/// checkRegisters - Prints the registers in Expected after a run and
+/// compares them against their reference values.
+///
+template <typename RunnerT>
+static void checkRegisters(RunnerT &Runner, const RegisterValues &Expected) {
+  unsigned Failures = 0;
+  for (unsigned i = 0, e = Expected.size(); i != e; ++i) {
+    uint64_t Value;
+    if (!Runner.getRegister(Expected[i].first, Value))
+      return;
+    bool Match = Value == Expected[i].second;
+    if (!Match)
+      ++Failures;
+    outs() << format("%-8s = 0x%08" PRIx64, Expected[i].first.c_str(), Value);
+    if (!Match)
+      outs() << format("  MISMATCH (expected 0x%08" PRIx64 ")",
+        Expected[i].second);
+    outs() << "\n";
+  }
+  if (!Expected.empty())
+    outs() << (Failures ? "FAIL" : "PASS") << ": " << Failures << " of "
+           << Expected.size() << " registers differ\n";
+}
+
+///===---------------------------------------------------------------------===//
+/// runTranslated - The run and bench commands under -dbt. The code at Address
+/// is translated trace by trace as it runs, against a copy of the binary's
+/// memory.
+///
+static void runTranslated(uint64_t Address, StringRef FunctionName,
+  bool Bench, unsigned OptLevel, unsigned MaxBlocks, unsigned Iterations,
+  StringRef SPName, const RegisterValues &Inputs,
+  const RegisterValues &Expected) {
+  BlockTranslator Translator(DEC, OptLevel, MaxBlocks, nulls(), errs());
+  if (!Translator.isValid() || !Translator.mapMemory(SPName, 1 << 20))
+    return;
+
+  for (unsigned i = 0, e = Inputs.size(); i != e; ++i)
+    if (!Translator.setRegister(Inputs[i].first, Inputs[i].second))
+      return;
+
+  double NsPerCall = 0;
+  if (Bench) {
+    NsPerCall = Translator.bench(Address, Iterations);
+    if (NsPerCall < 0)
+      return;
+  } else if (!Translator.run(Address)) {
+    return;
+  }
+
+  checkRegisters(Translator, Expected);
+
+  if (Bench)
+    outs() << FunctionName << " -O" << OptLevel << " -dbt: "
+           << format("%.2f", NsPerCall) << " ns/call over " << Iterations
+           << " calls\n";
+  Translator.printStatistics(outs());
+}
+
+///===---------------------------------------------------------------------===//
+/// runLiftedFunction - Shared implementation of the run and bench commands.
+/// JIT-compiles the decompiled module, seeds the register file, executes the
+/// function and checks the registers against any expected values. With -dbt,
+/// the code is instead translated trace by trace as it runs, from the binary
+/// rather than the decompiled module.
+///
+/// @param CommandLine - <cmd> <function> [-O<n>] [-n <count>] [-dbt]
+///                      [-superblock <blocks>] [REG=VALUE ...]
+///                      [expect REG=VALUE ...]
+/// @param Bench - Time Iterations calls and report ns/call.
+///
+static void runLiftedFunction(std::vector<std::string> &CommandLine,
+  bool Bench) {
+  if (!haveBinary(CommandLine[0]))
+    return;
+  if (CommandLine.size() < 2) {
+    errs() << CommandLine[0] << " <function> [-O<n>] [-n <count>] [-dbt] "
+           << "[-superblock <blocks>] [REG=VALUE ...] "
+           << "[expect REG=VALUE ...]\n";
+    return;
+  }
+
+  std::string FunctionName = CommandLine[1];
+  uint64_t Address;
+  bool HaveAddress = !StringRef(FunctionName).getAsInteger(0, Address);
+  if (HaveAddress)
+    FunctionName = DAS->getFunctionName(Address);
+
+  unsigned OptLevel = 0, Iterations = 100000, MaxBlocks = 8;
+  bool InExpect = false, Translate = false;
+  RegisterValues Inputs, Expected;
+  for (unsigned i = 2, e = CommandLine.size(); i != e; ++i) {
+    StringRef Arg = CommandLine[i];
+    if (Arg == "expect") {
+      InExpect = true;
+      continue;
+    }
+    if (Arg.startswith("-O")) {
+      if (Arg.substr(2).getAsInteger(10, OptLevel) || OptLevel > 3) {
+        errs() << "Invalid optimization level: " << Arg << "\n";
+        return;
+      }
+      continue;
+    }
+    if (Arg == "-n" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, Iterations)) {
+        errs() << "Invalid iteration count: " << CommandLine[i] << "\n";
+        return;
+      }
+      continue;
+    }
+    if (Arg == "-dbt") {
+      Translate = true;
+      continue;
+    }
+    if (Arg == "-superblock" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, MaxBlocks)
+          || MaxBlocks == 0) {
+        errs() << "Invalid superblock size: " << CommandLine[i] << "\n";
+        return;
+      }
+      continue;
+    }
+    std::pair<StringRef, StringRef> RegVal = Arg.split('=');
+    uint64_t Value;
+    if (RegVal.second.empty() || RegVal.second.getAsInteger(0, Value)) {
+      errs() << "Invalid register assignment: " << Arg << "\n";
+      return;
+    }
+    (InExpect ? Expected : Inputs).push_back(
+      std::make_pair(RegVal.first.upper(), Value));
+  }
+
+  // Give the function a stack if it uses the stack pointer.
+  const TargetLowering *TLI =
+    MCD->getTargetMachine()->getSubtargetImpl()->getTargetLowering();
+  unsigned SPReg = TLI ? TLI->getStackPointerRegisterToSaveRestore() : 0;
+
+  if (Translate) {
+    if (!HaveAddress && !nameLookupAddr(FunctionName, Address)) {
+      errs() << "Error retrieving address based on function name.\n";
+      return;
+    }
+    runTranslated(Address, FunctionName, Bench, OptLevel, MaxBlocks,
+      Iterations, SPReg ? MCD->getMCRegisterInfo()->getName(SPReg) : "",
+      Inputs, Expected);
+    return;
+  }
+
+  LiftedRunner Runner(DEC->getModule(), OptLevel, nulls(), errs());
+  StringRef SPName;
+  if (SPReg != 0 && DEC->getModule()->getGlobalVariable(
+        MCD->getMCRegisterInfo()->getName(SPReg)) != NULL)
+    SPName = MCD->getMCRegisterInfo()->getName(SPReg);
+  if (!Runner.isValid()
+      || !Runner.mapMemory(DAS->getMemory(), SPName, 1 << 20))
+    return;
+
+  for (unsigned i = 0, e = Inputs.size(); i != e; ++i)
+    if (!Runner.setRegister(Inputs[i].first, Inputs[i].second))
+      return;
+
+  double NsPerCall = 0;
+  if (Bench) {
+    NsPerCall = Runner.bench(FunctionName, Iterations);
+    if (NsPerCall < 0)
+      return;
+  } else if (!Runner.run(FunctionName)) {
+    return;
+  }
+
+  checkRegisters(Runner, Expected);
+
+  if (Bench)
+    outs() << FunctionName << " -O" << OptLevel << ": "
+           << format("%.2f", NsPerCall) << " ns/call over " << Iterations
+           << " calls\n";
+}
+
+///===---------------------------------------------------------------------===//
+/// runRunCommand - JIT-compile and execute a decompiled function once.
+///
+static void runRunCommand(std::vector<std::string> &CommandLine) {
+  runLiftedFunction(CommandLine, false);
+}
+
+///===---------------------------------------------------------------------===//
+/// runBenchCommand - JIT-compile and time a decompiled function.
+///
+static void runBenchCommand(std::vector<std::string> &CommandLine) {
+  runLiftedFunction(CommandLine, true);
+}
+
+///===---------------------------------------------------------------------===//
+/// runRecompileCommand - Optimize the decompiled module and emit native object
+/// code for the host (or a chosen) triple.
+///
+/// @param CommandLine - recompile <file.o> [-O<n>] [-triple <triple>]
+///                      [-mcpu <cpu>] [-j <threads>] [-fPIC]
+///
+static void runRecompileCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("recompile"))
+    return;
+  if (CommandLine.size() < 2) {
+    errs() << "recompile <file.o> [-O<n>] [-triple <triple>] [-mcpu <cpu>] "
+           << "[-j <threads>] [-fPIC]\n";
+    return;
+  }
+
+  unsigned OptLevel = 2, NumThreads = 1;
+  // -mcpu on the command line names the CPU of the binary, not of the
+  // code we emit.
+  std::string HostTriple, HostCPU = "generic";
+  Reloc::Model RM = Reloc::Default;
+  for (unsigned i = 2, e = CommandLine.size(); i != e; ++i) {
+    StringRef Arg = CommandLine[i];
+    if (Arg.startswith("-O")) {
+      if (Arg.substr(2).getAsInteger(10, OptLevel) || OptLevel > 3) {
+        errs() << "Invalid optimization level: " << Arg << "\n";
+        return;
+      }
+    } else if (Arg == "-triple" && i + 1 != e) {
+      HostTriple = CommandLine[++i];
+    } else if (Arg == "-mcpu" && i + 1 != e) {
+      HostCPU = CommandLine[++i];
+    } else if (Arg == "-j" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, NumThreads)) {
+        errs() << "Invalid thread count: " << CommandLine[i] << "\n";
+        return;
+      }
+    } else if (Arg == "-fPIC") {
+      RM = Reloc::PIC_;
+    } else {
+      errs() << "Unknown option: " << Arg << "\n";
+      return;
+    }
+  }
+
+  Recompiler RC(HostTriple, HostCPU, "", RM, outs(), errs());
+  if (!RC.isValid())
+    return;
+
+  std::vector<std::string> Outputs;
+  RC.compileParallel(DEC->getModule(), OptLevel, CommandLine[1], NumThreads,
+    Outputs);
+}
+
+///===---------------------------------------------------------------------===//
+/// collectELFFunctions - Gather the address and name of every function symbol
+/// (and every function found by the stripped disassembler).
+///
+template <class ELFT>
+static void collectELFFunctions(const object::ELFObjectFile<ELFT>* elf,
+  std::map<uint64_t, std::string> &Functions) {
+  std::vector<object::SymbolRef> Syms;
+  for (object::symbol_iterator si = elf->symbols().begin(), se =
+         elf->symbols().end(); si != se; ++si)
+    Syms.push_back(*si);
+  for (object::symbol_iterator si = elf->dynamic_symbol_begin(), se =
+         elf->dynamic_symbol_end(); si != se; ++si)
+    Syms.push_back(*si);
+
+  for (unsigned i = 0, e = Syms.size(); i != e; ++i) {
+    StringRef Name;
+    uint64_t Addr;
+    object::SymbolRef::Type Type;
+    if (error(Syms[i].getType(Type)) || Type != object::SymbolRef::ST_Function)
+      continue;
+    if (error(Syms[i].getName(Name)) || error(Syms[i].getAddress(Addr)))
+      continue;
+    // Imports have no address in this binary.
+    if (Addr == 0 || Addr == object::UnknownAddressOrSize)
+      continue;
+    Functions.insert(std::make_pair(Addr, Name.str()));
+  }
+
+  if (isStripped)
+    for (auto &it : SDAS->getStrippedGraph()->getHeadNodes()) {
+      StringRef Name = (SDAS->getMain() == it->Address ?
+                        "main" : DAS->getFunctionName(it->Address));
+      Functions.insert(std::make_pair(it->Address, Name.str()));
+    }
+}
+
+///===---------------------------------------------------------------------===//
+/// collectFunctions - The functions of the binary by address. Prints an error
+/// and returns false if there are none.
+///
+static bool collectFunctions(std::map<uint64_t, std::string> &Functions) {
+  const object::ObjectFile* Executable = DAS->getExecutable();
+  if (const object::ELF32LEObjectFile *elf =
+    dyn_cast<const object::ELF32LEObjectFile>(Executable)) {
+    collectELFFunctions(elf, Functions);
+  } else if (const object::ELF32BEObjectFile *elf =
+    dyn_cast<const object::ELF32BEObjectFile>(Executable)) {
+    collectELFFunctions(elf, Functions);
+  } else if (const object::ELF64BEObjectFile *elf =
+    dyn_cast<const object::ELF64BEObjectFile>(Executable)) {
+    collectELFFunctions(elf, Functions);
+  } else if (const object::ELF64LEObjectFile *elf =
+    dyn_cast<const object::ELF64LEObjectFile>(Executable)) {
+    collectELFFunctions(elf, Functions);
+  } else {
+    errs() << "Unsupported section type.\n";
+    return false;
+  }
+  if (Functions.empty()) {
+    errs() << "No functions found.\n";
+    return false;
+  }
+  return true;
+}
+
+///===---------------------------------------------------------------------===//
+/// runBatchCommand - Decompile every function in the binary with a pool of
+/// worker processes, checkpointing progress in the output directory.
+///
+/// @param CommandLine - batch <outdir> [-j <workers>] [-timeout <seconds>]
+///
+static void runBatchCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("batch"))
+    return;
+  if (CommandLine.size() < 2) {
+    errs() << "batch <outdir> [-j <workers>] [-timeout <seconds>]\n";
+    return;
+  }
+
+  unsigned NumWorkers = std::max(1u, std::thread::hardware_concurrency());
+  unsigned Timeout = 300;
+  for (unsigned i = 2, e = CommandLine.size(); i != e; ++i) {
+    StringRef Arg = CommandLine[i];
+    if (Arg == "-j" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, NumWorkers) ||
+          NumWorkers == 0) {
+        errs() << "Invalid worker count: " << CommandLine[i] << "\n";
+        return;
+      }
+    } else if (Arg == "-timeout" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, Timeout)) {
+        errs() << "Invalid timeout: " << CommandLine[i] << "\n";
+        return;
+      }
+    } else {
+      errs() << "Unknown option: " << Arg << "\n";
+      return;
+    }
+  }
+
+  std::map<uint64_t, std::string> FunctionMap;
+  if (!collectFunctions(FunctionMap))
+    return;
+
+  std::vector<BatchDriver::FunctionEntry> Functions(FunctionMap.begin(),
+    FunctionMap.end());
+  BatchDriver Batch(DAS, DEC, CommandLine[1], NumWorkers, Timeout, outs(),
+    errs());
+  Batch.run(Functions);
+}
+
+///===---------------------------------------------------------------------===//
+/// printFunctionCost - Per-block and per-loop estimates of one function.
+///
+static void printFunctionCost(const CostModel &CM,
+  const CostModel::FunctionCost &Cost) {
+  outs() << Cost.Name << " at " << format("0x%" PRIx64, Cost.Address)
+         << ": " << format("%.1f", Cost.Cycles) << " cycles (" << MCPU
+         << ", " << CM.getModelName() << ")\n\n";
+
+  outs() << "Block                Instrs   uOps  Thruput  Latency  Depth\n";
+  for (unsigned i = 0, e = Cost.Blocks.size(); i != e; ++i) {
+    const CostModel::BlockCost &B = Cost.Blocks[i];
+    outs() << format("0x%016" PRIx64 " %8u %6u %8.2f %8u %6u\n", B.Address,
+      B.NumInstrs, B.MicroOps, B.Throughput, B.Latency, B.LoopDepth);
+  }
+  if (Cost.Loops.empty())
+    return;
+
+  outs() << "\nLoop header          Depth  Blocks  Instrs  Thruput  "
+         << "Recurrence  Cycles/iter\n";
+  for (unsigned i = 0, e = Cost.Loops.size(); i != e; ++i) {
+    const CostModel::LoopCost &L = Cost.Loops[i];
+    outs() << format("0x%016" PRIx64 " %6u %7u %7u %8.2f %11u %12.2f\n",
+      L.Header, L.Depth, L.NumBlocks, L.NumInstrs, L.Throughput,
+      L.Recurrence, L.getCycles());
+  }
+}
+
+static bool byScore(const std::pair<double, CostModel::FunctionCost> &A,
+  const std::pair<double, CostModel::FunctionCost> &B) {
+  return A.first > B.first;
+}
+
+///===---------------------------------------------------------------------===//
+/// runCostCommand - Estimate the cycles of the original code of a function,
+/// or rank every function by estimated cycles times profile weight.
+///
+/// @param CommandLine - cost [FUNCNAME or FUNCADDRESS] [-profile FILE]
+///                      [-n COUNT]
+///
+static void runCostCommand(std::vector<std::string> &CommandLine) {
+  if (!haveBinary("cost"))
+    return;
+  std::string Target, ProfileFile;
+  unsigned Count = 0;
+  for (unsigned i = 1, e = CommandLine.size(); i != e; ++i) {
+    StringRef Arg = CommandLine[i];
+    if (Arg == "-profile" && i + 1 != e) {
+      ProfileFile = CommandLine[++i];
+    } else if (Arg == "-n" && i + 1 != e) {
+      if (StringRef(CommandLine[++i]).getAsInteger(0, Count)) {
+        errs() << "Invalid count: " << CommandLine[i] << "\n";
+        return;
+      }
+    } else if (!Arg.startswith("-") && Target.empty()) {
+      Target = Arg;
+    } else {
+      errs() << "cost [FUNCNAME or FUNCADDRESS] [-profile FILE] [-n COUNT]\n";
+      return;
+    }
+  }
+
+  CostModel CM(DAS);
+  if (!Target.empty()) {
+    uint64_t Address;
+    if (StringRef(Target).getAsInteger(0, Address) &&
+        !nameLookupAddr(Target, Address)) {
+      errs() << "Error retrieving address based on function name.\n";
+      return;
+    }
+    CostModel::FunctionCost Cost;
+    if (!CM.estimateFunction(Address, Cost)) {
+      errs() << "Unable to decode function at "
+             << format("0x%" PRIx64, Address) << ".\n";
+      return;
+    }
+    printFunctionCost(CM, Cost);
+    return;
+  }
+
+  std::map<uint64_t, uint64_t> Weights;
+  if (!ProfileFile.empty())
+    if (std::error_code EC = CostModel::readProfile(ProfileFile, Weights)) {
+      errs() << "Unable to read profile '" << ProfileFile << "': "
+             << EC.message() << "\n";
+      return;
+    }
+
+  std::map<uint64_t, std::string> Functions;
+  if (!collectFunctions(Functions))
+    return;
+
+  // Without a profile every function weighs the same; with one, functions
+  // that never ran are left out.
+  std::vector<std::pair<double, CostModel::FunctionCost> > Ranked;
+  for (std::map<uint64_t, std::string>::iterator I = Functions.begin(),
+         E = Functions.end(); I != E; ++I) {
+    double Weight = 1;
+    if (!ProfileFile.empty()) {
+      std::map<uint64_t, uint64_t>::iterator W = Weights.find(I->first);
+      if (W == Weights.end() || W->second == 0)
+        continue;
+      Weight = W->second;
+    }
+    CostModel::FunctionCost Cost;
+    if (!CM.estimateFunction(I->first, Cost))
+      continue;
+    Cost.Name = I->second;
+    Ranked.push_back(std::make_pair(Cost.Cycles * Weight, Cost));
+  }
+  std::stable_sort(Ranked.begin(), Ranked.end(), byScore);
+  if (Count != 0 && Count < Ranked.size())
+    Ranked.resize(Count);
+
+  outs() << "Estimated cycles for " << MCPU << " (" << CM.getModelName()
+         << ")\n\n";
+  outs() << "Rank  Address                 Cycles  Loops         Score  "
+         << "Function\n";
+  for (unsigned i = 0, e = Ranked.size(); i != e; ++i) {
+    const CostModel::FunctionCost &Cost = Ranked[i].second;
+    outs() << format("%4u  0x%016" PRIx64 " %10.1f %6u %13.1f  ", i + 1,
+      Cost.Address, Cost.Cycles, unsigned(Cost.Loops.size()), Ranked[i].first)
+           << Cost.Name << "\n";
+  }
+}
+
+///===---------------------------------------------------------------------===//
+/// projectName - The unsaved analyst name, else the project's name for
+/// Address.
+///
+static std::string projectName(uint64_t Address) {
+  std::map<uint64_t, std::string>::iterator I = ProjectNames.find(Address);
+  if (I != ProjectNames.end())
+    return I->second;
+  return Project ? Project->getName(Address).str() : std::string();
+}
+
+static bool projectLookup(StringRef NameOrAddress, uint64_t &Address) {
+  if (!NameOrAddress.getAsInteger(0, Address))
+    return true;
+  for (std::map<uint64_t, std::string>::iterator I = ProjectNames.begin(),
+         E = ProjectNames.end(); I != E; ++I)
+    if (I->second == NameOrAddress) {
+      Address = I->first;
+      return true;
+    }
+  if (Project && Project->lookupName(NameOrAddress, Address))
+    return true;
+  errs() << "Unknown function: " << NameOrAddress << "\n";
+  return false;
+}
+
+static void printProjectAddress(uint64_t Address) {
+  outs() << format("%08" PRIx64, Address);
+  std::string Name = projectName(Address);
+  if (!Name.empty())
+    outs() << " <" << Name << ">";
+}
+
+/// projectFunctionEnd - End of the function at Address: its symbol size, else
+/// the end of its last block, else the start of the next function.
+static uint64_t projectFunctionEnd(uint64_t Address) {
+  const projectdb::SymbolRecord *Sym = Project->findSymbol(Address);
+  if (Sym && Sym->Address == Address && Sym->Size)
+    return Address + Sym->Size;
+  uint64_t End = 0;
+  for (const projectdb::BlockRecord &B : Project->getBlocks(Address))
+    End = std::max<uint64_t>(End, B.End);
+  if (End)
+    return End;
+  ArrayRef<projectdb::FunctionRecord> Funcs = Project->functions();
+  for (unsigned i = 0, e = Funcs.size(); i != e; ++i)
+    if (Funcs[i].Address > Address)
+      return Funcs[i].Address;
+  return UINT64_MAX;
+}
+
+///===---------------------------------------------------------------------===//
+/// runProjectCommand - Save the session to a project database, reopen one,
+/// and answer queries from it.
+///
+/// @param CommandLine - project <subcommand> [args]
+///
+static void runProjectCommand(std::vector<std::string> &CommandLine) {
+  if (CommandLine.size() < 2) {
+    errs() << "project open|save|info|functions|dis|cfg|calls|ir|name ...\n";
+    return;
+  }
+  StringRef Sub = CommandLine[1];
+
+  if (Sub == "open" || Sub == "save") {
+    if (CommandLine.size() != 3) {
+      errs() << "project " << Sub << " <file>\n";
+      return;
+    }
+    if (Sub == "save") {
+      ProjectDBWriter Writer;
+      if (Project)
+        Writer.merge(*Project);
+      if (DAS) {
+        Writer.addBinary(DAS);
+        Writer.addFunctions(DAS, DEC);
+      }
+      for (std::map<uint64_t, std::string>::iterator I = ProjectNames.begin(),
+             E = ProjectNames.end(); I != E; ++I)
+        Writer.setName(I->first, I->second);
+      // The open project stays mapped until its replacement is in place,
+      // so a failed write loses nothing.
+      if (std::error_code EC = Writer.write(CommandLine[2])) {
+        errs() << "Unable to write " << CommandLine[2] << ": "
+               << EC.message() << "\n";
+        return;
+      }
+      Project.reset();
+      ProjectNames.clear();
+    }
+    ErrorOr<std::unique_ptr<ProjectDB> > DB = ProjectDB::open(CommandLine[2]);
+    if (std::error_code EC = DB.getError()) {
+      errs() << "Unable to open " << CommandLine[2] << ": " << EC.message()
+             << "\n";
+      return;
+    }
+    Project = std::move(DB.get());
+    return;
+  }
+
+  if (!Project) {
+    errs() << "No project is open, use 'project open <file>'.\n";
+    return;
+  }
+
+  if (Sub == "info") {
+    outs() << "Project:      " << Project->getPath() << "\n"
+           << "Binary:       " << Project->getFileName() << "\n"
+           << "Triple:       " << Project->getTriple() << "\n"
+           << "Sections:     " << Project->sections().size() << "\n"
+           << "Symbols:      " << Project->symbols().size() << "\n"
+           << "Instructions: " << Project->instructions().size() << "\n"
+           << "Functions:    " << Project->functions().size() << "\n"
+           << "Blocks:       " << Project->blocks().size() << "\n"
+           << "Calls:        " << Project->calls().size() << "\n"
+           << "Names:        " << Project->names().size() << "\n";
+    return;
+  }
+
+  if (Sub == "functions") {
+    for (const projectdb::FunctionRecord &F : Project->functions()) {
+      printProjectAddress(F.Address);
+      outs() << "\t" << Project->getBlocks(F.Address).size() << " blocks\n";
+    }
+    return;
+  }
+
+  if (Sub == "name") {
+    uint64_t Address;
+    if (CommandLine.size() < 3 ||
+        StringRef(CommandLine[2]).getAsInteger(0, Address)) {
+      errs() << "project name <address> [name]\n";
+      return;
+    }
+    ProjectNames[Address] = CommandLine.size() > 3 ? CommandLine[3] : "";
+    return;
+  }
+
+  uint64_t Address;
+  if (CommandLine.size() != 3 || !projectLookup(CommandLine[2], Address)) {
+    errs() << "project " << Sub << " <address or function>\n";
+    return;
+  }
+
+  if (Sub == "dis") {
+    for (const projectdb::InstrRecord &I :
+           Project->getInstructions(Address, projectFunctionEnd(Address))) {
+      std::string Name = projectName(I.Address);
+      if (!Name.empty())
+        outs() << Name << ":\n";
+      outs() << format("%08" PRIx64 ":", uint64_t(I.Address)) << "\t"
+             << Project->getString(I.Text) << "\n";
+    }
+  } else if (Sub == "cfg") {
+    for (const projectdb::BlockRecord &B : Project->getBlocks(Address)) {
+      outs() << format("%08" PRIx64 "-%08" PRIx64 ":", uint64_t(B.Address),
+        uint64_t(B.End));
+      for (const projectdb::EdgeRecord &E :
+             Project->getSuccessors(B.Address))
+        outs() << format(" %08" PRIx64, uint64_t(E.To));
+      outs() << "\n";
+    }
+  } else if (Sub == "calls") {
+    outs() << "Calls:\n";
+    for (const projectdb::EdgeRecord &E : Project->getCallees(Address)) {
+      outs() << "  ";
+      printProjectAddress(E.To);
+      outs() << "\n";
+    }
+    outs() << "Called by:\n";
+    for (const projectdb::EdgeRecord &E : Project->getCallers(Address)) {
+      outs() << "  ";
+      printProjectAddress(E.To);
+      outs() << "\n";
+    }
+  } else if (Sub == "ir") {
+    const projectdb::FunctionRecord *F = Project->findFunction(Address);
+    if (F == NULL) {
+      errs() << "Function was not decompiled when the project was saved.\n";
+      return;
+    }
+    LLVMContext Ctx;
+    std::unique_ptr<MemoryBuffer> Buf(
+      MemoryBuffer::getMemBuffer(Project->getBitcode(*F), "", false));
+    ErrorOr<Module*> ModOrErr = parseBitcodeFile(Buf->getMemBufferRef(), Ctx);
+    if (std::error_code EC = ModOrErr.getError()) {
+      errs() << "Unable to read bitcode: " << EC.message() << "\n";
+      return;
+    }
+    std::unique_ptr<Module> M(ModOrErr.get());
+    outs() << *M;
+  } else {
+    errs() << "Unknown project command: " << Sub << "\n";
+  }
+}
+
 static void initializeCommands() {
   CommandParser.registerCommand("?", &printHelp);
   CommandParser.registerCommand("help", &printHelp);
@@ -1032,6 +1935,12 @@ static void initializeCommands() {
   CommandParser.registerCommand("sections", &runSectionsCommand);
   CommandParser.registerCommand("symbols", &runSymbolsCommand);
   CommandParser.registerCommand("save", &runSaveCommand);
+  CommandParser.registerCommand("run", &runRunCommand);
+  CommandParser.registerCommand("bench", &runBenchCommand);
+  CommandParser.registerCommand("recompile", &runRecompileCommand);
+  CommandParser.registerCommand("batch", &runBatchCommand);
+  CommandParser.registerCommand("cost", &runCostCommand);
+  CommandParser.registerCommand("project", &runProjectCommand);
   // TODO:
   // CommandParser.registerCommand("cfg", &runCfgCommand);
   // CommandParser.registerCommand("functions", &runFunctionsCommand);
@@ -1074,12 +1983,24 @@ int main(int argc, char *argv[]) {
 
   initializeCommands();
 
-  if (std::error_code Err = loadBinary(InputFileName.getValue())) {
-    errs() << ProgramName << ": Could not open the file '"
-        << InputFileName.getValue() << "'. " << Err.message() << ".\n";
+  if (!ProjectFileName.empty()) {
+    std::vector<std::string> CL;
+    CL.push_back("project");
+    CL.push_back("open");
+    CL.push_back(ProjectFileName);
+    runProjectCommand(CL);
+  }
+
+  // A project answers queries on its own, so the binary is optional then.
+  if (ProjectFileName.empty() || InputFileName != "-") {
+    if (std::error_code Err = loadBinary(InputFileName.getValue())) {
+      errs() << ProgramName << ": Could not open the file '"
+          << InputFileName.getValue() << "'. " << Err.message() << ".\n";
+    }
   }
 //If the -stripped flag is set and the file is actually stripped.
-  if(DAS->getExecutable()->symbol_begin() == DAS->getExecutable()->symbol_end()
+  if(DAS &&
+     DAS->getExecutable()->symbol_begin() == DAS->getExecutable()->symbol_end()
      && StrippedBinary){
     isStripped = true;
     outs() << "File is Stripped\n";
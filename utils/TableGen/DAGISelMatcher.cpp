@@ -83,6 +83,16 @@ ScopeMatcher::~ScopeMatcher() {
     delete Children[i];
 }
 
+SwitchOpcodeMatcher::~SwitchOpcodeMatcher() {
+  for (unsigned i = 0, e = Cases.size(); i != e; ++i)
+    delete Cases[i].second;
+}
+
+SwitchTypeMatcher::~SwitchTypeMatcher() {
+  for (unsigned i = 0, e = Cases.size(); i != e; ++i)
+    delete Cases[i].second;
+}
+
 
 // CheckPredicateMatcher::CheckPredicateMatcher(const TreePredicateFn &pred)
 //   : Matcher(CheckPredicate), Pred(pred.getOrigPatFragRecord()) {}
@@ -149,7 +159,7 @@ void CheckOpcodeMatcher::printImpl(raw_ostream &OS, unsigned indent) const {
 void SwitchOpcodeMatcher::printImpl(raw_ostream &OS, unsigned indent) const {
   OS.indent(indent) << "SwitchOpcode: {\n";
   for (unsigned i = 0, e = Cases.size(); i != e; ++i) {
-    OS.indent(indent) << "case " << Cases[i].first->getEnumName() << ":\n";
+    OS.indent(indent) << "case " << Cases[i].first << ":\n";
     Cases[i].second->print(OS, indent+2);
   }
   OS.indent(indent) << "}\n";
@@ -358,29 +368,35 @@ static bool TypesAreContradictory(MVT::SimpleValueType T1,
   return true;
 }
 
-// bool CheckOpcodeMatcher::isContradictoryImpl(const Matcher *M) const {
-//   if (const CheckOpcodeMatcher *COM = dyn_cast<CheckOpcodeMatcher>(M)) {
-//     // One node can't have two different opcodes!
-//     // Note: pointer equality isn't enough here, we have to check the enum names
-//     // to ensure that the nodes are for the same opcode.
-//     return COM->getOpcode().getEnumName() != getOpcode().getEnumName();
-//   }
-
-//   // If the node has a known type, and if the type we're checking for is
-//   // different, then we know they contradict.  For example, a check for
-//   // ISD::STORE will never be true at the same time a check for Type i32 is.
-//   if (const CheckTypeMatcher *CT = dyn_cast<CheckTypeMatcher>(M)) {
-//     // If checking for a result the opcode doesn't have, it can't match.
-//     if (CT->getResNo() >= getOpcode().getNumResults())
-//       return true;
-
-//     MVT::SimpleValueType NodeType = getOpcode().getKnownType(CT->getResNo());
-//     if (NodeType != MVT::Other)
-//       return TypesAreContradictory(NodeType, CT->getType());
-//   }
-
-//   return false;
-// }
+bool CheckOpcodeMatcher::isContradictoryImpl(const Matcher *M) const {
+  if (const CheckOpcodeMatcher *COM = dyn_cast<CheckOpcodeMatcher>(M)) {
+    // SDNode and target opcodes share one numbering in the matcher table, so
+    // only opcodes of the same kind are known to be different.
+    if (COM->isSDNode != isSDNode)
+      return false;
+    // One node can't have two different opcodes!
+    // Note: pointer equality isn't enough here, we have to check the enum names
+    // to ensure that the nodes are for the same opcode.
+    return COM->getEnumName() != getEnumName();
+  }
+
+  // If the node has a known type, and if the type we're checking for is
+  // different, then we know they contradict.  For example, a check for
+  // ISD::STORE will never be true at the same time a check for Type i32 is.
+  if (const CheckTypeMatcher *CT = dyn_cast<CheckTypeMatcher>(M)) {
+    if (!isSDNode)
+      return false;
+    // If checking for a result the opcode doesn't have, it can't match.
+    if (CT->getResNo() >= SDOpcode->getNumResults())
+      return true;
+
+    MVT::SimpleValueType NodeType = SDOpcode->getKnownType(CT->getResNo());
+    if (NodeType != MVT::Other)
+      return TypesAreContradictory(NodeType, CT->getType());
+  }
+
+  return false;
+}
 
 bool CheckTypeMatcher::isContradictoryImpl(const Matcher *M) const {
   if (const CheckTypeMatcher *CT = dyn_cast<CheckTypeMatcher>(M))
@@ -30,9 +30,10 @@ namespace llvm {
 
 // Matcher *ConvertPatternToMatcher(const PatternToMatch &Pattern,unsigned Variant,
 //                                  const CodeGenDAGPatterns &CGP);
-// Matcher *OptimizeMatcher(Matcher *Matcher, const CodeGenDAGPatterns &CGP);
+Matcher *OptimizeMatcher(Matcher *Matcher, const CodeInvDAGPatterns &CIP);
 void EmitMatcherTable(const Matcher *Matcher, const CodeInvDAGPatterns &CIP,
                       raw_ostream &OS);
+void EmitMatcherHistogram(const Matcher *Matcher, raw_ostream &OS);
 
 
 /// Matcher - Base class for all the DAG ISel Matcher representation
@@ -457,6 +458,8 @@ public:
     : Matcher(CheckOpcode), SDOpcode(0), TgtOpcode(&opcode), isSDNode(false) {}
 
   /* const SDNodeInfo &getOpcode() const { return *SDOpcode; } */
+  const SDNodeInfo *getSDNodeInfo() const { return SDOpcode; }
+  const CodeGenInstruction *getInstruction() const { return TgtOpcode; }
   const std::string getEnumName() const {
     return (isSDNode) ? SDOpcode->getEnumName() :
       TgtOpcode->Namespace + "::" + TgtOpcode->TheDef->getName();
@@ -472,19 +475,23 @@ private:
   virtual void printImpl(raw_ostream &OS, unsigned indent) const;
   virtual bool isEqualImpl(const Matcher *M) const;
   virtual unsigned getHashImpl() const;
-  /* virtual bool isContradictoryImpl(const Matcher *M) const; */
+  virtual bool isContradictoryImpl(const Matcher *M) const;
 };
 
 /// SwitchOpcodeMatcher - Switch based on the current node's opcode, dispatching
 /// to one matcher per opcode.  If the opcode doesn't match any of the cases,
 /// then the match fails.  This is semantically equivalent to a Scope node where
 /// every child does a CheckOpcode, but is much faster.
+///
+/// The inverse matcher switches on target instructions as well as SDNodes, so
+/// cases are keyed by the opcode enum name rather than by SDNodeInfo.
 class SwitchOpcodeMatcher : public Matcher {
-  SmallVector<std::pair<const SDNodeInfo*, Matcher*>, 8> Cases;
+  SmallVector<std::pair<std::string, Matcher*>, 8> Cases;
 public:
-  SwitchOpcodeMatcher(const std::pair<const SDNodeInfo*, Matcher*> *cases,
+  SwitchOpcodeMatcher(const std::pair<std::string, Matcher*> *cases,
                       unsigned numcases)
     : Matcher(SwitchOpcode), Cases(cases, cases+numcases) {}
+  virtual ~SwitchOpcodeMatcher();
 
   static inline bool classof(const Matcher *N) {
     return N->getKind() == SwitchOpcode;
@@ -492,7 +499,7 @@ public:
 
   unsigned getNumCases() const { return Cases.size(); }
 
-  const SDNodeInfo &getCaseOpcode(unsigned i) const { return *Cases[i].first; }
+  const std::string &getCaseOpcode(unsigned i) const { return Cases[i].first; }
   Matcher *getCaseMatcher(unsigned i) { return Cases[i].second; }
   const Matcher *getCaseMatcher(unsigned i) const { return Cases[i].second; }
 
@@ -539,6 +546,7 @@ public:
   SwitchTypeMatcher(const std::pair<MVT::SimpleValueType, Matcher*> *cases,
                     unsigned numcases)
   : Matcher(SwitchType), Cases(cases, cases+numcases) {}
+  virtual ~SwitchTypeMatcher();
 
   static inline bool classof(const Matcher *N) {
     return N->getKind() == SwitchType;
@@ -337,7 +337,7 @@ EmitMatcher(const Matcher *N, unsigned Indent, unsigned CurrentIdx,
 
       OS << ' ';
       if (const SwitchOpcodeMatcher *SOM = dyn_cast<SwitchOpcodeMatcher>(N))
-        OS << "TARGET_VAL(" << SOM->getCaseOpcode(i).getEnumName() << "),";
+        OS << "TARGET_VAL(" << SOM->getCaseOpcode(i) << "),";
       else
         OS << getEnumName(cast<SwitchTypeMatcher>(N)->getCaseType(i)) << ',';
 
@@ -745,11 +745,7 @@ static void BuildHistogram(const Matcher *M, std::vector<unsigned> &OpcodeFreq){
   }
 }
 
-void MatcherTableEmitter::EmitHistogram(const Matcher *M,
-                                        formatted_raw_ostream &OS) {
-  if (OmitComments)
-    return;
-
+static void PrintHistogram(const Matcher *M, formatted_raw_ostream &OS) {
   std::vector<unsigned> OpcodeFreq;
   BuildHistogram(M, OpcodeFreq);
 
@@ -799,6 +795,18 @@ void MatcherTableEmitter::EmitHistogram(const Matcher *M,
   OS << '\n';
 }
 
+void MatcherTableEmitter::EmitHistogram(const Matcher *M,
+                                        formatted_raw_ostream &OS) {
+  if (OmitComments)
+    return;
+  PrintHistogram(M, OS);
+}
+
+void llvm::EmitMatcherHistogram(const Matcher *M, raw_ostream &O) {
+  formatted_raw_ostream OS(O);
+  PrintHistogram(M, OS);
+}
+
 
 void llvm::EmitMatcherTable(const Matcher *TheMatcher,
                             const CodeInvDAGPatterns &CGP,
@@ -0,0 +1,201 @@
+//===- FractureInstrClassEmitter.cpp - Instruction classes -------*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This tablegen backend emits one bitset per instruction class (nop, push,
+// call, return, ...), indexed by opcode. The disassembler side uses these
+// instead of hard-coded opcode numbers, so classification is a single bit
+// test and survives LLVM renumbering the instruction enum.
+//
+// Classes are derived from the instruction flags where TableGen has them
+// (isCall, isReturn, isIndirectBranch, mayLoad), from the mnemonic, and from
+// a short list of record names for target idioms that neither captures.
+//
+// NOTE: The class order must match InstrClass in CodeInv/InstrClassInfo.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeGenInstruction.h"
+#include "CodeGenTarget.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/TableGen/Record.h"
+#include "llvm/TableGen/TableGenBackend.h"
+#include <cctype>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+enum InstrClass {
+  IC_Nop,
+  IC_Padding,
+  IC_Push,
+  IC_Move,
+  IC_ZeroIdiom,
+  IC_Call,
+  IC_Return,
+  IC_IndirectBranch,
+  IC_PCRelLoad,
+  IC_NumClasses
+};
+
+static const char *const ClassNames[IC_NumClasses] = {
+  "Nop", "Padding", "Push", "Move", "ZeroIdiom", "Call", "Return",
+  "IndirectBranch", "PCRelLoad"
+};
+
+struct NameRule {
+  const char *Target;
+  InstrClass Class;
+  const char *Prefix;
+};
+
+// Record name prefixes for target idioms the flags and mnemonics miss.
+static const NameRule NameRules[] = {
+  // Alignment in ARM objects is zero filled, and a zero word decodes as
+  // andeq/muleq/ldreq. The EQ predicate is checked when the bit is used.
+  { "ARM", IC_Padding, "ANDr" },
+  { "ARM", IC_Padding, "MUL" },
+  { "ARM", IC_Padding, "LDR" },
+  // Multi-byte x86 nops are emitted as xchg and lea forms.
+  { "X86", IC_Padding, "XCHG" },
+  { "X86", IC_Padding, "LEA" },
+  { "ARM", IC_Push, "STMDB_UPD" },
+  { "ARM", IC_Push, "STR_PRE_IMM" },
+  { "ARM", IC_Push, "t2STMDB_UPD" },
+  { "PPC", IC_Push, "STWU" },
+  { "PPC", IC_Push, "STDU" },
+  { "ARM", IC_PCRelLoad, "LDRi12" },
+  { "ARM", IC_PCRelLoad, "LDRcp" },
+  { "ARM", IC_PCRelLoad, "tLDRpci" },
+  { "ARM", IC_PCRelLoad, "t2LDRpci" }
+};
+
+class FractureInstrClassEmitter {
+public:
+  explicit FractureInstrClassEmitter(RecordKeeper &R) : Records(R) {}
+  void run(raw_ostream &OS);
+private:
+  RecordKeeper &Records;
+  unsigned classify(StringRef TargetName, const CodeGenInstruction *CGI);
+};
+
+/// getMnemonic - Returns the lower case mnemonic of the first asm variant,
+/// e.g. "xor" for "xor{l}\t{$src, $dst|$dst, $src}".
+static std::string getMnemonic(const CodeGenInstruction *CGI) {
+  std::string Asm =
+    CodeGenInstruction::FlattenAsmStringVariants(CGI->AsmString, 0);
+  std::string Mnemonic;
+  for (unsigned i = 0, e = Asm.size(); i != e; ++i) {
+    char C = Asm[i];
+    if (!isalnum(C) && C != '.' && C != '_')
+      break;
+    Mnemonic += tolower(C);
+  }
+  return Mnemonic;
+}
+
+static bool hasMemOperand(const CodeGenInstruction *CGI) {
+  for (unsigned i = 0, e = CGI->Operands.size(); i != e; ++i)
+    if (CGI->Operands[i].OperandType == "MCOI::OPERAND_MEMORY")
+      return true;
+  return false;
+}
+
+static bool hasOnlyRegOperands(const CodeGenInstruction *CGI) {
+  if (CGI->Operands.size() == 0)
+    return false;
+  for (unsigned i = 0, e = CGI->Operands.size(); i != e; ++i)
+    if (!CGI->Operands[i].Rec->isSubClassOf("RegisterClass"))
+      return false;
+  return true;
+}
+
+unsigned FractureInstrClassEmitter::classify(StringRef TargetName,
+  const CodeGenInstruction *CGI) {
+  unsigned Classes = 0;
+  std::string Mnemonic = getMnemonic(CGI);
+  StringRef Name = CGI->TheDef->getName();
+
+  if (Mnemonic == "nop")
+    Classes |= 1 << IC_Nop;
+  if (Mnemonic == "push")
+    Classes |= 1 << IC_Push;
+  if (Mnemonic == "mov")
+    Classes |= 1 << IC_Move;
+  // xor/eor of a register with itself is the usual way to clear it.
+  if ((Mnemonic == "xor" || Mnemonic == "eor") && hasOnlyRegOperands(CGI))
+    Classes |= 1 << IC_ZeroIdiom;
+  if (CGI->isCall)
+    Classes |= 1 << IC_Call;
+  if (CGI->isReturn)
+    Classes |= 1 << IC_Return;
+  if (CGI->isIndirectBranch)
+    Classes |= 1 << IC_IndirectBranch;
+  // Any x86 memory operand can be RIP relative.
+  if (TargetName == "X86" && (CGI->mayLoad || Mnemonic == "lea") &&
+      hasMemOperand(CGI))
+    Classes |= 1 << IC_PCRelLoad;
+
+  for (unsigned i = 0, e = array_lengthof(NameRules); i != e; ++i)
+    if (TargetName == NameRules[i].Target &&
+        Name.startswith(NameRules[i].Prefix))
+      Classes |= 1 << NameRules[i].Class;
+
+  return Classes;
+}
+
+void FractureInstrClassEmitter::run(raw_ostream &OS) {
+  CodeGenTarget Target(Records);
+  const std::string &TargetName = Target.getName();
+  const std::vector<const CodeGenInstruction*> &Instrs =
+    Target.getInstructionsByEnumValue();
+
+  emitSourceFileHeader("Instruction classes for the " + TargetName
+    + " target", OS);
+
+  unsigned NumOpcodes = Instrs.size();
+  unsigned NumWords = (NumOpcodes + 63) / 64;
+  std::vector<std::vector<uint64_t> > Bits(IC_NumClasses,
+    std::vector<uint64_t>(NumWords, 0));
+  for (unsigned Opc = 0; Opc != NumOpcodes; ++Opc) {
+    unsigned Classes = classify(TargetName, Instrs[Opc]);
+    for (unsigned C = 0; C != IC_NumClasses; ++C)
+      if (Classes & (1 << C))
+        Bits[C][Opc / 64] |= 1ULL << (Opc % 64);
+  }
+
+  OS << "namespace " << TargetName << "InstrClasses {\n\n";
+  OS << "static const unsigned NumOpcodes = " << NumOpcodes << ";\n\n";
+  for (unsigned C = 0; C != IC_NumClasses; ++C) {
+    OS << "static const uint64_t " << ClassNames[C] << "[] = {";
+    for (unsigned w = 0; w != NumWords; ++w) {
+      OS << (w % 4 == 0 ? "\n  " : " ");
+      OS << format("0x%016" PRIx64 "ULL", Bits[C][w]) << ",";
+    }
+    OS << "\n};\n\n";
+  }
+
+  OS << "static const uint64_t *const Classes[] = {\n";
+  for (unsigned C = 0; C != IC_NumClasses; ++C)
+    OS << "  " << ClassNames[C] << ",\n";
+  OS << "};\n\n";
+  OS << "} // end namespace " << TargetName << "InstrClasses\n";
+}
+
+} // end anonymous namespace
+
+namespace fracture {
+
+void EmitInstrClasses(RecordKeeper &Records, raw_ostream &OS) {
+  FractureInstrClassEmitter(Records).run(OS);
+}
+
+} // end namespace fracture
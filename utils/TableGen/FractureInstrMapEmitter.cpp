@@ -16,28 +16,57 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This tablegen backend emits patternless instructions.
+// This tablegen backend emits the inverse instruction selector tables.
+//
+// Each pattern is turned into a matcher independently, so the patterns are
+// spread over a pool of threads and the results are merged back in pattern
+// order, which keeps the output identical to a serial run. Matchers can also
+// be reused from a previous run with -instr-map-cache, see InvMatcherCache.
 //
 //===----------------------------------------------------------------------===//
 
 #include "CodeInvDAGPatterns.h"
 #include "DAGISelMatcher.h"
+#include "InvMatcherCache.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/TableGen/Record.h"
 #include "llvm/TableGen/StringMatcher.h"
 #include "llvm/TableGen/TableGenBackend.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <thread>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "invdag-patterns"
 
+static cl::opt<unsigned>
+InstrMapThreads("instr-map-threads",
+  cl::desc("Number of threads used to build inverse matchers "
+           "(default: one per core)"),
+  cl::init(0));
+
+static cl::opt<std::string>
+InstrMapCache("instr-map-cache",
+  cl::desc("Reuse inverse matchers of unchanged patterns from this file"),
+  cl::value_desc("filename"));
+
+static cl::opt<bool>
+InstrMapOptimize("instr-map-opt",
+  cl::desc("Factor and contract the inverse matcher before emitting it"),
+  cl::init(true));
+
+/// FractureInstrMapEmitter - Builds the matcher for a single pattern. Every
+/// pattern gets its own emitter, so emitters can run on different threads as
+/// long as they only read the shared CodeInvDAGPatterns.
 class FractureInstrMapEmitter {
-  const CodeInvDAGPatterns CIP;
+  const CodeInvDAGPatterns &CIP;
+  raw_ostream &Log;
   Matcher *TheMatcher, *CurNode;
   StringMap<unsigned> VariableMap;
   unsigned NextOpNo;
@@ -55,12 +84,15 @@ class FractureInstrMapEmitter {
   SmallVector<unsigned, 2> MatchedChainNodes;
 
 public:
-  explicit FractureInstrMapEmitter(RecordKeeper &R)
-    : CIP(R), TheMatcher(0), CurNode(0), NextOpNo(0) {}
-  void run(raw_ostream &OS);
+  FractureInstrMapEmitter(const CodeInvDAGPatterns &CIP, raw_ostream &Log)
+    : CIP(CIP), Log(Log), TheMatcher(0), CurNode(0), NextOpNo(0),
+      MatcherGenFailed(false) {}
+
+  /// CreateMatcher - Returns the matcher for Pattern, or null if the pattern
+  /// could not be inverted.
+  Matcher *CreateMatcher(const InvPatternToMatch *Pattern);
 private:
   void AddMatcher(Matcher* NewNode);
-  void CreateMatcherFromPattern(const InvPatternToMatch *Pattern);
 
   // These functions create pattern checks
   void EmitMatcherCode(const InvTreePatternNode *N);
@@ -92,9 +124,9 @@ static MVT::SimpleValueType getRegisterValueType(Record *R,
   const CodeGenRegister *Reg = T.getRegBank().getReg(R);
 
   //ArrayRef<CodeGenRegisterClass*> RCs = T.getRegBank().getRegClasses();
-  std::list<CodeGenRegisterClass> RCs = T.getRegBank().getRegClasses();
+  const std::list<CodeGenRegisterClass> &RCs = T.getRegBank().getRegClasses();
 
-  for ( auto RC : RCs ) {
+  for (const auto &RC : RCs) {
     if (!RC.contains(Reg))
       continue;
 
@@ -128,16 +160,32 @@ static MVT::SimpleValueType getRegisterValueType(Record *R,
   return VT;
 }
 
+Matcher *FractureInstrMapEmitter::CreateMatcher(
+  const InvPatternToMatch *Pattern) {
+  // Create the matching logic
+  Log << "EmitMatchCode: ";
+  Pattern->getSrcPattern()->print(Log);
+  Log << "\n";
+  EmitMatcherCode(Pattern->getSrcPattern());
+  // The resulting graph
+  Log << "EmitResultCode: ";
+  Pattern->getDstPattern()->print(Log);
+  Log << "\n";
+  EmitResultCode(Pattern);
+
+  if (MatcherGenFailed) {
+    delete TheMatcher;
+    return 0;
+  }
+  return TheMatcher;
+}
+
 namespace fracture {
 
-// Emits the class definitions for attributes.
+// Emits the inverse instruction selector for the target.
 void EmitInstrMap(RecordKeeper &Records, raw_ostream &OS) {
-  FractureInstrMapEmitter(Records).run(OS);
-}
+  CodeInvDAGPatterns CIP(Records);
 
-} // end namespace fracture
-
-void  FractureInstrMapEmitter::run(raw_ostream &OS) {
   emitSourceFileHeader("DAG Instruction Deselector for the " +
     CIP.getTargetInfo().getName() + "target", OS);
 
@@ -157,53 +205,91 @@ void  FractureInstrMapEmitter::run(raw_ostream &OS) {
     }
   );
 
-  // Convert each pattern into a matcher
+  // The register bank and the instruction list are built lazily, make sure
+  // that happens before the workers share CIP.
+  CIP.getTargetInfo().getRegBank();
+  CIP.getTargetInfo().getInstructionsByEnumValue();
+
+  InvMatcherCache Cache(CIP, Records);
+  if (!InstrMapCache.empty())
+    Cache.load(InstrMapCache);
+
+  unsigned NumPatterns = Patterns.size();
+  std::vector<Matcher*> Matchers(NumPatterns, (Matcher*)0);
+  std::vector<std::string> Logs(NumPatterns);
+  std::vector<uint64_t> Keys(NumPatterns);
+  std::vector<unsigned> Work;
+  unsigned CacheHits = 0;
+  for (unsigned i = 0; i != NumPatterns; ++i) {
+    Keys[i] = InvMatcherCache::getKey(Patterns[i]);
+    Matchers[i] = Cache.lookup(Keys[i], Patterns[i], Logs[i]);
+    if (Matchers[i] != 0)
+      ++CacheHits;
+    else
+      Work.push_back(i);
+  }
+
+  // Convert each remaining pattern into a matcher
+  unsigned NumThreads = InstrMapThreads;
+  if (NumThreads == 0)
+    NumThreads = std::max(1u, std::thread::hardware_concurrency());
+  NumThreads = std::min<unsigned>(NumThreads, Work.size());
+  std::atomic<unsigned> NextWork(0);
+  auto Worker = [&]() {
+    for (unsigned w = NextWork++; w < Work.size(); w = NextWork++) {
+      unsigned i = Work[w];
+      raw_string_ostream Log(Logs[i]);
+      FractureInstrMapEmitter Gen(CIP, Log);
+      Matchers[i] = Gen.CreateMatcher(Patterns[i]);
+      Log.flush();
+    }
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned t = 1; t < NumThreads; ++t)
+    Workers.push_back(std::thread(Worker));
+  Worker();
+  for (unsigned t = 0, e = Workers.size(); t != e; ++t)
+    Workers[t].join();
+
+  // Merge in pattern order so the table does not depend on scheduling.
   std::vector<Matcher*> PatternMatchers;
   unsigned FailCount = 0;
-  for (unsigned i = 0, e = Patterns.size(); i != e; ++i) {
-    MatcherGenFailed = false;
-    // Create the matching logic
-    errs() << "EmitMatchCode: ";
-    Patterns[i]->getSrcPattern()->print(errs());
-    errs() << "\n";
-    EmitMatcherCode(Patterns[i]->getSrcPattern());
-    // The resulting graph
-    errs() << "EmitResultCode: ";
-    Patterns[i]->getDstPattern()->print(errs());
-    errs() << "\n";
-
-    EmitResultCode(Patterns[i]);
-    if (!MatcherGenFailed) {
-      PatternMatchers.push_back(TheMatcher);
-    } else {
+  for (unsigned i = 0; i != NumPatterns; ++i) {
+    errs() << Logs[i];
+    if (Matchers[i] == 0) {
       FailCount++;
+      continue;
     }
-
-    // TheMatcher->dump();
-
-    // Reset variables for next loop
-    TheMatcher = 0;
-    CurNode = 0;
-    NextOpNo = 0;
-    VariableMap.clear();
-    MatchedComplexPatterns.clear();
-    MatchedChainNodes.clear();
+    Cache.insert(Keys[i], Matchers[i], Logs[i]);
+    PatternMatchers.push_back(Matchers[i]);
   }
 
+  if (!InstrMapCache.empty())
+    Cache.save(InstrMapCache);
+
   // this looks necessary for 3.5+ but it's mintor
   // ArrayRef<Matcher*> pMatchers = ArrayRef<Matcher*>( PatternMatchers );
   //   Matcher *FinalMatcher = new ScopeMatcher( pMatchers );
   Matcher *FinalMatcher = new ScopeMatcher( &PatternMatchers[0], PatternMatchers.size() );
 
-  // TheMatcher->dump();
-
   outs() << "Fail Count: " << FailCount << "\n";
   outs() << "Number of Matchers: " << PatternMatchers.size() << "\n";
+  outs() << "Cached Matchers: " << CacheHits << "\n";
+
+  if (InstrMapOptimize) {
+    outs() << "Matcher histogram before optimization:\n";
+    EmitMatcherHistogram(FinalMatcher, outs());
+    FinalMatcher = OptimizeMatcher(FinalMatcher, CIP);
+    outs() << "Matcher histogram after optimization:\n";
+    EmitMatcherHistogram(FinalMatcher, outs());
+  }
 
   EmitMatcherTable(FinalMatcher, CIP, OS);
-  delete TheMatcher;
+  delete FinalMatcher;
 }
 
+} // end namespace fracture
+
 void FractureInstrMapEmitter::AddMatcher(Matcher *NewNode) {
   if (CurNode != 0) {
     CurNode->setNext(NewNode);
@@ -263,12 +349,12 @@ void FractureInstrMapEmitter::EmitResultOperand(
     return;
   }
 
-  errs() << "Unknown result node to emit code for: " << *N << "\n";
-  errs() << OpRec->getName() << "\n";
+  Log << "Unknown result node to emit code for: " << *N << "\n";
+  Log << OpRec->getName() << "\n";
   std::vector<Record*> classes = OpRec->getSuperClasses();
-  errs() << "Superclasses: " << classes.size() << "\n";
+  Log << "Superclasses: " << classes.size() << "\n";
   for (unsigned i = 0, e = classes.size(); i != e; ++i) {
-    errs() << classes[i]->getName() << "\n";
+    Log << classes[i]->getName() << "\n";
   }
   MatcherGenFailed = true;
   // abort();
@@ -302,8 +388,8 @@ void FractureInstrMapEmitter::EmitResultOfNamedOperand(
   // FIXME: Terrible hack here. SlotNo should never be 0...
   // Unfortunately our pattern matchers don't line up the names.
   if (SlotNo != 0) {
-    errs() << "Variable " << Name
-           << " referenced but not defined and not caught earlier!";
+    Log << "Variable " << Name
+        << " referenced but not defined and not caught earlier!";
     SlotNo -= 1;
   }
 
@@ -335,14 +421,14 @@ void FractureInstrMapEmitter::EmitResultLeafAsOperand(
     }
   }
 
-  errs() << "Unknown result node to emit code for: " << *N << "\n";
+  Log << "Unknown result node to emit code for: " << *N << "\n";
   Init *LeafVal = N->getLeafVal();
-  errs() << "Kind: " << LeafVal->getKind() << "\n";
+  Log << "Kind: " << LeafVal->getKind() << "\n";
 
 
   // Don't handle anything else (for now)
-  errs() << "Unhandled leaf node: \n";
-  N->print(errs());
+  Log << "Unhandled leaf node: \n";
+  N->print(Log);
 }
 
 void FractureInstrMapEmitter::EmitResultInstructionAsOperand(
@@ -599,7 +685,7 @@ void FractureInstrMapEmitter::EmitLeafMatchCode(
 
   DefInit *DI = dyn_cast<DefInit>(N->getLeafVal());
   if (DI == 0) {
-    errs() << N->getName() + " has no DefInit.\n";
+    Log << N->getName() + " has no DefInit.\n";
     return;
   }
 
@@ -623,14 +709,14 @@ void FractureInstrMapEmitter::EmitLeafMatchCode(
     return AddMatcher(new CheckValueTypeMatcher(LeafRec->getName()));
   }
 
-  errs() << "Unknown result node to emit code for: " << *N << "\n";
+  Log << "Unknown result node to emit code for: " << *N << "\n";
   Record *OpRec = LeafRec;
-  errs() << OpRec->getName() << "\n";
+  Log << OpRec->getName() << "\n";
   std::vector<Record*> classes = OpRec->getSuperClasses();
-  errs() << "Superclasses: " << classes.size() << "\n";
+  Log << "Superclasses: " << classes.size() << "\n";
   for (unsigned i = 0, e = classes.size(); i != e; ++i) {
-    errs() << classes[i]->getName() << "\n";
+    Log << classes[i]->getName() << "\n";
   }
 
-  errs() << N->getName() << " is an unknown leaf node.\n";
+  Log << N->getName() << " is an unknown leaf node.\n";
 }
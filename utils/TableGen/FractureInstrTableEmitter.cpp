@@ -0,0 +1,271 @@
+//===- FractureInstrTableEmitter.cpp - Compact instruction info --*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This tablegen backend emits a 4 byte record per opcode with the
+// instruction properties Fracture queries while disassembling and building
+// DAGs: a flags byte, the fixed encoding size, the number of defs and the
+// width and alignment of the memory access, with a bit for loads that
+// sign-extend.
+//
+// The memory width is not part of the instruction definitions, so it is
+// taken from the memory operand type on x86 and from the mnemonic on the
+// load/store architectures. The same rules tell which loads sign-extend.
+//
+// A second table gives the value type of every MachineInstr operand, with
+// complex operands such as x86 addresses flattened into their parts, so
+// the DAG builder can type immediates the way the patterns expect.
+//
+// NOTE: The layout must match InstrInfoEntry in CodeInv/InstrClassInfo.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CodeGenInstruction.h"
+#include "CodeGenTarget.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/TableGen/Error.h"
+#include "llvm/TableGen/Record.h"
+#include "llvm/TableGen/TableGenBackend.h"
+#include <cctype>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+enum InstrInfoFlag {
+  IIF_MayLoad,
+  IIF_MayStore,
+  IIF_Branch,
+  IIF_IndirectBranch,
+  IIF_Return,
+  IIF_Call,
+  IIF_Terminator,
+  IIF_Barrier
+};
+
+struct MemRule {
+  const char *Target;
+  const char *Mnemonic;
+  unsigned Bytes;
+  bool SignExtend;
+};
+
+// Memory widths by mnemonic prefix, the first match wins.
+static const MemRule MemRules[] = {
+  { "ARM", "ldrsb", 1, true }, { "ARM", "ldrsh", 2, true },
+  { "ARM", "ldrb", 1, false }, { "ARM", "strb", 1, false },
+  { "ARM", "ldrh", 2, false }, { "ARM", "strh", 2, false },
+  { "ARM", "ldrd", 8, false }, { "ARM", "strd", 8, false },
+  { "ARM", "ldrexd", 8, false }, { "ARM", "strexd", 8, false },
+  { "ARM", "ldrexb", 1, false }, { "ARM", "strexb", 1, false },
+  { "ARM", "ldrexh", 2, false }, { "ARM", "strexh", 2, false },
+  { "ARM", "ldr", 4, false }, { "ARM", "str", 4, false },
+  { "PPC", "lbz", 1, false }, { "PPC", "stb", 1, false },
+  { "PPC", "lhz", 2, false }, { "PPC", "lha", 2, true },
+  { "PPC", "sth", 2, false },
+  { "PPC", "lwz", 4, false }, { "PPC", "lwa", 4, true },
+  { "PPC", "stw", 4, false },
+  { "PPC", "lfs", 4, false }, { "PPC", "stfs", 4, false },
+  { "PPC", "lfd", 8, false }, { "PPC", "stfd", 8, false },
+  { "PPC", "ld", 8, false }, { "PPC", "std", 8, false }
+};
+
+class FractureInstrTableEmitter {
+public:
+  explicit FractureInstrTableEmitter(RecordKeeper &R) : Records(R) {}
+  void run(raw_ostream &OS);
+private:
+  RecordKeeper &Records;
+  unsigned getMemBytes(StringRef TargetName, const CodeGenInstruction *CGI,
+    bool &SignExtend);
+  void emitOperandTypes(raw_ostream &OS,
+    const std::vector<const CodeGenInstruction*> &Instrs);
+};
+
+/// getOperandVT - The value type of a MachineInstr operand declared as Rec,
+/// MVT::Other if it has none.
+static MVT::SimpleValueType getOperandVT(Record *Rec) {
+  if (Rec->isSubClassOf("RegisterOperand"))
+    Rec = Rec->getValueAsDef("RegClass");
+  if (Rec->isSubClassOf("RegisterClass")) {
+    std::vector<Record*> VTs = Rec->getValueAsListOfDefs("RegTypes");
+    return VTs.empty() ? MVT::Other : getValueType(VTs[0]);
+  }
+  if (Rec->isSubClassOf("PointerLikeRegClass"))
+    return MVT::iPTR;
+  if (Rec->isSubClassOf("Operand"))
+    return getValueType(Rec->getValueAsDef("Type"));
+  return MVT::Other;
+}
+
+static std::string getMnemonic(const CodeGenInstruction *CGI) {
+  std::string Asm =
+    CodeGenInstruction::FlattenAsmStringVariants(CGI->AsmString, 0);
+  std::string Mnemonic;
+  for (unsigned i = 0, e = Asm.size(); i != e; ++i) {
+    char C = Asm[i];
+    if (!isalnum(C) && C != '.' && C != '_')
+      break;
+    Mnemonic += tolower(C);
+  }
+  return Mnemonic;
+}
+
+/// getX86MemBits - Returns the width encoded in x86 memory operand names
+/// such as i32mem, f80mem or opaque48mem, or 0.
+static unsigned getX86MemBits(StringRef OpName) {
+  if (OpName == "ssmem") return 32;
+  if (OpName == "sdmem") return 64;
+  if (!OpName.endswith("mem"))
+    return 0;
+  OpName = OpName.drop_back(3);
+  size_t Digits = OpName.find_first_of("0123456789");
+  if (Digits == StringRef::npos)
+    return 0;
+  unsigned Bits = 0;
+  if (OpName.substr(Digits).getAsInteger(10, Bits))
+    return 0;
+  return Bits;
+}
+
+unsigned FractureInstrTableEmitter::getMemBytes(StringRef TargetName,
+  const CodeGenInstruction *CGI, bool &SignExtend) {
+  SignExtend = false;
+  if (!CGI->mayLoad && !CGI->mayStore)
+    return 0;
+
+  if (TargetName == "X86") {
+    SignExtend = CGI->TheDef->getName().startswith("MOVSX");
+    for (unsigned i = 0, e = CGI->Operands.size(); i != e; ++i)
+      if (unsigned Bits = getX86MemBits(CGI->Operands[i].Rec->getName()))
+        return Bits / 8;
+    return 0;
+  }
+
+  std::string Mnemonic = getMnemonic(CGI);
+  StringRef Name = CGI->TheDef->getName();
+  for (unsigned i = 0, e = array_lengthof(MemRules); i != e; ++i)
+    if (TargetName == MemRules[i].Target &&
+        StringRef(Mnemonic).startswith(MemRules[i].Mnemonic)) {
+      SignExtend = CGI->mayLoad && MemRules[i].SignExtend;
+      return MemRules[i].Bytes;
+    }
+
+  if (TargetName == "ARM") {
+    if (Name.startswith("VLDRD") || Name.startswith("VSTRD"))
+      return 8;
+    if (Name.startswith("VLDRS") || Name.startswith("VSTRS"))
+      return 4;
+  }
+  // Unknown, as for ldm/stm and the NEON structure loads and stores.
+  return 0;
+}
+
+void FractureInstrTableEmitter::emitOperandTypes(raw_ostream &OS,
+  const std::vector<const CodeGenInstruction*> &Instrs) {
+  std::vector<unsigned> Index;
+  OS << "static const uint8_t OperandTypes[] = {\n";
+  unsigned Num = 0;
+  for (unsigned Opc = 0, e = Instrs.size(); Opc != e; ++Opc) {
+    const CodeGenInstruction *CGI = Instrs[Opc];
+    Index.push_back(Num);
+    std::vector<MVT::SimpleValueType> VTs;
+    for (unsigned i = 0, e = CGI->Operands.size(); i != e; ++i) {
+      const CGIOperandList::OperandInfo &Op = CGI->Operands[i];
+      DagInit *MIOps = Op.MIOperandInfo;
+      bool HasParts = Op.MINumOperands > 1 && MIOps &&
+        MIOps->getNumArgs() == Op.MINumOperands;
+      for (unsigned j = 0; j != Op.MINumOperands; ++j) {
+        if (!HasParts) {
+          VTs.push_back(getOperandVT(Op.Rec));
+          continue;
+        }
+        DefInit *Part = dyn_cast<DefInit>(MIOps->getArg(j));
+        VTs.push_back(Part ? getOperandVT(Part->getDef()) : MVT::Other);
+      }
+    }
+    if (VTs.empty())
+      continue;
+    OS << "  ";
+    for (unsigned i = 0, e = VTs.size(); i != e; ++i)
+      OS << getEnumName(VTs[i]) << ", ";
+    OS << "// " << CGI->TheDef->getName() << "\n";
+    Num += VTs.size();
+  }
+  OS << "  MVT::Other\n};\n\n";
+  Index.push_back(Num);
+
+  OS << "// Start of each opcode's operands in OperandTypes.\n";
+  OS << "static const uint32_t OperandTypeIndex[] = {\n";
+  for (unsigned i = 0, e = Index.size(); i != e; ++i)
+    OS << (i % 8 ? " " : "  ") << Index[i] << ","
+       << ((i % 8 == 7 || i + 1 == e) ? "\n" : "");
+  OS << "};\n\n";
+}
+
+void FractureInstrTableEmitter::run(raw_ostream &OS) {
+  CodeGenTarget Target(Records);
+  const std::string &TargetName = Target.getName();
+  const std::vector<const CodeGenInstruction*> &Instrs =
+    Target.getInstructionsByEnumValue();
+
+  emitSourceFileHeader("Compact instruction info for the " + TargetName
+    + " target", OS);
+
+  OS << "namespace " << TargetName << "InstrTable {\n\n";
+  OS << "static const InstrInfoEntry Entries[] = {\n";
+  for (unsigned Opc = 0, e = Instrs.size(); Opc != e; ++Opc) {
+    const CodeGenInstruction *CGI = Instrs[Opc];
+    unsigned Flags = 0;
+    if (CGI->mayLoad) Flags |= 1 << IIF_MayLoad;
+    if (CGI->mayStore) Flags |= 1 << IIF_MayStore;
+    if (CGI->isBranch) Flags |= 1 << IIF_Branch;
+    if (CGI->isIndirectBranch) Flags |= 1 << IIF_IndirectBranch;
+    if (CGI->isReturn) Flags |= 1 << IIF_Return;
+    if (CGI->isCall) Flags |= 1 << IIF_Call;
+    if (CGI->isTerminator) Flags |= 1 << IIF_Terminator;
+    if (CGI->isBarrier) Flags |= 1 << IIF_Barrier;
+
+    int64_t Size = CGI->TheDef->getValueAsInt("Size");
+    unsigned NumDefs = CGI->Operands.NumDefs;
+    bool SignExtend;
+    unsigned MemBytes = getMemBytes(TargetName, CGI, SignExtend);
+    // x86 allows unaligned accesses, the others are naturally aligned.
+    unsigned MemAlign = 0;
+    if (MemBytes != 0)
+      MemAlign = (TargetName == "X86" || !isPowerOf2_32(MemBytes)) ? 1
+        : MemBytes;
+
+    if (Size < 0 || Size > 255 || NumDefs > 15 || MemBytes > 127)
+      PrintFatalError(CGI->TheDef->getLoc(),
+        "Instruction does not fit in an InstrInfoEntry");
+
+    OS << "  { " << format("0x%02x", Flags) << ", " << Size << ", "
+       << (SignExtend ? format("0x%02x", MemBytes | 0x80)
+                      : format("%u", MemBytes)) << ", "
+       << format("0x%02x", NumDefs | (MemAlign ? (Log2_32(MemAlign) + 1) << 4
+                                              : 0))
+       << " }, // " << CGI->TheDef->getName() << "\n";
+  }
+  OS << "};\n\n";
+  emitOperandTypes(OS, Instrs);
+  OS << "} // end namespace " << TargetName << "InstrTable\n";
+}
+
+} // end anonymous namespace
+
+namespace fracture {
+
+void EmitInstrTable(RecordKeeper &Records, raw_ostream &OS) {
+  FractureInstrTableEmitter(Records).run(OS);
+}
+
+} // end namespace fracture
@@ -18,11 +18,21 @@
 //
 // This tablegen backend emits patternless instructions.
 //
+// With -gen-fallback-table it emits a table describing the defs, uses and
+// side effects of each patternless opcode instead. The inverse selector has
+// nothing to match these against, so the lifter uses the table to emit an
+// opaque call with the right dataflow rather than giving up.
+//
+// NOTE: The layout must match FallbackEntry in CodeInv/InstrClassInfo.h.
+//
 //===----------------------------------------------------------------------===//
 
 #include "CodeGenInstruction.h"
+#include "CodeGenTarget.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Format.h"
+#include "llvm/TableGen/Error.h"
 #include "llvm/TableGen/Record.h"
 #include "llvm/TableGen/StringMatcher.h"
 #include "llvm/TableGen/TableGenBackend.h"
@@ -64,11 +74,29 @@ static bool hasNullFragReference(ListInit *LI) {
   return false;
 }
 
+/// isPatternless - A pattern which references the null_frag operator is
+/// as-if no pattern were specified. Normally this is from a multiclass
+/// expansion w/ a SDPatternOperator passed in as null_frag.
+static bool isPatternless(Record *Inst) {
+  ListInit *LI = 0;
+  if (isa<ListInit>(Inst->getValueInit("Pattern")))
+    LI = Inst->getValueAsListInit("Pattern");
+  return !LI || LI->getSize() == 0 || hasNullFragReference(LI);
+}
+
+enum FallbackFlag {
+  FBF_MayLoad,
+  FBF_MayStore,
+  FBF_SideEffects,
+  FBF_ControlFlow
+};
+
 class FracturePatternlessInstrsEmitter {
 public:
   std::vector<CodeGenInstruction*> Instructions;
   explicit FracturePatternlessInstrsEmitter(RecordKeeper &R) : Records(&R) {}
   void run(raw_ostream &OS);
+  void runFallbackTable(raw_ostream &OS);
 private:
   RecordKeeper *Records;
   void ParseInstructions();
@@ -78,23 +106,62 @@ private:
 void FracturePatternlessInstrsEmitter::ParseInstructions() {
   std::vector<Record*> Instrs = Records->getAllDerivedDefinitions("Instruction");
   for (unsigned i = 0, e = Instrs.size(); i != e; ++i) {
-    ListInit *LI = 0;
-
-    if (isa<ListInit>(Instrs[i]->getValueInit("Pattern")))
-      LI = Instrs[i]->getValueAsListInit("Pattern");
-
     // If there is no pattern, only collect minimal information about the
     // instruction for its operand list.  We have to assume that there is one
-    // result, as we have no detailed info. A pattern which references the
-    // null_frag operator is as-if no pattern were specified. Normally this
-    // is from a multiclass expansion w/ a SDPatternOperator passed in as
-    // null_frag.
-    if (!LI || LI->getSize() == 0 || hasNullFragReference(LI)) {
+    // result, as we have no detailed info.
+    if (isPatternless(Instrs[i])) {
       Instructions.push_back(new CodeGenInstruction(Instrs[i]));
     }
   }
 }
 
+void FracturePatternlessInstrsEmitter::runFallbackTable(raw_ostream &OS) {
+  CodeGenTarget Target(*Records);
+  const std::string &TargetName = Target.getName();
+  const std::vector<const CodeGenInstruction*> &Instrs =
+    Target.getInstructionsByEnumValue();
+
+  emitSourceFileHeader("Fallback lifter table for the " + TargetName
+    + " target", OS);
+
+  OS << "namespace " << TargetName << "Fallback {\n\n";
+  OS << "// Sorted by opcode.\n";
+  OS << "static const FallbackEntry Entries[] = {\n";
+  unsigned NumEntries = 0;
+  for (unsigned Opc = 0, e = Instrs.size(); Opc != e; ++Opc) {
+    const CodeGenInstruction *CGI = Instrs[Opc];
+    if (CGI->isPseudo || CGI->isCodeGenOnly || !isPatternless(CGI->TheDef))
+      continue;
+
+    unsigned Flags = 0;
+    if (CGI->mayLoad) Flags |= 1 << FBF_MayLoad;
+    if (CGI->mayStore) Flags |= 1 << FBF_MayStore;
+    if (CGI->hasSideEffects) Flags |= 1 << FBF_SideEffects;
+    if (CGI->isBranch || CGI->isIndirectBranch || CGI->isReturn ||
+        CGI->isCall || CGI->isTerminator || CGI->isBarrier)
+      Flags |= 1 << FBF_ControlFlow;
+
+    unsigned NumDefs = CGI->Operands.NumDefs;
+    unsigned NumUses = CGI->Operands.size() - NumDefs;
+    unsigned NumImpDefs = CGI->ImplicitDefs.size();
+    unsigned NumImpUses = CGI->ImplicitUses.size();
+    if (Opc > 0xffff || NumDefs > 255 || NumUses > 255 || NumImpDefs > 255
+        || NumImpUses > 255)
+      PrintFatalError(CGI->TheDef->getLoc(),
+        "Instruction does not fit in a FallbackEntry");
+
+    OS << "  { " << Opc << ", " << format("0x%02x", Flags) << ", " << NumDefs
+       << ", " << NumUses << ", " << NumImpDefs << ", " << NumImpUses
+       << " }, // " << CGI->TheDef->getName() << "\n";
+    ++NumEntries;
+  }
+  // Keep the array non-empty for targets where every opcode has a pattern.
+  if (NumEntries == 0)
+    OS << "  { 0xffff, 0, 0, 0, 0, 0 }\n";
+  OS << "};\n\n";
+  OS << "} // end namespace " << TargetName << "Fallback\n";
+}
+
 
 }
 
@@ -105,6 +172,10 @@ void EmitPatternlessInstrs(RecordKeeper &Records, raw_ostream &OS) {
   FracturePatternlessInstrsEmitter(Records).run(OS);
 }
 
+void EmitFallbackTable(RecordKeeper &Records, raw_ostream &OS) {
+  FracturePatternlessInstrsEmitter(Records).runFallbackTable(OS);
+}
+
 } // end namespace fracture
 
 void  FracturePatternlessInstrsEmitter::run(raw_ostream &OS) {
@@ -0,0 +1,420 @@
+//===- InvMatcherCache.cpp - Cache of inverse pattern matchers ---*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The cache is a text file. After a header line, each entry starts with
+// "P <key> <lines> <log lines>" followed by one line per matcher in the chain:
+//
+//   RecordNode <slot> <what for>
+//   CheckOpcode SD|Inst <record>
+//   EmitNode <first result> <chain> <in glue> <out glue> <memrefs>
+//            <fixed arity> <#vts> <vts...> <#ops> <ops...> <opcode name>
+//   ...
+//
+// and then by the log the generator printed for the pattern, which is printed
+// again when the entry is used.
+//
+//===----------------------------------------------------------------------===//
+
+#include "InvMatcherCache.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace llvm;
+
+static const char *const CacheMagic = "fracture-instr-map-cache";
+/// Bump this whenever the matcher generator or the file format changes, so
+/// entries made by an older fracture-tblgen are not used.
+static const unsigned CacheVersion = 2;
+
+/// FNV-1a, which unlike hash_value is stable across runs and hosts.
+static uint64_t hashString(StringRef S, uint64_t Hash = 14695981039346656037ULL) {
+  for (unsigned i = 0, e = S.size(); i != e; ++i) {
+    Hash ^= (unsigned char)S[i];
+    Hash *= 1099511628211ULL;
+  }
+  return Hash;
+}
+
+InvMatcherCache::InvMatcherCache(const CodeInvDAGPatterns &CIP,
+  RecordKeeper &Records) : CIP(CIP), Records(Records) {
+  static const char *const EnvClasses[] = {
+    "SDNode", "ComplexPattern", "RegisterClass"
+  };
+  EnvHash = hashString(utostr(CacheVersion));
+  EnvHash = hashString(CIP.getTargetInfo().getName(), EnvHash);
+  for (unsigned c = 0; c != array_lengthof(EnvClasses); ++c) {
+    std::vector<Record*> Defs = Records.getAllDerivedDefinitions(EnvClasses[c]);
+    for (unsigned i = 0, e = Defs.size(); i != e; ++i) {
+      std::string Text;
+      raw_string_ostream OS(Text);
+      OS << *Defs[i];
+      EnvHash = hashString(OS.str(), EnvHash);
+    }
+  }
+
+  std::vector<Record*> CPs = Records.getAllDerivedDefinitions("ComplexPattern");
+  for (unsigned i = 0, e = CPs.size(); i != e; ++i)
+    ComplexPatternRecs[&CIP.getComplexPattern(CPs[i])] = CPs[i];
+}
+
+/// Collects the Instruction records referenced by the tree at N, by name so
+/// the key does not depend on where they were allocated.
+static void findInstructions(const InvTreePatternNode *N,
+  std::map<std::string, const Record*> &Insts) {
+  const Record *Rec = 0;
+  if (!N->isLeaf())
+    Rec = N->getRecord();
+  else if (DefInit *DI = dyn_cast<DefInit>(N->getLeafVal()))
+    Rec = DI->getDef();
+  if (Rec != 0 && Rec->isSubClassOf("Instruction"))
+    Insts[Rec->getName()] = Rec;
+  for (unsigned i = 0, e = N->getNumChildren(); i != e; ++i)
+    findInstructions(N->getChild(i), Insts);
+}
+
+uint64_t InvMatcherCache::getKey(const InvPatternToMatch *Pattern) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << CacheVersion << "\n" << Pattern->SrcRecord->getName() << "\n";
+  Pattern->getSrcPattern()->print(OS);
+  OS << "\n";
+  Pattern->getDstPattern()->print(OS);
+  OS << "\n";
+
+  // The matcher also depends on the operands, flags and properties of the
+  // instructions involved, which the printed patterns do not show.
+  std::map<std::string, const Record*> Insts;
+  if (Pattern->SrcRecord->isSubClassOf("Instruction"))
+    Insts[Pattern->SrcRecord->getName()] = Pattern->SrcRecord;
+  findInstructions(Pattern->getSrcPattern(), Insts);
+  findInstructions(Pattern->getDstPattern(), Insts);
+  for (std::map<std::string, const Record*>::const_iterator I = Insts.begin(),
+         E = Insts.end(); I != E; ++I)
+    OS << *I->second;
+  return hashString(OS.str());
+}
+
+void InvMatcherCache::load(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > BufOrErr =
+    MemoryBuffer::getFile(Path);
+  if (!BufOrErr)
+    return;
+
+  // Logs may contain empty lines, so keep them; the file ends in a newline.
+  SmallVector<StringRef, 0> Lines;
+  (*BufOrErr)->getBuffer().split(Lines, "\n", -1, true);
+  if (!Lines.empty() && Lines.back().empty())
+    Lines.pop_back();
+  if (Lines.empty() || Lines[0] != (std::string(CacheMagic) + " v" +
+        utostr(CacheVersion) + " " + utohexstr(EnvHash)))
+    return;
+
+  for (unsigned i = 1, e = Lines.size(); i < e; ) {
+    SmallVector<StringRef, 4> Header;
+    Lines[i++].split(Header, " ");
+    uint64_t Key;
+    unsigned NumLines, NumLogLines;
+    if (Header.size() != 4 || Header[0] != "P" ||
+        Header[1].getAsInteger(16, Key) || Header[2].getAsInteger(10, NumLines)
+        || Header[3].getAsInteger(10, NumLogLines)
+        || i + NumLines + NumLogLines > e) {
+      Loaded.clear();
+      return;
+    }
+    Entry &Ent = Loaded[Key];
+    for (unsigned l = 0; l != NumLines; ++l)
+      Ent.Matchers += Lines[i++].str() + "\n";
+    for (unsigned l = 0; l != NumLogLines; ++l)
+      Ent.Log += Lines[i++].str() + "\n";
+  }
+}
+
+void InvMatcherCache::save(StringRef Path) const {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "Unable to write " << Path << ": " << EC.message() << "\n";
+    return;
+  }
+  OS << CacheMagic << " v" << CacheVersion << " " << utohexstr(EnvHash)
+     << "\n";
+  for (std::map<uint64_t, Entry>::const_iterator I = Current.begin(),
+         E = Current.end(); I != E; ++I) {
+    const Entry &Ent = I->second;
+    OS << "P " << utohexstr(I->first) << " "
+       << std::count(Ent.Matchers.begin(), Ent.Matchers.end(), '\n') << " "
+       << std::count(Ent.Log.begin(), Ent.Log.end(), '\n') << "\n"
+       << Ent.Matchers << Ent.Log;
+  }
+}
+
+Matcher *InvMatcherCache::lookup(uint64_t Key,
+  const InvPatternToMatch *Pattern, std::string &Log) const {
+  std::map<uint64_t, Entry>::const_iterator I = Loaded.find(Key);
+  if (I == Loaded.end())
+    return 0;
+
+  SmallVector<StringRef, 16> Lines;
+  StringRef(I->second.Matchers).split(Lines, "\n", -1, false);
+  Matcher *Head = 0, *Tail = 0;
+  for (unsigned i = 0, e = Lines.size(); i != e; ++i) {
+    Matcher *M = deserialize(Lines[i], Pattern);
+    if (M == 0) {
+      delete Head;
+      return 0;
+    }
+    if (Tail != 0)
+      Tail->setNext(M);
+    else
+      Head = M;
+    Tail = M;
+  }
+  Log = I->second.Log;
+  return Head;
+}
+
+void InvMatcherCache::insert(uint64_t Key, const Matcher *M,
+  StringRef Log) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  for (; M != 0; M = M->getNext())
+    if (!serialize(M, OS))
+      return;
+  Entry &Ent = Current[Key];
+  Ent.Matchers = OS.str();
+  Ent.Log = Log;
+  // Every log line is stored with its newline.
+  if (!Ent.Log.empty() && Ent.Log[Ent.Log.size() - 1] != '\n')
+    Ent.Log += "\n";
+}
+
+bool InvMatcherCache::serialize(const Matcher *M, raw_ostream &OS) const {
+  switch (M->getKind()) {
+  case Matcher::RecordNode: {
+    const RecordMatcher *RM = cast<RecordMatcher>(M);
+    OS << "RecordNode " << RM->getResultNo() << " " << RM->getWhatFor();
+    break;
+  }
+  case Matcher::MoveChild:
+    OS << "MoveChild " << cast<MoveChildMatcher>(M)->getChildNo();
+    break;
+  case Matcher::MoveParent:
+    OS << "MoveParent";
+    break;
+  case Matcher::CheckSame:
+    OS << "CheckSame " << cast<CheckSameMatcher>(M)->getMatchNumber();
+    break;
+  case Matcher::CheckOpcode: {
+    const CheckOpcodeMatcher *CM = cast<CheckOpcodeMatcher>(M);
+    if (CM->getSDNodeInfo() != 0)
+      OS << "CheckOpcode SD " << CM->getSDNodeInfo()->getRecord()->getName();
+    else
+      OS << "CheckOpcode Inst " << CM->getInstruction()->TheDef->getName();
+    break;
+  }
+  case Matcher::CheckInteger:
+    OS << "CheckInteger " << cast<CheckIntegerMatcher>(M)->getValue();
+    break;
+  case Matcher::CheckValueType:
+    OS << "CheckValueType " << cast<CheckValueTypeMatcher>(M)->getTypeName();
+    break;
+  case Matcher::CheckComplexPat: {
+    const CheckComplexPatMatcher *CM = cast<CheckComplexPatMatcher>(M);
+    Record *Rec = ComplexPatternRecs.lookup(&CM->getPattern());
+    if (Rec == 0)
+      return false;
+    OS << "CheckComplexPat " << CM->getMatchNumber() << " "
+       << CM->getFirstResult() << " " << Rec->getName() << " "
+       << CM->getName();
+    break;
+  }
+  case Matcher::EmitInteger: {
+    const EmitIntegerMatcher *EM = cast<EmitIntegerMatcher>(M);
+    OS << "EmitInteger " << EM->getValue() << " " << (unsigned)EM->getVT();
+    break;
+  }
+  case Matcher::EmitRegister: {
+    const EmitRegisterMatcher *EM = cast<EmitRegisterMatcher>(M);
+    OS << "EmitRegister " << (unsigned)EM->getVT() << " "
+       << (EM->getReg() ? EM->getReg()->TheDef->getName() : "zero_reg");
+    break;
+  }
+  case Matcher::EmitMergeInputChains: {
+    const EmitMergeInputChainsMatcher *EM =
+      cast<EmitMergeInputChainsMatcher>(M);
+    OS << "EmitMergeInputChains " << EM->getNumNodes();
+    for (unsigned i = 0, e = EM->getNumNodes(); i != e; ++i)
+      OS << " " << EM->getNode(i);
+    break;
+  }
+  case Matcher::EmitNode: {
+    const EmitNodeMatcher *EM = cast<EmitNodeMatcher>(M);
+    OS << "EmitNode " << EM->getFirstResultSlot() << " " << EM->hasChain()
+       << " " << EM->hasInFlag() << " " << EM->hasOutFlag() << " "
+       << EM->hasMemRefs() << " " << EM->getNumFixedArityOperands() << " "
+       << EM->getNumVTs();
+    for (unsigned i = 0, e = EM->getNumVTs(); i != e; ++i)
+      OS << " " << (unsigned)EM->getVT(i);
+    OS << " " << EM->getNumOperands();
+    for (unsigned i = 0, e = EM->getNumOperands(); i != e; ++i)
+      OS << " " << EM->getOperand(i);
+    OS << " " << EM->getOpcodeName();
+    break;
+  }
+  case Matcher::CompleteMatch: {
+    const CompleteMatchMatcher *CM = cast<CompleteMatchMatcher>(M);
+    OS << "CompleteMatch " << CM->getNumResults();
+    for (unsigned i = 0, e = CM->getNumResults(); i != e; ++i)
+      OS << " " << CM->getResult(i);
+    break;
+  }
+  default:
+    return false;
+  }
+  OS << "\n";
+  return true;
+}
+
+/// Splits off the next space separated token of Line.
+static StringRef nextToken(StringRef &Line) {
+  std::pair<StringRef, StringRef> Split = Line.split(' ');
+  Line = Split.second;
+  return Split.first;
+}
+
+template <typename T>
+static bool nextInt(StringRef &Line, T &Val) {
+  long long V;
+  if (nextToken(Line).getAsInteger(10, V))
+    return false;
+  Val = (T)V;
+  return true;
+}
+
+Matcher *InvMatcherCache::deserialize(StringRef Line,
+  const InvPatternToMatch *Pattern) const {
+  StringRef Kind = nextToken(Line);
+
+  if (Kind == "RecordNode") {
+    unsigned Slot;
+    if (!nextInt(Line, Slot))
+      return 0;
+    return new RecordMatcher(Line, Slot);
+  }
+  if (Kind == "MoveChild") {
+    unsigned Child;
+    return nextInt(Line, Child) ? new MoveChildMatcher(Child) : 0;
+  }
+  if (Kind == "MoveParent")
+    return new MoveParentMatcher();
+  if (Kind == "CheckSame") {
+    unsigned Slot;
+    return nextInt(Line, Slot) ? new CheckSameMatcher(Slot) : 0;
+  }
+  if (Kind == "CheckOpcode") {
+    StringRef Which = nextToken(Line);
+    Record *Rec = Records.getDef(Line);
+    if (Rec == 0)
+      return 0;
+    if (Which == "SD")
+      return Rec->isSubClassOf("SDNode")
+        ? new CheckOpcodeMatcher(CIP.getSDNodeInfo(Rec)) : 0;
+    return Rec->isSubClassOf("Instruction")
+      ? new CheckOpcodeMatcher(CIP.getTgtNodeInfo(Rec)) : 0;
+  }
+  if (Kind == "CheckInteger") {
+    int64_t Val;
+    return nextInt(Line, Val) ? new CheckIntegerMatcher(Val) : 0;
+  }
+  if (Kind == "CheckValueType") {
+    // The matcher keeps a StringRef, so point it at the record's name.
+    Record *Rec = Records.getDef(Line);
+    return Rec ? new CheckValueTypeMatcher(Rec->getName()) : 0;
+  }
+  if (Kind == "CheckComplexPat") {
+    unsigned MatchNumber, FirstResult;
+    if (!nextInt(Line, MatchNumber) || !nextInt(Line, FirstResult))
+      return 0;
+    Record *Rec = Records.getDef(nextToken(Line));
+    if (Rec == 0 || !Rec->isSubClassOf("ComplexPattern"))
+      return 0;
+    return new CheckComplexPatMatcher(CIP.getComplexPattern(Rec), MatchNumber,
+      Line, FirstResult);
+  }
+  if (Kind == "EmitInteger") {
+    int64_t Val;
+    unsigned VT;
+    if (!nextInt(Line, Val) || !nextInt(Line, VT))
+      return 0;
+    return new EmitIntegerMatcher(Val, (MVT::SimpleValueType)VT);
+  }
+  if (Kind == "EmitRegister") {
+    unsigned VT;
+    if (!nextInt(Line, VT))
+      return 0;
+    const CodeGenRegister *Reg = 0;
+    if (Line != "zero_reg") {
+      Record *Rec = Records.getDef(Line);
+      if (Rec == 0 || !Rec->isSubClassOf("Register"))
+        return 0;
+      Reg = CIP.getTargetInfo().getRegBank().getReg(Rec);
+    }
+    return new EmitRegisterMatcher(Reg, (MVT::SimpleValueType)VT);
+  }
+  if (Kind == "EmitMergeInputChains") {
+    unsigned Num;
+    if (!nextInt(Line, Num))
+      return 0;
+    SmallVector<unsigned, 3> Nodes(Num);
+    for (unsigned i = 0; i != Num; ++i)
+      if (!nextInt(Line, Nodes[i]))
+        return 0;
+    return new EmitMergeInputChainsMatcher(Nodes.data(), Nodes.size());
+  }
+  if (Kind == "EmitNode") {
+    unsigned FirstResult, Chain, InGlue, OutGlue, MemRefs, NumVTs, NumOps;
+    int FixedArity;
+    if (!nextInt(Line, FirstResult) || !nextInt(Line, Chain) ||
+        !nextInt(Line, InGlue) || !nextInt(Line, OutGlue) ||
+        !nextInt(Line, MemRefs) || !nextInt(Line, FixedArity) ||
+        !nextInt(Line, NumVTs))
+      return 0;
+    SmallVector<MVT::SimpleValueType, 4> VTs(NumVTs);
+    for (unsigned i = 0; i != NumVTs; ++i) {
+      unsigned VT;
+      if (!nextInt(Line, VT))
+        return 0;
+      VTs[i] = (MVT::SimpleValueType)VT;
+    }
+    if (!nextInt(Line, NumOps))
+      return 0;
+    SmallVector<unsigned, 8> Ops(NumOps);
+    for (unsigned i = 0; i != NumOps; ++i)
+      if (!nextInt(Line, Ops[i]))
+        return 0;
+    return new EmitNodeMatcher(Line, VTs.data(), VTs.size(), Ops.data(),
+      Ops.size(), Chain, InGlue, OutGlue, MemRefs, FixedArity, FirstResult);
+  }
+  if (Kind == "CompleteMatch") {
+    unsigned Num;
+    if (!nextInt(Line, Num))
+      return 0;
+    SmallVector<unsigned, 2> Results(Num);
+    for (unsigned i = 0; i != Num; ++i)
+      if (!nextInt(Line, Results[i]))
+        return 0;
+    return new CompleteMatchMatcher(Results.data(), Results.size(), *Pattern);
+  }
+  return 0;
+}
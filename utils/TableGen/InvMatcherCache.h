@@ -0,0 +1,75 @@
+//===- InvMatcherCache.h - Cache of inverse pattern matchers -----*- C++ -*-=//
+//
+//              Fracture: The Draper Decompiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Keeps the matcher chain generated for each inverse pattern between runs of
+// fracture-tblgen. Entries are keyed by a hash of the instruction name and
+// the printed source and destination patterns, so editing one pattern only
+// regenerates that pattern's matcher. The key also covers the definitions of
+// the instructions the pattern refers to, and the cache version.
+//
+// The whole file is dropped when any SDNode, ComplexPattern or register class
+// definition changes, because matchers depend on those too, or when it was
+// written by another version of the generator.
+//
+// Each entry also keeps what the generator logged for the pattern, so a run
+// that uses the cache prints the same output as one that does not.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INVMATCHERCACHE_H
+#define INVMATCHERCACHE_H
+
+#include "CodeInvDAGPatterns.h"
+#include "DAGISelMatcher.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <map>
+#include <string>
+
+namespace llvm {
+
+class InvMatcherCache {
+public:
+  InvMatcherCache(const CodeInvDAGPatterns &CIP, RecordKeeper &Records);
+
+  /// load - Reads the cache file. A missing or stale file leaves the cache
+  /// empty.
+  void load(StringRef Path);
+  /// save - Writes every entry inserted during this run.
+  void save(StringRef Path) const;
+
+  static uint64_t getKey(const InvPatternToMatch *Pattern);
+
+  /// lookup - Rebuilds the matcher chain cached for Key and sets Log to what
+  /// was logged when it was generated, or returns null.
+  Matcher *lookup(uint64_t Key, const InvPatternToMatch *Pattern,
+                  std::string &Log) const;
+  /// insert - Records the chain starting at M and its Log. Chains containing
+  /// matchers the cache cannot represent are skipped.
+  void insert(uint64_t Key, const Matcher *M, StringRef Log);
+
+private:
+  const CodeInvDAGPatterns &CIP;
+  RecordKeeper &Records;
+  /// Hash of the definitions every matcher depends on.
+  uint64_t EnvHash;
+  struct Entry {
+    std::string Matchers, Log;
+  };
+  /// Entries read from disk, and entries for the current run.
+  std::map<uint64_t, Entry> Loaded, Current;
+  DenseMap<const ComplexPattern*, Record*> ComplexPatternRecs;
+
+  bool serialize(const Matcher *M, raw_ostream &OS) const;
+  Matcher *deserialize(StringRef Line, const InvPatternToMatch *Pattern) const;
+};
+
+} // end namespace llvm
+
+#endif
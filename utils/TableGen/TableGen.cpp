@@ -33,7 +33,10 @@ using namespace fracture;
 
 enum ActionType {
   GenPatternlessInstrs,
-  GenInstrMap
+  GenInstrMap,
+  GenInstrClasses,
+  GenInstrTable,
+  GenFallbackTable
 };
 
 namespace {
@@ -44,6 +47,12 @@ namespace {
              "Generate list of patternless instructions"),
            clEnumValN(GenInstrMap, "gen-instr-map",
              "Generate map of instructions to generic instructions"),
+           clEnumValN(GenInstrClasses, "gen-instr-classes",
+             "Generate per-opcode instruction class bitsets"),
+           clEnumValN(GenInstrTable, "gen-instr-table",
+             "Generate compact per-opcode instruction info"),
+           clEnumValN(GenFallbackTable, "gen-fallback-table",
+             "Generate fallback lifter info for patternless instructions"),
            clEnumValEnd)
          );
 
@@ -55,6 +64,15 @@ bool FractureTableGenMain(raw_ostream &OS, RecordKeeper &Records) {
   case GenInstrMap:
     EmitInstrMap(Records, OS);
     break;
+  case GenInstrClasses:
+    EmitInstrClasses(Records, OS);
+    break;
+  case GenInstrTable:
+    EmitInstrTable(Records, OS);
+    break;
+  case GenFallbackTable:
+    EmitFallbackTable(Records, OS);
+    break;
   }
 
   return false;
@@ -36,5 +36,8 @@ namespace fracture {
 
 void EmitPatternlessInstrs(RecordKeeper &RK, raw_ostream &OS);
 void EmitInstrMap(RecordKeeper &RK, raw_ostream &OS);
+void EmitInstrClasses(RecordKeeper &RK, raw_ostream &OS);
+void EmitInstrTable(RecordKeeper &RK, raw_ostream &OS);
+void EmitFallbackTable(RecordKeeper &RK, raw_ostream &OS);
 
 } // end namespace clang